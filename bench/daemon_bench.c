@@ -0,0 +1,171 @@
+// lunar --check on a generated tree of modules: cold processes against
+// the --cache files and a warm lunar --daemon.
+//
+//   make bench-daemon
+//   ./bench/daemon_bench [modules] [checks]
+//
+// Writes `modules` files (default 3000) under a temp dir, 100 to a
+// directory, each importing two others of its directory, and prints the
+// time per `lunar --check main.lr` (process start included) for: a process without a
+// cache; with --cache (.lri/.lrc files up to date); through the daemon
+// with nothing changed; with one function body changed; and with one
+// module's interface changed, which rebuilds the modules importing it.
+
+#define _DEFAULT_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GROUP 100 // modules per directory
+#define FNS   5   // functions per module
+
+static char dir[256];
+static char sock[300];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void die(const char *what, const char *why) {
+    fprintf(stderr, "daemon_bench: %s%s%s\n", what, why ? ": " : "", why ? why : "");
+    exit(1);
+}
+
+// Module j of group g is g<g>/m<j>.lr. It imports m<j-1> and m<j/2>, so
+// the last one reaches the whole group; `extra` adds a function (an
+// interface change) and `salt` changes a body.
+static void write_module(size_t g, size_t j, int extra, int salt) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/g%zu/m%zu.lr", dir, g, j);
+    FILE *f = fopen(path, "w");
+    if (!f) die("cannot write", path);
+    if (j > 0) fprintf(f, "import m%zu;\n", j - 1);
+    if (j > 1 && j / 2 != j - 1) fprintf(f, "import m%zu;\n", j / 2);
+    for (int k = 0; k < FNS; k++) {
+        fprintf(f,
+                "funct f%zu_%zu_%d(x: int) ret int {\n"
+                "    let mut s: int = x + %d;\n"
+                "    let mut i: int = 0;\n"
+                "    while i < 10 { s = s + i * %d; i = i + 1; }\n",
+                g, j, k, salt, k + 1);
+        if (j > 0) fprintf(f, "    s = s + f%zu_%zu_0(i);\n", g, j - 1);
+        if (k > 0) fprintf(f, "    s = s + f%zu_%zu_%d(s);\n", g, j, k - 1);
+        fprintf(f, "    return s;\n}\n");
+    }
+    if (extra) fprintf(f, "funct extra%zu_%zu() ret int { return %d; }\n", g, j, extra);
+    fclose(f);
+}
+
+static void generate(size_t modules) {
+    size_t groups = (modules + GROUP - 1) / GROUP;
+    char path[512];
+    for (size_t g = 0; g < groups; g++) {
+        snprintf(path, sizeof(path), "%s/g%zu", dir, g);
+        if (mkdir(path, 0700) != 0) die("cannot create", path);
+        size_t n = g + 1 < groups ? GROUP : modules - g * GROUP;
+        for (size_t j = 0; j < n; j++) write_module(g, j, 0, 0);
+    }
+    snprintf(path, sizeof(path), "%s/main.lr", dir);
+    FILE *f = fopen(path, "w");
+    if (!f) die("cannot write", path);
+    for (size_t g = 0; g < groups; g++) {
+        size_t n = g + 1 < groups ? GROUP : modules - g * GROUP;
+        fprintf(f, "import g%zu.m%zu;\n", g, n - 1);
+    }
+    fprintf(f, "funct main() ret int { return 0; }\n");
+    fclose(f);
+}
+
+static pid_t start(char *const argv[], int wait_for_it) {
+    fflush(stdout); // or the child writes out our buffer too
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir) != 0 || !freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) _exit(127);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (pid < 0) die("fork failed", NULL);
+    if (wait_for_it) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            die("lunar --check failed (run make first)", NULL);
+        }
+    }
+    return pid;
+}
+
+static char lunar[512];
+
+static void check(const char *mode) {
+    char *argv[5] = { lunar, "--check", NULL, "main.lr", NULL };
+    char arg[320];
+    if (mode) {
+        snprintf(arg, sizeof(arg), "%s%s", mode, strcmp(mode, "--connect=") == 0 ? sock : "");
+        argv[2] = arg;
+    } else {
+        argv[2] = "main.lr";
+        argv[3] = NULL;
+    }
+    start(argv, 1);
+}
+
+// time per check, changing a module before each one when `change` is set
+static double timed(const char *mode, size_t n, int change) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (change == 1) write_module(0, GROUP / 2, 0, (int)i + 1);
+        if (change == 2) write_module(0, GROUP / 2, (int)i + 1, 0);
+        double t0 = now_ns();
+        check(mode);
+        total += now_ns() - t0;
+    }
+    write_module(0, GROUP / 2, 0, 0);
+    return total / (double)n;
+}
+
+static void cleanup(void) {
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) fprintf(stderr, "daemon_bench: could not remove %s\n", dir);
+}
+
+int main(int argc, char **argv) {
+    size_t modules = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : 3000;
+    size_t n = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : 10;
+    if (modules < GROUP || !n) die("usage: daemon_bench [modules >= 100] [checks]", NULL);
+    if (!realpath("lunar", lunar)) die("no ./lunar (run make first)", NULL);
+
+    snprintf(dir, sizeof(dir), "/tmp/lunar-daemon-bench-XXXXXX");
+    if (!mkdtemp(dir)) die("mkdtemp failed", NULL);
+    snprintf(sock, sizeof(sock), "%s/lunar.sock", dir);
+    atexit(cleanup);
+    generate(modules);
+
+    printf("%zu modules, %d functions each, %zu checks per row\n", modules, FNS, n);
+    printf("cold, no cache:              %10.2f ms/check\n", timed(NULL, n, 0) / 1e6);
+    check("--cache");
+    printf("cold, --cache files:         %10.2f ms/check\n", timed("--cache", n, 0) / 1e6);
+
+    char arg[320];
+    snprintf(arg, sizeof(arg), "--daemon=%s", sock);
+    char *dargv[3] = { lunar, arg, NULL };
+    pid_t daemon = start(dargv, 0);
+    for (int i = 0; i < 100 && access(sock, F_OK) != 0; i++) usleep(10000);
+    double t0 = now_ns();
+    check("--connect=");
+    printf("daemon, first check:         %10.2f ms\n", (now_ns() - t0) / 1e6);
+    printf("daemon, nothing changed:     %10.2f ms/check\n", timed("--connect=", n, 0) / 1e6);
+    printf("daemon, one body changed:    %10.2f ms/check\n", timed("--connect=", n, 1) / 1e6);
+    printf("daemon, one interface changed:%9.2f ms/check\n", timed("--connect=", n, 2) / 1e6);
+
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,177 @@
+// liblunar against a lunar process per request, on bench/embed.lr.
+//
+//   make bench-embed
+//   ./bench/embed_bench [requests] [threads]
+//
+// Prints the time per request for: running ./lunar once per request
+// (process start, read, parse and compile every time); lunar_call on one
+// VM with a lunar_vm_reset between requests; calling a function that does
+// nothing; a fresh VM per request; and `threads` threads, each with its own VM, all running the
+// one module.
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/lunar.h"
+
+#define SCRIPT "bench/embed.lr"
+#define EXPECT 9912 // handle(100, "world")
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char *)malloc(n > 0 ? (size_t)n : 1);
+    *len = buf ? fread(buf, 1, (size_t)n, f) : 0;
+    fclose(f);
+    return buf;
+}
+
+static void die(const char *what, const char *why) {
+    fprintf(stderr, "embed_bench: %s%s%s\n", what, why ? ": " : "", why ? why : "");
+    exit(1);
+}
+
+static int request(LunarVm *vm) {
+    LunarValue args[2] = {lunar_int(100), lunar_string("world", 5)};
+    LunarValue ret;
+    if (!lunar_call(vm, "handle", args, 2, &ret)) die("call failed", lunar_vm_error(vm));
+    return ret.type == LUNAR_INT && ret.as.i == EXPECT;
+}
+
+static double per_process(size_t n) {
+    fflush(stdout); // or every child writes out our buffer too
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (!freopen("/dev/null", "w", stdout)) _exit(127);
+            execl("./lunar", "lunar", SCRIPT, (char *)NULL);
+            _exit(127);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            die("./lunar " SCRIPT " failed (run make first)", NULL);
+        }
+    }
+    return (now_ns() - t0) / (double)n;
+}
+
+static double reused_vm(const LunarModule *m, size_t n) {
+    LunarVm *vm = lunar_vm_new(m);
+    if (!vm) die("lunar_vm_new", NULL);
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        if (!request(vm)) die("wrong result", NULL);
+        lunar_vm_reset(vm);
+    }
+    double t = (now_ns() - t0) / (double)n;
+    lunar_vm_free(vm);
+    return t;
+}
+
+static double empty_calls(const LunarModule *m, size_t n) {
+    LunarVm *vm = lunar_vm_new(m);
+    if (!vm) die("lunar_vm_new", NULL);
+    LunarValue ret;
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        if (!lunar_call(vm, "ping", NULL, 0, &ret)) die("call failed", lunar_vm_error(vm));
+    }
+    double t = (now_ns() - t0) / (double)n;
+    lunar_vm_free(vm);
+    return t;
+}
+
+static double fresh_vm(const LunarModule *m, size_t n) {
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        LunarVm *vm = lunar_vm_new(m);
+        if (!vm || !request(vm)) die("fresh VM", NULL);
+        lunar_vm_free(vm);
+    }
+    return (now_ns() - t0) / (double)n;
+}
+
+typedef struct {
+    const LunarModule *m;
+    size_t n;
+    int ok;
+} Job;
+
+static void *worker(void *arg) {
+    Job *j = (Job *)arg;
+    LunarVm *vm = lunar_vm_new(j->m);
+    if (!vm) return NULL;
+    j->ok = 1;
+    for (size_t i = 0; i < j->n; i++) {
+        if (!request(vm)) j->ok = 0;
+        lunar_vm_reset(vm);
+    }
+    lunar_vm_free(vm);
+    return NULL;
+}
+
+static double threaded(const LunarModule *m, size_t n, size_t threads) {
+    pthread_t *tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    Job *jobs = (Job *)calloc(threads, sizeof(Job));
+    if (!tids || !jobs) die("out of memory", NULL);
+    double t0 = now_ns();
+    for (size_t i = 0; i < threads; i++) {
+        jobs[i].m = m;
+        jobs[i].n = n / threads;
+        if (pthread_create(&tids[i], NULL, worker, &jobs[i]) != 0) die("pthread_create", NULL);
+    }
+    for (size_t i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    double t = (now_ns() - t0) / (double)(n / threads * threads);
+    for (size_t i = 0; i < threads; i++) {
+        if (!jobs[i].ok) die("a thread got a wrong result", NULL);
+    }
+    free(tids);
+    free(jobs);
+    return t;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : 100000;
+    size_t threads = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : 4;
+    if (!n || !threads) die("usage: embed_bench [requests] [threads]", NULL);
+    if (lunar_api_version() != LUNAR_API_VERSION) die("liblunar does not match lunar.h", NULL);
+
+    size_t len = 0;
+    char *src = read_file(SCRIPT, &len);
+    if (!src) die("cannot read " SCRIPT, NULL);
+
+    char err[1024];
+    double t0 = now_ns();
+    LunarModule *m = lunar_compile(SCRIPT, src, len, NULL, err, sizeof(err));
+    double compile = now_ns() - t0;
+    if (!m) die("compile failed", err);
+    free(src);
+
+    size_t procs = n / 100 ? n / 100 : 1;
+    printf("compile once:               %10.1f us\n", compile / 1e3);
+    printf("process per request:        %10.1f us/request (%zu)\n", per_process(procs) / 1e3, procs);
+    printf("lunar_call + lunar_vm_reset:%10.2f us/request (%zu)\n", reused_vm(m, n) / 1e3, n);
+    printf("lunar_call of an empty fn:  %10.3f us/call (%zu)\n", empty_calls(m, n * 10) / 1e3, n * 10);
+    printf("new VM per request:         %10.2f us/request (%zu)\n", fresh_vm(m, n / 10 ? n / 10 : 1) / 1e3, n / 10);
+    printf("%zu threads, one module:     %10.2f us/request (%zu, wall clock)\n", threads, threaded(m, n, threads) / 1e3,
+           n);
+
+    lunar_module_free(m);
+    return 0;
+}
@@ -0,0 +1,485 @@
+// Front-end throughput: lexer_next, parse_program and arena_alloc over
+// synthetic programs from 1KB up, checked against a stored baseline.
+//
+//   make bench                  run, compare with bench/front_baseline.txt
+//   make bench-baseline         run, rewrite the baseline
+//   make bench BENCH_ARGS=--max=1G
+//   ./bench/front_bench gen <style> <size> > prog.lr
+//
+// Sizes go 1KB, 16KB, 256KB, 4MB, 64MB, 1GB up to --max (default 4MB);
+// parsing stops at 64MB, where the AST already takes gigabytes. Styles:
+//   fns       many small functions
+//   deep      long, deeply nested expressions
+//   comments  mostly // and /* */ comments
+//   strings   big tables of string literals, some with escapes
+//   idents    long identifiers, many locals
+//   mixed     all of the above, function by function
+// Programs are generated from a fixed seed, so every run sees the same
+// input. Each measurement is a warmup, then BENCH_SAMPLES samples of
+// enough repetitions to take BENCH_SAMPLE_NS; the median is what counts
+// and the spread (relative standard deviation) says how much to trust it.
+// A case more than --tolerance (default 35%) slower than the baseline
+// fails the run; it is measured up to BENCH_RETRIES times first, so one
+// noisy sample does not.
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/ast.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+
+#define BENCH_SAMPLES   7
+#define BENCH_SAMPLE_NS 20e6
+#define BENCH_RETRIES   3
+#define BENCH_PARSE_MAX (64u << 20)
+#define BENCH_MAX_CASES 256
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// ----- generator -----
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    uint64_t rng;
+} Gen;
+
+static uint64_t next_rand(Gen *g) {
+    g->rng ^= g->rng << 13;
+    g->rng ^= g->rng >> 7;
+    g->rng ^= g->rng << 17;
+    return g->rng;
+}
+
+static size_t pick(Gen *g, size_t n) {
+    return (size_t)(next_rand(g) % n);
+}
+
+static void put(Gen *g, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(g->buf + g->len, g->cap - g->len, fmt, ap);
+        va_end(ap);
+        if (n >= 0 && (size_t)n < g->cap - g->len) {
+            g->len += (size_t)n;
+            return;
+        }
+        size_t cap = g->cap * 2 + (size_t)n + 1;
+        char *b = (char *)realloc(g->buf, cap);
+        if (!b) {
+            fprintf(stderr, "front_bench: out of memory\n");
+            exit(1);
+        }
+        g->buf = b;
+        g->cap = cap;
+    }
+}
+
+static const char *const words[] = {
+    "alpha", "beta", "gamma", "delta", "count", "total", "index", "value", "result", "buffer",
+    "offset", "length", "cursor", "window", "bucket", "weight", "factor", "margin", "limit", "scale",
+};
+#define WORDS (sizeof(words) / sizeof(words[0]))
+
+static void gen_expr(Gen *g, int depth) {
+    if (depth <= 0 || pick(g, 4) == 0) {
+        if (pick(g, 2)) put(g, "%zu", pick(g, 1000));
+        else put(g, "%s", pick(g, 2) ? "a" : "b");
+        return;
+    }
+    static const char *const ops[] = {"+", "-", "*", "/"};
+    put(g, "(");
+    gen_expr(g, depth - 1);
+    put(g, " %s ", ops[pick(g, 4)]);
+    gen_expr(g, depth - 1);
+    put(g, ")");
+}
+
+static void gen_fns(Gen *g, size_t i) {
+    put(g, "funct f%zu(a: int, b: int) ret int {\n", i);
+    put(g, "    let mut x = a + %zu;\n", pick(g, 100));
+    put(g, "    if x > b {\n        x = x - b;\n    } else {\n        x = x + 1;\n    }\n");
+    put(g, "    while x < %zu {\n        x = x * 2;\n    }\n", 10 + pick(g, 90));
+    put(g, "    return x;\n}\n\n");
+}
+
+static void gen_deep(Gen *g, size_t i) {
+    put(g, "funct d%zu(a: int, b: int) ret int {\n", i);
+    for (int k = 0; k < 4; k++) {
+        put(g, "    let v%d = ", k);
+        gen_expr(g, 6 + (int)pick(g, 4));
+        put(g, ";\n");
+    }
+    put(g, "    return v0 + v1 - v2 * v3;\n}\n\n");
+}
+
+static void gen_comments(Gen *g, size_t i) {
+    put(g, "// f%zu: ", i);
+    for (int k = 0; k < 12; k++) put(g, "%s ", words[pick(g, WORDS)]);
+    put(g, "\n/*\n");
+    for (int l = 0; l < 6; l++) {
+        put(g, "   ");
+        for (int k = 0; k < 10; k++) put(g, " %s", words[pick(g, WORDS)]);
+        put(g, "\n");
+    }
+    put(g, "*/\nfunct c%zu(a: int) ret int {\n    // the only line of code\n    return a + %zu;\n}\n\n", i,
+        pick(g, 100));
+}
+
+static void gen_strings(Gen *g, size_t i) {
+    put(g, "funct s%zu() ret list[string] {\n    let t: list[string] = [\n", i);
+    for (int k = 0; k < 12; k++) {
+        put(g, "        \"%s %s", words[pick(g, WORDS)], words[pick(g, WORDS)]);
+        if (pick(g, 3) == 0) put(g, "\\n\\t\\\"%s\\\"", words[pick(g, WORDS)]);
+        put(g, " %zu\",\n", pick(g, 100000));
+    }
+    put(g, "        \"end\"\n    ];\n    return t;\n}\n\n");
+}
+
+static void gen_idents(Gen *g, size_t i) {
+    put(g, "funct compute_%s_%s_%zu(input_%s: int, input_%s: int) ret int {\n", words[pick(g, WORDS)],
+        words[pick(g, WORDS)], i, words[0], words[1]);
+    size_t last = 0;
+    for (int k = 0; k < 8; k++) {
+        last = pick(g, WORDS);
+        put(g, "    let mut local_%s_%s_%d = input_%s + input_%s;\n", words[k], words[last], k, words[0], words[1]);
+    }
+    put(g, "    return local_%s_%s_7 + input_%s;\n}\n\n", words[7], words[last], words[0]);
+}
+
+typedef void (*GenFn)(Gen *g, size_t i);
+
+static const struct {
+    const char *name;
+    GenFn fn;
+} styles[] = {
+    {"fns", gen_fns},
+    {"deep", gen_deep},
+    {"comments", gen_comments},
+    {"strings", gen_strings},
+    {"idents", gen_idents},
+    {"mixed", NULL},
+};
+#define STYLES (sizeof(styles) / sizeof(styles[0]))
+
+// a whole program of about `size` bytes (whole functions, then main)
+static char *generate(size_t style, size_t size, size_t *len) {
+    Gen g = {0};
+    g.cap = size + 4096;
+    g.buf = (char *)malloc(g.cap);
+    g.rng = 0x9e3779b97f4a7c15ull ^ (style + 1) * 0x100000001b3ull;
+    if (!g.buf) return NULL;
+    for (size_t i = 0; g.len < size; i++) {
+        GenFn fn = styles[style].fn ? styles[style].fn : styles[i % (STYLES - 1)].fn;
+        fn(&g, i);
+    }
+    put(&g, "funct main() ret int {\n    return 0;\n}\n");
+    *len = g.len;
+    return g.buf;
+}
+
+// ----- measuring -----
+
+typedef struct {
+    char name[64];
+    double median_ns; // per operation
+    double rsd;       // relative standard deviation of the samples
+    double mbps;      // bytes / median
+} Result;
+
+typedef double (*OpFn)(const char *src, size_t len); // runs once, returns a checksum-ish value
+
+static volatile double sink;
+
+static double op_lex(const char *src, size_t len) {
+    Lexer lx;
+    lexer_init(&lx, "bench.lr", src, len);
+    size_t n = 0;
+    while (lexer_next(&lx).kind != TOK_EOF) n++;
+    return (double)n;
+}
+
+static double op_parse(const char *src, size_t len) {
+    Lexer lx;
+    lexer_init(&lx, "bench.lr", src, len);
+    Arena arena;
+    arena_init(&arena, 64 * 1024);
+    Parser p;
+    parser_init(&p, &lx, &arena);
+    Program *prog = parse_program(&p);
+    if (!prog || p.had_error || lx.had_error) {
+        fprintf(stderr, "front_bench: generated program does not parse\n");
+        exit(1);
+    }
+    double r = (double)prog->fns_len;
+    arena_free(&arena);
+    return r;
+}
+
+// len bytes of AST-sized objects, like a parse of that much source makes
+static double op_arena(const char *src, size_t len) {
+    (void)src;
+    static const size_t sizes[] = {sizeof(Expr), sizeof(Stmt), sizeof(FnDecl), 16, 8, 24, 40, 64};
+    Arena arena;
+    arena_init(&arena, 64 * 1024);
+    size_t done = 0, i = 0;
+    while (done < len) {
+        size_t sz = sizes[i++ & 7];
+        if (!arena_alloc(&arena, sz, 8)) break;
+        done += sz;
+    }
+    arena_free(&arena);
+    return (double)i;
+}
+
+// a fixed amount of plain integer work, which only depends on how fast
+// the machine is right now; see machine_speed
+static double op_probe(const char *src, size_t len) {
+    (void)src;
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ (i & 0xff)) * 1099511628211ull;
+    return (double)(h & 0xffff);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static Result measure(const char *name, OpFn op, const char *src, size_t len) {
+    Result r;
+    snprintf(r.name, sizeof(r.name), "%s", name);
+
+    // warmup, which also sizes the samples
+    double t0 = now_ns();
+    sink = op(src, len);
+    double once = now_ns() - t0;
+    size_t reps = once >= BENCH_SAMPLE_NS ? 1 : (size_t)(BENCH_SAMPLE_NS / (once > 1 ? once : 1)) + 1;
+
+    double samples[BENCH_SAMPLES];
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        t0 = now_ns();
+        for (size_t k = 0; k < reps; k++) sink = op(src, len);
+        samples[s] = (now_ns() - t0) / (double)reps;
+    }
+    double mean = 0, var = 0;
+    for (int s = 0; s < BENCH_SAMPLES; s++) mean += samples[s];
+    mean /= BENCH_SAMPLES;
+    for (int s = 0; s < BENCH_SAMPLES; s++) var += (samples[s] - mean) * (samples[s] - mean);
+    var /= BENCH_SAMPLES - 1;
+    qsort(samples, BENCH_SAMPLES, sizeof(double), cmp_double);
+
+    r.median_ns = samples[BENCH_SAMPLES / 2];
+    r.rsd = mean > 0 ? sqrt(var) / mean : 0;
+    r.mbps = (double)len / 1048576.0 / (r.median_ns / 1e9);
+    return r;
+}
+
+// ----- baseline -----
+
+typedef struct {
+    char name[64];
+    double mbps;
+} Base;
+
+static Base base[BENCH_MAX_CASES];
+static size_t base_len;
+static double tolerance = 0.35;
+static double speed_ratio = 1.0; // machine speed now / when the baseline was written
+
+#define PROBE_NAME "probe"
+
+static size_t load_baseline(const char *path, Base *out, size_t cap) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256];
+    size_t n = 0;
+    while (n < cap && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "%63s %lf", out[n].name, &out[n].mbps) == 2) n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static int write_baseline(const char *path, double probe, const Result *rs, size_t n) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    fprintf(f, "# front_bench medians in MB/s; `make bench-baseline` rewrites this file\n");
+    fprintf(f, "%s %.1f\n", PROBE_NAME, probe);
+    for (size_t i = 0; i < n; i++) fprintf(f, "%s %.1f\n", rs[i].name, rs[i].mbps);
+    return fclose(f) == 0;
+}
+
+static const Base *find_base(const char *name) {
+    for (size_t i = 0; i < base_len; i++) {
+        if (strcmp(base[i].name, name) == 0) return &base[i];
+    }
+    return NULL;
+}
+
+static int too_slow(const Result *r) {
+    const Base *b = find_base(r->name);
+    return b && r->mbps < b->mbps * speed_ratio * (1.0 - tolerance);
+}
+
+// shared and virtual machines speed up and slow down as a whole by a
+// third or more between runs, far beyond the spread within one run; the
+// probe is measured with the baseline and now, and the expectations are
+// scaled by the ratio, so only the front end getting slower relative to
+// the machine counts
+static double machine_speed(void) {
+    double best = 0;
+    for (int k = 0; k < 3; k++) {
+        Result r = measure(PROBE_NAME, op_probe, NULL, 16u << 20);
+        if (r.mbps > best) best = r.mbps;
+    }
+    return best;
+}
+
+// measures and prints one case; one that looks slower than its baseline
+// is measured again (best of BENCH_RETRIES) before it counts
+static Result run_case(const char *name, OpFn op, const char *src, size_t len) {
+    Result r = measure(name, op, src, len);
+    for (int k = 1; k < BENCH_RETRIES && too_slow(&r); k++) {
+        Result again = measure(name, op, src, len);
+        if (again.mbps > r.mbps) r = again;
+    }
+    printf("%-28s %9.3f ms %7.1f%% %10.1f\n", r.name, r.median_ns / 1e6, r.rsd * 100, r.mbps);
+    fflush(stdout);
+    return r;
+}
+
+// "4M", "1G", "512K" or plain bytes
+static size_t parse_size(const char *s) {
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k') v <<= 10;
+    else if (*end == 'M' || *end == 'm') v <<= 20;
+    else if (*end == 'G' || *end == 'g') v <<= 30;
+    return (size_t)v;
+}
+
+static void size_name(char *out, size_t cap, size_t n) {
+    if (n >= (1u << 30)) snprintf(out, cap, "%zuGB", n >> 30);
+    else if (n >= (1u << 20)) snprintf(out, cap, "%zuMB", n >> 20);
+    else snprintf(out, cap, "%zuKB", n >> 10);
+}
+
+static long find_style(const char *name) {
+    for (size_t i = 0; i < STYLES; i++) {
+        if (strcmp(styles[i].name, name) == 0) return (long)i;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "gen") == 0) {
+        long style = find_style(argv[2]);
+        size_t len = 0;
+        char *src = style >= 0 ? generate((size_t)style, parse_size(argv[3]), &len) : NULL;
+        if (!src) {
+            fprintf(stderr, "usage: %s gen fns|deep|comments|strings|idents|mixed <size>\n", argv[0]);
+            return 2;
+        }
+        fwrite(src, 1, len, stdout);
+        free(src);
+        return 0;
+    }
+
+    const char *baseline = NULL, *write_to = NULL;
+    size_t max = 4u << 20;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--baseline=", 11) == 0) baseline = argv[i] + 11;
+        else if (strncmp(argv[i], "--write-baseline=", 17) == 0) write_to = argv[i] + 17;
+        else if (strncmp(argv[i], "--max=", 6) == 0) max = parse_size(argv[i] + 6);
+        else if (strncmp(argv[i], "--tolerance=", 12) == 0) tolerance = atof(argv[i] + 12) / 100.0;
+        else {
+            fprintf(stderr, "usage: %s [--baseline=FILE] [--write-baseline=FILE] [--max=SIZE] [--tolerance=PCT]\n"
+                            "       %s gen <style> <size>\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if (baseline) {
+        base_len = load_baseline(baseline, base, BENCH_MAX_CASES);
+        if (!base_len) {
+            fprintf(stderr, "front_bench: no baseline in %s (make bench-baseline writes one)\n", baseline);
+            return 1;
+        }
+    }
+
+    double probe = machine_speed();
+    const Base *pb = find_base(PROBE_NAME);
+    if (pb && pb->mbps > 0) speed_ratio = probe / pb->mbps;
+    printf("machine speed %.1f MB/s", probe);
+    if (pb) printf(", %.0f%% of the baseline's", speed_ratio * 100);
+    printf("\n");
+
+    static Result results[BENCH_MAX_CASES];
+    size_t n = 0;
+    printf("%-28s %12s %8s %10s\n", "case", "median", "spread", "MB/s");
+    for (size_t size = 1024; size <= max && n + 2 * STYLES + 1 <= BENCH_MAX_CASES; size *= 16) {
+        char sz[16];
+        size_name(sz, sizeof(sz), size);
+        for (size_t s = 0; s < STYLES; s++) {
+            size_t len = 0;
+            char *src = generate(s, size, &len);
+            if (!src) {
+                fprintf(stderr, "front_bench: out of memory generating %s\n", sz);
+                return 1;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "lex/%s/%s", styles[s].name, sz);
+            results[n++] = run_case(name, op_lex, src, len);
+            if (size <= BENCH_PARSE_MAX) {
+                snprintf(name, sizeof(name), "parse/%s/%s", styles[s].name, sz);
+                results[n++] = run_case(name, op_parse, src, len);
+            }
+            free(src);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "arena/%s", sz);
+        results[n++] = run_case(name, op_arena, NULL, size);
+        if (size > ((size_t)-1) / 16) break;
+    }
+
+    if (write_to) {
+        if (!write_baseline(write_to, probe, results, n)) {
+            fprintf(stderr, "front_bench: could not write %s\n", write_to);
+            return 1;
+        }
+        printf("baseline written to %s\n", write_to);
+    }
+
+    if (!baseline) return 0;
+    int failed = 0;
+    size_t compared = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Base *b = find_base(results[i].name);
+        if (!b) continue;
+        compared++;
+        if (too_slow(&results[i])) {
+            double want = b->mbps * speed_ratio;
+            printf("REGRESSION %-28s %.1f MB/s, baseline %.1f MB/s at this machine speed (%.0f%% slower)\n",
+                   results[i].name, results[i].mbps, want, (1.0 - results[i].mbps / want) * 100);
+            failed = 1;
+        }
+    }
+    printf("%zu case(s) compared with %s (tolerance %.0f%%): %s\n", compared, baseline, tolerance * 100,
+           failed ? "FAILED" : "ok");
+    return failed;
+}
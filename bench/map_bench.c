@@ -0,0 +1,217 @@
+// map[K] throughput: the runtime's Swiss-style table (src/map.c) against a
+// naive separately-chained table, for int and string keys.
+//
+//   make bench-map && ./bench/map_bench [max_entries]
+//
+// Prints ns/op for insert, lookup (all hits, in shuffled order so the
+// chained table's nodes are not walked in allocation order) and a full
+// iteration.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/map.h"
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// ----- naive chained table -----
+
+typedef struct Node {
+    struct Node *next;
+    Value key;
+    Value val;
+} Node;
+
+typedef struct {
+    Node **buckets;
+    size_t cap;
+    size_t len;
+} Chained;
+
+static uint64_t chained_hash(Value k) {
+    if (k.kind == VAL_INT) return (uint64_t)k.as.i * 0x9e3779b97f4a7c15ull;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < k.as.s.len; i++) h = (h ^ (unsigned char)k.as.s.ptr[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static int key_eq(Value a, Value b) {
+    if (a.kind == VAL_INT) return a.as.i == b.as.i;
+    return sv_eq(a.as.s, b.as.s);
+}
+
+static void chained_grow(Chained *t) {
+    size_t cap = t->cap ? t->cap * 2 : 16;
+    Node **b = (Node **)calloc(cap, sizeof(Node *));
+    for (size_t i = 0; i < t->cap; i++) {
+        Node *n = t->buckets[i];
+        while (n) {
+            Node *next = n->next;
+            size_t j = chained_hash(n->key) & (cap - 1);
+            n->next = b[j];
+            b[j] = n;
+            n = next;
+        }
+    }
+    free(t->buckets);
+    t->buckets = b;
+    t->cap = cap;
+}
+
+static void chained_set(Chained *t, Value k, Value v) {
+    if (t->len >= t->cap) chained_grow(t);
+    size_t j = chained_hash(k) & (t->cap - 1);
+    for (Node *n = t->buckets[j]; n; n = n->next) {
+        if (key_eq(n->key, k)) {
+            n->val = v;
+            return;
+        }
+    }
+    Node *n = (Node *)malloc(sizeof(Node));
+    n->key = k;
+    n->val = v;
+    n->next = t->buckets[j];
+    t->buckets[j] = n;
+    t->len++;
+}
+
+static Value *chained_find(const Chained *t, Value k) {
+    size_t j = chained_hash(k) & (t->cap - 1);
+    for (Node *n = t->buckets[j]; n; n = n->next) {
+        if (key_eq(n->key, k)) return &n->val;
+    }
+    return NULL;
+}
+
+static void chained_free(Chained *t) {
+    for (size_t i = 0; i < t->cap; i++) {
+        Node *n = t->buckets[i];
+        while (n) {
+            Node *next = n->next;
+            free(n);
+            n = next;
+        }
+    }
+    free(t->buckets);
+}
+
+// ----- driver -----
+
+typedef struct {
+    double insert, lookup, iterate; // ns per entry
+    int64_t check;
+} Result;
+
+static Value *make_keys(size_t n, int strings, char **storage) {
+    Value *keys = (Value *)malloc(n * sizeof(Value));
+    *storage = NULL;
+    if (strings) {
+        char *buf = (char *)malloc(n * 24);
+        size_t off = 0;
+        for (size_t i = 0; i < n; i++) {
+            int len = snprintf(buf + off, 24, "key:%zu", i * 2654435761u);
+            keys[i] = value_str((StrView){ buf + off, (size_t)len });
+            off += (size_t)len;
+        }
+        *storage = buf;
+    } else {
+        for (size_t i = 0; i < n; i++) keys[i] = value_int((int64_t)(i * 2654435761u));
+    }
+    return keys;
+}
+
+// Fisher-Yates with a fixed xorshift seed, so runs are comparable
+static size_t *shuffled(size_t n) {
+    size_t *order = (size_t *)malloc(n * sizeof(size_t));
+    uint64_t x = 0x2545f4914f6cdd1dull;
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    for (size_t i = n; i > 1; i--) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        size_t j = (size_t)(x % i);
+        size_t t = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = t;
+    }
+    return order;
+}
+
+static Result run_swiss(const Value *keys, const size_t *order, size_t n, ValueKind kind) {
+    Result r = {0};
+    Map m;
+    map_init(&m, kind);
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) map_set(&m, keys[i], value_int((int64_t)i));
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++) r.check += map_find(&m, keys[order[i]])->as.i;
+    double t2 = now_ns();
+    size_t it = 0;
+    Value k, v;
+    while (map_next(&m, &it, &k, &v)) r.check -= v.as.i;
+    double t3 = now_ns();
+
+    r.insert = (t1 - t0) / (double)n;
+    r.lookup = (t2 - t1) / (double)n;
+    r.iterate = (t3 - t2) / (double)n;
+    map_release(&m);
+    return r;
+}
+
+static Result run_chained(const Value *keys, const size_t *order, size_t n) {
+    Result r = {0};
+    Chained t = {0};
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) chained_set(&t, keys[i], value_int((int64_t)i));
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++) r.check += chained_find(&t, keys[order[i]])->as.i;
+    double t2 = now_ns();
+    for (size_t b = 0; b < t.cap; b++) {
+        for (Node *nd = t.buckets[b]; nd; nd = nd->next) r.check -= nd->val.as.i;
+    }
+    double t3 = now_ns();
+
+    r.insert = (t1 - t0) / (double)n;
+    r.lookup = (t2 - t1) / (double)n;
+    r.iterate = (t3 - t2) / (double)n;
+    chained_free(&t);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t max = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : 10000000;
+
+    printf("%-7s %10s | %8s %8s %8s | %8s %8s %8s   (ns/op)\n",
+           "keys", "entries", "ins", "find", "iter", "ins", "find", "iter");
+    printf("%-7s %10s | %26s | %26s\n", "", "", "swiss", "chained");
+    for (int strings = 0; strings <= 1; strings++) {
+        // string keys stop at 1M to keep memory reasonable
+        size_t limit = strings && max > 1000000 ? 1000000 : max;
+        for (size_t n = 1000; n <= limit; n *= 10) {
+            char *storage;
+            Value *keys = make_keys(n, strings, &storage);
+            size_t *order = shuffled(n);
+            Result s = run_swiss(keys, order, n, strings ? VAL_STR : VAL_INT);
+            Result c = run_chained(keys, order, n);
+            if (s.check != 0 || c.check != 0) {
+                fprintf(stderr, "map_bench: lookup mismatch at n=%zu\n", n);
+                return 1;
+            }
+            printf("%-7s %10zu | %8.1f %8.1f %8.1f | %8.1f %8.1f %8.1f\n",
+                   strings ? "string" : "int", n, s.insert, s.lookup, s.iterate, c.insert, c.lookup, c.iterate);
+            free(order);
+            free(keys);
+            free(storage);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Plain runs against profile-guided ones.
+//
+//   make bench-pgo
+//   ./bench/pgo_bench [--runs=N] prog.lr...
+//
+// For each program: one run with --pgo-gen records a profile, then plain
+// runs and --pgo-use runs take turns, N of each (default 5). Prints the
+// median wall time (process start included) of both and the speedup,
+// and the geometric mean of the speedups at the end. Runs that exit
+// with a different status than the plain ones fail the bench.
+
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RUNS_MAX 101
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void die(const char *what, const char *why) {
+    fprintf(stderr, "pgo_bench: %s%s%s\n", what, why ? ": " : "", why ? why : "");
+    exit(1);
+}
+
+// runs ./lunar [opt] prog with its output thrown away; returns the exit
+// status and the time it took in *ns
+static int run(const char *opt, const char *prog, double *ns) {
+    char *argv[4] = { "./lunar", (char *)opt, (char *)prog, NULL };
+    if (!opt) {
+        argv[1] = (char *)prog;
+        argv[2] = NULL;
+    }
+    fflush(stdout);
+    double t0 = now_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) _exit(127);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (pid < 0) die("fork failed", NULL);
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) die("waitpid failed", NULL);
+    *ns = now_ns() - t0;
+    if (!WIFEXITED(status)) die("lunar crashed on", prog);
+    if (WEXITSTATUS(status) == 127) die("cannot run ./lunar (run make first)", NULL);
+    return WEXITSTATUS(status);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *xs, size_t n) {
+    qsort(xs, n, sizeof(double), cmp_double);
+    return n % 2 ? xs[n / 2] : (xs[n / 2 - 1] + xs[n / 2]) / 2;
+}
+
+int main(int argc, char **argv) {
+    size_t runs = 5;
+    int first = 1;
+    if (argc > 1 && strncmp(argv[1], "--runs=", 7) == 0) {
+        runs = (size_t)strtoull(argv[1] + 7, NULL, 10);
+        first = 2;
+    }
+    if (first >= argc || !runs || runs > RUNS_MAX) die("usage: pgo_bench [--runs=N] prog.lr...", NULL);
+
+    char profile[] = "/tmp/lunar-pgo-bench-XXXXXX";
+    int fd = mkstemp(profile);
+    if (fd < 0) die("mkstemp failed", NULL);
+    close(fd);
+    char gen[64], use[64];
+    snprintf(gen, sizeof(gen), "--pgo-gen=%s", profile);
+    snprintf(use, sizeof(use), "--pgo-use=%s", profile);
+
+    printf("%-28s %12s %12s %9s   (median of %zu runs)\n", "program", "plain ms", "pgo ms", "speedup", runs);
+    double log_sum = 0;
+    size_t n = 0;
+    for (int i = first; i < argc; i++) {
+        const char *prog = argv[i];
+        double ns, plain[RUNS_MAX], pgo[RUNS_MAX];
+        int want = run(gen, prog, &ns);
+        for (size_t r = 0; r < runs; r++) {
+            if (run(NULL, prog, &plain[r]) != want || run(use, prog, &pgo[r]) != want) {
+                unlink(profile);
+                die("exit status changed on", prog);
+            }
+        }
+        double p = median(plain, runs) / 1e6, q = median(pgo, runs) / 1e6;
+        printf("%-28s %12.1f %12.1f %8.3fx\n", prog, p, q, p / q);
+        log_sum += log(p / q);
+        n++;
+    }
+    unlink(profile);
+    printf("%-28s %12s %12s %8.3fx\n", "geometric mean", "", "", exp(log_sum / (double)n));
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "ast.h"
+#include "util.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -6,40 +7,67 @@ static size_t align_up(size_t x, size_t a) {
     return (x + (a - 1)) & ~(a - 1);
 }
 
+static ArenaBlock *arena_block_new(size_t cap) {
+    ArenaBlock *b = (ArenaBlock *)malloc(sizeof(ArenaBlock) + cap);
+    if (!b) return NULL;
+    b->prev = NULL;
+    b->cap = cap;
+    b->used = 0;
+    b->buf = (unsigned char *)(b + 1);
+    return b;
+}
+
 void arena_init(Arena *a, size_t initial_cap) {
-    a->buf = (unsigned char *)malloc(initial_cap);
-    a->cap = a->buf ? initial_cap : 0;
-    a->used = 0;
+    a->block_size = initial_cap ? initial_cap : 1024;
+    a->requested = 0;
+    a->head = arena_block_new(a->block_size);
 }
 
 void arena_free(Arena *a) {
-    free(a->buf);
-    a->buf = NULL;
-    a->cap = 0;
-    a->used = 0;
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *prev = b->prev;
+        free(b);
+        b = prev;
+    }
+    a->head = NULL;
 }
 
 void *arena_alloc(Arena *a, size_t size, size_t align) {
     if (align == 0) align = 1;
-    size_t start = align_up(a->used, align);
-    size_t end = start + size;
+    ArenaBlock *b = a->head;
 
-    if (end > a->cap) {
-        size_t new_cap = a->cap ? a->cap : 1024;
-        while (new_cap < end) new_cap *= 2;
-
-        unsigned char *nb = (unsigned char *)realloc(a->buf, new_cap);
+    // block buffers start right after the header, which malloc aligns
+    size_t start = b ? align_up(b->used, align) : 0;
+    if (!b || start + size > b->cap) {
+        // start a fresh block; old blocks stay put so earlier pointers remain valid
+        size_t cap = a->block_size;
+        while (cap < size + align) cap *= 2;
+        ArenaBlock *nb = arena_block_new(cap);
         if (!nb) return NULL;
-        a->buf = nb;
-        a->cap = new_cap;
+        nb->prev = b;
+        a->head = nb;
+        b = nb;
+        start = align_up(0, align);
+        if (a->block_size < 16u * 1024 * 1024) a->block_size *= 2;
     }
 
-    void *p = a->buf + start;
-    a->used = end;
+    void *p = b->buf + start;
+    b->used = start + size;
+    a->requested += size;
     memset(p, 0, size);
     return p;
 }
 
+void arena_stats(const Arena *a, ArenaStats *out) {
+    memset(out, 0, sizeof(*out));
+    for (const ArenaBlock *b = a->head; b; b = b->prev) {
+        out->blocks++;
+        out->reserved += b->cap;
+    }
+    out->requested = a->requested;
+}
+
 Expr *ast_new_expr(Arena *a, ExprKind k, Span sp) {
     Expr *e = (Expr *)arena_alloc(a, sizeof(Expr), _Alignof(Expr));
     if (!e) return NULL;
@@ -65,3 +93,57 @@ Program *ast_new_program(Arena *a) {
     Program *p = (Program *)arena_alloc(a, sizeof(Program), _Alignof(Program));
     return p;
 }
+
+int sv_eq(StrView a, StrView b) {
+    // interned literals share storage, so the pointer check settles most
+    return a.len == b.len && (a.len == 0 || a.ptr == b.ptr || memcmp(a.ptr, b.ptr, a.len) == 0);
+}
+
+int sv_eq_cstr(StrView a, const char *s) {
+    size_t n = strlen(s);
+    return a.len == n && memcmp(a.ptr, s, n) == 0;
+}
+
+long ast_find_fn(const Program *prog, StrView name) {
+    if (prog->fn_index) {
+        size_t mask = prog->fn_index_cap - 1;
+        size_t i = (size_t)hash_bytes(name.ptr, name.len, HASH_SEED) & mask;
+        while (prog->fn_index[i]) {
+            size_t fn = prog->fn_index[i] - 1;
+            if (sv_eq(prog->fns[fn]->name, name)) return (long)fn;
+            i = (i + 1) & mask;
+        }
+        return -1;
+    }
+
+    for (size_t i = 0; i < prog->fns_len; i++) {
+        if (sv_eq(prog->fns[i]->name, name)) return (long)i;
+    }
+    return -1;
+}
+
+int ast_index_fns(Program *prog, Arena *a) {
+    size_t cap = 16;
+    while (cap < prog->fns_len * 2) cap *= 2;
+    size_t *slots = (size_t *)arena_alloc(a, cap * sizeof(size_t), _Alignof(size_t));
+    if (!slots) return 0;
+
+    size_t mask = cap - 1;
+    for (size_t fn = 0; fn < prog->fns_len; fn++) {
+        StrView name = prog->fns[fn]->name;
+        size_t i = (size_t)hash_bytes(name.ptr, name.len, HASH_SEED) & mask;
+        int dup = 0;
+        while (slots[i]) {
+            if (sv_eq(prog->fns[slots[i] - 1]->name, name)) {
+                dup = 1;
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+        if (!dup) slots[i] = fn + 1;
+    }
+
+    prog->fn_index = slots;
+    prog->fn_index_cap = cap;
+    return 1;
+}
@@ -18,12 +18,19 @@ typedef enum {
     EXPR_BINARY,
     EXPR_ASSIGN,
     EXPR_CALL,
+
+    EXPR_LIST,      // [a, b, c]
+    EXPR_MAP,       // {k: v, ...}
+    EXPR_INDEX,     // xs[i]
+    EXPR_SET_INDEX, // xs[i] = v
 } ExprKind;
 
 typedef enum {
     STMT_LET = 1,
     STMT_RETURN,
     STMT_EXPR,
+    STMT_IF,
+    STMT_WHILE,
 } StmtKind;
 
 typedef enum {
@@ -59,11 +66,28 @@ typedef struct {
     size_t body_len;
 
     Span span;
+
+    // declared by another module's interface or loaded from a .lrc:
+    // there is no body to inline or tree-walk
+    int external;
 } FnDecl;
 
+// import a.b; -- name is the dotted name as written, spaces dropped
+typedef struct {
+    StrView name;
+    Span span;
+} Import;
+
 typedef struct {
     FnDecl **fns;
     size_t fns_len;
+
+    Import *imports;
+    size_t imports_len;
+
+    // name -> index+1, open addressing; built by ast_index_fns
+    size_t *fn_index;
+    size_t fn_index_cap;
 } Program;
 
 // --- Expr / Stmt nodes ---
@@ -96,7 +120,28 @@ struct Expr {
             Expr *callee;      // usually EXPR_NAME for now
             Expr **args;
             size_t args_len;
+            int spawn;         // `spawn f(...)`: runs as a task, the value is its handle
+            int go;            // `go f(...)`: runs as a coroutine, the value is its handle
         } call;
+
+        struct {
+            Expr **items;
+            size_t items_len;
+            StrView type_name; // declared `list[T]` when known (len==0 otherwise)
+        } list;
+
+        struct {
+            Expr **keys;
+            Expr **values;
+            size_t len;
+            StrView type_name; // declared `map[K]` when known (len==0 otherwise)
+        } map;
+
+        struct {
+            Expr *target;
+            Expr *index;
+            Expr *value; // EXPR_SET_INDEX only
+        } index;
     } as;
 };
 
@@ -118,21 +163,54 @@ struct Stmt {
         struct {
             Expr *expr;
         } expr_stmt;
+
+        struct {
+            Expr *cond;
+            Stmt **then_body;
+            size_t then_len;
+            Stmt **else_body; // NULL when there is no else
+            size_t else_len;
+        } if_stmt;
+
+        struct {
+            Expr *cond;
+            Stmt **body;
+            size_t body_len;
+        } while_stmt;
     } as;
 };
 
 // --- Arena allocator (simple bump arena) ---
+// Memory comes in blocks that never move, so pointers handed out stay
+// valid for the arena's lifetime.
 
-typedef struct {
-    unsigned char *buf;
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;
     size_t cap;
     size_t used;
+    unsigned char *buf;
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head; // block currently bumped from
+    size_t block_size;
+    size_t requested; // bytes asked for, not counting alignment
 } Arena;
 
 void arena_init(Arena *a, size_t initial_cap);
 void arena_free(Arena *a);
 void *arena_alloc(Arena *a, size_t size, size_t align);
 
+// for --stats: reserved - requested is what the arena wastes, in the
+// unused tails of its blocks and in alignment padding
+typedef struct {
+    size_t blocks;
+    size_t reserved;
+    size_t requested;
+} ArenaStats;
+
+void arena_stats(const Arena *a, ArenaStats *out);
+
 // Helpers for AST allocations
 Expr *ast_new_expr(Arena *a, ExprKind k, Span sp);
 Stmt *ast_new_stmt(Arena *a, StmtKind k, Span sp);
@@ -140,4 +218,15 @@ Stmt *ast_new_stmt(Arena *a, StmtKind k, Span sp);
 FnDecl *ast_new_fn(Arena *a);
 Program *ast_new_program(Arena *a);
 
+// StrView helpers
+int sv_eq(StrView a, StrView b);
+int sv_eq_cstr(StrView a, const char *s);
+
+// index of the function called `name` in prog->fns, or -1.
+// the first declaration wins when a name is declared twice.
+long ast_find_fn(const Program *prog, StrView name);
+
+// builds the name index so ast_find_fn is O(1); without it lookups scan
+int ast_index_fns(Program *prog, Arena *a);
+
 #endif
@@ -0,0 +1,323 @@
+#include "builtins.h"
+#include "vm.h"
+#include "list.h"
+#include "map.h"
+#include "task.h"
+#include "coro.h"
+#include <stdio.h>
+
+static int bi_print(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc; (void)where;
+    value_print(&vm->out, args[0]);
+    outbuf_newline(&vm->out);
+    *out = value_int(0);
+    return 1;
+}
+
+static int bi_flush(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)args; (void)argc; (void)where;
+    outbuf_flush(&vm->out);
+    *out = value_int(0);
+    return 1;
+}
+
+// ----- lists -----
+
+static int want_list(Vm *vm, const char *name, Value v, Span where, List **out) {
+    if (v.kind != VAL_LIST) {
+        return vm_error(vm, where, "'%s' expects a list, got %s", name, value_kind_name(v.kind));
+    }
+    *out = v.as.list;
+    return 1;
+}
+
+static int want_int_list(Vm *vm, const char *name, Value v, Span where, List **out) {
+    if (!want_list(vm, name, v, where, out)) return 0;
+    if ((*out)->elem != VAL_INT && (*out)->len) {
+        return vm_error(vm, where, "'%s' expects a list[int], got list[%s]", name, value_kind_name((*out)->elem));
+    }
+    return 1;
+}
+
+static int bi_len(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    if (args[0].kind == VAL_STR) {
+        *out = value_int((int64_t)value_sv(&args[0]).len);
+        return 1;
+    }
+    if (args[0].kind == VAL_MAP) {
+        *out = value_int((int64_t)args[0].as.map->len);
+        return 1;
+    }
+    List *l = NULL;
+    if (!want_list(vm, "len", args[0], where, &l)) return 0;
+    *out = value_int((int64_t)l->len);
+    return 1;
+}
+
+static int bi_push(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "push", args[0], where, &l)) return 0;
+    if (!vm_list_accepts(vm, l, args[1], where)) return 0;
+    if (!heap_list_push(&vm->heap, l, args[1])) return vm_error(vm, where, "out of memory");
+    *out = value_int(0);
+    return 1;
+}
+
+static int bi_pop(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "pop", args[0], where, &l)) return 0;
+    if (!l->len) return vm_error(vm, where, "'pop' on an empty list");
+    *out = list_get(l, --l->len);
+    return 1;
+}
+
+static int bi_resize(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "resize", args[0], where, &l)) return 0;
+    if (args[1].kind != VAL_INT || args[1].as.i < 0) {
+        return vm_error(vm, where, "'resize' expects a length >= 0");
+    }
+    if (l->elem != VAL_INT && l->elem != VAL_BOOL && l->elem != VAL_STR) {
+        return vm_error(vm, where, "'resize' needs a list[int], list[bool] or list[string]");
+    }
+    if (!heap_list_resize(&vm->heap, l, (size_t)args[1].as.i)) return vm_error(vm, where, "out of memory");
+    *out = value_int(0);
+    return 1;
+}
+
+static int bi_fill(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "fill", args[0], where, &l)) return 0;
+    if (!vm_list_accepts(vm, l, args[1], where)) return 0;
+    heap_list_fill(&vm->heap, l, args[1]);
+    *out = value_int(0);
+    return 1;
+}
+
+static int bi_contains(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "contains", args[0], where, &l)) return 0;
+    *out = value_bool(list_contains(l, args[1]));
+    return 1;
+}
+
+static int bi_sum(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_list(vm, "sum", args[0], where, &l)) return 0;
+    if (l->len && l->elem != VAL_INT && l->elem != VAL_BOOL) {
+        return vm_error(vm, where, "'sum' expects a list[int] or list[bool], got list[%s]", value_kind_name(l->elem));
+    }
+    *out = value_int(list_sum(l));
+    return 1;
+}
+
+static int bi_min(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_int_list(vm, "min", args[0], where, &l)) return 0;
+    if (!l->len) return vm_error(vm, where, "'min' of an empty list");
+    *out = value_int(list_min(l));
+    return 1;
+}
+
+static int bi_max(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l = NULL;
+    if (!want_int_list(vm, "max", args[0], where, &l)) return 0;
+    if (!l->len) return vm_error(vm, where, "'max' of an empty list");
+    *out = value_int(list_max(l));
+    return 1;
+}
+
+// ----- maps -----
+
+static int want_map(Vm *vm, const char *name, Value v, Span where, Map **out) {
+    if (v.kind != VAL_MAP) {
+        return vm_error(vm, where, "'%s' expects a map, got %s", name, value_kind_name(v.kind));
+    }
+    *out = v.as.map;
+    return 1;
+}
+
+static int bi_has(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    Map *m = NULL;
+    if (!want_map(vm, "has", args[0], where, &m)) return 0;
+    *out = value_bool(map_find(m, args[1]) != NULL);
+    return 1;
+}
+
+static int bi_remove(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    Map *m = NULL;
+    if (!want_map(vm, "remove", args[0], where, &m)) return 0;
+    *out = value_bool(map_remove(m, args[1]));
+    return 1;
+}
+
+// keys(m) / values(m): a new list, in the map's (unspecified) order
+static int map_to_list(Vm *vm, const char *name, const Value *args, Span where, int want_keys, Value *out) {
+    Map *m = NULL;
+    if (!want_map(vm, name, args[0], where, &m)) return 0;
+    List *l = heap_new_list(&vm->heap, want_keys ? m->key : m->val, m->len);
+    if (!l) return vm_error(vm, where, "out of memory");
+
+    size_t it = 0;
+    Value k, v;
+    while (map_next(m, &it, &k, &v)) heap_list_set(&vm->heap, l, l->len++, want_keys ? k : v);
+    *out = value_list(l);
+    return 1;
+}
+
+static int bi_keys(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    return map_to_list(vm, "keys", args, where, 1, out);
+}
+
+static int bi_values(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    return map_to_list(vm, "values", args, where, 0, out);
+}
+
+// ----- tasks -----
+
+static int bi_join(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    return task_join(vm, args[0], where, out);
+}
+
+// the user function named by args[1] (see Builtin.fn_arg), taking `params` arguments
+static int want_fn(Vm *vm, const char *name, const Value *args, size_t params, Span where, size_t *out) {
+    if (args[1].kind != VAL_STR) {
+        return vm_error(vm, where, "'%s' expects a function, got %s", name, value_kind_name(args[1].kind));
+    }
+    StrView fname = value_sv(&args[1]);
+    long fn = ast_find_fn(vm->prog, fname);
+    if (fn < 0) return vm_error(vm, where, "'%s': no function named '%.*s'", name, (int)fname.len, fname.ptr);
+    if (vm->prog->fns[fn]->params_len != params) {
+        return vm_error(vm, where, "'%s' expects a function of %zu argument(s), '%.*s' takes %zu", name, params,
+                        (int)fname.len, fname.ptr, vm->prog->fns[fn]->params_len);
+    }
+    *out = (size_t)fn;
+    return 1;
+}
+
+static int bi_parallel_map(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l;
+    size_t fn;
+    if (!want_list(vm, "parallel_map", args[0], where, &l) || !want_fn(vm, "parallel_map", args, 1, where, &fn)) return 0;
+    return task_parallel_map(vm, fn, args, where, out);
+}
+
+static int bi_parallel_reduce(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    List *l;
+    size_t fn;
+    if (!want_list(vm, "parallel_reduce", args[0], where, &l) || !want_fn(vm, "parallel_reduce", args, 2, where, &fn)) {
+        return 0;
+    }
+    return task_parallel_reduce(vm, fn, args, where, out);
+}
+
+// ----- coroutines, files and pipes -----
+
+static int want_int(Vm *vm, const char *name, Value v, Span where) {
+    if (v.kind == VAL_INT) return 1;
+    return vm_error(vm, where, "'%s' expects an int, got %s", name, value_kind_name(v.kind));
+}
+
+static int want_str(Vm *vm, const char *name, Value v, Span where) {
+    if (v.kind == VAL_STR) return 1;
+    return vm_error(vm, where, "'%s' expects a string, got %s", name, value_kind_name(v.kind));
+}
+
+static int bi_wait(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    return coro_wait(vm, args[0], where, out);
+}
+
+static int bi_yield(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)args; (void)argc;
+    *out = value_int(0);
+    return coro_yield(vm, where);
+}
+
+static int bi_open(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    if (!want_str(vm, "open", args[0], where) || !want_str(vm, "open", args[1], where)) return 0;
+    return coro_open(vm, value_sv(&args[0]), value_sv(&args[1]), where, out);
+}
+
+static int bi_pipe(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)args; (void)argc;
+    return coro_pipe(vm, where, out);
+}
+
+static int bi_read(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    if (!want_int(vm, "read", args[0], where) || !want_int(vm, "read", args[1], where)) return 0;
+    return coro_read(vm, args[0].as.i, args[1].as.i, where, out);
+}
+
+static int bi_write(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    if (!want_int(vm, "write", args[0], where) || !want_str(vm, "write", args[1], where)) return 0;
+    return coro_write(vm, args[0].as.i, &args[1], where, out);
+}
+
+static int bi_close(Vm *vm, const Value *args, size_t argc, Span where, Value *out) {
+    (void)argc;
+    if (!want_int(vm, "close", args[0], where)) return 0;
+    *out = value_int(0);
+    return coro_close(vm, args[0].as.i, where);
+}
+
+static const Builtin builtins[] = {
+    { "print", 1, bi_print, 1, 0, 0, 0 },
+    { "flush", 0, bi_flush, 0, 0, 0, 0 },
+    { "len", 1, bi_len, 1, 0, 0, 0 },
+    { "push", 2, bi_push, 1, 1, 0, 0 },
+    { "pop", 1, bi_pop, 1, 1, 0, 0 },
+    { "resize", 2, bi_resize, 1, 1, 0, 0 },
+    { "fill", 2, bi_fill, 1, 0, 0, 0 },
+    { "contains", 2, bi_contains, 1, 0, 0, 0 },
+    { "sum", 1, bi_sum, 1, 0, 0, 0 },
+    { "min", 1, bi_min, 1, 0, 0, 0 },
+    { "max", 1, bi_max, 1, 0, 0, 0 },
+    { "has", 2, bi_has, 1, 0, 0, 0 },
+    { "remove", 2, bi_remove, 1, 0, 0, 0 },
+    { "keys", 1, bi_keys, 1, 0, 0, 0 },
+    { "values", 1, bi_values, 1, 0, 0, 0 },
+    { "join", 1, bi_join, 1, 0, 0, 0 },
+    { "parallel_map", 2, bi_parallel_map, 1, 0, 0, 2 },
+    { "parallel_reduce", 3, bi_parallel_reduce, 1, 0, 0, 2 },
+    { "wait", 1, bi_wait, 1, 0, 1, 0 },
+    { "yield", 0, bi_yield, 0, 0, 1, 0 },
+    { "open", 2, bi_open, 1, 0, 1, 0 },
+    { "pipe", 0, bi_pipe, 0, 0, 1, 0 },
+    { "read", 2, bi_read, 1, 0, 1, 0 },
+    { "write", 2, bi_write, 1, 0, 1, 0 },
+    { "close", 1, bi_close, 1, 0, 1, 0 },
+};
+
+#define BUILTINS_LEN (sizeof(builtins) / sizeof(builtins[0]))
+
+int builtin_find(StrView name) {
+    for (size_t i = 0; i < BUILTINS_LEN; i++) {
+        if (sv_eq_cstr(name, builtins[i].name)) return (int)i;
+    }
+    return -1;
+}
+
+const Builtin *builtin_get(int id) {
+    if (id < 0 || (size_t)id >= BUILTINS_LEN) return NULL;
+    return &builtins[id];
+}
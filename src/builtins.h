@@ -0,0 +1,29 @@
+#ifndef LUNAR_BUILTINS_H
+#define LUNAR_BUILTINS_H
+
+#include <stddef.h>
+#include "ast.h"
+#include "value.h"
+
+typedef struct Vm Vm;
+
+// args are read-only; the result goes to *out. returns 1 on success,
+// 0 after reporting a runtime error at `where`.
+typedef int (*BuiltinFn)(Vm *vm, const Value *args, size_t argc, Span where, Value *out);
+
+typedef struct {
+    const char *name;
+    size_t arity;
+    BuiltinFn fn;
+    int borrows; // keeps no reference to its first argument after returning
+    int resizes; // may change the length of a list argument
+    int suspends; // may switch to another coroutine, which may change any list
+    int fn_arg;  // 1-based position of an argument that names a user function, or 0.
+                 // a bare function name there is passed as its name (a string)
+} Builtin;
+
+// builtin id for `name`, or -1. user functions shadow builtins.
+int builtin_find(StrView name);
+const Builtin *builtin_get(int id);
+
+#endif
@@ -0,0 +1,1785 @@
+#include "bytecode.h"
+#include "builtins.h"
+#include "fold.h"
+#include "value.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BC_MAX_LOCALS 256
+#define RANGE_DEPTH 8          // how deep expr_range looks into an expression
+#define LEN_MAX ((int64_t)1 << 60) // no list, map or string gets longer than this
+#define GUARD_MAX 8            // lists one loop may check up front
+#define VERSION_MAX 200        // AST nodes; bigger loop bodies are not compiled twice
+
+// what the compiler knows about an int value: known means it is an int
+// in [lo, hi] whenever the code runs
+typedef struct {
+    int known;
+    int64_t lo, hi;
+} Range;
+
+typedef struct {
+    StrView name;
+    int is_mut;
+    size_t slot;
+    const Expr *literal; // inlined param bound directly to a literal argument
+    Range range;
+    const Expr *step;    // the loop's `i + K` that the range already accounts for
+    int constant;        // immutable, with value known at compile time
+    Value value;
+} Local;
+
+// a `while` whose counter indexes some lists without bounds checks
+typedef struct BoundsCtx {
+    long counter;           // local
+    long lists[GUARD_MAX];  // locals where list[counter] is always in range
+    size_t lists_len;
+    const Stmt *bump;       // after this statement the counter may have reached the end
+    int active;
+    struct BoundsCtx *outer;
+} BoundsCtx;
+
+// a callee body being compiled into its caller
+typedef struct {
+    size_t slot_base; // first arg slot; the call's result ends up here
+    size_t *exits;    // `return` jumps to patch once the body is done
+    size_t exits_len;
+    size_t exits_cap;
+} InlineCtx;
+
+typedef struct {
+    const Program *prog;
+    const BcOptions *opts;
+    size_t fn_index;
+    const FnDecl *fn;
+    const FnDecl *body; // whose statements are being compiled: fn, or the callee being inlined
+    Chunk *chunk;
+
+    Local locals[BC_MAX_LOCALS];
+    size_t locals_len;
+    size_t scope_floor; // locals below this belong to the function we are inlined into
+
+    InlineCtx *inl;
+    size_t inline_depth;
+    size_t loops; // while loops we are in
+
+    BoundsCtx *bounds;
+    int guarded_copy; // inside the fast copy of a guarded loop, whose loops are no OSR targets
+
+    FoldEnv fold;           // fold.cg is NULL when folding is off
+    const Expr *folded;     // the last expression compiled to a literal...
+    Value folded_value;     // ...and its value
+
+    size_t depth; // current stack height: locals + temporaries
+    int failed;
+} Compiler;
+
+// ----- chunk building -----
+
+static int grow(void **buf, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap) return 1;
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    while (new_cap < need) new_cap *= 2;
+    void *nb = realloc(*buf, new_cap * elem);
+    if (!nb) return 0;
+    *buf = nb;
+    *cap = new_cap;
+    return 1;
+}
+
+static void emit(Compiler *c, uint8_t byte, Span sp) {
+    Chunk *ch = c->chunk;
+    if (c->failed) return;
+    if (!grow((void **)&ch->code, &ch->cap, ch->len + 1, sizeof(uint8_t))) {
+        c->failed = 1;
+        return;
+    }
+    const SrcPos *last = ch->pos_len ? &ch->pos[ch->pos_len - 1] : NULL;
+    if (!last || last->line != (uint32_t)sp.line || last->col != (uint32_t)sp.col) {
+        if (!grow((void **)&ch->pos, &ch->pos_cap, ch->pos_len + 1, sizeof(SrcPos))) {
+            c->failed = 1;
+            return;
+        }
+        SrcPos *p = &ch->pos[ch->pos_len++];
+        p->offset = (uint32_t)ch->len;
+        p->line = (uint32_t)sp.line;
+        p->col = (uint32_t)sp.col;
+    }
+    ch->code[ch->len++] = byte;
+}
+
+// drops code emitted past `len`, with its positions
+static void truncate_code(Chunk *ch, size_t len) {
+    ch->len = len;
+    while (ch->pos_len && ch->pos[ch->pos_len - 1].offset >= len) ch->pos_len--;
+}
+
+static void emit_u16(Compiler *c, size_t v, Span sp) {
+    if (v > UINT16_MAX) {
+        c->failed = 1;
+        return;
+    }
+    emit(c, (uint8_t)(v & 0xff), sp);
+    emit(c, (uint8_t)(v >> 8), sp);
+}
+
+static void patch_u16(Compiler *c, size_t at, size_t v) {
+    if (c->failed) return;
+    if (v > UINT16_MAX) {
+        c->failed = 1;
+        return;
+    }
+    c->chunk->code[at] = (uint8_t)(v & 0xff);
+    c->chunk->code[at + 1] = (uint8_t)(v >> 8);
+}
+
+static void push(Compiler *c, size_t n) {
+    c->depth += n;
+    if (c->depth > c->chunk->max_stack) c->chunk->max_stack = (uint32_t)c->depth;
+}
+
+static void pop(Compiler *c, size_t n) {
+    c->depth -= n;
+}
+
+static size_t add_int(Compiler *c, int64_t v) {
+    Chunk *ch = c->chunk;
+    for (size_t i = 0; i < ch->ints_len; i++) {
+        if (ch->ints[i] == v) return i;
+    }
+    if (!grow((void **)&ch->ints, &ch->ints_cap, ch->ints_len + 1, sizeof(int64_t))) {
+        c->failed = 1;
+        return 0;
+    }
+    ch->ints[ch->ints_len] = v;
+    return ch->ints_len++;
+}
+
+static size_t add_str(Compiler *c, StrView s) {
+    Chunk *ch = c->chunk;
+    if (!grow((void **)&ch->strs, &ch->strs_cap, ch->strs_len + 1, sizeof(StrView))) {
+        c->failed = 1;
+        return 0;
+    }
+    ch->strs[ch->strs_len] = s;
+    return ch->strs_len++;
+}
+
+static void emit_int(Compiler *c, int64_t v, Span sp) {
+    emit(c, OP_INT, sp);
+    emit_u16(c, add_int(c, v), sp);
+    push(c, 1);
+}
+
+// emits a forward jump and returns the operand offset to patch
+static size_t emit_jump(Compiler *c, OpCode op, Span sp) {
+    emit(c, (uint8_t)op, sp);
+    size_t at = c->chunk->len;
+    emit_u16(c, 0, sp);
+    return at;
+}
+
+static void patch_jump(Compiler *c, size_t at) {
+    patch_u16(c, at, c->chunk->len - (at + 2));
+}
+
+// --pgo-gen: OP_COUNT or OP_COUNT_BRANCH for the site of node, if it is one
+static void emit_count(Compiler *c, OpCode op, const void *node, Span sp) {
+    if (!c->opts || !c->opts->pgo_gen) return;
+    long site = pgo_site(c->opts->pgo, node);
+    if (site < 0) return;
+    emit(c, (uint8_t)op, sp);
+    emit_u16(c, add_int(c, site), sp);
+}
+
+// ----- locals -----
+
+// index into c->locals, or -1
+static long resolve_local(Compiler *c, StrView name) {
+    for (size_t i = c->locals_len; i > c->scope_floor; i--) {
+        if (sv_eq(c->locals[i - 1].name, name)) return (long)(i - 1);
+    }
+    return -1;
+}
+
+static void declare_local(Compiler *c, StrView name, int is_mut, size_t slot) {
+    if (c->locals_len == BC_MAX_LOCALS) {
+        c->failed = 1;
+        return;
+    }
+    c->locals[c->locals_len].name = name;
+    c->locals[c->locals_len].is_mut = is_mut;
+    c->locals[c->locals_len].slot = slot;
+    c->locals[c->locals_len].literal = NULL;
+    c->locals[c->locals_len].range.known = 0;
+    c->locals[c->locals_len].step = NULL;
+    c->locals[c->locals_len].constant = 0;
+    c->locals_len++;
+}
+
+// ----- helpers for the inliner -----
+
+static int expr_assigns(const Expr *e, const StrView *name) {
+    if (!e) return 0;
+    switch (e->kind) {
+        case EXPR_UNARY:  return expr_assigns(e->as.unary.rhs, name);
+        case EXPR_BINARY: return expr_assigns(e->as.binary.lhs, name) || expr_assigns(e->as.binary.rhs, name);
+        case EXPR_ASSIGN:
+            if (!name || sv_eq(e->as.assign.name, *name)) return 1;
+            return expr_assigns(e->as.assign.value, name);
+        case EXPR_CALL:
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (expr_assigns(e->as.call.args[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) {
+                if (expr_assigns(e->as.list.items[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                if (expr_assigns(e->as.map.keys[i], name) || expr_assigns(e->as.map.values[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            // element stores go through the list, not the binding
+            return expr_assigns(e->as.index.target, name) || expr_assigns(e->as.index.index, name) ||
+                   expr_assigns(e->as.index.value, name);
+        default: return 0;
+    }
+}
+
+// 1 if any statement may assign `name` (NULL: any name at all)
+static int stmts_assign(Stmt **stmts, size_t len, const StrView *name) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    if (expr_assigns(s->as.let_stmt.init, name)) return 1; break;
+            case STMT_RETURN: if (expr_assigns(s->as.ret_stmt.value, name)) return 1; break;
+            case STMT_EXPR:   if (expr_assigns(s->as.expr_stmt.expr, name)) return 1; break;
+            case STMT_IF:
+                if (expr_assigns(s->as.if_stmt.cond, name) ||
+                    stmts_assign(s->as.if_stmt.then_body, s->as.if_stmt.then_len, name) ||
+                    stmts_assign(s->as.if_stmt.else_body, s->as.if_stmt.else_len, name)) return 1;
+                break;
+            case STMT_WHILE:
+                if (expr_assigns(s->as.while_stmt.cond, name) ||
+                    stmts_assign(s->as.while_stmt.body, s->as.while_stmt.body_len, name)) return 1;
+                break;
+        }
+    }
+    return 0;
+}
+
+// ----- escape analysis -----
+// A list bound by `let` stays inside its frame if its name is only ever
+// indexed, compared, or passed as the first argument of a builtin that
+// borrows it. Anything else (assigning it, returning it, passing it to a
+// user function, storing it in a container) counts as an escape. Shadowed
+// names are not told apart, which only errs on the side of escaping.
+
+static int expr_leaks(const Program *prog, const Expr *e, StrView name);
+
+// `e` is in a position where the bare name is harmless
+static int use_leaks(const Program *prog, const Expr *e, StrView name) {
+    if (e && e->kind == EXPR_NAME) return 0;
+    return expr_leaks(prog, e, name);
+}
+
+static int expr_leaks(const Program *prog, const Expr *e, StrView name) {
+    if (!e) return 0;
+    switch (e->kind) {
+        case EXPR_INT:
+        case EXPR_STRING:
+        case EXPR_BOOL:
+            return 0;
+        case EXPR_NAME:
+            return sv_eq(e->as.str, name);
+        case EXPR_UNARY:
+            return expr_leaks(prog, e->as.unary.rhs, name);
+        case EXPR_BINARY:
+            if (e->as.binary.op == BOP_EQ || e->as.binary.op == BOP_NE) {
+                return use_leaks(prog, e->as.binary.lhs, name) || use_leaks(prog, e->as.binary.rhs, name);
+            }
+            return expr_leaks(prog, e->as.binary.lhs, name) || expr_leaks(prog, e->as.binary.rhs, name);
+        case EXPR_ASSIGN:
+            return sv_eq(e->as.assign.name, name) || expr_leaks(prog, e->as.assign.value, name);
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            int borrows = 0;
+            if (callee && callee->kind == EXPR_NAME && ast_find_fn(prog, callee->as.str) < 0) {
+                int bi = builtin_find(callee->as.str);
+                borrows = bi >= 0 && builtin_get(bi)->borrows;
+            }
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                const Expr *a = e->as.call.args[i];
+                if ((i == 0 && borrows) ? use_leaks(prog, a, name) : expr_leaks(prog, a, name)) return 1;
+            }
+            return 0;
+        }
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) {
+                if (expr_leaks(prog, e->as.list.items[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                if (expr_leaks(prog, e->as.map.keys[i], name) || expr_leaks(prog, e->as.map.values[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX:
+            return use_leaks(prog, e->as.index.target, name) || expr_leaks(prog, e->as.index.index, name);
+        case EXPR_SET_INDEX:
+            return use_leaks(prog, e->as.index.target, name) || expr_leaks(prog, e->as.index.index, name) ||
+                   expr_leaks(prog, e->as.index.value, name);
+    }
+    return 1;
+}
+
+static int stmts_leak(const Program *prog, Stmt **stmts, size_t len, StrView name) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    if (expr_leaks(prog, s->as.let_stmt.init, name)) return 1; break;
+            case STMT_RETURN: if (expr_leaks(prog, s->as.ret_stmt.value, name)) return 1; break;
+            case STMT_EXPR:   if (expr_leaks(prog, s->as.expr_stmt.expr, name)) return 1; break;
+            case STMT_IF:
+                if (expr_leaks(prog, s->as.if_stmt.cond, name) ||
+                    stmts_leak(prog, s->as.if_stmt.then_body, s->as.if_stmt.then_len, name) ||
+                    stmts_leak(prog, s->as.if_stmt.else_body, s->as.if_stmt.else_len, name)) return 1;
+                break;
+            case STMT_WHILE:
+                if (expr_leaks(prog, s->as.while_stmt.cond, name) ||
+                    stmts_leak(prog, s->as.while_stmt.body, s->as.while_stmt.body_len, name)) return 1;
+                break;
+        }
+    }
+    return 0;
+}
+
+// `let name = <list literal>` can use a region slot: the elements must be
+// ints or bools, so the list never points at anything the GC has to see.
+// Each slot is reused every time its `let` runs again, which is safe
+// because the previous list bound there is dead by then.
+static int list_stays_local(Compiler *c, const Stmt *let) {
+    const Expr *init = let->as.let_stmt.init;
+    if (!init || init->kind != EXPR_LIST || c->chunk->region_lists >= UINT16_MAX) return 0;
+    ValueKind elem = value_list_elem_for_type(init->as.list.type_name);
+    if (elem != VAL_INT && elem != VAL_BOOL) return 0;
+    return !stmts_leak(c->prog, c->body->body, c->body->body_len, let->as.let_stmt.name);
+}
+
+// ----- expressions -----
+
+// ----- int ranges -----
+// Proves that some + - * cannot overflow, so they compile to the
+// unchecked OP_IADD family. Facts come from literals, immutable lets,
+// len(), counters that only ever go up, and the condition of a
+// `while i < n { ... i = i + K; }` loop. Overflow stops the program
+// unless --overflow=wrap, so a value that got computed is exact.
+
+static const Range range_any = {1, INT64_MIN, INT64_MAX};
+
+static Range range_exact(int64_t v) {
+    Range r = {1, v, v};
+    return r;
+}
+
+// *safe is cleared when op may overflow for some operands in l and r
+static Range range_arith(BinaryOp op, Range l, Range r, int *safe) {
+    *safe = 0;
+    Range out = range_any;
+    int64_t v[4];
+    switch (op) {
+        case BOP_ADD:
+            if (__builtin_add_overflow(l.lo, r.lo, &out.lo) || __builtin_add_overflow(l.hi, r.hi, &out.hi)) return range_any;
+            break;
+        case BOP_SUB:
+            if (__builtin_sub_overflow(l.lo, r.hi, &out.lo) || __builtin_sub_overflow(l.hi, r.lo, &out.hi)) return range_any;
+            break;
+        case BOP_MUL:
+            if (__builtin_mul_overflow(l.lo, r.lo, &v[0]) || __builtin_mul_overflow(l.lo, r.hi, &v[1]) ||
+                __builtin_mul_overflow(l.hi, r.lo, &v[2]) || __builtin_mul_overflow(l.hi, r.hi, &v[3])) return range_any;
+            out.lo = out.hi = v[0];
+            for (int i = 1; i < 4; i++) {
+                if (v[i] < out.lo) out.lo = v[i];
+                if (v[i] > out.hi) out.hi = v[i];
+            }
+            break;
+        case BOP_DIV: {
+            // |a / b| <= |a| once b cannot be 0 (nor -1 with a = INT64_MIN)
+            if ((r.lo <= 0 && r.hi >= 0) || l.lo == INT64_MIN) return range_any;
+            int64_t m = -l.lo > l.hi ? -l.lo : l.hi;
+            out.lo = -m;
+            out.hi = m;
+            break;
+        }
+        default: return range_any;
+    }
+    *safe = 1;
+    return out;
+}
+
+static Range expr_range(Compiler *c, const Expr *e, int depth) {
+    Range none = {0, 0, 0};
+    if (!e || depth > RANGE_DEPTH) return none;
+    switch (e->kind) {
+        case EXPR_INT: return range_exact(e->as.int_val);
+        case EXPR_NAME: {
+            long local = resolve_local(c, e->as.str);
+            if (local < 0) return none;
+            if (c->locals[local].literal) return expr_range(c, c->locals[local].literal, depth + 1);
+            return c->locals[local].range;
+        }
+        case EXPR_UNARY: {
+            if (e->as.unary.op != UOP_NEG) return none;
+            Range r = expr_range(c, e->as.unary.rhs, depth + 1);
+            if (!r.known || r.lo == INT64_MIN) return r.known ? range_any : none;
+            Range out = {1, -r.hi, -r.lo};
+            return out;
+        }
+        case EXPR_BINARY: {
+            BinaryOp op = e->as.binary.op;
+            if (op != BOP_ADD && op != BOP_SUB && op != BOP_MUL && op != BOP_DIV) return none;
+            Range l = expr_range(c, e->as.binary.lhs, depth + 1);
+            Range r = expr_range(c, e->as.binary.rhs, depth + 1);
+            if (!l.known || !r.known) return none;
+            int safe;
+            return range_arith(op, l, r, &safe);
+        }
+        case EXPR_ASSIGN: return expr_range(c, e->as.assign.value, depth + 1);
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            if (!callee || callee->kind != EXPR_NAME || ast_find_fn(c->prog, callee->as.str) >= 0) return none;
+            int bi = builtin_find(callee->as.str);
+            if (bi < 0 || strcmp(builtin_get(bi)->name, "len") != 0) return none;
+            Range out = {1, 0, LEN_MAX};
+            return out;
+        }
+        default: return none;
+    }
+}
+
+// `name = name + K` with a literal K > 0; returns K or 0
+static int64_t step_of(const Expr *e, StrView name) {
+    if (!e || e->kind != EXPR_ASSIGN || !sv_eq(e->as.assign.name, name)) return 0;
+    const Expr *v = e->as.assign.value;
+    if (v->kind != EXPR_BINARY || v->as.binary.op != BOP_ADD) return 0;
+    const Expr *l = v->as.binary.lhs;
+    const Expr *r = v->as.binary.rhs;
+    if (l->kind != EXPR_NAME || !sv_eq(l->as.str, name) || r->kind != EXPR_INT || r->as.int_val <= 0) return 0;
+    return r->as.int_val;
+}
+
+// 1 if every assignment to name in e counts it up
+static int expr_counts_up(const Expr *e, StrView name) {
+    if (!e) return 1;
+    if (e->kind == EXPR_ASSIGN && sv_eq(e->as.assign.name, name)) return step_of(e, name) > 0;
+    switch (e->kind) {
+        case EXPR_UNARY:  return expr_counts_up(e->as.unary.rhs, name);
+        case EXPR_BINARY: return expr_counts_up(e->as.binary.lhs, name) && expr_counts_up(e->as.binary.rhs, name);
+        case EXPR_ASSIGN: return expr_counts_up(e->as.assign.value, name);
+        case EXPR_CALL:
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (!expr_counts_up(e->as.call.args[i], name)) return 0;
+            }
+            return 1;
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) {
+                if (!expr_counts_up(e->as.list.items[i], name)) return 0;
+            }
+            return 1;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                if (!expr_counts_up(e->as.map.keys[i], name) || !expr_counts_up(e->as.map.values[i], name)) return 0;
+            }
+            return 1;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            return expr_counts_up(e->as.index.target, name) && expr_counts_up(e->as.index.index, name) &&
+                   expr_counts_up(e->as.index.value, name);
+        default: return 1;
+    }
+}
+
+static int stmts_count_up(Stmt **stmts, size_t len, StrView name) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    if (!expr_counts_up(s->as.let_stmt.init, name)) return 0; break;
+            case STMT_RETURN: if (!expr_counts_up(s->as.ret_stmt.value, name)) return 0; break;
+            case STMT_EXPR:   if (!expr_counts_up(s->as.expr_stmt.expr, name)) return 0; break;
+            case STMT_IF:
+                if (!expr_counts_up(s->as.if_stmt.cond, name) ||
+                    !stmts_count_up(s->as.if_stmt.then_body, s->as.if_stmt.then_len, name) ||
+                    !stmts_count_up(s->as.if_stmt.else_body, s->as.if_stmt.else_len, name)) return 0;
+                break;
+            case STMT_WHILE:
+                if (!expr_counts_up(s->as.while_stmt.cond, name) ||
+                    !stmts_count_up(s->as.while_stmt.body, s->as.while_stmt.body_len, name)) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+// range of a local right after `let`; a counter keeps its start as lower bound
+static Range let_range(Compiler *c, const Stmt *s) {
+    Range r = expr_range(c, s->as.let_stmt.init, 0);
+    if (!s->as.let_stmt.is_mut || !r.known) return r;
+    if (c->opts && c->opts->wrap_ints) r.known = 0;
+    else if (stmts_count_up(c->body->body, c->body->body_len, s->as.let_stmt.name)) r.hi = INT64_MAX;
+    else r.known = 0;
+    return r;
+}
+
+// For `while i < n` (or <=) whose body bumps i exactly once, as a plain
+// `i = i + K;` statement: inside the body i stays below n's upper bound
+// plus K. Returns the local (or -1) and sets *inside to that range and
+// *step to the increment.
+static long loop_counter(Compiler *c, const Stmt *s, Range *inside, const Expr **step) {
+    const Expr *cond = s->as.while_stmt.cond;
+    if (cond->kind != EXPR_BINARY || (cond->as.binary.op != BOP_LT && cond->as.binary.op != BOP_LTE)) return -1;
+    const Expr *lhs = cond->as.binary.lhs;
+    if (lhs->kind != EXPR_NAME) return -1;
+    long local = resolve_local(c, lhs->as.str);
+    if (local < 0 || !c->locals[local].is_mut) return -1;
+    // `<` only passes ints, so n is one even when nothing else is known
+    Range bound = expr_range(c, cond->as.binary.rhs, 0);
+    if (!bound.known) bound = range_any;
+
+    StrView name = lhs->as.str;
+    Stmt **body = s->as.while_stmt.body;
+    size_t len = s->as.while_stmt.body_len;
+    int64_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        const Expr *e = body[i]->kind == STMT_EXPR ? body[i]->as.expr_stmt.expr : NULL;
+        if (e && e->kind == EXPR_ASSIGN && sv_eq(e->as.assign.name, name)) {
+            if (k || !(k = step_of(e, name))) return -1;
+            *step = e->as.assign.value;
+            continue;
+        }
+        if (stmts_assign(&body[i], 1, &name)) return -1;
+    }
+    if (!k || expr_assigns(cond->as.binary.rhs, &name)) return -1;
+
+    int64_t hi = bound.hi;
+    if (cond->as.binary.op == BOP_LT && __builtin_sub_overflow(hi, 1, &hi)) return -1;
+    if (__builtin_add_overflow(hi, k, &hi)) return -1;
+    Range known = c->locals[local].range;
+    inside->known = 1;
+    inside->lo = known.known ? known.lo : INT64_MIN;
+    inside->hi = hi;
+    return local;
+}
+
+// ----- bounds checks -----
+// In `while i < len(xs) { ... xs[i] ... i = i + 1; }` every xs[i] before
+// the increment is in range, as long as i starts at 0 or above and
+// nothing in the loop resizes a list, or lets another coroutine run that
+// might (wait, yield and the fd builtins, here or in a callee). Other lists indexed by i get one
+// check before the loop instead (n <= len(ys) for `while i < n`): the
+// loop is compiled twice and the guards pick the copy without bounds
+// checks.
+
+// calls visit on e and everything below it; stops at the first nonzero
+static int expr_walk(const Expr *e, int (*visit)(void *ctx, const Expr *e), void *ctx) {
+    if (!e) return 0;
+    if (visit(ctx, e)) return 1;
+    switch (e->kind) {
+        case EXPR_UNARY:  return expr_walk(e->as.unary.rhs, visit, ctx);
+        case EXPR_BINARY: return expr_walk(e->as.binary.lhs, visit, ctx) || expr_walk(e->as.binary.rhs, visit, ctx);
+        case EXPR_ASSIGN: return expr_walk(e->as.assign.value, visit, ctx);
+        case EXPR_CALL:
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (expr_walk(e->as.call.args[i], visit, ctx)) return 1;
+            }
+            return 0;
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) {
+                if (expr_walk(e->as.list.items[i], visit, ctx)) return 1;
+            }
+            return 0;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                if (expr_walk(e->as.map.keys[i], visit, ctx) || expr_walk(e->as.map.values[i], visit, ctx)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            return expr_walk(e->as.index.target, visit, ctx) || expr_walk(e->as.index.index, visit, ctx) ||
+                   expr_walk(e->as.index.value, visit, ctx);
+        default: return 0;
+    }
+}
+
+static int stmts_walk(Stmt **stmts, size_t len, int (*visit)(void *ctx, const Expr *e), void *ctx) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    if (expr_walk(s->as.let_stmt.init, visit, ctx)) return 1; break;
+            case STMT_RETURN: if (expr_walk(s->as.ret_stmt.value, visit, ctx)) return 1; break;
+            case STMT_EXPR:   if (expr_walk(s->as.expr_stmt.expr, visit, ctx)) return 1; break;
+            case STMT_IF:
+                if (expr_walk(s->as.if_stmt.cond, visit, ctx) ||
+                    stmts_walk(s->as.if_stmt.then_body, s->as.if_stmt.then_len, visit, ctx) ||
+                    stmts_walk(s->as.if_stmt.else_body, s->as.if_stmt.else_len, visit, ctx)) return 1;
+                break;
+            case STMT_WHILE:
+                if (expr_walk(s->as.while_stmt.cond, visit, ctx) ||
+                    stmts_walk(s->as.while_stmt.body, s->as.while_stmt.body_len, visit, ctx)) return 1;
+                break;
+        }
+    }
+    return 0;
+}
+
+// 1 if some `let` in stmts declares name
+static int stmts_declare(Stmt **stmts, size_t len, StrView name) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        if (s->kind == STMT_LET && sv_eq(s->as.let_stmt.name, name)) return 1;
+        if (s->kind == STMT_IF && (stmts_declare(s->as.if_stmt.then_body, s->as.if_stmt.then_len, name) ||
+                                   stmts_declare(s->as.if_stmt.else_body, s->as.if_stmt.else_len, name))) return 1;
+        if (s->kind == STMT_WHILE && stmts_declare(s->as.while_stmt.body, s->as.while_stmt.body_len, name)) return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    Compiler *c;
+    Stmt **body; // the loop's
+    size_t body_len;
+    StrView counter;
+    long found[GUARD_MAX];
+    size_t found_len;
+} LoopScan;
+
+// 1 if e is a name of the enclosing function that the loop never
+// rebinds or assigns; its local goes to *out
+static int outer_name(const LoopScan *ls, const Expr *e, long *out) {
+    if (!e || e->kind != EXPR_NAME || stmts_declare(ls->body, ls->body_len, e->as.str) ||
+        stmts_assign(ls->body, ls->body_len, &e->as.str)) return 0;
+    *out = resolve_local(ls->c, e->as.str);
+    return *out >= 0;
+}
+
+// builtin id if e calls one (not shadowed by a user function), else -1
+static int builtin_call(const Compiler *c, const Expr *e) {
+    const Expr *callee = e->kind == EXPR_CALL ? e->as.call.callee : NULL;
+    if (!callee || callee->kind != EXPR_NAME || ast_find_fn(c->prog, callee->as.str) >= 0) return -1;
+    return builtin_find(callee->as.str);
+}
+
+// proven to be an int, so passing it along cannot hand out a list
+static int int_arg(const LoopScan *ls, const Expr *e) {
+    switch (e->kind) {
+        case EXPR_INT: return 1;
+        case EXPR_NAME:
+            return !stmts_declare(ls->body, ls->body_len, e->as.str) && expr_range(ls->c, e, 0).known;
+        case EXPR_UNARY: return e->as.unary.op == UOP_NEG && int_arg(ls, e->as.unary.rhs);
+        case EXPR_BINARY:
+            return e->as.binary.op >= BOP_ADD && e->as.binary.op <= BOP_DIV &&
+                   int_arg(ls, e->as.binary.lhs) && int_arg(ls, e->as.binary.rhs);
+        default: return 0;
+    }
+}
+
+// a user callback may yield as well, and resize whatever it is handed
+static int builtin_suspends(const Builtin *b) {
+    return b->suspends || b->fn_arg;
+}
+
+typedef struct {
+    const Program *prog;
+    unsigned char *seen; // functions already walked
+} SuspendScan;
+
+// visit: calls that may switch to another coroutine, directly or further
+// down; functions without a body here count as switching
+static int may_suspend(void *ctx, const Expr *e) {
+    SuspendScan *ss = (SuspendScan *)ctx;
+    if (e->kind != EXPR_CALL) return 0;
+    const Expr *callee = e->as.call.callee;
+    if (!callee || callee->kind != EXPR_NAME) return 1;
+    long fn = ast_find_fn(ss->prog, callee->as.str);
+    if (fn < 0) {
+        int bi = builtin_find(callee->as.str);
+        return bi < 0 || builtin_suspends(builtin_get(bi));
+    }
+    const FnDecl *decl = ss->prog->fns[fn];
+    if (decl->external) return 1;
+    if (ss->seen[fn]) return 0;
+    ss->seen[fn] = 1;
+    return stmts_walk(decl->body, decl->body_len, may_suspend, ss);
+}
+
+// visit: calls that may change the length of some list (ours or an alias)
+static int resizes_lists(void *ctx, const Expr *e) {
+    const LoopScan *ls = (const LoopScan *)ctx;
+    if (e->kind != EXPR_CALL) return 0;
+    const Expr *callee = e->as.call.callee;
+    if (!callee || callee->kind != EXPR_NAME) return 1;
+    int bi = builtin_call(ls->c, e);
+    if (bi >= 0) return builtin_get(bi)->resizes || builtin_suspends(builtin_get(bi));
+    // user functions only see what they are passed, but may suspend
+    for (size_t i = 0; i < e->as.call.args_len; i++) {
+        if (!int_arg(ls, e->as.call.args[i])) return 1;
+    }
+    SuspendScan ss = { ls->c->prog, (unsigned char *)calloc(ls->c->prog->fns_len, 1) };
+    int r = !ss.seen || may_suspend(&ss, e);
+    free(ss.seen);
+    return r;
+}
+
+// visit: collects the lists indexed by the counter
+static int indexed_by_counter(void *ctx, const Expr *e) {
+    LoopScan *ls = (LoopScan *)ctx;
+    if (e->kind != EXPR_INDEX && e->kind != EXPR_SET_INDEX) return 0;
+    const Expr *idx = e->as.index.index;
+    long list;
+    if (idx->kind != EXPR_NAME || !sv_eq(idx->as.str, ls->counter) || !outer_name(ls, e->as.index.target, &list) ||
+        ls->c->locals[list].literal) return 0;
+    for (size_t i = 0; i < ls->found_len; i++) {
+        if (ls->found[i] == list) return 0;
+    }
+    if (ls->found_len == GUARD_MAX) return 1;
+    ls->found[ls->found_len++] = list;
+    return 0;
+}
+
+// n in `while i < n` can be evaluated once more up front, and means the
+// same on every iteration
+static int invariant_bound(const LoopScan *ls, const Expr *e) {
+    long local;
+    switch (e->kind) {
+        case EXPR_INT: return 1;
+        case EXPR_NAME: return outer_name(ls, e, &local);
+        case EXPR_UNARY: return e->as.unary.op == UOP_NEG && invariant_bound(ls, e->as.unary.rhs);
+        case EXPR_BINARY:
+            return e->as.binary.op >= BOP_ADD && e->as.binary.op <= BOP_DIV &&
+                   invariant_bound(ls, e->as.binary.lhs) && invariant_bound(ls, e->as.binary.rhs);
+        case EXPR_CALL: {
+            int bi = builtin_call(ls->c, e);
+            return bi >= 0 && strcmp(builtin_get(bi)->name, "len") == 0 && invariant_bound(ls, e->as.call.args[0]);
+        }
+        default: return 0;
+    }
+}
+
+// Which lists `counter` may index unchecked in loop s: those proven by
+// the condition go to b->lists, those needing a guard to guarded[].
+// Returns 0 if there are none.
+static int plan_bounds(Compiler *c, const Stmt *s, long counter, BoundsCtx *b, long *guarded, size_t *guarded_len) {
+    const Expr *cond = s->as.while_stmt.cond;
+    const Range *r = &c->locals[counter].range;
+    *guarded_len = 0;
+    if (cond->as.binary.op != BOP_LT || !r->known || r->lo < 0) return 0;
+
+    LoopScan ls = {0};
+    ls.c = c;
+    ls.body = s->as.while_stmt.body;
+    ls.body_len = s->as.while_stmt.body_len;
+    ls.counter = c->locals[counter].name;
+    if (stmts_declare(ls.body, ls.body_len, ls.counter)) return 0;
+    if (expr_walk(cond, resizes_lists, &ls) || stmts_walk(ls.body, ls.body_len, resizes_lists, &ls)) return 0;
+
+    // only accesses ahead of the increment count
+    size_t bump = 0;
+    while (bump < ls.body_len && !(ls.body[bump]->kind == STMT_EXPR && step_of(ls.body[bump]->as.expr_stmt.expr, ls.counter))) bump++;
+    if (bump == ls.body_len) return 0;
+    stmts_walk(ls.body, bump, indexed_by_counter, &ls);
+
+    const Expr *n = cond->as.binary.rhs;
+    long len_of = -1;
+    if (builtin_call(c, n) >= 0 && strcmp(builtin_get(builtin_call(c, n))->name, "len") == 0) {
+        outer_name(&ls, n->as.call.args[0], &len_of);
+    }
+    int guards_ok = invariant_bound(&ls, n);
+
+    b->counter = counter;
+    b->lists_len = 0;
+    b->bump = ls.body[bump];
+    for (size_t i = 0; i < ls.found_len; i++) {
+        if (ls.found[i] == len_of) b->lists[b->lists_len++] = ls.found[i];
+        else if (guards_ok) guarded[(*guarded_len)++] = ls.found[i];
+    }
+    return b->lists_len || *guarded_len;
+}
+
+// ----- vector loops -----
+// `while i < n { dst[i] = x[i] op y[i]; i = i + 1; }` with op one of
+// + - *, and x or y possibly a constant instead. OP_VEC_ARITH runs as
+// much of it as it can in vector code and leaves i where it stopped;
+// the scalar loop after it does the rest, including any error.
+
+typedef struct {
+    long dst, x, y;   // locals; x/y -1 for the constant side
+    const Expr *k;    // the constant side, or NULL
+    const Expr *op;   // the BINARY
+} VecPlan;
+
+// the list local if e is list[counter] (read, or written with kind
+// EXPR_SET_INDEX), else -1
+static long vec_operand(const LoopScan *ls, const Expr *e, ExprKind kind) {
+    long list;
+    if (e->kind != kind || e->as.index.index->kind != EXPR_NAME ||
+        !sv_eq(e->as.index.index->as.str, ls->counter) || !outer_name(ls, e->as.index.target, &list) ||
+        ls->c->locals[list].literal) return -1;
+    return list;
+}
+
+static int plan_vector(Compiler *c, const Stmt *s, long counter, VecPlan *v) {
+    const Expr *cond = s->as.while_stmt.cond;
+    Stmt **body = s->as.while_stmt.body;
+    if ((c->opts && c->opts->no_vectorize) || cond->as.binary.op != BOP_LT || s->as.while_stmt.body_len != 2 ||
+        body[0]->kind != STMT_EXPR || body[1]->kind != STMT_EXPR) return 0;
+
+    LoopScan ls = {0};
+    ls.c = c;
+    ls.body = body;
+    ls.body_len = 2;
+    ls.counter = c->locals[counter].name;
+    const Expr *store = body[0]->as.expr_stmt.expr;
+    if (step_of(body[1]->as.expr_stmt.expr, ls.counter) != 1 || store->kind != EXPR_SET_INDEX ||
+        !invariant_bound(&ls, cond->as.binary.rhs)) return 0;
+
+
+    const Expr *val = store->as.index.value;
+    if (val->kind != EXPR_BINARY || val->as.binary.op > BOP_MUL) return 0;
+    v->dst = vec_operand(&ls, store, EXPR_SET_INDEX);
+    v->x = vec_operand(&ls, val->as.binary.lhs, EXPR_INDEX);
+    v->y = vec_operand(&ls, val->as.binary.rhs, EXPR_INDEX);
+    v->k = NULL;
+    v->op = val;
+    if (v->dst < 0 || (v->x < 0 && v->y < 0)) return 0;
+
+    // the other side has to mean the same on every iteration
+    const Expr *k = v->x < 0 ? val->as.binary.lhs : v->y < 0 ? val->as.binary.rhs : NULL;
+    long local;
+    if (k && k->kind != EXPR_INT && !outer_name(&ls, k, &local)) return 0;
+    v->k = k;
+    return 1;
+}
+
+static void compile_expr(Compiler *c, const Expr *e);
+static void compile_stmt(Compiler *c, const Stmt *s);
+static void compile_block(Compiler *c, Stmt **stmts, size_t len);
+
+// Leaves the inlined body: the result on top of the stack moves down to
+// slot_base and the callee's locals are dropped, then jump past the body.
+static void emit_inline_return(Compiler *c, Span sp, int jump) {
+    InlineCtx *inl = c->inl;
+    size_t extra = c->depth - inl->slot_base - 1;
+    if (extra) {
+        emit(c, OP_STORE, sp);
+        emit_u16(c, inl->slot_base, sp);
+        emit(c, OP_POPN, sp);
+        emit_u16(c, extra, sp);
+    }
+    pop(c, 1);
+    if (!jump) return;
+
+    if (inl->exits_len == inl->exits_cap &&
+        !grow((void **)&inl->exits, &inl->exits_cap, inl->exits_len + 1, sizeof(size_t))) {
+        c->failed = 1;
+        return;
+    }
+    inl->exits[inl->exits_len++] = emit_jump(c, OP_JUMP, sp);
+}
+
+// ----- compile-time evaluation -----
+
+// FoldName over the locals: inlined params bound to a literal, and lets
+// whose initializer was folded
+static int fold_name(void *ctx, StrView name, Value *out) {
+    Compiler *c = (Compiler *)ctx;
+    long local = resolve_local(c, name);
+    if (local < 0) return 0;
+    const Local *l = &c->locals[local];
+    if (l->constant) *out = l->value;
+    else if (l->literal && l->literal->kind == EXPR_INT) *out = value_int(l->literal->as.int_val);
+    else if (l->literal && l->literal->kind == EXPR_BOOL) *out = value_bool(l->literal->as.bool_val);
+    else return 0;
+    return 1;
+}
+
+// Emits e as a literal if it is a constant expression (see fold.h);
+// returns 0 with nothing emitted otherwise
+static int compile_folded(Compiler *c, const Expr *e) {
+    Value v;
+    size_t calls = c->fold.calls;
+    if (!c->fold.cg || (c->opts->fold_in_loops && !c->loops) || !fold_expr(&c->fold, e, &v)) return 0;
+    c->chunk->folded += (uint32_t)(c->fold.calls - calls);
+    if (v.kind == VAL_INT) {
+        emit_int(c, v.as.i, e->span);
+    } else {
+        emit(c, v.as.b ? OP_TRUE : OP_FALSE, e->span);
+        push(c, 1);
+    }
+    c->folded = e;
+    c->folded_value = v;
+    return 1;
+}
+
+// Compiles the call to fns[fn] by splicing the callee's body in place:
+// the arguments become the callee's first locals, exactly as in a real
+// frame, but without the call/return overhead. Only small, non-recursive
+// callees qualify. Returns 0 (with nothing emitted) if we should make a
+// real call instead.
+static int try_inline(Compiler *c, const Expr *e, size_t fn) {
+    const BcOptions *o = c->opts;
+    if (!o || !o->cg || fn == c->fn_index || c->prog->fns[fn]->external) return 0;
+    const CallGraphNode *node = &o->cg->nodes[fn];
+    int fits = node->size <= o->inline_budget && c->inline_depth < o->inline_depth;
+    PgoHeat heat = o->pgo ? pgo_call_heat(o->pgo, e) : PGO_UNKNOWN;
+    if (heat == PGO_COLD) {
+        if (!node->recursive && fits) c->chunk->pgo_cold++;
+        return 0;
+    }
+    // a hot call may take a bigger callee, one level deeper
+    size_t budget = heat == PGO_HOT ? o->inline_budget * PGO_HOT_BUDGET : o->inline_budget;
+    size_t depth = heat == PGO_HOT ? o->inline_depth + 1 : o->inline_depth;
+    if (node->recursive || node->size > budget || c->inline_depth >= depth) return 0;
+
+    // snapshot, so a callee we cannot compile falls back to a real call
+    Chunk *ch = c->chunk;
+    size_t saved_len = ch->len;
+    size_t saved_ints = ch->ints_len;
+    size_t saved_strs = ch->strs_len;
+    uint32_t saved_inlined = ch->inlined;
+    uint32_t saved_tails = ch->tail_calls;
+    uint32_t saved_region = ch->region_lists;
+    uint32_t saved_arith = ch->arith_ops;
+    uint32_t saved_proven = ch->arith_proven;
+    uint32_t saved_index = ch->index_ops;
+    uint32_t saved_unchecked = ch->index_proven;
+    uint32_t saved_guards = ch->loop_guards;
+    uint32_t saved_vector = ch->vector_loops;
+    uint32_t saved_pgo_inlined = ch->pgo_inlined;
+    uint32_t saved_pgo_cold = ch->pgo_cold;
+    uint32_t saved_flipped = ch->pgo_flipped;
+    uint32_t saved_folded = ch->folded;
+    size_t saved_depth = c->depth;
+    size_t saved_locals = c->locals_len;
+    size_t saved_floor = c->scope_floor;
+    InlineCtx *outer = c->inl;
+
+    const FnDecl *callee = c->prog->fns[fn];
+    const FnDecl *outer_body = c->body;
+    InlineCtx ctx = {0};
+    ctx.slot_base = c->depth;
+
+    // Arguments that are literals or plain caller locals are bound to the
+    // param directly instead of being copied into a fresh slot, as long as
+    // neither side can change while the body runs.
+    size_t argc = e->as.call.args_len;
+    int args_assign = 0;
+    for (size_t i = 0; i < argc; i++) args_assign |= expr_assigns(e->as.call.args[i], NULL);
+
+    long alias[256];
+    for (size_t i = 0; i < argc; i++) {
+        const Expr *a = e->as.call.args[i];
+        alias[i] = -1;
+        if (args_assign || stmts_assign(callee->body, callee->body_len, &callee->params[i].name)) {
+            compile_expr(c, a);
+            continue;
+        }
+        if (a->kind == EXPR_NAME) alias[i] = resolve_local(c, a->as.str);
+        else if (a->kind == EXPR_INT || a->kind == EXPR_BOOL || a->kind == EXPR_STRING) alias[i] = -2;
+        if (alias[i] == -1) compile_expr(c, a);
+    }
+
+    c->scope_floor = c->locals_len;
+    size_t next_slot = ctx.slot_base;
+    for (size_t i = 0; i < argc; i++) {
+        if (alias[i] >= 0) {
+            const Local *src = &c->locals[alias[i]];
+            declare_local(c, callee->params[i].name, 0, src->slot);
+            c->locals[c->locals_len - 1].literal = src->literal;
+            c->locals[c->locals_len - 1].range = src->range;
+            c->locals[c->locals_len - 1].constant = src->constant;
+            c->locals[c->locals_len - 1].value = src->value;
+        } else if (alias[i] == -2) {
+            declare_local(c, callee->params[i].name, 0, 0);
+            c->locals[c->locals_len - 1].literal = e->as.call.args[i];
+        } else {
+            declare_local(c, callee->params[i].name, 1, next_slot++);
+        }
+    }
+    c->inl = &ctx;
+    c->body = callee;
+    c->inline_depth++;
+
+    for (size_t i = 0; i < callee->body_len && !c->failed; i++) compile_stmt(c, callee->body[i]);
+
+    if (callee->body_len && callee->body[callee->body_len - 1]->kind == STMT_RETURN) {
+        // no fallthrough; and the final return needs no jump to the very next byte
+        if (ctx.exits_len && ctx.exits[ctx.exits_len - 1] + 2 == ch->len) {
+            truncate_code(ch, ch->len - 3);
+            ctx.exits_len--;
+        }
+    } else {
+        emit_int(c, 0, callee->span);
+        emit_inline_return(c, callee->span, 0);
+    }
+    for (size_t i = 0; i < ctx.exits_len; i++) patch_jump(c, ctx.exits[i]);
+    free(ctx.exits);
+
+    c->inl = outer;
+    c->body = outer_body;
+    c->inline_depth--;
+    c->scope_floor = saved_floor;
+    c->locals_len = saved_locals;
+
+    if (c->failed) {
+        truncate_code(ch, saved_len);
+        ch->ints_len = saved_ints;
+        ch->strs_len = saved_strs;
+        ch->inlined = saved_inlined;
+        ch->tail_calls = saved_tails;
+        ch->region_lists = saved_region;
+        ch->arith_ops = saved_arith;
+        ch->arith_proven = saved_proven;
+        ch->index_ops = saved_index;
+        ch->index_proven = saved_unchecked;
+        ch->loop_guards = saved_guards;
+        ch->vector_loops = saved_vector;
+        ch->pgo_inlined = saved_pgo_inlined;
+        ch->pgo_cold = saved_pgo_cold;
+        ch->pgo_flipped = saved_flipped;
+        ch->folded = saved_folded;
+        c->depth = saved_depth;
+        c->failed = 0;
+        return 0;
+    }
+
+    c->depth = ctx.slot_base;
+    push(c, 1);
+    ch->inlined++;
+    if (!fits) ch->pgo_inlined++;
+    return 1;
+}
+
+// tail: the call is the value of a `return` in the function's own body.
+// returns 1 if a tail call was emitted (the caller then emits no RETURN).
+static int compile_call(Compiler *c, const Expr *e, int tail) {
+    if (compile_folded(c, e)) return 0;
+    const Expr *callee = e->as.call.callee;
+    size_t argc = e->as.call.args_len;
+    if (!callee || callee->kind != EXPR_NAME || argc > UINT8_MAX) {
+        c->failed = 1;
+        return 0;
+    }
+
+    long fn = ast_find_fn(c->prog, callee->as.str);
+    int bi = fn < 0 ? builtin_find(callee->as.str) : -1;
+    if (fn >= 0) {
+        if (c->prog->fns[fn]->params_len != argc) {
+            c->failed = 1;
+            return 0;
+        }
+        if (!e->as.call.spawn && !e->as.call.go && try_inline(c, e, (size_t)fn)) return 0;
+        emit_count(c, OP_COUNT, e, e->span);
+    } else if (bi >= 0 && !e->as.call.spawn && !e->as.call.go) {
+        if (builtin_get(bi)->arity != argc) {
+            c->failed = 1;
+            return 0;
+        }
+    } else {
+        c->failed = 1;
+        return 0;
+    }
+
+    for (size_t i = 0; i < argc; i++) {
+        const Expr *a = e->as.call.args[i];
+        if (bi >= 0 && builtin_get(bi)->fn_arg == (int)i + 1 && a->kind == EXPR_NAME &&
+            resolve_local(c, a->as.str) < 0 && ast_find_fn(c->prog, a->as.str) >= 0) {
+            // a function named as an argument is passed as its name
+            emit(c, OP_STR, a->span);
+            emit_u16(c, add_str(c, a->as.str), a->span);
+            push(c, 1);
+            continue;
+        }
+        compile_expr(c, a);
+    }
+
+    if (fn >= 0 && (e->as.call.spawn || e->as.call.go)) {
+        emit(c, e->as.call.go ? OP_GO : OP_SPAWN, e->span);
+        emit_u16(c, (size_t)fn, e->span);
+        tail = 0;
+    } else if (fn >= 0) {
+        emit(c, tail ? OP_TAILCALL : OP_CALL, e->span);
+        emit_u16(c, (size_t)fn, e->span);
+        if (tail) c->chunk->tail_calls++;
+    } else {
+        emit(c, OP_BUILTIN, e->span);
+        emit(c, (uint8_t)bi, e->span);
+    }
+    emit(c, (uint8_t)argc, e->span);
+    pop(c, argc);
+    push(c, 1);
+    return fn >= 0 && tail;
+}
+
+// local: the list goes into the next region slot of the frame
+static void compile_list(Compiler *c, const Expr *e, int local) {
+    size_t n = e->as.list.items_len;
+    for (size_t i = 0; i < n; i++) compile_expr(c, e->as.list.items[i]);
+    emit(c, local ? OP_LIST_LOCAL : OP_LIST, e->span);
+    emit_u16(c, n, e->span);
+    emit(c, (uint8_t)value_list_elem_for_type(e->as.list.type_name), e->span);
+    if (local) emit_u16(c, c->chunk->region_lists++, e->span);
+    pop(c, n);
+    push(c, 1);
+}
+
+// xs[i] / xs[i] = v where an enclosing loop proved i in range for xs
+static int compile_in_bounds(Compiler *c, const Expr *e) {
+    const Expr *t = e->as.index.target;
+    const Expr *idx = e->as.index.index;
+    if (!c->bounds || t->kind != EXPR_NAME || idx->kind != EXPR_NAME) return 0;
+    long list = resolve_local(c, t->as.str);
+    long counter = resolve_local(c, idx->as.str);
+    if (list < 0 || counter < 0) return 0;
+
+    for (const BoundsCtx *b = c->bounds; b; b = b->outer) {
+        if (!b->active || b->counter != counter) continue;
+        for (size_t i = 0; i < b->lists_len; i++) {
+            if (b->lists[i] != list) continue;
+            if (e->kind == EXPR_SET_INDEX) compile_expr(c, e->as.index.value);
+            else push(c, 1);
+            emit(c, e->kind == EXPR_SET_INDEX ? OP_STORE_ELEM : OP_LOAD_ELEM, e->span);
+            emit_u16(c, c->locals[list].slot, e->span);
+            emit_u16(c, c->locals[counter].slot, e->span);
+            c->chunk->index_proven++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void compile_expr(Compiler *c, const Expr *e) {
+    if (c->failed) return;
+    if (!e) {
+        c->failed = 1;
+        return;
+    }
+
+    switch (e->kind) {
+        case EXPR_INT:
+            emit_int(c, e->as.int_val, e->span);
+            return;
+
+        case EXPR_STRING:
+            emit(c, OP_STR, e->span);
+            emit_u16(c, add_str(c, e->as.str), e->span);
+            push(c, 1);
+            return;
+
+        case EXPR_BOOL:
+            emit(c, e->as.bool_val ? OP_TRUE : OP_FALSE, e->span);
+            push(c, 1);
+            return;
+
+        case EXPR_NAME: {
+            long local = resolve_local(c, e->as.str);
+            if (local < 0) {
+                c->failed = 1;
+                return;
+            }
+            if (c->locals[local].literal) {
+                compile_expr(c, c->locals[local].literal);
+                return;
+            }
+            emit(c, OP_LOAD, e->span);
+            emit_u16(c, c->locals[local].slot, e->span);
+            push(c, 1);
+            return;
+        }
+
+        case EXPR_UNARY:
+            if (compile_folded(c, e)) return;
+            compile_expr(c, e->as.unary.rhs);
+            emit(c, e->as.unary.op == UOP_NEG ? OP_NEG : OP_NOT, e->span);
+            return;
+
+        case EXPR_BINARY: {
+            if (compile_folded(c, e)) return;
+            compile_expr(c, e->as.binary.lhs);
+            compile_expr(c, e->as.binary.rhs);
+            BinaryOp bop = e->as.binary.op;
+            if (bop == BOP_ADD || bop == BOP_SUB || bop == BOP_MUL) {
+                c->chunk->arith_ops++;
+                int safe = 0;
+                const Expr *lhs = e->as.binary.lhs;
+                long counter = lhs->kind == EXPR_NAME ? resolve_local(c, lhs->as.str) : -1;
+                if (counter >= 0 && c->locals[counter].step == e) {
+                    safe = 1; // loop_counter checked that this one lands inside the range
+                } else {
+                    Range l = expr_range(c, lhs, 1);
+                    Range r = expr_range(c, e->as.binary.rhs, 1);
+                    if (l.known && r.known) range_arith(bop, l, r, &safe);
+                }
+                if (safe) {
+                    c->chunk->arith_proven++;
+                    emit(c, bop == BOP_ADD ? OP_IADD : bop == BOP_SUB ? OP_ISUB : OP_IMUL, e->span);
+                    pop(c, 1);
+                    return;
+                }
+            }
+            OpCode op = OP_ADD;
+            switch (e->as.binary.op) {
+                case BOP_ADD: op = OP_ADD; break;
+                case BOP_SUB: op = OP_SUB; break;
+                case BOP_MUL: op = OP_MUL; break;
+                case BOP_DIV: op = OP_DIV; break;
+                case BOP_EQ:  op = OP_EQ;  break;
+                case BOP_NE:  op = OP_NE;  break;
+                case BOP_LT:  op = OP_LT;  break;
+                case BOP_LTE: op = OP_LTE; break;
+                case BOP_GT:  op = OP_GT;  break;
+                case BOP_GTE: op = OP_GTE; break;
+            }
+            emit(c, (uint8_t)op, e->span);
+            pop(c, 1);
+            return;
+        }
+
+        case EXPR_ASSIGN: {
+            long local = resolve_local(c, e->as.assign.name);
+            if (local < 0 || !c->locals[local].is_mut) {
+                c->failed = 1;
+                return;
+            }
+            compile_expr(c, e->as.assign.value);
+            emit(c, OP_STORE, e->span);
+            emit_u16(c, c->locals[local].slot, e->span);
+            return;
+        }
+
+        case EXPR_CALL:
+            compile_call(c, e, 0);
+            return;
+
+        case EXPR_LIST:
+            compile_list(c, e, 0);
+            return;
+
+        case EXPR_MAP: {
+            size_t n = e->as.map.len;
+            for (size_t i = 0; i < n; i++) {
+                compile_expr(c, e->as.map.keys[i]);
+                compile_expr(c, e->as.map.values[i]);
+            }
+            emit(c, OP_MAP, e->span);
+            emit_u16(c, n, e->span);
+            emit(c, (uint8_t)value_map_key_for_type(e->as.map.type_name), e->span);
+            pop(c, 2 * n);
+            push(c, 1);
+            return;
+        }
+
+        case EXPR_INDEX:
+            c->chunk->index_ops++;
+            if (compile_in_bounds(c, e)) return;
+            compile_expr(c, e->as.index.target);
+            compile_expr(c, e->as.index.index);
+            emit(c, OP_INDEX, e->span);
+            pop(c, 1);
+            return;
+
+        case EXPR_SET_INDEX:
+            c->chunk->index_ops++;
+            if (compile_in_bounds(c, e)) return;
+            compile_expr(c, e->as.index.target);
+            compile_expr(c, e->as.index.index);
+            compile_expr(c, e->as.index.value);
+            emit(c, OP_SET_INDEX, e->span);
+            pop(c, 2);
+            return;
+    }
+    c->failed = 1;
+}
+
+// ----- statements -----
+
+// the loop itself: condition, body and back-edge. counter/inside/step
+// come from loop_counter, b (may be NULL) from plan_bounds.
+static void compile_loop(Compiler *c, const Stmt *s, long counter, Range inside, const Expr *step, BoundsCtx *b) {
+    Chunk *ch = c->chunk;
+    size_t header = ch->len;
+    c->loops++;
+    compile_expr(c, s->as.while_stmt.cond);
+    emit_count(c, OP_COUNT_BRANCH, s, s->span);
+    size_t to_exit = emit_jump(c, OP_JUMP_IF_FALSE, s->span);
+    pop(c, 1);
+
+    Local saved;
+    if (counter >= 0) {
+        saved = c->locals[counter];
+        c->locals[counter].range = inside;
+        c->locals[counter].step = step;
+    }
+    if (b) {
+        b->active = 1;
+        b->outer = c->bounds;
+        c->bounds = b;
+    }
+    compile_block(c, s->as.while_stmt.body, s->as.while_stmt.body_len);
+    c->loops--;
+    if (b) c->bounds = b->outer;
+    if (counter >= 0) c->locals[counter] = saved;
+    emit(c, OP_LOOP, s->span);
+    emit_u16(c, ch->len + 2 - header, s->span);
+    patch_jump(c, to_exit);
+}
+
+static void compile_stmt(Compiler *c, const Stmt *s) {
+    if (c->failed) return;
+
+    switch (s->kind) {
+        case STMT_LET: {
+            const Expr *init = s->as.let_stmt.init;
+            c->folded = NULL;
+            if (list_stays_local(c, s)) compile_list(c, init, 1);
+            else compile_expr(c, init);
+            // the initializer's stack slot becomes the local
+            declare_local(c, s->as.let_stmt.name, s->as.let_stmt.is_mut, c->depth - 1);
+            if (c->failed) return;
+            Local *l = &c->locals[c->locals_len - 1];
+            l->range = let_range(c, s);
+            // an immutable local set to a constant is one for the folding too
+            if (s->as.let_stmt.is_mut) return;
+            if (c->folded == init) {
+                l->constant = 1;
+                l->value = c->folded_value;
+            } else if (init->kind == EXPR_INT || init->kind == EXPR_BOOL) {
+                l->constant = 1;
+                l->value = init->kind == EXPR_INT ? value_int(init->as.int_val) : value_bool(init->as.bool_val);
+            }
+            return;
+        }
+
+        case STMT_RETURN: {
+            const Expr *v = s->as.ret_stmt.value;
+            if (c->inl) {
+                if (v) compile_expr(c, v);
+                else emit_int(c, 0, s->span);
+                emit_inline_return(c, s->span, 1);
+                return;
+            }
+            if (v && v->kind == EXPR_CALL) {
+                // `return f(x);` jumps into f, reusing this frame
+                if (compile_call(c, v, 1)) {
+                    pop(c, 1);
+                    return;
+                }
+            } else if (v) {
+                compile_expr(c, v);
+            } else {
+                emit_int(c, 0, s->span);
+            }
+            emit(c, OP_RETURN, s->span);
+            pop(c, 1);
+            return;
+        }
+
+        case STMT_EXPR:
+            for (BoundsCtx *b = c->bounds; b; b = b->outer) {
+                if (b->bump == s) b->active = 0;
+            }
+            compile_expr(c, s->as.expr_stmt.expr);
+            emit(c, OP_POP, s->span);
+            pop(c, 1);
+            return;
+
+        case STMT_IF: {
+            // the branch that ran more often in the profile falls through
+            Stmt **first = s->as.if_stmt.then_body, **second = s->as.if_stmt.else_body;
+            size_t first_len = s->as.if_stmt.then_len, second_len = s->as.if_stmt.else_len;
+            int flip = second && c->opts && c->opts->pgo && !c->opts->pgo_gen && pgo_else_first(c->opts->pgo, s);
+            if (flip) {
+                first = s->as.if_stmt.else_body;
+                first_len = s->as.if_stmt.else_len;
+                second = s->as.if_stmt.then_body;
+                second_len = s->as.if_stmt.then_len;
+                c->chunk->pgo_flipped++;
+            }
+            compile_expr(c, s->as.if_stmt.cond);
+            emit_count(c, OP_COUNT_BRANCH, s, s->span);
+            size_t to_second = emit_jump(c, flip ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, s->span);
+            pop(c, 1);
+            compile_block(c, first, first_len);
+            if (second) {
+                size_t to_end = emit_jump(c, OP_JUMP, s->span);
+                patch_jump(c, to_second);
+                compile_block(c, second, second_len);
+                patch_jump(c, to_end);
+            } else {
+                patch_jump(c, to_second);
+            }
+            return;
+        }
+
+        case STMT_WHILE: {
+            Chunk *ch = c->chunk;
+            size_t header = ch->len;
+            // inlined loops are not OSR targets: the tree-walker only ever
+            // enters a function's own chunk. OSR into a guarded loop
+            // starts at its guards.
+            if (!c->inl && !c->guarded_copy) {
+                if (!grow((void **)&ch->loops, &ch->loops_cap, ch->loops_len + 1, sizeof(LoopEntry))) {
+                    c->failed = 1;
+                    return;
+                }
+                ch->loops[ch->loops_len].stmt = s;
+                ch->loops[ch->loops_len].offset = (uint32_t)header;
+                ch->loops[ch->loops_len].live_locals = (uint32_t)c->locals_len;
+                ch->loops_len++;
+            }
+
+            Range inside;
+            const Expr *step = NULL;
+            long counter = loop_counter(c, s, &inside, &step);
+            VecPlan v;
+            if (counter >= 0 && plan_vector(c, s, counter, &v)) {
+                compile_expr(c, s->as.while_stmt.cond->as.binary.rhs);
+                if (v.k) compile_expr(c, v.k);
+                emit(c, OP_VEC_ARITH, s->span);
+                emit(c, (uint8_t)v.op->as.binary.op, s->span);
+                emit(c, (uint8_t)((v.x >= 0 ? VEC_X_LIST : 0) | (v.y >= 0 ? VEC_Y_LIST : 0)), s->span);
+                emit_u16(c, c->locals[v.dst].slot, s->span);
+                emit_u16(c, v.x >= 0 ? c->locals[v.x].slot : 0, s->span);
+                emit_u16(c, v.y >= 0 ? c->locals[v.y].slot : 0, s->span);
+                emit_u16(c, c->locals[counter].slot, s->span);
+                pop(c, v.k ? 2 : 1);
+                ch->vector_loops++;
+            }
+            BoundsCtx b;
+            long guarded[GUARD_MAX];
+            size_t guarded_len = 0;
+            int bounded = counter >= 0 && plan_bounds(c, s, counter, &b, guarded, &guarded_len);
+            if (guarded_len && ast_stmts_size(s->as.while_stmt.body, s->as.while_stmt.body_len) > VERSION_MAX) {
+                guarded_len = 0;
+                bounded = b.lists_len > 0;
+            }
+            if (!guarded_len) {
+                compile_loop(c, s, counter, inside, step, bounded ? &b : NULL);
+                return;
+            }
+
+            size_t to_checked[GUARD_MAX];
+            const Expr *n = s->as.while_stmt.cond->as.binary.rhs;
+            for (size_t i = 0; i < guarded_len; i++) {
+                compile_expr(c, n);
+                emit(c, OP_GUARD_LEN, s->span);
+                emit_u16(c, c->locals[guarded[i]].slot, s->span);
+                to_checked[i] = emit_jump(c, OP_JUMP_IF_FALSE, s->span);
+                pop(c, 1);
+                ch->loop_guards++;
+            }
+            size_t proven = b.lists_len;
+            for (size_t i = 0; i < guarded_len; i++) b.lists[b.lists_len++] = guarded[i];
+            c->guarded_copy++;
+            compile_loop(c, s, counter, inside, step, &b);
+            c->guarded_copy--;
+            size_t to_end = emit_jump(c, OP_JUMP, s->span);
+
+            // the copy with checks counts for nothing in --opt-report
+            for (size_t i = 0; i < guarded_len; i++) patch_jump(c, to_checked[i]);
+            uint32_t inlined = ch->inlined, tails = ch->tail_calls, arith = ch->arith_ops, arith_proven = ch->arith_proven;
+            uint32_t index = ch->index_ops, index_proven = ch->index_proven, guards = ch->loop_guards;
+            uint32_t vector = ch->vector_loops, pgo_inlined = ch->pgo_inlined, pgo_cold = ch->pgo_cold;
+            uint32_t flipped = ch->pgo_flipped, folded = ch->folded;
+            b.lists_len = proven;
+            compile_loop(c, s, counter, inside, step, proven ? &b : NULL);
+            ch->inlined = inlined;
+            ch->tail_calls = tails;
+            ch->arith_ops = arith;
+            ch->arith_proven = arith_proven;
+            ch->index_ops = index;
+            ch->index_proven = index_proven;
+            ch->loop_guards = guards;
+            ch->vector_loops = vector;
+            ch->pgo_inlined = pgo_inlined;
+            ch->pgo_cold = pgo_cold;
+            ch->pgo_flipped = flipped;
+            ch->folded = folded;
+            patch_jump(c, to_end);
+            return;
+        }
+    }
+    c->failed = 1;
+}
+
+static void compile_block(Compiler *c, Stmt **stmts, size_t len) {
+    size_t saved = c->locals_len;
+    for (size_t i = 0; i < len && !c->failed; i++) compile_stmt(c, stmts[i]);
+
+    size_t n = c->locals_len - saved;
+    if (n) {
+        Span sp = len ? stmts[len - 1]->span : c->fn->span;
+        emit(c, OP_POPN, sp);
+        emit_u16(c, n, sp);
+        pop(c, n);
+    }
+    c->locals_len = saved;
+}
+
+Chunk *bc_compile(const Program *prog, size_t fn_index, const BcOptions *opts) {
+    const FnDecl *fn = prog->fns[fn_index];
+
+    Chunk *chunk = (Chunk *)calloc(1, sizeof(Chunk));
+    if (!chunk) return NULL;
+
+    Compiler *c = (Compiler *)calloc(1, sizeof(Compiler));
+    if (!c) {
+        free(chunk);
+        return NULL;
+    }
+    c->prog = prog;
+    c->opts = opts;
+    c->fn_index = fn_index;
+    c->fn = fn;
+    c->body = fn;
+    c->chunk = chunk;
+    if (opts && opts->fold) {
+        c->fold.prog = prog;
+        c->fold.cg = opts->fold;
+        c->fold.wrap_ints = opts->wrap_ints;
+        c->fold.name = fold_name;
+        c->fold.ctx = c;
+        c->fold.steps = FOLD_BUDGET;
+    }
+
+    // params occupy the first slots; they are assignable like `let mut`
+    for (size_t i = 0; i < fn->params_len; i++) {
+        declare_local(c, fn->params[i].name, 1, i);
+        push(c, 1);
+    }
+
+    for (size_t i = 0; i < fn->body_len && !c->failed; i++) compile_stmt(c, fn->body[i]);
+
+    // falling off the end behaves like `return;`
+    emit_int(c, 0, fn->span);
+    emit(c, OP_RETURN, fn->span);
+
+    int failed = c->failed;
+    free(c);
+    if (failed) {
+        chunk_free(chunk);
+        return NULL;
+    }
+    return chunk;
+}
+
+void chunk_free(Chunk *c) {
+    if (!c) return;
+    if (c->mapped) {
+        free(c->strs);
+        free(c);
+        return;
+    }
+    free(c->code);
+    free(c->pos);
+    free(c->ints);
+    free(c->strs);
+    free(c->loops);
+    free(c);
+}
+
+const LoopEntry *chunk_find_loop(const Chunk *c, const Stmt *stmt) {
+    for (size_t i = 0; i < c->loops_len; i++) {
+        if (c->loops[i].stmt == stmt) return &c->loops[i];
+    }
+    return NULL;
+}
+
+SrcPos chunk_pos_at(const Chunk *c, size_t off) {
+    SrcPos none = {0, 0, 0};
+    if (!c->pos_len || c->pos[0].offset > off) return none;
+
+    // last entry with offset <= off
+    size_t lo = 0, hi = c->pos_len;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (c->pos[mid].offset <= off) lo = mid;
+        else hi = mid;
+    }
+    return c->pos[lo];
+}
+
+// ----- disassembler -----
+
+static size_t read_u16(const uint8_t *p) {
+    return (size_t)p[0] | ((size_t)p[1] << 8);
+}
+
+static const char *op_name(OpCode op) {
+    switch (op) {
+        case OP_INT: return "INT";
+        case OP_STR: return "STR";
+        case OP_TRUE: return "TRUE";
+        case OP_FALSE: return "FALSE";
+        case OP_LOAD: return "LOAD";
+        case OP_STORE: return "STORE";
+        case OP_POP: return "POP";
+        case OP_POPN: return "POPN";
+        case OP_NEG: return "NEG";
+        case OP_NOT: return "NOT";
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_EQ: return "EQ";
+        case OP_NE: return "NE";
+        case OP_LT: return "LT";
+        case OP_LTE: return "LTE";
+        case OP_GT: return "GT";
+        case OP_GTE: return "GTE";
+        case OP_JUMP: return "JUMP";
+        case OP_JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+        case OP_LOOP: return "LOOP";
+        case OP_CALL: return "CALL";
+        case OP_TAILCALL: return "TAILCALL";
+        case OP_BUILTIN: return "BUILTIN";
+        case OP_RETURN: return "RETURN";
+        case OP_LIST: return "LIST";
+        case OP_INDEX: return "INDEX";
+        case OP_SET_INDEX: return "SET_INDEX";
+        case OP_MAP: return "MAP";
+        case OP_LIST_LOCAL: return "LIST_LOCAL";
+        case OP_IADD: return "IADD";
+        case OP_ISUB: return "ISUB";
+        case OP_IMUL: return "IMUL";
+        case OP_LOAD_ELEM: return "LOAD_ELEM";
+        case OP_STORE_ELEM: return "STORE_ELEM";
+        case OP_GUARD_LEN: return "GUARD_LEN";
+        case OP_VEC_ARITH: return "VEC_ARITH";
+        case OP_SPAWN: return "SPAWN";
+        case OP_GO: return "GO";
+        case OP_JUMP_IF_TRUE: return "JUMP_IF_TRUE";
+        case OP_COUNT: return "COUNT";
+        case OP_COUNT_BRANCH: return "COUNT_BRANCH";
+        default: return "<?>";
+    }
+}
+
+void bc_disassemble(FILE *out, const Chunk *c, StrView name) {
+    fprintf(out, "== %.*s (max_stack=%u inlined=%u tail_calls=%u region_lists=%u) ==\n",
+            (int)name.len, name.ptr, c->max_stack, c->inlined, c->tail_calls, c->region_lists);
+    size_t i = 0;
+    while (i < c->len) {
+        OpCode op = (OpCode)c->code[i];
+        fprintf(out, "%5zu  %4u  %-14s", i, chunk_pos_at(c, i).line, op_name(op));
+        switch (op) {
+            case OP_INT:
+                fprintf(out, " %lld", (long long)c->ints[read_u16(&c->code[i + 1])]);
+                i += 3;
+                break;
+            case OP_STR: {
+                StrView s = c->strs[read_u16(&c->code[i + 1])];
+                fprintf(out, " \"%.*s\"", (int)s.len, s.ptr);
+                i += 3;
+                break;
+            }
+            case OP_LOAD: case OP_STORE: case OP_POPN: case OP_GUARD_LEN:
+                fprintf(out, " %zu", read_u16(&c->code[i + 1]));
+                i += 3;
+                break;
+            case OP_VEC_ARITH: {
+                static const char ops[] = "?+-*";
+                int form = c->code[i + 2];
+                fprintf(out, " %zu[i] = ", read_u16(&c->code[i + 3]));
+                if (form & VEC_X_LIST) fprintf(out, "%zu[i]", read_u16(&c->code[i + 5]));
+                else fprintf(out, "k");
+                fprintf(out, " %c ", ops[c->code[i + 1] & 3]);
+                if (form & VEC_Y_LIST) fprintf(out, "%zu[i]", read_u16(&c->code[i + 7]));
+                else fprintf(out, "k");
+                fprintf(out, " for i=%zu", read_u16(&c->code[i + 9]));
+                i += 11;
+                break;
+            }
+            case OP_LOAD_ELEM: case OP_STORE_ELEM:
+                fprintf(out, " %zu[%zu]", read_u16(&c->code[i + 1]), read_u16(&c->code[i + 3]));
+                i += 5;
+                break;
+            case OP_COUNT: case OP_COUNT_BRANCH:
+                fprintf(out, " site#%lld", (long long)c->ints[read_u16(&c->code[i + 1])]);
+                i += 3;
+                break;
+            case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_JUMP_IF_TRUE:
+                fprintf(out, " -> %zu", i + 3 + read_u16(&c->code[i + 1]));
+                i += 3;
+                break;
+            case OP_LOOP:
+                fprintf(out, " -> %zu", i + 3 - read_u16(&c->code[i + 1]));
+                i += 3;
+                break;
+            case OP_CALL: case OP_TAILCALL: case OP_SPAWN: case OP_GO:
+                fprintf(out, " fn#%zu argc=%u", read_u16(&c->code[i + 1]), c->code[i + 3]);
+                i += 4;
+                break;
+            case OP_BUILTIN:
+                fprintf(out, " %s argc=%u", builtin_get(c->code[i + 1])->name, c->code[i + 2]);
+                i += 3;
+                break;
+            case OP_LIST:
+                fprintf(out, " %zu", read_u16(&c->code[i + 1]));
+                if (c->code[i + 3]) fprintf(out, " list[%s]", value_kind_name((ValueKind)c->code[i + 3]));
+                i += 4;
+                break;
+            case OP_LIST_LOCAL:
+                fprintf(out, " %zu list[%s] region#%zu", read_u16(&c->code[i + 1]),
+                        value_kind_name((ValueKind)c->code[i + 3]), read_u16(&c->code[i + 4]));
+                i += 6;
+                break;
+            case OP_MAP:
+                fprintf(out, " %zu", read_u16(&c->code[i + 1]));
+                if (c->code[i + 3]) fprintf(out, " map[%s]", value_kind_name((ValueKind)c->code[i + 3]));
+                i += 4;
+                break;
+            default:
+                i += 1;
+                break;
+        }
+        fputc('\n', out);
+    }
+}
+
+// ----- linking -----
+
+static size_t insn_len(const uint8_t *ip) {
+    switch ((OpCode)*ip) {
+        case OP_INT: case OP_STR: case OP_LOAD: case OP_STORE: case OP_POPN: case OP_GUARD_LEN:
+        case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_LOOP: case OP_BUILTIN:
+        case OP_JUMP_IF_TRUE: case OP_COUNT: case OP_COUNT_BRANCH:
+            return 3;
+        case OP_CALL: case OP_TAILCALL: case OP_SPAWN: case OP_GO: case OP_LIST: case OP_MAP:
+            return 4;
+        case OP_LOAD_ELEM: case OP_STORE_ELEM:
+            return 5;
+        case OP_LIST_LOCAL:
+            return 6;
+        case OP_VEC_ARITH:
+            return 11;
+        default:
+            return 1;
+    }
+}
+
+int bc_relocate(Chunk *c, const uint32_t *map, size_t map_len) {
+    for (size_t i = 0; i < c->len; i += insn_len(&c->code[i])) {
+        OpCode op = (OpCode)c->code[i];
+        if (op != OP_CALL && op != OP_TAILCALL && op != OP_SPAWN && op != OP_GO) continue;
+        if (i + 3 >= c->len || read_u16(&c->code[i + 1]) >= map_len) return 0;
+        uint32_t fn = map[read_u16(&c->code[i + 1])];
+        if (fn > UINT16_MAX) return 0;
+        c->code[i + 1] = (uint8_t)(fn & 0xff);
+        c->code[i + 2] = (uint8_t)(fn >> 8);
+    }
+    return 1;
+}
@@ -0,0 +1,165 @@
+#ifndef LUNAR_BYTECODE_H
+#define LUNAR_BYTECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+#include "callgraph.h"
+#include "pgo.h"
+
+// Tier 1: a compact stack bytecode per function.
+// Locals live in stack slots in declaration order (same layout the
+// tree-walker uses), temporaries are pushed above them.
+// Operands are little-endian; u16 unless noted.
+
+typedef enum {
+    OP_INT,           // u16 index into ints
+    OP_STR,           // u16 index into strs
+    OP_TRUE,
+    OP_FALSE,
+    OP_LOAD,          // u16 slot
+    OP_STORE,         // u16 slot (assigned value stays on the stack)
+    OP_POP,
+    OP_POPN,          // u16 count
+
+    OP_NEG,
+    OP_NOT,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+    OP_EQ, OP_NE,
+    OP_LT, OP_LTE,
+    OP_GT, OP_GTE,
+
+    OP_JUMP,          // u16 forward offset
+    OP_JUMP_IF_FALSE, // u16 forward offset, pops the condition
+    OP_LOOP,          // u16 backward offset
+
+    OP_CALL,          // u16 fn index, u8 argc
+    OP_TAILCALL,      // u16 fn index, u8 argc: `return f(...)`, reuses the frame
+    OP_BUILTIN,       // u8 builtin id, u8 argc
+    OP_RETURN,
+
+    OP_LIST,          // u16 item count, u8 element kind (0: from the first item)
+    OP_INDEX,         // list/map, index -> element
+    OP_SET_INDEX,     // list/map, index, value -> value
+    OP_MAP,           // u16 pair count, u8 key kind (0: from the first key); pairs are key, value
+    OP_LIST_LOCAL,    // like OP_LIST (kind always set), then u16 index into the frame's region
+    OP_IADD, OP_ISUB, OP_IMUL, // ints the range analysis proved cannot overflow: no checks at all
+    OP_LOAD_ELEM,     // u16 list slot, u16 index slot; the index is known to be in range if it is a list
+    OP_STORE_ELEM,    // same, storing the value on top (which stays there)
+    OP_GUARD_LEN,     // u16 list slot; pops n, pushes whether the slot holds a list with n <= len
+    OP_VEC_ARITH,     // u8 BinaryOp, u8 VEC_* form, u16 slots dst/x/y/counter; pops n (and k). see vm.c
+    OP_SPAWN,         // u16 fn index, u8 argc: like OP_CALL, but pushes a task handle (see task.h)
+    OP_GO,            // u16 fn index, u8 argc: like OP_CALL, but pushes a coroutine handle (see coro.h)
+    OP_JUMP_IF_TRUE,  // u16 forward offset, pops the condition
+    OP_COUNT,         // u16 index into ints holding a pgo site: counts a call (--pgo-gen)
+    OP_COUNT_BRANCH,  // same, counting the condition on top of the stack as true or false
+} OpCode;
+
+// source position of the code from `offset` up to the next entry;
+// only recorded where the position changes
+typedef struct {
+    uint32_t offset;
+    uint32_t line;
+    uint32_t col;
+} SrcPos;
+
+// loop headers, so the tree-walker can jump into the middle of a
+// function once one of its loops gets hot (on-stack replacement)
+typedef struct {
+    const Stmt *stmt;
+    uint32_t offset;
+    uint32_t live_locals;
+} LoopEntry;
+
+typedef struct {
+    uint8_t *code;
+    size_t len;
+    size_t cap;
+
+    SrcPos *pos; // sorted by offset
+    size_t pos_len;
+    size_t pos_cap;
+
+    int64_t *ints;
+    size_t ints_len;
+    size_t ints_cap;
+
+    StrView *strs;
+    size_t strs_len;
+    size_t strs_cap;
+
+    LoopEntry *loops;
+    size_t loops_len;
+    size_t loops_cap;
+
+    uint32_t max_stack; // locals + temporaries
+
+    // optimization counters for --opt-report
+    uint32_t inlined;
+    uint32_t tail_calls;
+    uint32_t region_lists; // list literals that never leave the frame; each gets a region slot
+    uint32_t arith_ops;    // + - * in the code
+    uint32_t arith_proven; // ...of which compiled without an overflow check
+    uint32_t index_ops;    // xs[i] reads and writes
+    uint32_t index_proven; // ...of which compiled without a bounds check
+    uint32_t loop_guards;  // checks hoisted in front of a loop instead
+    uint32_t vector_loops; // element-wise loops with an OP_VEC_ARITH in front
+    uint32_t pgo_inlined;  // inlined only because the profile found the call hot
+    uint32_t pgo_cold;     // calls left out of line because they never ran in the profile
+    uint32_t pgo_flipped;  // if/else laid out else first
+    uint32_t folded;       // calls to pure functions evaluated at compile time
+
+    // code/pos/ints point into a mapped .lrc file (see cache.h); only
+    // strs and the Chunk itself are heap allocated
+    int mapped;
+} Chunk;
+
+// bump this whenever opcodes, their encoding or the code compiled for a
+// program change; it keys .lrc files
+#define BC_FORMAT_VERSION 15
+
+// OP_VEC_ARITH operands: which sides are lists (the other one is the
+// constant k from the stack)
+enum {
+    VEC_X_LIST = 1,
+    VEC_Y_LIST = 2,
+};
+
+typedef struct {
+    const CallGraph *cg;   // NULL disables inlining
+    const CallGraph *fold; // pure functions to evaluate at compile time (see fold.h); NULL disables folding
+    int fold_in_loops;     // ...only inside loops: the code before them has run already
+    size_t inline_budget; // max callee size in AST nodes
+    size_t inline_depth;  // max nesting of inlined bodies
+    int wrap_ints;        // --overflow=wrap: overflow does not stop the program, so fewer facts hold
+    int no_vectorize;
+    Pgo *pgo;             // --pgo-gen: emit counters; --pgo-use: steer inlining and layout
+    int pgo_gen;
+} BcOptions;
+
+#define BC_DEFAULT_INLINE_BUDGET 24
+#define BC_DEFAULT_INLINE_DEPTH  3
+
+// Compiles prog->fns[fn_index]. Returns NULL if the function uses anything
+// this tier cannot prove valid up front (unknown names, arity mismatches,
+// assignment to immutable bindings...); such functions stay in the
+// tree-walker, which reports the error when the code actually runs.
+// opts may be NULL (no inlining).
+Chunk *bc_compile(const Program *prog, size_t fn_index, const BcOptions *opts);
+void chunk_free(Chunk *c);
+
+const LoopEntry *chunk_find_loop(const Chunk *c, const Stmt *stmt);
+
+// source position of the instruction at code offset `off`
+SrcPos chunk_pos_at(const Chunk *c, size_t off);
+
+void bc_disassemble(FILE *out, const Chunk *c, StrView name);
+
+// Points every call, spawn and go at map[its fn index]: a module's code
+// is compiled with its own numbering (see module.h) and renumbered when
+// the program is put together. Returns 0 if an index is out of range
+// either way.
+int bc_relocate(Chunk *c, const uint32_t *map, size_t map_len);
+
+#endif
@@ -0,0 +1,607 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cache.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ----- on-disk layout (native endianness, checked on load) -----
+//
+//   LrcHeader
+//   LrcFn[fns_len]
+//   per function, 8-byte aligned: code bytes, SrcPos[pos_len],
+//                                 int64_t ints[], LrcStr strs[]
+//   LrcStr externs[externs_len]
+//   string blob (function names and string constants)
+//
+//   LriHeader
+//   LriImport[imports_len]
+//   LriFn[fns_len]
+//   LrcStr param_types[params_len] (all functions' in a row)
+//   string blob
+
+#define LRC_MAGIC "LUNARBC"
+#define LRI_MAGIC "LUNARIF"
+#define LRC_ENDIAN 0x01020304u
+#define LRC_LAYOUT 3 // of these structs, as opposed to the bytecode in them
+
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t endian;
+    uint64_t key;
+    uint64_t file_size;
+    uint32_t fns_len;
+    uint32_t layout;
+    uint64_t blob_off;
+    uint64_t blob_len;
+    uint64_t externs_off;
+    uint32_t externs_len;
+    uint32_t reserved;
+    uint64_t checksum; // of the whole file but this field, see file_checksum
+} LrcHeader;
+
+typedef struct {
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t params_len;
+    uint32_t max_stack;
+    uint32_t inlined;
+    uint32_t tail_calls;
+    uint32_t region_lists;
+    uint32_t arith_ops;
+    uint32_t arith_proven;
+    uint32_t index_ops;
+    uint32_t index_proven;
+    uint32_t loop_guards;
+    uint32_t vector_loops;
+    uint32_t folded;
+    uint64_t code_off;
+    uint64_t code_len;
+    uint64_t pos_off;
+    uint64_t pos_len;
+    uint64_t ints_off;
+    uint64_t ints_len;
+    uint64_t strs_off;
+    uint64_t strs_len;
+} LrcFn;
+
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} LrcStr;
+
+typedef struct {
+    char magic[8];
+    uint32_t layout;
+    uint32_t endian;
+    uint64_t key;
+    uint64_t hash;
+    uint64_t file_size;
+    uint32_t imports_len;
+    uint32_t fns_len;
+    uint32_t params_len;
+    uint32_t reserved;
+    uint64_t blob_off;
+    uint64_t blob_len;
+    uint64_t checksum; // as in LrcHeader
+} LriHeader;
+
+typedef struct {
+    LrcStr name;
+    uint32_t line;
+    uint32_t col;
+} LriImport;
+
+typedef struct {
+    LrcStr name;
+    LrcStr ret;
+    uint32_t params_len;
+    uint32_t params_start; // into param_types
+    uint32_t line;
+    uint32_t col;
+} LriFn;
+
+// hash of a whole file but its checksum, which is the header's last field
+static uint64_t file_checksum(const void *data, size_t len, size_t header_len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = hash_bytes(p, header_len - sizeof(uint64_t), HASH_SEED);
+    return hash_bytes(p + header_len, len - header_len, h);
+}
+
+uint64_t cache_key(const char *src, size_t len, size_t inline_budget, size_t inline_depth, int wrap_ints,
+                   int no_vectorize, int no_fold) {
+    uint32_t format = BC_FORMAT_VERSION | (wrap_ints ? 0x80000000u : 0) | (no_vectorize ? 0x40000000u : 0) |
+                      (no_fold ? 0x20000000u : 0);
+    uint64_t budget = inline_budget;
+    uint64_t depth = inline_depth;
+
+    uint64_t h = hash_bytes(LRC_MAGIC, sizeof(LRC_MAGIC), HASH_SEED);
+    h = hash_bytes(&format, sizeof(format), h);
+    h = hash_bytes(&budget, sizeof(budget), h);
+    h = hash_bytes(&depth, sizeof(depth), h);
+    return hash_bytes(src, len, h);
+}
+
+int cache_path(char *out, size_t cap, const char *src_path, const char *cache_dir, uint64_t key, const char *ext) {
+    int n;
+    if (cache_dir && *cache_dir) {
+        n = snprintf(out, cap, "%s/%016llx.%s", cache_dir, (unsigned long long)key, ext);
+    } else {
+        size_t len = strlen(src_path);
+        if (len >= 3 && strcmp(src_path + len - 3, ".lr") == 0) len -= 3;
+        n = snprintf(out, cap, "%.*s.%s", (int)len, src_path, ext);
+    }
+    return n > 0 && (size_t)n < cap;
+}
+
+// ----- writer -----
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int oom;
+} Buf;
+
+static size_t buf_put(Buf *b, const void *p, size_t n, size_t align) {
+    size_t start = (b->len + (align - 1)) & ~(align - 1);
+    size_t end = start + n;
+    if (end > b->cap) {
+        size_t new_cap = b->cap ? b->cap * 2 : 4096;
+        while (new_cap < end) new_cap *= 2;
+        unsigned char *nd = (unsigned char *)realloc(b->data, new_cap);
+        if (!nd) {
+            b->oom = 1;
+            return 0;
+        }
+        b->data = nd;
+        b->cap = new_cap;
+    }
+    memset(b->data + b->len, 0, start - b->len);
+    if (n && p) memcpy(b->data + start, p, n);
+    else if (n) memset(b->data + start, 0, n);
+    b->len = end;
+    return start;
+}
+
+static LrcStr put_str(Buf *blob, StrView s) {
+    LrcStr r;
+    r.off = (uint32_t)buf_put(blob, s.ptr, s.len, 1);
+    r.len = (uint32_t)s.len;
+    return r;
+}
+
+// temp file + rename, so readers never see half a file
+static int write_atomic(const char *path, const Buf *out) {
+    char tmp[4096];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long)getpid());
+    if (n <= 0 || (size_t)n >= sizeof(tmp)) return 0;
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+    int ok = fwrite(out->data, 1, out->len, f) == out->len;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+    return ok;
+}
+
+int cache_write(const char *path, uint64_t key, const Program *prog, size_t own, Chunk **chunks) {
+    Buf out = {0};
+    Buf blob = {0};
+
+    LrcHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LRC_MAGIC, sizeof(LRC_MAGIC));
+    hdr.format = BC_FORMAT_VERSION;
+    hdr.layout = LRC_LAYOUT;
+    hdr.endian = LRC_ENDIAN;
+    hdr.key = key;
+    hdr.fns_len = (uint32_t)own;
+    hdr.externs_len = (uint32_t)(prog->fns_len - own);
+    buf_put(&out, &hdr, sizeof(hdr), 8);
+
+    size_t table = buf_put(&out, NULL, own * sizeof(LrcFn), 8);
+
+    for (size_t i = 0; i < own && !out.oom && !blob.oom; i++) {
+        const FnDecl *fn = prog->fns[i];
+        const Chunk *c = chunks[i];
+        LrcFn rec;
+        memset(&rec, 0, sizeof(rec));
+
+        rec.name_off = (uint32_t)buf_put(&blob, fn->name.ptr, fn->name.len, 1);
+        rec.name_len = (uint32_t)fn->name.len;
+        rec.params_len = (uint32_t)fn->params_len;
+        rec.max_stack = c->max_stack;
+        rec.inlined = c->inlined;
+        rec.tail_calls = c->tail_calls;
+        rec.region_lists = c->region_lists;
+        rec.arith_ops = c->arith_ops;
+        rec.arith_proven = c->arith_proven;
+        rec.index_ops = c->index_ops;
+        rec.index_proven = c->index_proven;
+        rec.loop_guards = c->loop_guards;
+        rec.vector_loops = c->vector_loops;
+        rec.folded = c->folded;
+
+        rec.code_off = buf_put(&out, c->code, c->len, 8);
+        rec.code_len = c->len;
+        rec.pos_off = buf_put(&out, c->pos, c->pos_len * sizeof(SrcPos), 8);
+        rec.pos_len = c->pos_len;
+        rec.ints_off = buf_put(&out, c->ints, c->ints_len * sizeof(int64_t), 8);
+        rec.ints_len = c->ints_len;
+
+        rec.strs_off = buf_put(&out, NULL, c->strs_len * sizeof(LrcStr), 8);
+        rec.strs_len = c->strs_len;
+        for (size_t j = 0; j < c->strs_len && !out.oom; j++) {
+            LrcStr s = put_str(&blob, c->strs[j]);
+            memcpy(out.data + rec.strs_off + j * sizeof(LrcStr), &s, sizeof(s));
+        }
+
+        if (!out.oom) memcpy(out.data + table + i * sizeof(LrcFn), &rec, sizeof(rec));
+    }
+
+    size_t externs = buf_put(&out, NULL, (prog->fns_len - own) * sizeof(LrcStr), 8);
+    for (size_t i = own; i < prog->fns_len && !out.oom; i++) {
+        LrcStr s = put_str(&blob, prog->fns[i]->name);
+        memcpy(out.data + externs + (i - own) * sizeof(LrcStr), &s, sizeof(s));
+    }
+
+    size_t blob_off = buf_put(&out, blob.data, blob.len, 8);
+    int ok = !out.oom && !blob.oom;
+    if (ok) {
+        LrcHeader *h = (LrcHeader *)(void *)out.data;
+        h->blob_off = blob_off;
+        h->blob_len = blob.len;
+        h->externs_off = externs;
+        h->file_size = out.len;
+        h->checksum = file_checksum(out.data, out.len, sizeof(LrcHeader));
+    }
+    free(blob.data);
+
+    if (ok) ok = write_atomic(path, &out);
+    free(out.data);
+    return ok;
+}
+
+// ----- loader -----
+
+static int in_bounds(uint64_t off, uint64_t len, uint64_t elem, size_t file_size) {
+    if (elem && len > (uint64_t)file_size / elem) return 0;
+    return off <= file_size && len * elem <= file_size - off;
+}
+
+int cache_load(CacheImage *img, const char *path, uint64_t key, const char *src_path, Arena *arena) {
+    memset(img, 0, sizeof(*img));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LrcHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    // private and writable: linking patches the calls in place, and only
+    // the pages it touches get copied
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const unsigned char *base = (const unsigned char *)map;
+    const LrcHeader *hdr = (const LrcHeader *)map;
+    if (memcmp(hdr->magic, LRC_MAGIC, sizeof(LRC_MAGIC)) != 0 ||
+        hdr->format != BC_FORMAT_VERSION || hdr->layout != LRC_LAYOUT || hdr->endian != LRC_ENDIAN ||
+        hdr->key != key || hdr->file_size != size ||
+        !in_bounds(sizeof(LrcHeader), hdr->fns_len, sizeof(LrcFn), size) ||
+        !in_bounds(hdr->externs_off, hdr->externs_len, sizeof(LrcStr), size) ||
+        !in_bounds(hdr->blob_off, hdr->blob_len, 1, size) ||
+        file_checksum(map, size, sizeof(LrcHeader)) != hdr->checksum) {
+        // a corrupted payload could send the code anywhere: compile again
+        munmap(map, size);
+        return 0;
+    }
+
+    size_t n = hdr->fns_len;
+    size_t n_ext = hdr->externs_len;
+    const LrcFn *recs = (const LrcFn *)(const void *)(base + sizeof(LrcHeader));
+    const LrcStr *ext = (const LrcStr *)(const void *)(base + hdr->externs_off);
+    const char *blob = (const char *)base + hdr->blob_off;
+
+    Program *prog = ast_new_program(arena);
+    FnDecl **fns = (FnDecl **)arena_alloc(arena, (n ? n : 1) * sizeof(FnDecl *), _Alignof(FnDecl *));
+    StrView *externs = (StrView *)arena_alloc(arena, (n_ext ? n_ext : 1) * sizeof(StrView), _Alignof(StrView));
+    Chunk **chunks = (Chunk **)calloc(n ? n : 1, sizeof(Chunk *));
+    int ok = prog && fns && externs && chunks && hdr->externs_off % 8 == 0;
+
+    for (size_t i = 0; i < n_ext && ok; i++) {
+        ok = in_bounds(ext[i].off, ext[i].len, 1, hdr->blob_len);
+        externs[i].ptr = blob + ext[i].off;
+        externs[i].len = ext[i].len;
+    }
+
+    for (size_t i = 0; i < n && ok; i++) {
+        const LrcFn *r = &recs[i];
+        ok = in_bounds(r->name_off, r->name_len, 1, hdr->blob_len) &&
+             in_bounds(r->code_off, r->code_len, 1, size) &&
+             in_bounds(r->pos_off, r->pos_len, sizeof(SrcPos), size) &&
+             in_bounds(r->ints_off, r->ints_len, sizeof(int64_t), size) &&
+             in_bounds(r->strs_off, r->strs_len, sizeof(LrcStr), size) &&
+             r->code_len > 0 && r->code_off % 8 == 0 && r->pos_off % 8 == 0 &&
+             r->ints_off % 8 == 0;
+        if (!ok) break;
+
+        FnDecl *fn = ast_new_fn(arena);
+        Chunk *c = (Chunk *)calloc(1, sizeof(Chunk));
+        ok = fn && c;
+        if (!ok) {
+            free(c);
+            break;
+        }
+
+        fn->name.ptr = blob + r->name_off;
+        fn->name.len = r->name_len;
+        fn->params_len = r->params_len;
+        fn->span.path = src_path;
+        fn->external = 1;
+        fns[i] = fn;
+
+        c->mapped = 1;
+        c->code = (uint8_t *)(base + r->code_off);
+        c->pos = (SrcPos *)(void *)(base + r->pos_off);
+        c->pos_len = c->pos_cap = r->pos_len;
+        c->len = c->cap = r->code_len;
+        c->ints = (int64_t *)(void *)(base + r->ints_off);
+        c->ints_len = c->ints_cap = r->ints_len;
+        c->max_stack = r->max_stack;
+        c->inlined = r->inlined;
+        c->tail_calls = r->tail_calls;
+        c->region_lists = r->region_lists;
+        c->arith_ops = r->arith_ops;
+        c->arith_proven = r->arith_proven;
+        c->index_ops = r->index_ops;
+        c->index_proven = r->index_proven;
+        c->loop_guards = r->loop_guards;
+        c->vector_loops = r->vector_loops;
+        c->folded = r->folded;
+        chunks[i] = c;
+
+        // the only fixup: string constants become StrViews into the blob
+        if (r->strs_len) {
+            const LrcStr *ss = (const LrcStr *)(const void *)(base + r->strs_off);
+            c->strs = (StrView *)malloc(r->strs_len * sizeof(StrView));
+            ok = c->strs != NULL;
+            for (size_t j = 0; ok && j < r->strs_len; j++) {
+                ok = in_bounds(ss[j].off, ss[j].len, 1, hdr->blob_len);
+                if (!ok) break;
+                c->strs[j].ptr = blob + ss[j].off;
+                c->strs[j].len = ss[j].len;
+            }
+            c->strs_len = c->strs_cap = r->strs_len;
+        }
+    }
+
+    if (!ok) {
+        if (chunks) {
+            for (size_t i = 0; i < n; i++) chunk_free(chunks[i]);
+        }
+        free(chunks);
+        munmap(map, size);
+        return 0;
+    }
+
+    prog->fns = fns;
+    prog->fns_len = n;
+    ast_index_fns(prog, arena);
+    img->map = map;
+    img->map_len = size;
+    img->prog = prog;
+    img->chunks = chunks;
+    img->externs = externs;
+    img->externs_len = n_ext;
+    return 1;
+}
+
+void cache_unload(CacheImage *img) {
+    free(img->chunks);
+    if (img->map) munmap(img->map, img->map_len);
+    memset(img, 0, sizeof(*img));
+}
+
+// ----- interfaces -----
+
+static uint64_t hash_sv(StrView s, uint64_t h) {
+    uint64_t len = s.len;
+    h = hash_bytes(&len, sizeof(len), h);
+    return hash_bytes(s.ptr, s.len, h);
+}
+
+uint64_t cache_iface_hash(FnDecl *const *fns, size_t fns_len) {
+    uint64_t h = hash_bytes(LRI_MAGIC, sizeof(LRI_MAGIC), HASH_SEED);
+    for (size_t i = 0; i < fns_len; i++) {
+        const FnDecl *fn = fns[i];
+        uint64_t params = fn->params_len;
+        h = hash_sv(fn->name, h);
+        h = hash_sv(fn->return_type, h);
+        h = hash_bytes(&params, sizeof(params), h);
+        for (size_t j = 0; j < fn->params_len; j++) h = hash_sv(fn->params[j].type_name, h);
+    }
+    return h;
+}
+
+int cache_write_iface(const char *path, uint64_t key, const Program *prog) {
+    Buf out = {0};
+    Buf blob = {0};
+
+    size_t params = 0;
+    for (size_t i = 0; i < prog->fns_len; i++) params += prog->fns[i]->params_len;
+
+    LriHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LRI_MAGIC, sizeof(LRI_MAGIC));
+    hdr.layout = LRC_LAYOUT;
+    hdr.endian = LRC_ENDIAN;
+    hdr.key = key;
+    hdr.hash = cache_iface_hash(prog->fns, prog->fns_len);
+    hdr.imports_len = (uint32_t)prog->imports_len;
+    hdr.fns_len = (uint32_t)prog->fns_len;
+    hdr.params_len = (uint32_t)params;
+    buf_put(&out, &hdr, sizeof(hdr), 8);
+
+    for (size_t i = 0; i < prog->imports_len && !out.oom; i++) {
+        const Import *imp = &prog->imports[i];
+        LriImport rec;
+        rec.name = put_str(&blob, imp->name);
+        rec.line = (uint32_t)imp->span.line;
+        rec.col = (uint32_t)imp->span.col;
+        buf_put(&out, &rec, sizeof(rec), 4);
+    }
+
+    size_t next_param = 0;
+    for (size_t i = 0; i < prog->fns_len && !out.oom; i++) {
+        const FnDecl *fn = prog->fns[i];
+        LriFn rec;
+        rec.name = put_str(&blob, fn->name);
+        rec.ret = put_str(&blob, fn->return_type);
+        rec.params_len = (uint32_t)fn->params_len;
+        rec.params_start = (uint32_t)next_param;
+        rec.line = (uint32_t)fn->span.line;
+        rec.col = (uint32_t)fn->span.col;
+        buf_put(&out, &rec, sizeof(rec), 4);
+        next_param += fn->params_len;
+    }
+
+    for (size_t i = 0; i < prog->fns_len && !out.oom; i++) {
+        const FnDecl *fn = prog->fns[i];
+        for (size_t j = 0; j < fn->params_len; j++) {
+            LrcStr s = put_str(&blob, fn->params[j].type_name);
+            buf_put(&out, &s, sizeof(s), 4);
+        }
+    }
+
+    size_t blob_off = buf_put(&out, blob.data, blob.len, 8);
+    int ok = !out.oom && !blob.oom;
+    if (ok) {
+        LriHeader *h = (LriHeader *)(void *)out.data;
+        h->blob_off = blob_off;
+        h->blob_len = blob.len;
+        h->file_size = out.len;
+        h->checksum = file_checksum(out.data, out.len, sizeof(LriHeader));
+    }
+    free(blob.data);
+
+    if (ok) ok = write_atomic(path, &out);
+    free(out.data);
+    return ok;
+}
+
+static StrView get_str(const char *blob, LrcStr s) {
+    StrView v;
+    v.ptr = blob + s.off;
+    v.len = s.len;
+    return v;
+}
+
+int cache_load_iface(CacheIface *ifc, const char *path, uint64_t key, const char *src_path, Arena *arena) {
+    memset(ifc, 0, sizeof(*ifc));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LriHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const unsigned char *base = (const unsigned char *)map;
+    const LriHeader *hdr = (const LriHeader *)map;
+    size_t imports_off = sizeof(LriHeader);
+    size_t fns_off = imports_off + (size_t)hdr->imports_len * sizeof(LriImport);
+    size_t params_off = fns_off + (size_t)hdr->fns_len * sizeof(LriFn);
+    if (memcmp(hdr->magic, LRI_MAGIC, sizeof(LRI_MAGIC)) != 0 || hdr->layout != LRC_LAYOUT ||
+        hdr->endian != LRC_ENDIAN || hdr->key != key || hdr->file_size != size ||
+        !in_bounds(imports_off, hdr->imports_len, sizeof(LriImport), size) ||
+        !in_bounds(fns_off, hdr->fns_len, sizeof(LriFn), size) ||
+        !in_bounds(params_off, hdr->params_len, sizeof(LrcStr), size) ||
+        !in_bounds(hdr->blob_off, hdr->blob_len, 1, size) ||
+        file_checksum(map, size, sizeof(LriHeader)) != hdr->checksum) {
+        munmap(map, size);
+        return 0;
+    }
+
+    const LriImport *imps = (const LriImport *)(const void *)(base + imports_off);
+    const LriFn *recs = (const LriFn *)(const void *)(base + fns_off);
+    const LrcStr *ptypes = (const LrcStr *)(const void *)(base + params_off);
+    const char *blob = (const char *)base + hdr->blob_off;
+    size_t n_imp = hdr->imports_len, n = hdr->fns_len;
+
+    Import *imports = (Import *)arena_alloc(arena, (n_imp ? n_imp : 1) * sizeof(Import), _Alignof(Import));
+    FnDecl **fns = (FnDecl **)arena_alloc(arena, (n ? n : 1) * sizeof(FnDecl *), _Alignof(FnDecl *));
+    int ok = imports && fns;
+
+    for (size_t i = 0; i < n_imp && ok; i++) {
+        ok = in_bounds(imps[i].name.off, imps[i].name.len, 1, hdr->blob_len);
+        imports[i].name = get_str(blob, imps[i].name);
+        imports[i].span.path = src_path;
+        imports[i].span.line = imps[i].line;
+        imports[i].span.col = imps[i].col;
+    }
+
+    for (size_t i = 0; i < n && ok; i++) {
+        const LriFn *r = &recs[i];
+        ok = in_bounds(r->name.off, r->name.len, 1, hdr->blob_len) &&
+             in_bounds(r->ret.off, r->ret.len, 1, hdr->blob_len) &&
+             r->params_start <= hdr->params_len && r->params_len <= hdr->params_len - r->params_start;
+        FnDecl *fn = ok ? ast_new_fn(arena) : NULL;
+        Param *params = ok ? (Param *)arena_alloc(arena, (r->params_len ? r->params_len : 1) * sizeof(Param),
+                                                  _Alignof(Param))
+                           : NULL;
+        ok = fn && params;
+        if (!ok) break;
+
+        fn->name = get_str(blob, r->name);
+        fn->return_type = get_str(blob, r->ret);
+        fn->span.path = src_path;
+        fn->span.line = r->line;
+        fn->span.col = r->col;
+        fn->external = 1;
+        for (size_t j = 0; j < r->params_len && ok; j++) {
+            LrcStr t = ptypes[r->params_start + j];
+            ok = in_bounds(t.off, t.len, 1, hdr->blob_len);
+            params[j].type_name = get_str(blob, t);
+            params[j].span = fn->span;
+        }
+        fn->params = params;
+        fn->params_len = r->params_len;
+        fns[i] = fn;
+    }
+
+    if (!ok || cache_iface_hash(fns, n) != hdr->hash) {
+        munmap(map, size);
+        return 0;
+    }
+    ifc->map = map;
+    ifc->map_len = size;
+    ifc->hash = hdr->hash;
+    ifc->imports = imports;
+    ifc->imports_len = n_imp;
+    ifc->fns = fns;
+    ifc->fns_len = n;
+    return 1;
+}
+
+void cache_unload_iface(CacheIface *ifc) {
+    if (ifc->map) munmap(ifc->map, ifc->map_len);
+    memset(ifc, 0, sizeof(*ifc));
+}
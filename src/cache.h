@@ -0,0 +1,83 @@
+#ifndef LUNAR_CACHE_H
+#define LUNAR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "bytecode.h"
+
+// Precompiled files of one module (see module.h).
+//
+// A .lrc file holds every function of a module as tier 1 bytecode,
+// keyed by a hash of the source text, BC_FORMAT_VERSION, the compiler
+// options and the interfaces of the modules it imports. Calls into those
+// are numbered after the module's own functions and listed by name, for
+// the linker to renumber. It is loaded with mmap: code, source positions
+// and int constants are used in place (the mapping is private, so the
+// linker can patch calls), only the string table is turned into
+// StrViews. On a hit, the source is hashed but never lexed or parsed.
+// Both headers hold a checksum of the rest of the file; a file that does
+// not match it is a miss, and the module is compiled again.
+//
+// A .lri file is the module's interface: its imports and the signature
+// of each function, keyed by a hash of the source alone. Importers are
+// compiled against it, and its hash of the signatures is what their
+// .lrc keys depend on, so a change inside a function body rebuilds no
+// one else.
+
+typedef struct {
+    void *map;
+    size_t map_len;
+
+    // Stand-in program: FnDecls carry name, param count and span.path only,
+    // enough for the VM to run them. Bodies are NULL.
+    Program *prog;
+    Chunk **chunks; // one per fn; ownership moves to whoever frees them
+
+    // functions of other modules the code calls: fn index
+    // prog->fns_len + i is externs[i]
+    StrView *externs;
+    size_t externs_len;
+} CacheImage;
+
+typedef struct {
+    void *map;
+    size_t map_len;
+
+    uint64_t hash; // of the signatures, see cache_iface_hash
+    Import *imports;
+    size_t imports_len;
+    FnDecl **fns; // external: name, params, return type and span only
+    size_t fns_len;
+} CacheIface;
+
+// inline_budget is 0 when inlining is off; wrap_ints and no_vectorize as in BcOptions,
+// no_fold as in TierConfig
+uint64_t cache_key(const char *src, size_t len, size_t inline_budget, size_t inline_depth, int wrap_ints,
+                   int no_vectorize, int no_fold);
+
+// Builds the path of a cache file with extension ext ("lrc" or "lri"):
+// <cache_dir>/<key>.<ext> when cache_dir is set, otherwise the source
+// path with the extension changed. returns 0 if it does not fit in `cap`.
+int cache_path(char *out, size_t cap, const char *src_path, const char *cache_dir, uint64_t key, const char *ext);
+
+// Writes prog->fns[0..own) with their chunks; the fns after those are
+// the externs. Atomically (temp file + rename). returns 1 on success.
+int cache_write(const char *path, uint64_t key, const Program *prog, size_t own, Chunk **chunks);
+
+// returns 1 on a valid hit. src_path is used for diagnostics only.
+int cache_load(CacheImage *img, const char *path, uint64_t key, const char *src_path, Arena *arena);
+
+// unmaps the file; chunks taken from the image must be freed first
+void cache_unload(CacheImage *img);
+
+// hash of the names, param counts and types and return types of
+// prog->fns[0..fns_len): everything importers are compiled against
+uint64_t cache_iface_hash(FnDecl *const *fns, size_t fns_len);
+
+// key is a hash of the source only; the interface does not depend on options
+int cache_write_iface(const char *path, uint64_t key, const Program *prog);
+int cache_load_iface(CacheIface *ifc, const char *path, uint64_t key, const char *src_path, Arena *arena);
+void cache_unload_iface(CacheIface *ifc);
+
+#endif
@@ -0,0 +1,319 @@
+#include "callgraph.h"
+#include <stdlib.h>
+
+size_t ast_expr_size(const Expr *e) {
+    if (!e) return 0;
+    switch (e->kind) {
+        case EXPR_UNARY:  return 1 + ast_expr_size(e->as.unary.rhs);
+        case EXPR_BINARY: return 1 + ast_expr_size(e->as.binary.lhs) + ast_expr_size(e->as.binary.rhs);
+        case EXPR_ASSIGN: return 1 + ast_expr_size(e->as.assign.value);
+        case EXPR_CALL: {
+            size_t n = 1;
+            for (size_t i = 0; i < e->as.call.args_len; i++) n += ast_expr_size(e->as.call.args[i]);
+            return n;
+        }
+        case EXPR_LIST: {
+            size_t n = 1;
+            for (size_t i = 0; i < e->as.list.items_len; i++) n += ast_expr_size(e->as.list.items[i]);
+            return n;
+        }
+        case EXPR_MAP: {
+            size_t n = 1;
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                n += ast_expr_size(e->as.map.keys[i]) + ast_expr_size(e->as.map.values[i]);
+            }
+            return n;
+        }
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            return 1 + ast_expr_size(e->as.index.target) + ast_expr_size(e->as.index.index) +
+                   ast_expr_size(e->as.index.value);
+        default: return 1;
+    }
+}
+
+size_t ast_stmts_size(Stmt **stmts, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        n++;
+        switch (s->kind) {
+            case STMT_LET:    n += ast_expr_size(s->as.let_stmt.init); break;
+            case STMT_RETURN: n += ast_expr_size(s->as.ret_stmt.value); break;
+            case STMT_EXPR:   n += ast_expr_size(s->as.expr_stmt.expr); break;
+            case STMT_IF:
+                n += ast_expr_size(s->as.if_stmt.cond);
+                n += ast_stmts_size(s->as.if_stmt.then_body, s->as.if_stmt.then_len);
+                n += ast_stmts_size(s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+                break;
+            case STMT_WHILE:
+                n += ast_expr_size(s->as.while_stmt.cond);
+                n += ast_stmts_size(s->as.while_stmt.body, s->as.while_stmt.body_len);
+                break;
+        }
+    }
+    return n;
+}
+
+// ----- edge collection -----
+
+typedef struct {
+    const Program *prog;
+    CallGraphNode *node;
+    size_t cap;
+    int oom;
+} EdgeWalk;
+
+static void add_edge(EdgeWalk *w, size_t callee) {
+    CallGraphNode *n = w->node;
+    n->call_sites++;
+    for (size_t i = 0; i < n->callees_len; i++) {
+        if (n->callees[i] == callee) return;
+    }
+    if (n->callees_len == w->cap) {
+        size_t new_cap = w->cap ? w->cap * 2 : 4;
+        size_t *nc = (size_t *)realloc(n->callees, new_cap * sizeof(size_t));
+        if (!nc) {
+            w->oom = 1;
+            return;
+        }
+        n->callees = nc;
+        w->cap = new_cap;
+    }
+    n->callees[n->callees_len++] = callee;
+}
+
+static void walk_expr(EdgeWalk *w, const Expr *e);
+static void walk_stmts(EdgeWalk *w, Stmt **stmts, size_t len);
+
+static void walk_expr(EdgeWalk *w, const Expr *e) {
+    if (!e) return;
+    switch (e->kind) {
+        case EXPR_UNARY:  walk_expr(w, e->as.unary.rhs); break;
+        case EXPR_BINARY:
+            walk_expr(w, e->as.binary.lhs);
+            walk_expr(w, e->as.binary.rhs);
+            break;
+        case EXPR_ASSIGN: walk_expr(w, e->as.assign.value); break;
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            if (callee && callee->kind == EXPR_NAME) {
+                long fn = ast_find_fn(w->prog, callee->as.str);
+                if (fn >= 0) add_edge(w, (size_t)fn);
+            }
+            for (size_t i = 0; i < e->as.call.args_len; i++) walk_expr(w, e->as.call.args[i]);
+            break;
+        }
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) walk_expr(w, e->as.list.items[i]);
+            break;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                walk_expr(w, e->as.map.keys[i]);
+                walk_expr(w, e->as.map.values[i]);
+            }
+            break;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            walk_expr(w, e->as.index.target);
+            walk_expr(w, e->as.index.index);
+            walk_expr(w, e->as.index.value);
+            break;
+        default: break;
+    }
+}
+
+static void walk_stmts(EdgeWalk *w, Stmt **stmts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    walk_expr(w, s->as.let_stmt.init); break;
+            case STMT_RETURN: walk_expr(w, s->as.ret_stmt.value); break;
+            case STMT_EXPR:   walk_expr(w, s->as.expr_stmt.expr); break;
+            case STMT_IF:
+                walk_expr(w, s->as.if_stmt.cond);
+                walk_stmts(w, s->as.if_stmt.then_body, s->as.if_stmt.then_len);
+                walk_stmts(w, s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+                break;
+            case STMT_WHILE:
+                walk_expr(w, s->as.while_stmt.cond);
+                walk_stmts(w, s->as.while_stmt.body, s->as.while_stmt.body_len);
+                break;
+        }
+    }
+}
+
+// ----- Tarjan's SCC, to find call cycles -----
+
+typedef struct {
+    CallGraph *cg;
+    size_t *index;   // 0 = unvisited, else dfs order + 1
+    size_t *lowlink;
+    int *on_stack;
+    size_t *stack;
+    size_t stack_len;
+    size_t next_index;
+    size_t next_scc;
+} Tarjan;
+
+static void strongconnect(Tarjan *t, size_t v) {
+    t->index[v] = t->lowlink[v] = ++t->next_index;
+    t->stack[t->stack_len++] = v;
+    t->on_stack[v] = 1;
+
+    CallGraphNode *n = &t->cg->nodes[v];
+    for (size_t i = 0; i < n->callees_len; i++) {
+        size_t w = n->callees[i];
+        if (!t->index[w]) {
+            strongconnect(t, w);
+            if (t->lowlink[w] < t->lowlink[v]) t->lowlink[v] = t->lowlink[w];
+        } else if (t->on_stack[w] && t->index[w] < t->lowlink[v]) {
+            t->lowlink[v] = t->index[w];
+        }
+    }
+
+    if (t->lowlink[v] != t->index[v]) return;
+
+    size_t scc = t->next_scc++;
+    size_t members = 0;
+    size_t first = t->stack_len;
+    do {
+        first--;
+        members++;
+    } while (t->stack[first] != v);
+
+    for (size_t i = first; i < t->stack_len; i++) {
+        size_t w = t->stack[i];
+        t->on_stack[w] = 0;
+        t->cg->nodes[w].scc = scc;
+        if (members > 1) t->cg->nodes[w].recursive = 1;
+    }
+    t->stack_len = first;
+}
+
+// ----- purity -----
+
+static int scalar_type(StrView t) {
+    return sv_eq_cstr(t, "int") || sv_eq_cstr(t, "bool");
+}
+
+// 1 if e computes on ints and bools only: no strings, lists, maps,
+// builtins (print among them), spawn or go. Locals are all there is to
+// assign to, so nothing outside the call can change. Whether the
+// functions it calls are pure is settled afterwards.
+static int expr_pure(const Program *prog, const Expr *e) {
+    if (!e) return 1;
+    switch (e->kind) {
+        case EXPR_INT:
+        case EXPR_BOOL:
+        case EXPR_NAME:   return 1;
+        case EXPR_UNARY:  return expr_pure(prog, e->as.unary.rhs);
+        case EXPR_BINARY: return expr_pure(prog, e->as.binary.lhs) && expr_pure(prog, e->as.binary.rhs);
+        case EXPR_ASSIGN: return expr_pure(prog, e->as.assign.value);
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            if (e->as.call.spawn || e->as.call.go || !callee || callee->kind != EXPR_NAME ||
+                ast_find_fn(prog, callee->as.str) < 0) return 0;
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (!expr_pure(prog, e->as.call.args[i])) return 0;
+            }
+            return 1;
+        }
+        default: return 0;
+    }
+}
+
+static int stmts_pure(const Program *prog, Stmt **stmts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        switch (s->kind) {
+            case STMT_LET:    if (!expr_pure(prog, s->as.let_stmt.init)) return 0; break;
+            case STMT_RETURN: if (!expr_pure(prog, s->as.ret_stmt.value)) return 0; break;
+            case STMT_EXPR:   if (!expr_pure(prog, s->as.expr_stmt.expr)) return 0; break;
+            case STMT_IF:
+                if (!expr_pure(prog, s->as.if_stmt.cond) ||
+                    !stmts_pure(prog, s->as.if_stmt.then_body, s->as.if_stmt.then_len) ||
+                    !stmts_pure(prog, s->as.if_stmt.else_body, s->as.if_stmt.else_len)) return 0;
+                break;
+            case STMT_WHILE:
+                if (!expr_pure(prog, s->as.while_stmt.cond) ||
+                    !stmts_pure(prog, s->as.while_stmt.body, s->as.while_stmt.body_len)) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+static int fn_pure(const Program *prog, const FnDecl *fn) {
+    if (fn->external || (fn->return_type.len && !scalar_type(fn->return_type))) return 0;
+    for (size_t i = 0; i < fn->params_len; i++) {
+        if (!scalar_type(fn->params[i].type_name)) return 0;
+    }
+    return stmts_pure(prog, fn->body, fn->body_len);
+}
+
+// a function calling an impure one is impure; repeat until nothing
+// changes, so recursive functions stay pure unless the cycle calls out
+static void mark_pure(CallGraph *cg, const Program *prog) {
+    for (size_t i = 0; i < cg->len; i++) cg->nodes[i].pure = fn_pure(prog, prog->fns[i]);
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (size_t i = 0; i < cg->len; i++) {
+            CallGraphNode *n = &cg->nodes[i];
+            for (size_t j = 0; n->pure && j < n->callees_len; j++) {
+                if (!cg->nodes[n->callees[j]].pure) n->pure = 0, changed = 1;
+            }
+        }
+    }
+}
+
+int callgraph_build(CallGraph *cg, const Program *prog) {
+    cg->len = prog->fns_len;
+    cg->nodes = (CallGraphNode *)calloc(cg->len ? cg->len : 1, sizeof(CallGraphNode));
+    if (!cg->nodes) return 0;
+
+    for (size_t i = 0; i < prog->fns_len; i++) {
+        const FnDecl *fn = prog->fns[i];
+        EdgeWalk w = { prog, &cg->nodes[i], 0, 0 };
+        walk_stmts(&w, fn->body, fn->body_len);
+        if (w.oom) {
+            callgraph_free(cg);
+            return 0;
+        }
+        cg->nodes[i].size = ast_stmts_size(fn->body, fn->body_len);
+        for (size_t j = 0; j < cg->nodes[i].callees_len; j++) {
+            if (cg->nodes[i].callees[j] == i) cg->nodes[i].recursive = 1;
+        }
+    }
+
+    size_t n = cg->len ? cg->len : 1;
+    Tarjan t = {0};
+    t.cg = cg;
+    t.index = (size_t *)calloc(n, sizeof(size_t));
+    t.lowlink = (size_t *)calloc(n, sizeof(size_t));
+    t.on_stack = (int *)calloc(n, sizeof(int));
+    t.stack = (size_t *)calloc(n, sizeof(size_t));
+    int ok = t.index && t.lowlink && t.on_stack && t.stack;
+    if (ok) {
+        for (size_t v = 0; v < cg->len; v++) {
+            if (!t.index[v]) strongconnect(&t, v);
+        }
+    }
+    free(t.index);
+    free(t.lowlink);
+    free(t.on_stack);
+    free(t.stack);
+
+    if (!ok) callgraph_free(cg);
+    else mark_pure(cg, prog);
+    return ok;
+}
+
+void callgraph_free(CallGraph *cg) {
+    if (cg->nodes) {
+        for (size_t i = 0; i < cg->len; i++) free(cg->nodes[i].callees);
+    }
+    free(cg->nodes);
+    cg->nodes = NULL;
+    cg->len = 0;
+}
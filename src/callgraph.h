@@ -0,0 +1,32 @@
+#ifndef LUNAR_CALLGRAPH_H
+#define LUNAR_CALLGRAPH_H
+
+#include <stddef.h>
+#include "ast.h"
+
+// Static call graph over Program.fns. Only direct calls (EXPR_CALL whose
+// callee is an EXPR_NAME naming a FnDecl) produce edges; builtins don't.
+
+typedef struct {
+    size_t *callees;   // indices into prog->fns, deduplicated
+    size_t callees_len;
+    size_t call_sites; // EXPR_CALL nodes naming a user function
+    size_t size;       // AST nodes in the body, used as the inlining cost
+    size_t scc;        // strongly connected component id
+    int recursive;     // on a call cycle (including direct self-calls)
+    int pure;          // int/bool parameters, and the body only computes on ints and bools,
+                       // calling nothing but pure functions (see fold.h)
+} CallGraphNode;
+
+typedef struct {
+    CallGraphNode *nodes;
+    size_t len;
+} CallGraph;
+
+int callgraph_build(CallGraph *cg, const Program *prog);
+void callgraph_free(CallGraph *cg);
+
+size_t ast_stmts_size(Stmt **stmts, size_t len);
+size_t ast_expr_size(const Expr *e);
+
+#endif
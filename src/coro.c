@@ -0,0 +1,821 @@
+#define _DEFAULT_SOURCE
+#include "coro.h"
+#include "vm.h"
+#include "list.h"
+#include "str.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#if !defined(LUNAR_UCONTEXT) && !(defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__)))
+#define LUNAR_UCONTEXT
+#endif
+#ifdef LUNAR_UCONTEXT
+#include <ucontext.h>
+#endif
+
+enum {
+    CORO_READY = 0, // queued, or running
+    CORO_BLOCKED,
+    CORO_DONE,
+    CORO_FAILED,
+};
+
+typedef struct Coro Coro;
+
+// ----- context switching -----
+// ctx_switch saves the callee-saved registers on the running stack,
+// stores the stack pointer in *from and resumes the stack saved in *to.
+// A new context is a stack laid out as if it had just switched away
+// from the start of lunar_ctx_boot, which calls lunar_coro_main(c).
+
+void lunar_coro_main(Coro *c);
+
+#ifndef LUNAR_UCONTEXT
+
+typedef struct {
+    void *sp;
+} Ctx;
+
+void lunar_ctx_switch(Ctx *from, Ctx *to);
+void lunar_ctx_boot(void);
+
+#if defined(__x86_64__)
+__asm__(
+    ".text\n"
+    ".globl lunar_ctx_switch\n"
+    ".hidden lunar_ctx_switch\n"
+    ".type lunar_ctx_switch, @function\n"
+    "lunar_ctx_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq (%rsi), %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size lunar_ctx_switch, .-lunar_ctx_switch\n"
+    ".globl lunar_ctx_boot\n"
+    ".hidden lunar_ctx_boot\n"
+    ".type lunar_ctx_boot, @function\n"
+    "lunar_ctx_boot:\n"
+    "    movq %r12, %rdi\n"
+    "    call lunar_coro_main@PLT\n"
+    "    ud2\n"
+    ".size lunar_ctx_boot, .-lunar_ctx_boot\n");
+
+// r15 r14 r13 r12 rbx rbp, then the return address; returning into
+// lunar_ctx_boot pops all 7 and leaves the stack 16-byte aligned
+#define CTX_WORDS 7
+#define CTX_ARG   3 // r12
+#define CTX_RET   6
+
+#elif defined(__aarch64__)
+__asm__(
+    ".text\n"
+    ".globl lunar_ctx_switch\n"
+    ".hidden lunar_ctx_switch\n"
+    ".type lunar_ctx_switch, %function\n"
+    "lunar_ctx_switch:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    ldr x9, [x1]\n"
+    "    mov sp, x9\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size lunar_ctx_switch, .-lunar_ctx_switch\n"
+    ".globl lunar_ctx_boot\n"
+    ".hidden lunar_ctx_boot\n"
+    ".type lunar_ctx_boot, %function\n"
+    "lunar_ctx_boot:\n"
+    "    mov x0, x19\n"
+    "    bl lunar_coro_main\n"
+    "    brk #0\n"
+    ".size lunar_ctx_boot, .-lunar_ctx_boot\n");
+
+// x19..x30 then d8..d15 (22 words); 176 bytes keeps sp 16-byte aligned
+#define CTX_WORDS 22
+#define CTX_ARG   0  // x19
+#define CTX_RET   11 // x30
+#endif
+
+static void ctx_init(Ctx *ctx, char *stack, size_t size, Coro *c) {
+    uintptr_t top = ((uintptr_t)(stack + size)) & ~(uintptr_t)15;
+    void **sp = (void **)(top - CTX_WORDS * sizeof(void *));
+    memset(sp, 0, CTX_WORDS * sizeof(void *));
+    sp[CTX_ARG] = c;
+    sp[CTX_RET] = (void *)(uintptr_t)lunar_ctx_boot;
+    ctx->sp = sp;
+}
+
+static void ctx_switch(Ctx *from, Ctx *to) {
+    lunar_ctx_switch(from, to);
+}
+
+#else
+
+typedef struct {
+    ucontext_t uc;
+    Coro *arg;
+} Ctx;
+
+// makecontext can only pass ints along, so a new context picks its
+// coroutine up from here
+static _Thread_local Coro *booting;
+
+static void ctx_boot(void) {
+    lunar_coro_main(booting);
+}
+
+static void ctx_init(Ctx *ctx, char *stack, size_t size, Coro *c) {
+    getcontext(&ctx->uc);
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = size;
+    ctx->uc.uc_link = NULL;
+    ctx->arg = c;
+    makecontext(&ctx->uc, ctx_boot, 0);
+}
+
+static void ctx_switch(Ctx *from, Ctx *to) {
+    booting = to->arg;
+    swapcontext(&from->uc, &to->uc);
+}
+
+#endif
+
+// ----- coroutines -----
+
+// One mapping per coroutine: this header and the VM stacks, then a
+// guard page and the C stack, which grows down towards it.
+typedef struct CoroMem {
+    struct CoroMem *next; // free list
+    size_t size;
+    char *c_stack;
+    Value *stack;
+    Binding *binds;
+    Frame *frames;
+    List *region; // see vm.h; kept for the next coroutine like the Vm keeps its own
+    size_t region_used;
+} CoroMem;
+
+struct Coro {
+    int64_t id; // 0 for the root
+    Ctx ctx;
+    Sched *sched;
+    CoroMem *mem; // NULL for the root, and once finished
+
+    // the Vm's execution state while this coroutine is switched out
+    Value *stack;
+    Binding *binds;
+    size_t sp;
+    Frame *frames;
+    size_t frames_len;
+    List *region;
+    size_t region_top;
+    size_t region_used;
+    size_t walk_depth;
+    size_t walk_max;
+
+    uint32_t fn;
+    uint32_t argc;
+    Span where; // the go, for errors
+    int state;
+    Value result;
+    Coro *waiter; // blocked in wait() for this one
+    Coro *next;   // run queue
+    size_t index; // in Sched.all
+};
+
+struct Sched {
+    Vm *vm;
+    Coro root;
+    Coro *cur;
+    Coro *head; // ready, oldest first
+    Coro *tail;
+
+    Coro **by_id; // handle - 1; NULL once waited for
+    size_t by_id_len;
+    size_t by_id_cap;
+    Coro **all;   // every coroutine not waited for yet
+    size_t all_len;
+    size_t all_cap;
+    HeapRoots *roots; // all_cap + 2 runs, see coro_roots
+    size_t roots_cap;
+    CoroMem *spare;   // free list
+    size_t spare_len;
+    CoroMem *dead;    // the stack a finished coroutine left on; freed by whoever runs next
+
+    size_t live;  // started, not finished
+    int draining; // the root waits for live to reach 0
+    int deadlock;
+    int failed;
+    size_t since_poll;
+
+    int epfd;
+    Coro **fd_wait; // fd -> the coroutine waiting on it
+    size_t fd_wait_cap;
+    size_t fd_waiting;
+};
+
+static size_t page_size(void) {
+    long n = sysconf(_SC_PAGESIZE);
+    return n > 0 ? (size_t)n : 4096;
+}
+
+static size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+static CoroMem *mem_new(void) {
+    size_t page = page_size();
+    size_t head = round_up(sizeof(CoroMem), 64);
+    size_t vals = VM_STACK_MAX * sizeof(Value);
+    size_t binds = VM_STACK_MAX * sizeof(Binding);
+    size_t frames = VM_FRAMES_MAX * sizeof(Frame);
+    size_t low = round_up(head + vals + binds + frames, page);
+    size_t size = low + page + round_up(CORO_C_STACK, page);
+
+    char *p = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    if (mprotect(p + low, page, PROT_NONE) != 0) {
+        munmap(p, size);
+        return NULL;
+    }
+    CoroMem *m = (CoroMem *)(void *)p;
+    m->next = NULL;
+    m->size = size;
+    m->stack = (Value *)(void *)(p + head);
+    m->binds = (Binding *)(void *)(p + head + vals);
+    m->frames = (Frame *)(void *)(p + head + vals + binds);
+    m->c_stack = p + low + page;
+    m->region = NULL;
+    m->region_used = 0;
+    return m;
+}
+
+static void mem_free(CoroMem *m) {
+    for (size_t i = 0; i < m->region_used; i++) list_release(&m->region[i]);
+    free(m->region);
+    munmap(m, m->size);
+}
+
+static CoroMem *mem_get(Sched *s) {
+    CoroMem *m = s->spare;
+    if (!m) return mem_new();
+    s->spare = m->next;
+    s->spare_len--;
+    return m;
+}
+
+static void mem_put(Sched *s, CoroMem *m) {
+    if (s->spare_len >= CORO_KEEP) {
+        mem_free(m);
+        return;
+    }
+    m->next = s->spare;
+    s->spare = m;
+    s->spare_len++;
+}
+
+static int grow(void **arr, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) return 1;
+    size_t n = *cap ? *cap * 2 : 64;
+    while (n < need) n *= 2;
+    void *p = realloc(*arr, n * size);
+    if (!p) return 0;
+    *arr = p;
+    *cap = n;
+    return 1;
+}
+
+static void save_exec(const Vm *vm, Coro *c) {
+    c->stack = vm->stack;
+    c->binds = vm->binds;
+    c->sp = vm->sp;
+    c->frames = vm->frames;
+    c->frames_len = vm->frames_len;
+    c->region = vm->region;
+    c->region_top = vm->region_top;
+    c->region_used = vm->region_used;
+    c->walk_depth = vm->walk_depth;
+    c->walk_max = vm->walk_max;
+}
+
+static void load_exec(Vm *vm, const Coro *c) {
+    vm->stack = c->stack;
+    vm->binds = c->binds;
+    vm->sp = c->sp;
+    vm->frames = c->frames;
+    vm->frames_len = c->frames_len;
+    vm->region = c->region;
+    vm->region_top = c->region_top;
+    vm->region_used = c->region_used;
+    vm->walk_depth = c->walk_depth;
+    vm->walk_max = c->walk_max;
+}
+
+static void make_ready(Sched *s, Coro *c) {
+    c->state = CORO_READY;
+    c->next = NULL;
+    if (s->tail) s->tail->next = c;
+    else s->head = c;
+    s->tail = c;
+}
+
+static void release_dead(Sched *s) {
+    if (!s->dead) return;
+    mem_put(s, s->dead);
+    s->dead = NULL;
+}
+
+// ----- waiting for fds -----
+
+static int grow_fd_wait(Sched *s, int fd) {
+    size_t old = s->fd_wait_cap;
+    if (!grow((void **)&s->fd_wait, &s->fd_wait_cap, (size_t)fd + 1, sizeof(Coro *))) return 0;
+    memset(s->fd_wait + old, 0, (s->fd_wait_cap - old) * sizeof(Coro *));
+    return 1;
+}
+
+static void fd_ready(Sched *s, int fd) {
+    if (fd < 0 || (size_t)fd >= s->fd_wait_cap || !s->fd_wait[fd]) return;
+    make_ready(s, s->fd_wait[fd]);
+    s->fd_wait[fd] = NULL;
+    s->fd_waiting--;
+}
+
+// wakes everyone: they retry their read or write and see the error themselves
+static void fd_wake_all(Sched *s) {
+    for (size_t fd = 0; fd < s->fd_wait_cap && s->fd_waiting; fd++) fd_ready(s, (int)fd);
+}
+
+#ifdef __linux__
+
+static int fd_arm(Sched *s, int fd, int write) {
+    if (s->epfd < 0) {
+        s->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (s->epfd < 0) return 0;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.fd = fd;
+    // an fd stays registered (and disarmed) after it fires, until it is closed
+    if (epoll_ctl(s->epfd, EPOLL_CTL_MOD, fd, &ev) == 0) return 1;
+    return errno == ENOENT && epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void fd_poll(Sched *s, int block) {
+    struct epoll_event evs[256];
+    int n = epoll_wait(s->epfd, evs, 256, block ? -1 : 0);
+    if (n < 0) {
+        if (errno != EINTR) fd_wake_all(s);
+        return;
+    }
+    for (int i = 0; i < n; i++) fd_ready(s, evs[i].data.fd);
+}
+
+#else
+
+static int fd_arm(Sched *s, int fd, int write) {
+    (void)s; (void)fd; (void)write;
+    return 1;
+}
+
+// which way each waiter waits is not recorded, so ask for both
+static void fd_poll(Sched *s, int block) {
+    struct pollfd *fds = (struct pollfd *)malloc(s->fd_waiting * sizeof(struct pollfd));
+    if (!fds) {
+        fd_wake_all(s);
+        return;
+    }
+    nfds_t n = 0;
+    for (size_t fd = 0; fd < s->fd_wait_cap; fd++) {
+        if (!s->fd_wait[fd]) continue;
+        fds[n].fd = (int)fd;
+        fds[n].events = POLLIN | POLLOUT;
+        fds[n].revents = 0;
+        n++;
+    }
+    int r = poll(fds, n, block ? -1 : 0);
+    if (r < 0 && errno != EINTR) fd_wake_all(s);
+    for (nfds_t i = 0; r > 0 && i < n; i++) {
+        if (fds[i].revents) fd_ready(s, fds[i].fd);
+    }
+    free(fds);
+}
+
+#endif
+
+// ----- scheduling -----
+
+static void switch_to(Sched *s, Coro *from, Coro *to) {
+    Vm *vm = s->vm;
+    save_exec(vm, from);
+    load_exec(vm, to);
+    s->cur = to;
+    vm->stats.coro_switches++;
+    ctx_switch(&from->ctx, &to->ctx);
+}
+
+// Runs other coroutines until the current one is ready again; it must
+// already be queued or blocked. returns 0 in the root when nothing can
+// ever wake it (every other coroutine waits for another one too).
+static int schedule(Sched *s) {
+    Coro *cur = s->cur;
+    Coro *next;
+    for (;;) {
+        if (s->fd_waiting && (!s->head || ++s->since_poll >= CORO_POLL_EVERY)) {
+            s->since_poll = 0;
+            fd_poll(s, !s->head);
+        }
+        next = s->head;
+        if (next) {
+            s->head = next->next;
+            if (!s->head) s->tail = NULL;
+            break;
+        }
+        if (s->fd_waiting) continue;
+        if (cur == &s->root) return 0;
+        // the root is blocked too (it would be queued otherwise); it reports this
+        s->deadlock = 1;
+        next = &s->root;
+        break;
+    }
+    if (next != cur) switch_to(s, cur, next);
+    release_dead(s);
+    if (s->deadlock && s->cur == &s->root) {
+        s->deadlock = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void lunar_coro_main(Coro *c) {
+    Sched *s = c->sched;
+    Vm *vm = s->vm;
+    release_dead(s);
+
+    Value r;
+    int ok = vm_call(vm, c->fn, c->argc, c->where, &r);
+    c->result = ok ? r : value_int(0);
+    c->state = ok ? CORO_DONE : CORO_FAILED;
+    if (!ok) s->failed = 1;
+
+    // the stacks go back once we are off them
+    CoroMem *m = c->mem;
+    m->region = vm->region;
+    m->region_used = vm->region_used;
+    c->mem = NULL;
+    s->dead = m;
+    s->live--;
+    if (c->waiter) {
+        make_ready(s, c->waiter);
+        c->waiter = NULL;
+    }
+    if (!s->live && s->draining) make_ready(s, &s->root);
+    schedule(s);
+    abort(); // nothing switches back to a finished coroutine
+}
+
+static Sched *sched_start(Vm *vm) {
+    Sched *s = (Sched *)calloc(1, sizeof(Sched));
+    if (!s) return NULL;
+    s->vm = vm;
+    s->cur = &s->root;
+    s->root.sched = s;
+    s->epfd = -1;
+    if (!grow((void **)&s->roots, &s->roots_cap, 2, sizeof(HeapRoots))) {
+        free(s);
+        return NULL;
+    }
+    vm->sched = s;
+    return s;
+}
+
+static void forget(Sched *s, Coro *c) {
+    s->by_id[c->id - 1] = NULL;
+    Coro *last = s->all[--s->all_len];
+    s->all[c->index] = last;
+    last->index = c->index;
+    free(c);
+}
+
+// ----- public -----
+
+int coro_go(Vm *vm, size_t fn, size_t argc, Span where, Value *out) {
+    if (vm->task_depth) return vm_error(vm, where, "cannot start a coroutine inside a task");
+    Sched *s = vm->sched ? vm->sched : sched_start(vm);
+    if (!s) return vm_error(vm, where, "out of memory");
+
+    Coro *c = (Coro *)calloc(1, sizeof(Coro));
+    CoroMem *m = c ? mem_get(s) : NULL;
+    if (!m || !grow((void **)&s->by_id, &s->by_id_cap, s->by_id_len + 1, sizeof(Coro *)) ||
+        !grow((void **)&s->all, &s->all_cap, s->all_len + 1, sizeof(Coro *)) ||
+        !grow((void **)&s->roots, &s->roots_cap, s->all_cap + 2, sizeof(HeapRoots))) {
+        if (m) mem_put(s, m);
+        free(c);
+        return vm_error(vm, where, "out of memory starting a coroutine");
+    }
+
+    // the arguments are moved over as they are: the heap is the same
+    memcpy(m->stack, &vm->stack[vm->sp - argc], argc * sizeof(Value));
+    for (size_t i = 0; i < argc; i++) {
+        m->binds[i].name = (StrView){0};
+        m->binds[i].is_mut = 0;
+    }
+    c->id = (int64_t)s->by_id_len + 1;
+    c->sched = s;
+    c->mem = m;
+    c->stack = m->stack;
+    c->binds = m->binds;
+    c->sp = argc;
+    c->frames = m->frames;
+    c->region = m->region;
+    c->region_used = m->region_used;
+    c->walk_max = CORO_WALK_DEPTH;
+    c->fn = (uint32_t)fn;
+    c->argc = (uint32_t)argc;
+    c->where = where;
+    ctx_init(&c->ctx, m->c_stack, CORO_C_STACK, c);
+
+    s->by_id[s->by_id_len++] = c;
+    c->index = s->all_len;
+    s->all[s->all_len++] = c;
+    s->live++;
+    make_ready(s, c);
+    vm->stats.coros_started++;
+    *out = value_int(c->id);
+    return 1;
+}
+
+int coro_wait(Vm *vm, Value handle, Span where, Value *out) {
+    if (handle.kind != VAL_INT) {
+        return vm_error(vm, where, "'wait' expects a coroutine handle, got %s", value_kind_name(handle.kind));
+    }
+    Sched *s = vm->sched;
+    int64_t id = handle.as.i;
+    Coro *c = s && id >= 1 && (uint64_t)id <= s->by_id_len ? s->by_id[id - 1] : NULL;
+    if (!c) {
+        return vm_error(vm, where, "no coroutine %lld to wait for (never started, or already waited for)", (long long)id);
+    }
+    if (c == s->cur) return vm_error(vm, where, "a coroutine cannot wait for itself");
+    if (c->waiter) return vm_error(vm, where, "coroutine %lld is already being waited for", (long long)id);
+
+    while (c->state == CORO_READY || c->state == CORO_BLOCKED) {
+        Coro *cur = s->cur;
+        c->waiter = cur;
+        cur->state = CORO_BLOCKED;
+        if (!schedule(s)) {
+            c->waiter = NULL;
+            cur->state = CORO_READY;
+            return vm_error(vm, where, "deadlock: every coroutine is waiting for another one");
+        }
+    }
+    int ok = c->state == CORO_DONE;
+    if (ok) *out = c->result;
+    forget(s, c);
+    // the coroutine reported its own error when it failed
+    return ok ? 1 : vm_error(vm, where, "coroutine %lld failed", (long long)id);
+}
+
+int coro_yield(Vm *vm, Span where) {
+    (void)where;
+    Sched *s = vm->sched;
+    if (!s || (!s->head && !s->fd_waiting)) return 1;
+    make_ready(s, s->cur);
+    return schedule(s);
+}
+
+int coro_wait_fd(Vm *vm, int fd, int write, Span where) {
+    Sched *s = vm->sched;
+    if (!s || !s->live) {
+        // nothing else to run meanwhile
+        struct pollfd p;
+        p.fd = fd;
+        p.events = write ? POLLOUT : POLLIN;
+        p.revents = 0;
+        while (poll(&p, 1, -1) < 0) {
+            if (errno != EINTR) return vm_error(vm, where, "cannot wait on fd %d: %s", fd, strerror(errno));
+        }
+        return 1;
+    }
+
+    if ((size_t)fd >= s->fd_wait_cap && !grow_fd_wait(s, fd)) return vm_error(vm, where, "out of memory");
+    if (s->fd_wait[fd]) return vm_error(vm, where, "another coroutine is already waiting on fd %d", fd);
+    if (!fd_arm(s, fd, write)) return vm_error(vm, where, "cannot wait on fd %d: %s", fd, strerror(errno));
+    s->fd_wait[fd] = s->cur;
+    s->fd_waiting++;
+    s->cur->state = CORO_BLOCKED;
+    return schedule(s);
+}
+
+size_t coro_roots(Vm *vm, const HeapRoots **out) {
+    Sched *s = vm->sched;
+    size_t n = 0;
+    s->roots[n].vals = vm->stack;
+    s->roots[n++].len = vm->sp;
+    if (s->cur != &s->root) {
+        s->roots[n].vals = s->root.stack;
+        s->roots[n++].len = s->root.sp;
+    }
+    for (size_t i = 0; i < s->all_len; i++) {
+        Coro *c = s->all[i];
+        if (c == s->cur || c->state == CORO_FAILED) continue;
+        if (c->state == CORO_DONE) {
+            s->roots[n].vals = &c->result;
+            s->roots[n++].len = 1;
+        } else {
+            s->roots[n].vals = c->stack;
+            s->roots[n++].len = c->sp;
+        }
+    }
+    *out = s->roots;
+    return n;
+}
+
+int coro_finish(Vm *vm, int abort, Span where) {
+    Sched *s = vm->sched;
+    if (!s) return 1;
+    while (!abort && s->live) {
+        s->draining = 1;
+        s->root.state = CORO_BLOCKED;
+        if (!schedule(s)) {
+            s->root.state = CORO_READY;
+            vm_error(vm, where, "deadlock: %zu coroutine(s) still waiting for each other", s->live);
+            s->failed = 1;
+            break;
+        }
+    }
+    s->draining = 0;
+    return !s->failed;
+}
+
+void coro_sched_free(Sched *s) {
+    if (!s) return;
+    release_dead(s);
+    for (size_t i = 0; i < s->all_len; i++) {
+        if (s->all[i]->mem) mem_free(s->all[i]->mem);
+        free(s->all[i]);
+    }
+    while (s->spare) {
+        CoroMem *m = s->spare;
+        s->spare = m->next;
+        mem_free(m);
+    }
+#ifdef __linux__
+    if (s->epfd >= 0) close(s->epfd);
+#endif
+    free(s->by_id);
+    free(s->all);
+    free(s->roots);
+    free(s->fd_wait);
+    free(s);
+}
+
+// ----- files and pipes -----
+
+static _Thread_local char io_buf[CORO_IO_MAX];
+
+static int set_nonblocking(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    return fl >= 0 && fcntl(fd, F_SETFL, fl | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+// Lets the process have as many fds as the hard limit allows; scripts
+// with thousands of pipes run out of the usual soft limit of 1024.
+static int raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur >= rl.rlim_max) return 0;
+    rl.rlim_cur = rl.rlim_max;
+    return setrlimit(RLIMIT_NOFILE, &rl) == 0;
+}
+
+static int want_fd(Vm *vm, const char *name, int64_t fd, Span where) {
+    if (fd < 0 || fd > INT32_MAX) return vm_error(vm, where, "'%s': %lld is not a file descriptor", name, (long long)fd);
+    return 1;
+}
+
+int coro_open(Vm *vm, StrView path, StrView mode, Span where, Value *out) {
+    int flags;
+    if (sv_eq_cstr(mode, "r")) flags = O_RDONLY;
+    else if (sv_eq_cstr(mode, "w")) flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (sv_eq_cstr(mode, "a")) flags = O_WRONLY | O_CREAT | O_APPEND;
+    else return vm_error(vm, where, "'open' mode must be \"r\", \"w\" or \"a\", got \"%.*s\"", (int)mode.len, mode.ptr);
+
+    if (memchr(path.ptr, '\0', path.len)) return vm_error(vm, where, "'open': the path contains a \\0");
+    char *p = (char *)malloc(path.len + 1);
+    if (!p) return vm_error(vm, where, "out of memory");
+    memcpy(p, path.ptr, path.len);
+    p[path.len] = '\0';
+    int fd = open(p, flags | O_NONBLOCK | O_CLOEXEC, 0666);
+    if (fd < 0 && errno == EMFILE && raise_fd_limit()) fd = open(p, flags | O_NONBLOCK | O_CLOEXEC, 0666);
+    int err = errno;
+    free(p);
+    if (fd < 0) return vm_error(vm, where, "cannot open '%.*s': %s", (int)path.len, path.ptr, strerror(err));
+    *out = value_int(fd);
+    return 1;
+}
+
+int coro_pipe(Vm *vm, Span where, Value *out) {
+    int fds[2];
+    int r = pipe(fds);
+    if (r != 0 && errno == EMFILE && raise_fd_limit()) r = pipe(fds);
+    if (r != 0) return vm_error(vm, where, "cannot create a pipe: %s", strerror(errno));
+    List *l = heap_new_list(&vm->heap, VAL_INT, 2);
+    if (!set_nonblocking(fds[0]) || !set_nonblocking(fds[1]) || !l || !heap_list_push(&vm->heap, l, value_int(fds[0])) ||
+        !heap_list_push(&vm->heap, l, value_int(fds[1]))) {
+        int err = errno;
+        close(fds[0]);
+        close(fds[1]);
+        return vm_error(vm, where, "cannot create a pipe: %s", l ? strerror(err) : "out of memory");
+    }
+    *out = value_list(l);
+    return 1;
+}
+
+int coro_read(Vm *vm, int64_t fd, int64_t n, Span where, Value *out) {
+    if (!want_fd(vm, "read", fd, where)) return 0;
+    if (n <= 0) return vm_error(vm, where, "'read' expects a positive byte count, got %lld", (long long)n);
+    size_t want = (uint64_t)n > CORO_IO_MAX ? CORO_IO_MAX : (size_t)n;
+    for (;;) {
+        ssize_t r = read((int)fd, io_buf, want);
+        if (r >= 0) {
+            if (!str_from(&vm->heap, io_buf, (size_t)r, out)) return vm_error(vm, where, "out of memory");
+            return 1;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return vm_error(vm, where, "cannot read fd %d: %s", (int)fd, strerror(errno));
+        }
+        if (!coro_wait_fd(vm, (int)fd, 0, where)) return 0;
+    }
+}
+
+int coro_write(Vm *vm, int64_t fd, const Value *str, Span where, Value *out) {
+    if (!want_fd(vm, "write", fd, where)) return 0;
+    // what print() buffered goes out first
+    if (fd == 1) outbuf_flush(&vm->out);
+    size_t done = 0;
+    for (;;) {
+        StrView s = value_sv(str);
+        if (done >= s.len) break;
+        ssize_t r = write((int)fd, s.ptr + done, s.len - done);
+        if (r >= 0) {
+            done += (size_t)r;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return vm_error(vm, where, "cannot write fd %d: %s", (int)fd, strerror(errno));
+        }
+        if (!coro_wait_fd(vm, (int)fd, 1, where)) return 0;
+    }
+    *out = value_int((int64_t)done);
+    return 1;
+}
+
+int coro_close(Vm *vm, int64_t fd, Span where) {
+    if (!want_fd(vm, "close", fd, where)) return 0;
+    // whoever waits on it finds out when it retries
+    if (vm->sched) fd_ready(vm->sched, (int)fd);
+    if (close((int)fd) != 0) return vm_error(vm, where, "cannot close fd %d: %s", (int)fd, strerror(errno));
+    return 1;
+}
@@ -0,0 +1,78 @@
+#ifndef LUNAR_CORO_H
+#define LUNAR_CORO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "heap.h"
+#include "value.h"
+
+// Coroutines: `go f(args)` and wait(h), plus fd builtins that suspend
+// the running coroutine instead of blocking the thread.
+//
+// A coroutine runs on the thread (and Vm) that started it and shares
+// its heap, so arguments and results are passed as they are. It has its
+// own C stack and VM stack; a switch swaps the Vm's stack, frames and
+// region for the other coroutine's, and the registers with a few
+// instructions of assembly (x86-64, aarch64; ucontext elsewhere, or when
+// built with -DLUNAR_UCONTEXT). Main is the root coroutine and keeps the
+// thread's own stacks.
+//
+// Nothing preempts: the running coroutine keeps the thread until it
+// waits for an fd, for another coroutine, or yields. Ready coroutines
+// run in FIFO order; fd waits go through epoll (poll outside Linux),
+// checked whenever nothing is ready and every CORO_POLL_EVERY switches
+// otherwise.
+//
+// Stacks are reserved with mmap, so only the pages a coroutine touches
+// cost memory, and finished coroutines' stacks are reused.
+
+typedef struct Vm Vm;
+typedef struct Sched Sched;
+
+#define CORO_C_STACK    (1u << 20) // bytes, plus a guard page
+#define CORO_WALK_DEPTH 400        // tree-walked calls that fit in CORO_C_STACK
+#define CORO_KEEP       256        // finished coroutines' stacks kept for reuse
+#define CORO_POLL_EVERY 64
+#define CORO_IO_MAX     (64u << 10) // bytes per read()
+
+// Starts fns[fn] with the argc arguments on top of vm's stack (left
+// there for the caller to pop) as a coroutine; it first runs once the
+// caller waits or yields. *out is the handle. returns 0 after reporting
+// an error.
+int coro_go(Vm *vm, size_t fn, size_t argc, Span where, Value *out);
+
+// Waits for a coroutine and returns its result; each handle can be
+// waited for once. A safepoint, like a call.
+int coro_wait(Vm *vm, Value handle, Span where, Value *out);
+
+// lets the other ready coroutines run first
+int coro_yield(Vm *vm, Span where);
+
+// Suspends the running coroutine until fd can be read (or written, with
+// write set). Without other coroutines this blocks in poll().
+int coro_wait_fd(Vm *vm, int fd, int write, Span where);
+
+// fds for the builtins. Files and pipes opened here are non-blocking,
+// so a read or write that would block waits in coro_wait_fd instead.
+int coro_open(Vm *vm, StrView path, StrView mode, Span where, Value *out);
+int coro_pipe(Vm *vm, Span where, Value *out);
+int coro_read(Vm *vm, int64_t fd, int64_t n, Span where, Value *out);
+// str points at the string argument on the VM stack: it is read again
+// after every wait, since its bytes may move
+int coro_write(Vm *vm, int64_t fd, const Value *str, Span where, Value *out);
+int coro_close(Vm *vm, int64_t fd, Span where);
+
+// The GC roots while coroutines exist: every coroutine's stack, the
+// results nobody waited for yet, and the running one's stack. *out
+// stays valid until the next call.
+size_t coro_roots(Vm *vm, const HeapRoots **out);
+
+// Called once main returns: runs the coroutines that have not finished
+// (or, with abort set, leaves them where they are). returns 0 if one of
+// them failed, after reporting a deadlock at `where` if there was one.
+int coro_finish(Vm *vm, int abort, Span where);
+
+void coro_sched_free(Sched *s);
+
+#endif
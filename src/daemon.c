@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include "daemon.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DAEMON_MAGIC    0x3152444cu // "LDR1"
+#define DAEMON_MAX_ARGS 4096
+#define DAEMON_MAX_LEN  (1u << 20)
+
+// what a client sends first, with its stdin, stdout and stderr attached;
+// then len bytes: the cwd and each argument, NUL terminated. While the
+// program runs, the client sends a byte with the signal number for each
+// SIGINT or SIGTERM it gets; the daemon answers with the int32 status.
+typedef struct {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t len;
+} Request;
+
+void daemon_socket_path(char *out, size_t cap) {
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    if (run && *run) snprintf(out, cap, "%s/lunar.sock", run);
+    else snprintf(out, cap, "/tmp/lunar-%u.sock", (unsigned)getuid());
+}
+
+static int sock_addr(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    size_t n = strlen(path);
+    if (n >= sizeof(addr->sun_path)) return 0;
+    memcpy(addr->sun_path, path, n + 1);
+    return 1;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = (const char *)data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void *data, size_t len) {
+    char *p = (char *)data;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+// ----- client -----
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig) {
+    interrupted = sig;
+}
+
+// Reads the status, passing SIGINT and SIGTERM on to the daemon until
+// it comes.
+static int await_status(int fd, int32_t *status) {
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &old);
+    struct sigaction sa, old_int, old_term;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_interrupt;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    char *p = (char *)status;
+    size_t left = sizeof(*status);
+    int ok = 1;
+    while (ok && left) {
+        if (interrupted) {
+            unsigned char sig = (unsigned char)interrupted;
+            interrupted = 0;
+            send(fd, &sig, 1, MSG_NOSIGNAL); // if the daemon is gone the read says so
+        }
+        // signals only get through while waiting here, so none is missed
+        struct pollfd pf = { fd, POLLIN, 0 };
+        if (ppoll(&pf, 1, NULL, &old) < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        ssize_t n = read(fd, p, left);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) ok = 0;
+        else {
+            p += n;
+            left -= (size_t)n;
+        }
+    }
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return ok;
+}
+
+int daemon_request(const char *sock_path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    if (!sock_addr(&addr, sock_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "lunar: error: cannot get the current directory\n");
+        close(fd);
+        return 1;
+    }
+    size_t len = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) len += strlen(argv[i]) + 1;
+    char *payload = len <= DAEMON_MAX_LEN ? (char *)malloc(len) : NULL;
+    if (!payload) {
+        fprintf(stderr, "lunar: error: command line too long for the daemon\n");
+        close(fd);
+        return 1;
+    }
+    size_t off = 0;
+    for (int i = -1; i < argc; i++) {
+        const char *s = i < 0 ? cwd : argv[i];
+        size_t n = strlen(s) + 1;
+        memcpy(payload + off, s, n);
+        off += n;
+    }
+
+    Request rq = { DAEMON_MAGIC, (uint32_t)argc, (uint32_t)len };
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    struct iovec iov = { &rq, sizeof(rq) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    int32_t status = 1;
+    int ok = sendmsg(fd, &msg, 0) == (ssize_t)sizeof(rq) && write_all(fd, payload, len) &&
+             await_status(fd, &status);
+    free(payload);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "lunar: error: lost the connection to the daemon at %s\n", sock_path);
+        return 1;
+    }
+    return (int)status;
+}
+
+// ----- watching -----
+
+typedef struct {
+    int wd;
+    char *dir;
+} Watch;
+
+typedef struct {
+    ModuleStore store;
+    DaemonMain run;
+    int inotify; // -1 if there is none: then nothing is kept past a request
+    Watch *watches;
+    size_t watches_len;
+    size_t watches_cap;
+} Daemon;
+
+// length of the directory part of a realpath ("/" for the root)
+static size_t dir_len(const char *real) {
+    const char *slash = strrchr(real, '/');
+    return slash && slash != real ? (size_t)(slash - real) : 1;
+}
+
+static int in_dir(const char *real, const char *dir, size_t len) {
+    return dir_len(real) == len && strncmp(real, dir, len) == 0;
+}
+
+static void forget_dir(Daemon *d, const char *dir, size_t len) {
+    for (size_t i = d->store.len; i-- > 0;) {
+        if (i < d->store.len && in_dir(d->store.modules[i]->real, dir, len)) {
+            module_store_forget(&d->store, d->store.modules[i]->real);
+        }
+    }
+}
+
+static Watch *find_watch(Daemon *d, const char *dir, size_t len) {
+    for (size_t i = 0; i < d->watches_len; i++) {
+        if (strlen(d->watches[i].dir) == len && strncmp(d->watches[i].dir, dir, len) == 0) return &d->watches[i];
+    }
+    return NULL;
+}
+
+// Modules read before their directory was watched may have changed in
+// between: compare them with the files once.
+static void recheck_dir(Daemon *d, const char *dir, size_t len) {
+    for (size_t i = d->store.len; i-- > 0;) {
+        if (i >= d->store.len) continue;
+        Module *m = d->store.modules[i];
+        if (!in_dir(m->real, dir, len)) continue;
+        FileBuf fb = read_whole_file(m->real);
+        int same = fb.data && fb.len == m->src.len && hash_bytes(fb.data, fb.len, HASH_SEED) == m->src_hash;
+        free_filebuf(&fb);
+        if (!same) module_store_forget(&d->store, m->real);
+    }
+}
+
+// Every kept module's directory is watched for files that are written,
+// replaced, moved or deleted. A module that cannot be watched is not kept.
+static void watch_store(Daemon *d) {
+    const char *last = NULL;
+    size_t last_len = 0;
+    for (size_t i = 0; i < d->store.len;) {
+        const char *real = d->store.modules[i]->real;
+        size_t len = dir_len(real);
+        if (last && len == last_len && strncmp(real, last, len) == 0) {
+            i++;
+            continue;
+        }
+        Watch *w = find_watch(d, real, len);
+        if (!w) {
+            char *dir = strndup(real, len);
+            int wd = dir ? inotify_add_watch(d->inotify, dir, IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM |
+                                                                   IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF |
+                                                                   IN_ONLYDIR)
+                             : -1;
+            if (wd >= 0 && d->watches_len == d->watches_cap) {
+                size_t cap = d->watches_cap ? d->watches_cap * 2 : 16;
+                Watch *ws = (Watch *)realloc(d->watches, cap * sizeof(Watch));
+                if (ws) {
+                    d->watches = ws;
+                    d->watches_cap = cap;
+                }
+            }
+            if (wd < 0 || d->watches_len == d->watches_cap) {
+                if (wd >= 0) inotify_rm_watch(d->inotify, wd);
+                if (dir) forget_dir(d, dir, len); // moves another module to i
+                else module_store_forget(&d->store, real);
+                free(dir);
+                last = NULL;
+                continue;
+            }
+            d->watches[d->watches_len++] = (Watch){ wd, dir };
+            w = &d->watches[d->watches_len - 1];
+            recheck_dir(d, w->dir, len);
+            last = NULL;
+            continue; // i may now hold another module
+        }
+        last = w->dir;
+        last_len = len;
+        i++;
+    }
+}
+
+static void drop_watch(Daemon *d, size_t i) {
+    forget_dir(d, d->watches[i].dir, strlen(d->watches[i].dir));
+    free(d->watches[i].dir);
+    d->watches[i] = d->watches[--d->watches_len];
+}
+
+static void drain_events(Daemon *d) {
+    _Alignas(struct inotify_event) char buf[4096];
+    for (;;) {
+        ssize_t n = read(d->inotify, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return; // EAGAIN: nothing more for now
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                module_store_forget(&d->store, NULL);
+                continue;
+            }
+            size_t wi = 0;
+            while (wi < d->watches_len && d->watches[wi].wd != ev->wd) wi++;
+            if (wi == d->watches_len) continue;
+            if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // the directory itself went away or moved: its paths mean nothing now
+                if (!(ev->mask & IN_IGNORED)) inotify_rm_watch(d->inotify, ev->wd);
+                drop_watch(d, wi);
+                continue;
+            }
+            if (!ev->len) continue;
+            char path[PATH_MAX];
+            const char *dir = d->watches[wi].dir;
+            if (snprintf(path, sizeof(path), "%s/%s", strcmp(dir, "/") ? dir : "", ev->name) < (int)sizeof(path)) {
+                module_store_forget(&d->store, path);
+            }
+        }
+    }
+}
+
+// ----- serving -----
+
+static volatile sig_atomic_t stopping;
+static int listen_fd = -1;
+static int client_fd = -1; // of the request being served
+
+static void on_stop(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+pid_t daemon_fork(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        if (listen_fd >= 0) close(listen_fd);
+        if (client_fd >= 0) close(client_fd);
+    }
+    return pid;
+}
+
+// what the client sent while the program runs: 1 to go on, 0 if it went away
+static int client_signal(pid_t pid) {
+    unsigned char sig;
+    ssize_t n = recv(client_fd, &sig, 1, MSG_DONTWAIT);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    if (n == 0) return 0;
+    if (sig == SIGINT || sig == SIGTERM) kill(pid, sig);
+    return 1;
+}
+
+int daemon_wait(pid_t pid, int *status) {
+    // the child's exit wakes poll through a pidfd (Linux 5.3 on);
+    // without one, look every few milliseconds
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &old);
+
+    int ok = 1;
+    for (;;) {
+        pid_t r = waitpid(pid, status, WNOHANG);
+        if (r == pid) break;
+        if (r < 0 && errno != EINTR) {
+            ok = 0;
+            break;
+        }
+        int alive = !stopping;
+        if (alive) {
+            struct pollfd pf[2] = { { client_fd, POLLIN, 0 }, { pidfd, POLLIN, 0 } };
+            struct timespec every = { 0, 5 * 1000 * 1000 };
+            if (ppoll(pf, pidfd >= 0 ? 2 : 1, pidfd >= 0 ? NULL : &every, &old) > 0) {
+                if (pf[0].revents & (POLLHUP | POLLERR)) alive = 0;
+                else if (pf[0].revents & POLLIN) alive = client_signal(pid);
+            }
+        }
+        if (!alive || stopping) {
+            // nobody is left to see the output, or the daemon is going away
+            kill(pid, SIGKILL);
+            while (waitpid(pid, status, 0) < 0 && errno == EINTR) {}
+            break;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    if (pidfd >= 0) close(pidfd);
+    return ok;
+}
+
+// Runs the request with the client's directory and stdio in place of the
+// daemon's, then puts those back.
+static int run_request(Daemon *d, const char *cwd, int argc, char **argv, const int *fds) {
+    int home = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (chdir(cwd) != 0) {
+        dprintf(fds[2], "lunar: error: the daemon cannot enter %s\n", cwd);
+        if (home >= 0) close(home);
+        return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    int saved[3];
+    for (int i = 0; i < 3; i++) {
+        saved[i] = dup(i);
+        dup2(fds[i], i);
+    }
+
+    int status = d->run(argc, argv, &d->store);
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], i);
+            close(saved[i]);
+        } else {
+            close(i);
+        }
+    }
+    clearerr(stdout);
+    clearerr(stderr);
+    if (home >= 0) {
+        if (fchdir(home) != 0) fprintf(stderr, "lunar: warning: the daemon lost its directory\n");
+        close(home);
+    }
+    return status;
+}
+
+static void serve_one(Daemon *d, int c) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(c, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != getuid()) return;
+    struct timeval tv = { 5, 0 }; // a client that connects and sends nothing
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    Request rq;
+    int fds[3] = { -1, -1, -1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { &rq, sizeof(rq) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    ssize_t n = recvmsg(c, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cm = n == (ssize_t)sizeof(rq) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS && cm->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    }
+
+    char *payload = NULL;
+    char **argv = NULL;
+    int32_t status = 1;
+    if (fds[2] < 0 || rq.magic != DAEMON_MAGIC || rq.argc == 0 || rq.argc > DAEMON_MAX_ARGS || rq.len > DAEMON_MAX_LEN) {
+        goto done;
+    }
+    payload = (char *)malloc(rq.len + 1);
+    argv = (char **)calloc(rq.argc + 1, sizeof(char *));
+    if (!payload || !argv || !read_all(c, payload, rq.len)) goto done;
+    payload[rq.len] = '\0';
+
+    // cwd, then the arguments
+    char *p = payload, *end = payload + rq.len;
+    const char *cwd = p;
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < rq.argc; i++) {
+        if (p >= end) goto done;
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+
+    drain_events(d); // whatever changed up to now
+    client_fd = c;
+    status = run_request(d, cwd, (int)rq.argc, argv, fds);
+    client_fd = -1;
+    if (d->inotify >= 0) watch_store(d);
+    else module_store_forget(&d->store, NULL);
+    write_all(c, &status, sizeof(status));
+
+done:
+    free(payload);
+    free(argv);
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+static int listen_on(const char *sock_path) {
+    struct sockaddr_un addr;
+    if (!sock_addr(&addr, sock_path)) {
+        fprintf(stderr, "%s: error: socket path too long\n", sock_path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s: error: %s\n", sock_path, strerror(errno));
+        return -1;
+    }
+    mode_t old = umask(077); // only we may connect
+    int r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (r != 0 && errno == EADDRINUSE) {
+        // left over from a daemon that did not stop cleanly, unless one answers
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (alive) {
+            umask(old);
+            fprintf(stderr, "%s: error: a daemon is already listening here\n", sock_path);
+            close(fd);
+            return -1;
+        }
+        unlink(sock_path);
+        r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    umask(old);
+    if (r != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "%s: error: %s\n", sock_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int daemon_serve(const char *sock_path, DaemonMain run) {
+    int lfd = listen_on(sock_path);
+    if (lfd < 0) return 1;
+    listen_fd = lfd;
+
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+    d.run = run;
+    d.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (d.inotify < 0) {
+        fprintf(stderr, "lunar: warning: no inotify (%s), every request starts cold\n", strerror(errno));
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop; // no SA_RESTART: poll has to return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // a client that went away
+
+    fprintf(stderr, "lunar: daemon listening on %s\n", sock_path);
+    while (!stopping) {
+        struct pollfd pf[2] = { { lfd, POLLIN, 0 }, { d.inotify, POLLIN, 0 } };
+        if (poll(pf, d.inotify >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "lunar: error: %s\n", strerror(errno));
+            break;
+        }
+        if (d.inotify >= 0 && (pf[1].revents & POLLIN)) drain_events(&d);
+        if (pf[0].revents & POLLIN) {
+            int c = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            if (c < 0) continue;
+            serve_one(&d, c);
+            close(c);
+        }
+    }
+
+    close(lfd);
+    listen_fd = -1;
+    unlink(sock_path);
+    if (d.inotify >= 0) close(d.inotify);
+    for (size_t i = 0; i < d.watches_len; i++) free(d.watches[i].dir);
+    free(d.watches);
+    module_store_free(&d.store);
+    return 0;
+}
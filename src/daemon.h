@@ -0,0 +1,46 @@
+#ifndef LUNAR_DAEMON_H
+#define LUNAR_DAEMON_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "module.h"
+
+// lunar --daemon: a compile server for edit-run loops.
+//
+// It listens on a Unix socket and runs the command line of each
+// `lunar --connect ...` client as if it had been started in the client's
+// directory, with the client's stdin, stdout and stderr (passed over the
+// socket). Modules stay parsed and compiled in a ModuleStore between
+// requests, and the directories they are in are watched with inotify:
+// a changed, moved or deleted file is forgotten, so a request only reads
+// and compiles what changed since the last one (and what imports a
+// changed interface). Programs run in a forked child, which links its
+// own copy of the kept code, so nothing they do reaches the store.
+//
+// Requests are served one at a time. The environment is the daemon's,
+// not the client's.
+
+// runs one command line; warm is the daemon's store, NULL in a client
+typedef int (*DaemonMain)(int argc, char **argv, ModuleStore *warm);
+
+// $XDG_RUNTIME_DIR/lunar.sock, else /tmp/lunar-<uid>.sock
+void daemon_socket_path(char *out, size_t cap);
+
+// Serves until SIGINT or SIGTERM; returns the exit status.
+int daemon_serve(const char *sock_path, DaemonMain run);
+
+// For run: forks the child a request's program runs in. The child gets
+// the default SIGINT, SIGTERM and SIGPIPE back and none of the daemon's
+// sockets.
+pid_t daemon_fork(void);
+
+// Waits for that child, like waitpid. A client that goes away or a
+// daemon that is stopped kills it; the client's interrupts are passed on
+// to it. returns 0 if it could not wait.
+int daemon_wait(pid_t pid, int *status);
+
+// Has the daemon run argv; returns its exit status, or -1 if no daemon
+// is listening at sock_path.
+int daemon_request(const char *sock_path, int argc, char **argv);
+
+#endif
@@ -1,15 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
 #include "diag.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 
+typedef struct {
+    Span where;
+    size_t seq; // report order, to keep the sort stable
+    size_t msg; // offset into the text buffer
+} Diag;
 
+// one collector per thread, so VMs and compiles on other threads (see
+// lunar.h) each get their own
+static _Thread_local struct {
+    int on;
+    size_t max;
+    int full;
+
+    Diag *items;
+    size_t len;
+    size_t cap;
+
+    char *text; // NUL-separated messages
+    size_t text_len;
+    size_t text_cap;
+} dq;
+
+static const char *path_or_stdin(const char *path) {
+    return path ? path : "<stdin>";
+}
+
+// whole line in one buffer so it goes out in one write; stderr is unbuffered
+static void print_now(Span where, const char *fmt, va_list ap) {
+    char line[1024];
+    int n = snprintf(line, sizeof(line), "%s:%zu:%zu: error: ", path_or_stdin(where.path), where.line, where.col);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(line)) {
+        int m = vsnprintf(line + n, sizeof(line) - (size_t)n, fmt, ap);
+        if (m > 0) n += m;
+    }
+    if ((size_t)n > sizeof(line) - 2) n = (int)sizeof(line) - 2;
+    line[n++] = '\n';
+    fwrite(line, 1, (size_t)n, stderr);
+}
+
+static int reserve_text(size_t more) {
+    if (dq.text_len + more <= dq.text_cap) return 1;
+    size_t cap = dq.text_cap ? dq.text_cap * 2 : 4096;
+    while (cap < dq.text_len + more) cap *= 2;
+    char *t = (char *)realloc(dq.text, cap);
+    if (!t) return 0;
+    dq.text = t;
+    dq.text_cap = cap;
+    return 1;
+}
+
+static void collect(Span where, const char *fmt, va_list ap) {
+    if (dq.full) return;
+
+    va_list copy;
+    va_copy(copy, ap);
+    int n = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (n < 0 || !reserve_text((size_t)n + 1)) return;
+    char *msg = dq.text + dq.text_len;
+    vsnprintf(msg, (size_t)n + 1, fmt, ap);
+
+    // the same error at the same place twice in a row is a cascade
+    if (dq.len) {
+        const Diag *last = &dq.items[dq.len - 1];
+        if (last->where.line == where.line && last->where.col == where.col && last->where.path == where.path &&
+            strcmp(dq.text + last->msg, msg) == 0) {
+            return;
+        }
+    }
+
+    if (dq.len == dq.cap) {
+        size_t cap = dq.cap ? dq.cap * 2 : 32;
+        Diag *d = (Diag *)realloc(dq.items, cap * sizeof(Diag));
+        if (!d) return;
+        dq.items = d;
+        dq.cap = cap;
+    }
+    dq.items[dq.len].where = where;
+    dq.items[dq.len].seq = dq.len;
+    dq.items[dq.len].msg = dq.text_len;
+    dq.len++;
+    dq.text_len += (size_t)n + 1;
+    if (dq.max && dq.len >= dq.max) dq.full = 1;
+}
+
+void diag_begin(size_t max_errors) {
+    dq.on = 1;
+    dq.max = max_errors;
+    dq.full = 0;
+    dq.len = 0;
+    dq.text_len = 0;
+}
+
+int diag_limit_reached(void) {
+    return dq.full;
+}
+
+static int cmp_diag(const void *a, const void *b) {
+    const Diag *x = (const Diag *)a, *y = (const Diag *)b;
+    if (x->where.path != y->where.path) {
+        int c = strcmp(path_or_stdin(x->where.path), path_or_stdin(y->where.path));
+        if (c) return c;
+    }
+    if (x->where.line != y->where.line) return x->where.line < y->where.line ? -1 : 1;
+    if (x->where.col != y->where.col) return x->where.col < y->where.col ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int same_diag(const Diag *x, const Diag *y) {
+    return x->where.line == y->where.line && x->where.col == y->where.col &&
+           strcmp(path_or_stdin(x->where.path), path_or_stdin(y->where.path)) == 0 &&
+           strcmp(dq.text + x->msg, dq.text + y->msg) == 0;
+}
+
+static void write_all(FILE *out) {
+    qsort(dq.items, dq.len, sizeof(Diag), cmp_diag);
+
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *mem = open_memstream(&buf, &size);
+    FILE *to = mem ? mem : out;
+    for (size_t i = 0; i < dq.len; i++) {
+        const Diag *d = &dq.items[i];
+        if (i && same_diag(d, &dq.items[i - 1])) continue;
+        fprintf(to, "%s:%zu:%zu: error: %s\n", path_or_stdin(d->where.path), d->where.line, d->where.col,
+                dq.text + d->msg);
+    }
+    if (dq.full) {
+        fprintf(to, "%s: too many errors, stopped after %zu (--max-errors=N changes the limit, 0 for none)\n",
+                path_or_stdin(dq.items[0].where.path), dq.len);
+    }
+    if (mem) {
+        fclose(mem);
+        fwrite(buf, 1, size, out);
+        free(buf);
+    }
+    fflush(out);
+}
+
+static void end_window(void) {
+    free(dq.items);
+    free(dq.text);
+    memset(&dq, 0, sizeof(dq));
+}
+
+void diag_flush(FILE *out) {
+    if (dq.len) write_all(out);
+    end_window();
+}
+
+char *diag_take(void) {
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *mem = dq.len ? open_memstream(&buf, &size) : NULL;
+    if (mem) {
+        write_all(mem);
+        fclose(mem);
+    } else if (dq.len) {
+        write_all(stderr);
+    }
+    end_window();
+    if (buf && !size) {
+        free(buf);
+        buf = NULL;
+    }
+    return buf;
+}
+
+void diag_verror(Span where, const char *fmt, va_list ap) {
+    if (dq.on) collect(where, fmt, ap);
+    else print_now(where, fmt, ap);
+}
 
 void diag_error(Span where, const char *fmt, ...) {
-    fprintf(stderr, "%s:%zu:%zu: error: ", where.path ? where.path : "<stdin>", where.line, where.col);
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
+    diag_verror(where, fmt, ap);
     va_end(ap);
-
-    fputc('\n', stderr);
-}
\ No newline at end of file
+}
@@ -2,6 +2,8 @@
 #define LUNAR_DIAG_H
 
 #include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 // Span of file path and a line and col in a struct literally called span lol
 
@@ -11,7 +13,22 @@ typedef struct {
     size_t col;
 } Span;
 
+#define DIAG_DEFAULT_MAX_ERRORS 20
+
+// Between diag_begin and diag_flush errors are collected instead of
+// printed; diag_flush writes them out sorted by position with exact
+// duplicates dropped, in one write. After max_errors of them (0: no
+// limit) the rest are dropped and diag_limit_reached tells the front end
+// to stop. The window is per thread; outside of it (runtime errors from
+// the lunar binary and its task threads) each error is written straight
+// to stderr.
+void diag_begin(size_t max_errors);
+void diag_flush(FILE *out);
+// like diag_flush, but returns the text (malloc'd; NULL if there was none)
+char *diag_take(void);
+int diag_limit_reached(void);
 
 void diag_error(Span where, const char *fmt, ...);
+void diag_verror(Span where, const char *fmt, va_list ap);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,271 @@
+#include "fold.h"
+#include <stdlib.h>
+
+typedef struct {
+    StrView name; // empty while an argument is being evaluated
+    int is_mut;
+    Value v;
+} Slot;
+
+typedef struct {
+    FoldEnv *env;
+    size_t steps; // left for this expression
+    size_t calls; // made outside any other call
+    Slot *slots; // allocated on the first call
+    size_t sp;
+    size_t base; // first slot of the current call
+    size_t depth;
+    Value ret;
+} Folder;
+
+typedef enum {
+    FOLD_NEXT,
+    FOLD_RETURN,
+    FOLD_FAIL,
+} FoldResult;
+
+static int step(Folder *f) {
+    if (!f->steps) return 0;
+    f->steps--;
+    return 1;
+}
+
+static int truthy(Value v, int *out) {
+    if (v.kind == VAL_BOOL) *out = v.as.b;
+    else if (v.kind == VAL_INT) *out = v.as.i != 0;
+    else return 0;
+    return 1;
+}
+
+// vm_unary and vm_binary, minus the strings and the error messages
+static int fold_unary(const Folder *f, UnaryOp op, Value v, Value *out) {
+    if (op == UOP_NEG) {
+        if (v.kind != VAL_INT || (v.as.i == INT64_MIN && !f->env->wrap_ints)) return 0;
+        *out = value_int((int64_t)(0 - (uint64_t)v.as.i));
+        return 1;
+    }
+    int truth = 0;
+    if (!truthy(v, &truth)) return 0;
+    *out = value_bool(!truth);
+    return 1;
+}
+
+static int fold_binary(const Folder *f, BinaryOp op, Value l, Value r, Value *out) {
+    if (op == BOP_EQ || op == BOP_NE) {
+        int eq = value_equal(l, r);
+        *out = value_bool(op == BOP_EQ ? eq : !eq);
+        return 1;
+    }
+    if (l.kind != VAL_INT || r.kind != VAL_INT) return 0;
+
+    int64_t a = l.as.i;
+    int64_t b = r.as.i;
+    int64_t v = 0;
+    int overflow = 0;
+    switch (op) {
+        case BOP_ADD: overflow = __builtin_add_overflow(a, b, &v); break;
+        case BOP_SUB: overflow = __builtin_sub_overflow(a, b, &v); break;
+        case BOP_MUL: overflow = __builtin_mul_overflow(a, b, &v); break;
+        case BOP_DIV:
+            if (b == 0) return 0;
+            overflow = a == INT64_MIN && b == -1;
+            v = overflow ? INT64_MIN : a / b;
+            break;
+        case BOP_LT:  *out = value_bool(a < b);  return 1;
+        case BOP_LTE: *out = value_bool(a <= b); return 1;
+        case BOP_GT:  *out = value_bool(a > b);  return 1;
+        case BOP_GTE: *out = value_bool(a >= b); return 1;
+        default: return 0;
+    }
+    if (overflow && !f->env->wrap_ints) return 0;
+    *out = value_int(v);
+    return 1;
+}
+
+static long find_slot(const Folder *f, StrView name) {
+    for (size_t i = f->sp; i > f->base; i--) {
+        if (sv_eq(f->slots[i - 1].name, name)) return (long)(i - 1);
+    }
+    return -1;
+}
+
+static int push_slot(Folder *f, StrView name, int is_mut, Value v) {
+    if (f->sp == FOLD_SLOTS) return 0;
+    f->slots[f->sp].name = name;
+    f->slots[f->sp].is_mut = is_mut;
+    f->slots[f->sp].v = v;
+    f->sp++;
+    return 1;
+}
+
+static int eval(Folder *f, const Expr *e, Value *out);
+static FoldResult exec_block(Folder *f, Stmt **stmts, size_t len);
+
+static int eval_call(Folder *f, const Expr *e, Value *out) {
+    const FoldEnv *env = f->env;
+    const Expr *callee = e->as.call.callee;
+    if (e->as.call.spawn || e->as.call.go || !callee || callee->kind != EXPR_NAME) return 0;
+    long fn = ast_find_fn(env->prog, callee->as.str);
+    if (fn < 0 || !env->cg->nodes[fn].pure) return 0;
+    const FnDecl *decl = env->prog->fns[fn];
+    size_t argc = e->as.call.args_len;
+    if (decl->params_len != argc || f->depth == FOLD_DEPTH) return 0;
+    if (!f->slots && !(f->slots = (Slot *)malloc(FOLD_SLOTS * sizeof(Slot)))) return 0;
+
+    size_t base = f->sp;
+    for (size_t i = 0; i < argc; i++) {
+        Value v;
+        if (!eval(f, e->as.call.args[i], &v) || !push_slot(f, (StrView){0}, 0, v)) {
+            f->sp = base;
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < argc; i++) {
+        f->slots[base + i].name = decl->params[i].name;
+        f->slots[base + i].is_mut = 1;
+    }
+
+    size_t saved_base = f->base;
+    f->base = base;
+    f->depth++;
+    f->ret = value_int(0);
+    FoldResult r = exec_block(f, decl->body, decl->body_len);
+    f->depth--;
+    f->base = saved_base;
+    f->sp = base;
+    if (r == FOLD_FAIL) {
+        if (!f->depth) {
+            f->env->failed[f->env->failed_next] = e;
+            f->env->failed_next = (f->env->failed_next + 1) % FOLD_FAILED;
+        }
+        return 0;
+    }
+    if (!f->depth) f->calls++;
+    *out = f->ret;
+    return 1;
+}
+
+static int eval(Folder *f, const Expr *e, Value *out) {
+    if (!e || !step(f)) return 0;
+    switch (e->kind) {
+        case EXPR_INT:
+            *out = value_int(e->as.int_val);
+            return 1;
+        case EXPR_BOOL:
+            *out = value_bool(e->as.bool_val);
+            return 1;
+        case EXPR_NAME: {
+            // outside any call the names are the compiler's
+            if (!f->depth) return f->env->name && f->env->name(f->env->ctx, e->as.str, out);
+            long slot = find_slot(f, e->as.str);
+            if (slot < 0) return 0;
+            *out = f->slots[slot].v;
+            return 1;
+        }
+        case EXPR_UNARY: {
+            Value v;
+            return eval(f, e->as.unary.rhs, &v) && fold_unary(f, e->as.unary.op, v, out);
+        }
+        case EXPR_BINARY: {
+            Value l, r;
+            return eval(f, e->as.binary.lhs, &l) && eval(f, e->as.binary.rhs, &r) &&
+                   fold_binary(f, e->as.binary.op, l, r, out);
+        }
+        case EXPR_ASSIGN: {
+            long slot = f->depth ? find_slot(f, e->as.assign.name) : -1;
+            if (slot < 0 || !f->slots[slot].is_mut) return 0;
+            Value v;
+            if (!eval(f, e->as.assign.value, &v)) return 0;
+            f->slots[slot].v = v;
+            *out = v;
+            return 1;
+        }
+        case EXPR_CALL: return eval_call(f, e, out);
+        default: return 0;
+    }
+}
+
+static FoldResult exec_stmt(Folder *f, const Stmt *s) {
+    if (!step(f)) return FOLD_FAIL;
+    Value v;
+    int truth = 0;
+    switch (s->kind) {
+        case STMT_LET:
+            if (!eval(f, s->as.let_stmt.init, &v) || !push_slot(f, s->as.let_stmt.name, s->as.let_stmt.is_mut, v)) {
+                return FOLD_FAIL;
+            }
+            return FOLD_NEXT;
+        case STMT_RETURN:
+            f->ret = value_int(0);
+            if (s->as.ret_stmt.value && !eval(f, s->as.ret_stmt.value, &f->ret)) return FOLD_FAIL;
+            return FOLD_RETURN;
+        case STMT_EXPR:
+            if (s->as.expr_stmt.expr && !eval(f, s->as.expr_stmt.expr, &v)) return FOLD_FAIL;
+            return FOLD_NEXT;
+        case STMT_IF:
+            if (!eval(f, s->as.if_stmt.cond, &v) || !truthy(v, &truth)) return FOLD_FAIL;
+            if (truth) return exec_block(f, s->as.if_stmt.then_body, s->as.if_stmt.then_len);
+            return exec_block(f, s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+        case STMT_WHILE:
+            for (;;) {
+                if (!eval(f, s->as.while_stmt.cond, &v) || !truthy(v, &truth)) return FOLD_FAIL;
+                if (!truth) return FOLD_NEXT;
+                FoldResult r = exec_block(f, s->as.while_stmt.body, s->as.while_stmt.body_len);
+                if (r != FOLD_NEXT) return r;
+            }
+    }
+    return FOLD_FAIL;
+}
+
+static FoldResult exec_block(Folder *f, Stmt **stmts, size_t len) {
+    size_t saved = f->sp;
+    for (size_t i = 0; i < len; i++) {
+        FoldResult r = exec_stmt(f, stmts[i]);
+        if (r != FOLD_NEXT) return r;
+    }
+    f->sp = saved; // drop block-scoped lets
+    return FOLD_NEXT;
+}
+
+// Cheap look before evaluating: literals, constant names, operators and
+// calls to pure functions all the way down. The compiler asks again for
+// each subexpression it emits, so this stops at FOLD_SHAPE levels.
+static int constant_shape(const FoldEnv *env, const Expr *e, size_t depth) {
+    if (!e || depth == FOLD_SHAPE) return 0;
+    Value v;
+    switch (e->kind) {
+        case EXPR_INT:
+        case EXPR_BOOL:   return 1;
+        case EXPR_NAME:   return env->name && env->name(env->ctx, e->as.str, &v);
+        case EXPR_UNARY:  return constant_shape(env, e->as.unary.rhs, depth + 1);
+        case EXPR_BINARY:
+            return constant_shape(env, e->as.binary.lhs, depth + 1) && constant_shape(env, e->as.binary.rhs, depth + 1);
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            if (!env->cg || e->as.call.spawn || e->as.call.go || !callee || callee->kind != EXPR_NAME) return 0;
+            long fn = ast_find_fn(env->prog, callee->as.str);
+            if (fn < 0 || !env->cg->nodes[fn].pure) return 0;
+            for (size_t i = 0; i < FOLD_FAILED; i++) {
+                if (env->failed[i] == e) return 0;
+            }
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (!constant_shape(env, e->as.call.args[i], depth + 1)) return 0;
+            }
+            return 1;
+        }
+        default: return 0;
+    }
+}
+
+int fold_expr(FoldEnv *env, const Expr *e, Value *out) {
+    if (!constant_shape(env, e, 0)) return 0;
+    Folder f = {0};
+    f.env = env;
+    f.steps = env->steps < FOLD_STEPS ? env->steps : FOLD_STEPS;
+    size_t limit = f.steps;
+    int ok = eval(&f, e, out);
+    env->steps -= limit - f.steps;
+    if (ok) env->calls += f.calls;
+    free(f.slots);
+    return ok;
+}
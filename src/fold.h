@@ -0,0 +1,44 @@
+#ifndef LUNAR_FOLD_H
+#define LUNAR_FOLD_H
+
+#include <stddef.h>
+#include "callgraph.h"
+#include "value.h"
+
+// Compile-time evaluation. The compiler hands its expressions here before
+// emitting them: operators on constants, and calls to pure functions (see
+// CallGraphNode) whose arguments are constants, are run by a small
+// interpreter over ints and bools with the semantics of both tiers, and
+// the result goes into the code as a literal. Anything the run would
+// report (overflow, division by zero, a wrong argument count, an unknown
+// name...) or that goes over a budget is left for run time as written.
+
+#define FOLD_STEPS  (1u << 20) // expressions and statements evaluated per folded expression...
+#define FOLD_BUDGET (1u << 22) // ...and per compiled function
+#define FOLD_DEPTH  64         // nested calls
+#define FOLD_SLOTS  4096       // arguments and locals alive at once
+#define FOLD_SHAPE  16         // deepest expression looked at before evaluating anything
+#define FOLD_FAILED 16         // calls remembered as not foldable
+
+// the value of a name the compiler knows to be constant; 0 if it is not
+typedef int (*FoldName)(void *ctx, StrView name, Value *out);
+
+typedef struct {
+    const Program *prog;
+    const CallGraph *cg;
+    int wrap_ints;
+    FoldName name;
+    void *ctx;
+    size_t steps; // FOLD_BUDGET at first; failed tries use it up too
+    size_t calls; // calls (outside any other call) in the expressions folded so far
+
+    // calls outside any other call that could not be folded, so a bigger
+    // expression around them does not run them again
+    const Expr *failed[FOLD_FAILED];
+    size_t failed_next;
+} FoldEnv;
+
+// 1 with the value of e (an int or a bool) in *out if e is constant
+int fold_expr(FoldEnv *env, const Expr *e, Value *out);
+
+#endif
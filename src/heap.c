@@ -0,0 +1,406 @@
+#include "heap.h"
+#include "map.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+// ----- sizes -----
+
+static int elem_is_ref(ValueKind k) {
+    return k == VAL_STR || k == VAL_LIST || k == VAL_MAP;
+}
+
+// bytes of the object itself (in the nursery: its footprint there)
+static size_t obj_size(const Obj *o) {
+    switch ((ObjKind)o->kind) {
+        case OBJ_LIST: return sizeof(List);
+        case OBJ_MAP:  return sizeof(Map);
+        case OBJ_STR:  return ALIGN8(sizeof(Str) + ((const Str *)o)->cap);
+    }
+    return 0;
+}
+
+static size_t ext_bytes(const Obj *o) {
+    switch ((ObjKind)o->kind) {
+        case OBJ_LIST: return list_bytes((const List *)o);
+        case OBJ_MAP:  return map_bytes((const Map *)o);
+        case OBJ_STR:  return 0;
+    }
+    return 0;
+}
+
+static void release(Obj *o) {
+    switch ((ObjKind)o->kind) {
+        case OBJ_LIST: list_release((List *)o); break;
+        case OBJ_MAP:  map_release((Map *)o); break;
+        case OBJ_STR:  break; // bytes are part of the object
+    }
+}
+
+// ----- allocation -----
+
+void heap_configure(Heap *h, const GcConfig *cfg) {
+    h->cfg = *cfg;
+}
+
+static void note_old_growth(Heap *h, size_t bytes) {
+    h->old_bytes += bytes;
+    if (h->old_bytes > h->stats.old_peak) h->stats.old_peak = h->old_bytes;
+    if (h->old_bytes >= h->next_major) h->want_gc |= GC_MAJOR;
+}
+
+static void link_old(Heap *h, Obj *o) {
+    o->gen = GEN_OLD;
+    o->next = h->old;
+    h->old = o;
+}
+
+static int nursery_ready(Heap *h) {
+    if (h->nursery) return 1;
+    if (!h->cfg.nursery_bytes) h->cfg.nursery_bytes = GC_DEFAULT_NURSERY;
+    if (h->cfg.nursery_bytes < GC_MIN_NURSERY) h->cfg.nursery_bytes = GC_MIN_NURSERY;
+    h->nursery = (char *)malloc(h->cfg.nursery_bytes);
+    if (!h->nursery) return 0;
+    h->nursery_cap = h->nursery_limit = h->cfg.nursery_bytes;
+    return 1;
+}
+
+// Never collects. When the nursery is full (or the object is large) the
+// object goes straight to the old generation and a collection is
+// requested for the next safepoint.
+static Obj *alloc_obj(Heap *h, ObjKind kind, size_t size) {
+    size = ALIGN8(size);
+    if (!h->next_major) h->next_major = GC_MIN_MAJOR;
+    h->stats.allocated += size;
+
+    Obj *o;
+    if (size <= GC_LARGE_OBJECT && nursery_ready(h) && h->nursery_limit - h->nursery_used >= size) {
+        o = (Obj *)(void *)(h->nursery + h->nursery_used);
+        h->nursery_used += size;
+        if (h->nursery_used + h->young_ext >= h->nursery_limit) h->want_gc |= GC_MINOR;
+        o->gen = GEN_YOUNG;
+        o->next = NULL;
+    } else {
+        o = (Obj *)malloc(size);
+        if (!o) return NULL;
+        link_old(h, o);
+        note_old_growth(h, size);
+        if (size <= GC_LARGE_OBJECT) h->want_gc |= GC_MINOR;
+    }
+    o->kind = kind;
+    o->marked = 0;
+    o->remembered = 0;
+    return o;
+}
+
+// buffers grow outside the nursery; count them toward the next collection
+static void note_growth(Heap *h, Obj *o, size_t before) {
+    if (o->gen == GEN_REGION) return;
+    size_t after = ext_bytes(o);
+    if (after <= before) return;
+    size_t grew = after - before;
+    h->stats.allocated += grew;
+    if (o->gen == GEN_YOUNG) {
+        h->young_ext += grew;
+        if (h->nursery_used + h->young_ext >= h->nursery_limit) h->want_gc |= GC_MINOR;
+    } else {
+        note_old_growth(h, grew);
+    }
+}
+
+List *heap_new_list(Heap *h, ValueKind elem, size_t cap) {
+    List *l = (List *)alloc_obj(h, OBJ_LIST, sizeof(List));
+    if (!l) return NULL;
+    l->elem = elem;
+    l->len = l->cap = 0;
+    l->as.raw = NULL;
+    if (elem && cap) {
+        if (!list_reserve(l, cap)) return NULL; // the husk is reclaimed like garbage
+        note_growth(h, &l->obj, 0);
+    }
+    return l;
+}
+
+Map *heap_new_map(Heap *h, ValueKind key) {
+    Map *m = (Map *)alloc_obj(h, OBJ_MAP, sizeof(Map));
+    if (!m) return NULL;
+    map_init(m, key);
+    return m;
+}
+
+Str *heap_new_str(Heap *h, size_t cap) {
+    if (cap > SIZE_MAX - sizeof(Str) - 8) return NULL;
+    Str *s = (Str *)alloc_obj(h, OBJ_STR, sizeof(Str) + cap);
+    if (!s) return NULL;
+    s->used = 0;
+    s->cap = ALIGN8(sizeof(Str) + cap) - sizeof(Str); // the padding is usable too
+    return s;
+}
+
+// ----- stores -----
+
+void heap_remember(Heap *h, Obj *o) {
+    if (h->remembered_len == h->remembered_cap) {
+        size_t cap = h->remembered_cap ? h->remembered_cap * 2 : 256;
+        Obj **r = (Obj **)realloc(h->remembered, cap * sizeof(Obj *));
+        if (!r) {
+            // cannot record it: promote everything at the next safepoint instead
+            h->want_gc |= GC_MAJOR;
+            return;
+        }
+        h->remembered = r;
+        h->remembered_cap = cap;
+    }
+    o->remembered = 1;
+    h->remembered[h->remembered_len++] = o;
+}
+
+int heap_list_push(Heap *h, List *l, Value v) {
+    size_t before = list_bytes(l);
+    if (!list_push(l, v)) return 0;
+    note_growth(h, &l->obj, before);
+    heap_barrier(h, &l->obj, v);
+    return 1;
+}
+
+int heap_list_resize(Heap *h, List *l, size_t n) {
+    size_t before = list_bytes(l);
+    if (!list_resize(l, n)) return 0;
+    note_growth(h, &l->obj, before); // new elements are never heap objects
+    return 1;
+}
+
+void heap_list_fill(Heap *h, List *l, Value v) {
+    list_fill(l, v);
+    if (l->len) heap_barrier(h, &l->obj, v);
+}
+
+int heap_map_set(Heap *h, Map *m, Value key, Value v) {
+    size_t before = map_bytes(m);
+    if (!map_set(m, key, v)) return 0;
+    note_growth(h, &m->obj, before);
+    heap_barrier(h, &m->obj, key);
+    heap_barrier(h, &m->obj, v);
+    return 1;
+}
+
+// ----- tracing -----
+
+static void gray_push(Heap *h, Obj *o) {
+    if (h->gray_len == h->gray_cap) {
+        size_t cap = h->gray_cap ? h->gray_cap * 2 : 1024;
+        Obj **g = (Obj **)realloc(h->gray, cap * sizeof(Obj *));
+        if (!g) {
+            // a collection cannot be abandoned halfway
+            fprintf(stderr, "lunar: out of memory during garbage collection\n");
+            abort();
+        }
+        h->gray = g;
+        h->gray_cap = cap;
+    }
+    h->gray[h->gray_len++] = o;
+}
+
+static int has_refs(const Obj *o) {
+    if (o->kind == OBJ_LIST) return elem_is_ref(((const List *)o)->elem);
+    if (o->kind == OBJ_MAP) {
+        const Map *m = (const Map *)o;
+        return m->key == VAL_STR || elem_is_ref(m->val);
+    }
+    return 0;
+}
+
+typedef void (*VisitFn)(void *ctx, Value *v);
+
+static void trace(Obj *o, VisitFn visit, void *ctx) {
+    if (o->kind == OBJ_LIST) {
+        List *l = (List *)o;
+        if (!elem_is_ref(l->elem)) return;
+        for (size_t i = 0; i < l->len; i++) visit(ctx, &l->as.vals[i]);
+    } else if (o->kind == OBJ_MAP) {
+        map_each_ref((Map *)o, visit, ctx);
+    }
+}
+
+static void point_at(Value *v, Obj *from, Obj *to) {
+    if (v->kind == VAL_LIST) v->as.list = (List *)to;
+    else if (v->kind == VAL_MAP) v->as.map = (Map *)to;
+    else v->as.s.ptr = ((Str *)to)->data + (v->as.s.ptr - ((Str *)from)->data);
+}
+
+// ----- minor collection -----
+
+static Obj *promote(Heap *h, Obj *o) {
+    // strings keep only the bytes some value can see
+    size_t size = o->kind == OBJ_STR ? ALIGN8(sizeof(Str) + ((Str *)o)->used) : obj_size(o);
+    Obj *copy = (Obj *)malloc(size);
+    if (!copy) {
+        fprintf(stderr, "lunar: out of memory during garbage collection\n");
+        abort();
+    }
+    memcpy(copy, o, o->kind == OBJ_STR ? sizeof(Str) + ((Str *)o)->used : size);
+    if (o->kind == OBJ_STR) ((Str *)copy)->cap = size - sizeof(Str);
+    copy->marked = 0;
+    copy->remembered = 0;
+    link_old(h, copy);
+
+    size_t moved = size + ext_bytes(copy);
+    h->stats.promoted += moved;
+    note_old_growth(h, moved);
+
+    o->gen = GEN_FORWARDED;
+    o->next = copy;
+    if (has_refs(copy)) gray_push(h, copy);
+    return copy;
+}
+
+static void evacuate(void *ctx, Value *v) {
+    if (!value_is_obj(*v)) return;
+    Obj *o = value_obj(*v);
+    if (o->gen != GEN_YOUNG && o->gen != GEN_FORWARDED) return;
+    Obj *to = o->gen == GEN_FORWARDED ? o->next : promote((Heap *)ctx, o);
+    point_at(v, o, to);
+}
+
+// Everything reachable in the nursery is promoted: there is no survivor
+// space, so one collection is enough to tell short-lived data apart.
+static void minor(Heap *h, const HeapRoots *roots, size_t n) {
+    for (size_t r = 0; r < n; r++) {
+        for (size_t i = 0; i < roots[r].len; i++) evacuate(h, &roots[r].vals[i]);
+    }
+    for (size_t i = 0; i < h->remembered_len; i++) {
+        Obj *o = h->remembered[i];
+        o->remembered = 0;
+        trace(o, evacuate, h);
+    }
+    h->remembered_len = 0;
+    while (h->gray_len) trace(h->gray[--h->gray_len], evacuate, h);
+
+    // the dead stay behind; only their buffers need freeing
+    size_t off = 0;
+    while (off < h->nursery_used) {
+        Obj *o = (Obj *)(void *)(h->nursery + off);
+        off += obj_size(o);
+        if (o->gen != GEN_FORWARDED) release(o);
+    }
+    h->nursery_used = 0;
+    h->young_ext = 0;
+    h->stats.minor++;
+}
+
+// ----- major collection -----
+
+static void mark(void *ctx, Value *v) {
+    if (!value_is_obj(*v)) return;
+    Obj *o = value_obj(*v);
+    if (o->marked || o->gen == GEN_REGION) return;
+    o->marked = 1;
+    if (has_refs(o)) gray_push((Heap *)ctx, o);
+}
+
+static void major(Heap *h, const HeapRoots *roots, size_t n) {
+    minor(h, roots, n); // afterwards every object is old
+
+    for (size_t r = 0; r < n; r++) {
+        for (size_t i = 0; i < roots[r].len; i++) mark(h, &roots[r].vals[i]);
+    }
+    while (h->gray_len) trace(h->gray[--h->gray_len], mark, h);
+
+    size_t live = 0;
+    Obj **link = &h->old;
+    while (*link) {
+        Obj *o = *link;
+        if (o->marked) {
+            o->marked = 0;
+            live += obj_size(o) + ext_bytes(o);
+            link = &o->next;
+        } else {
+            *link = o->next;
+            release(o);
+            free(o);
+        }
+    }
+    if (h->old_bytes > live) h->stats.freed += h->old_bytes - live;
+    h->old_bytes = live;
+    h->next_major = live * 2 > GC_MIN_MAJOR ? live * 2 : GC_MIN_MAJOR;
+    h->stats.major++;
+}
+
+int heap_collect(Heap *h, const HeapRoots *roots, size_t n) {
+    int want = h->want_gc;
+    h->want_gc = 0;
+    if (!want) return 1;
+
+    uint64_t t0 = monotonic_ns();
+    if (want & GC_MAJOR) major(h, roots, n);
+    else minor(h, roots, n);
+    uint64_t pause = monotonic_ns() - t0;
+
+    h->stats.pause_total_ns += pause;
+    if (pause > h->stats.pause_max_ns) h->stats.pause_max_ns = pause;
+
+    // minor pauses scale with what survives, so a smaller nursery bounds them
+    uint64_t target = h->cfg.pause_target_ns;
+    if (target && !(want & GC_MAJOR)) {
+        if (pause > target && h->nursery_limit / 2 >= GC_MIN_NURSERY) h->nursery_limit /= 2;
+        else if (pause < target / 4 && h->nursery_limit < h->nursery_cap) h->nursery_limit *= 2;
+    }
+
+    if (h->old_bytes >= h->next_major) h->want_gc |= GC_MAJOR;
+    return !(want & GC_MAJOR) || !h->cfg.heap_max || h->old_bytes <= h->cfg.heap_max;
+}
+
+void heap_print_stats(const Heap *h, FILE *out) {
+    const GcStats *st = &h->stats;
+    size_t n = st->minor + st->major;
+    fprintf(out, "gc:\n");
+    fprintf(out, "  collections:     %zu minor, %zu major\n", st->minor, st->major);
+    fprintf(out, "  pause total:     %.3f ms\n", (double)st->pause_total_ns / 1e6);
+    fprintf(out, "  pause max:       %.3f ms\n", (double)st->pause_max_ns / 1e6);
+    fprintf(out, "  pause avg:       %.3f ms\n", n ? (double)st->pause_total_ns / 1e6 / (double)n : 0.0);
+    fprintf(out, "  allocated:       %.1f MB\n", (double)st->allocated / 1048576.0);
+    fprintf(out, "  promoted:        %.1f MB\n", (double)st->promoted / 1048576.0);
+    fprintf(out, "  freed (old gen): %.1f MB\n", (double)st->freed / 1048576.0);
+    fprintf(out, "  old gen peak:    %.1f MB\n", (double)st->old_peak / 1048576.0);
+    fprintf(out, "  nursery:         %zu KB (limit %zu KB)\n", h->nursery_cap >> 10, h->nursery_limit >> 10);
+}
+
+static void release_all(Heap *h) {
+    size_t off = 0;
+    while (off < h->nursery_used) {
+        Obj *o = (Obj *)(void *)(h->nursery + off);
+        off += obj_size(o);
+        if (o->gen != GEN_FORWARDED) release(o);
+    }
+    Obj *o = h->old;
+    while (o) {
+        Obj *next = o->next;
+        release(o);
+        free(o);
+        o = next;
+    }
+}
+
+void heap_reset(Heap *h) {
+    release_all(h);
+    h->nursery_used = 0;
+    h->young_ext = 0;
+    h->old = NULL;
+    h->old_bytes = 0;
+    h->next_major = 0;
+    h->remembered_len = 0;
+    h->gray_len = 0;
+    h->want_gc = 0;
+}
+
+void heap_free(Heap *h) {
+    release_all(h);
+    free(h->nursery);
+    free(h->remembered);
+    free(h->gray);
+    GcConfig cfg = h->cfg;
+    memset(h, 0, sizeof(*h));
+    h->cfg = cfg;
+}
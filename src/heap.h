@@ -0,0 +1,133 @@
+#ifndef LUNAR_HEAP_H
+#define LUNAR_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "value.h"
+#include "list.h"
+
+// Program data: strings, lists and maps. Generational and precise.
+//
+// New objects are bump-allocated in the nursery. A minor collection
+// copies the survivors out into the old generation (malloc'd, one block
+// per object) and resets the nursery in one go; a major collection
+// marks from the roots and sweeps the old generation. Element and slot
+// buffers of lists and maps are malloc'd on their own and never move.
+//
+// Collections never start inside an allocation: the allocator only sets
+// want_gc, and the VM collects at its next safepoint (calls and loop
+// back-edges), where every live value is on the VM stack. So C code may
+// hold object pointers across allocations, just not across a safepoint.
+//
+// Old objects that get a nursery pointer stored into them are recorded
+// by the write barrier, so every store into a list or map goes through
+// the heap_* wrappers below.
+
+#define GC_DEFAULT_NURSERY (4u << 20)
+#define GC_MIN_NURSERY     (64u << 10)
+#define GC_MIN_MAJOR       (16u << 20) // no major collection below this much old data
+#define GC_LARGE_OBJECT    (16u << 10) // bigger objects go straight to the old generation
+
+enum {
+    GC_MINOR = 1,
+    GC_MAJOR = 2,
+};
+
+typedef struct {
+    size_t nursery_bytes;     // 0 = GC_DEFAULT_NURSERY
+    size_t heap_max;          // live bytes allowed after a major collection; 0 = no limit
+    uint64_t pause_target_ns; // minor pauses above this shrink the nursery; 0 = fixed size
+} GcConfig;
+
+typedef struct {
+    size_t minor;
+    size_t major;
+    uint64_t pause_total_ns;
+    uint64_t pause_max_ns;
+    size_t allocated; // bytes, objects and buffers
+    size_t promoted;  // bytes moved (or handed) to the old generation by minor GCs
+    size_t freed;     // old-generation bytes reclaimed by major GCs
+    size_t old_peak;
+} GcStats;
+
+typedef struct {
+    GcConfig cfg;
+
+    char *nursery;        // allocated on first use
+    size_t nursery_cap;
+    size_t nursery_limit; // bump limit; below cap while pauses run long
+    size_t nursery_used;
+    size_t young_ext;     // buffer bytes owned by nursery objects
+
+    Obj *old;             // most recent first
+    size_t old_bytes;     // objects plus their buffers, as last counted
+    size_t next_major;
+
+    Obj **remembered;     // old objects that may point into the nursery
+    size_t remembered_len;
+    size_t remembered_cap;
+
+    Obj **gray;           // tracing worklist
+    size_t gray_len;
+    size_t gray_cap;
+
+    int want_gc;          // GC_MINOR / GC_MAJOR bits, checked at safepoints
+    GcStats stats;
+} Heap;
+
+// optional; call before the first allocation
+void heap_configure(Heap *h, const GcConfig *cfg);
+
+// elem may be 0 (type decided by the first element); cap is a hint
+List *heap_new_list(Heap *h, ValueKind elem, size_t cap);
+
+// key may be 0 (decided by the first insert)
+Map *heap_new_map(Heap *h, ValueKind key);
+
+// room for cap bytes, none used yet
+Str *heap_new_str(Heap *h, size_t cap);
+
+// a run of root values, e.g. a VM stack
+typedef struct {
+    Value *vals;
+    size_t len;
+} HeapRoots;
+
+// Collects as requested by want_gc. The n runs of roots hold every value
+// the mutator can still reach; they are updated in place when objects
+// move. Returns 0 if live data exceeds cfg.heap_max after a major
+// collection.
+int heap_collect(Heap *h, const HeapRoots *roots, size_t n);
+
+void heap_print_stats(const Heap *h, FILE *out);
+
+void heap_free(Heap *h);
+
+// frees every object but keeps the nursery and the GC's own buffers, for
+// a VM that starts another run (see vm_reset); statistics carry on
+void heap_reset(Heap *h);
+
+// ----- write barrier -----
+
+void heap_remember(Heap *h, Obj *o);
+
+static inline void heap_barrier(Heap *h, Obj *o, Value v) {
+    if (o->gen == GEN_OLD && !o->remembered && value_is_obj(v) && value_obj(v)->gen == GEN_YOUNG) {
+        heap_remember(h, o);
+    }
+}
+
+// stores into containers; the element must already be accepted.
+// the allocating ones return 0 when out of memory.
+static inline void heap_list_set(Heap *h, List *l, size_t i, Value v) {
+    list_set(l, i, v);
+    heap_barrier(h, &l->obj, v);
+}
+
+int heap_list_push(Heap *h, List *l, Value v);
+int heap_list_resize(Heap *h, List *l, size_t n);
+void heap_list_fill(Heap *h, List *l, Value v);
+int heap_map_set(Heap *h, Map *m, Value key, Value v);
+
+#endif
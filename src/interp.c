@@ -0,0 +1,344 @@
+#include "interp.h"
+#include "builtins.h"
+#include "coro.h"
+#include "task.h"
+
+typedef enum {
+    EXEC_NEXT = 0,
+    EXEC_RETURN,
+    EXEC_TAIL, // the frame now belongs to w->fn: start its body over
+    EXEC_ERROR,
+} ExecResult;
+
+typedef struct {
+    Vm *vm;
+    size_t fn;
+    size_t base;
+    Value ret;
+    int tail; // set by a `return f(...)` that reused the frame
+} Walker;
+
+static int eval(Walker *w, const Expr *e, Value *out);
+static ExecResult exec_block(Walker *w, Stmt **stmts, size_t len);
+
+static int push_local(Walker *w, StrView name, int is_mut, Value v, Span sp) {
+    Vm *vm = w->vm;
+    if (vm->sp >= VM_STACK_MAX) return vm_error(vm, sp, "stack overflow");
+    vm->stack[vm->sp] = v;
+    vm->binds[vm->sp].name = name;
+    vm->binds[vm->sp].is_mut = is_mut;
+    vm->sp++;
+    return 1;
+}
+
+// A value held in a C local does not survive a collection: anything the
+// walker still needs while evaluating a later operand (which may call, and
+// so reach a safepoint) is parked on the stack and read back afterwards.
+static int hold(Walker *w, Value v, Span sp) {
+    return push_local(w, (StrView){0}, 0, v, sp);
+}
+
+static Value unhold(Walker *w) {
+    return w->vm->stack[--w->vm->sp];
+}
+
+static long find_local(Walker *w, StrView name) {
+    Vm *vm = w->vm;
+    for (size_t i = vm->sp; i > w->base; i--) {
+        if (sv_eq(vm->binds[i - 1].name, name)) return (long)(i - 1);
+    }
+    return -1;
+}
+
+// --pgo-gen: counts what compiled code counts with OP_COUNT(_BRANCH)
+static void count_site(Vm *vm, const void *node, int which) {
+    long site = pgo_site(vm->tier.pgo, node);
+    if (site >= 0) pgo_count(vm->tier.pgo, (size_t)site, which);
+}
+
+// tail: e is what a return statement returns
+static int eval_call(Walker *w, const Expr *e, Value *out, int tail) {
+    Vm *vm = w->vm;
+    const Expr *callee = e->as.call.callee;
+    if (!callee || callee->kind != EXPR_NAME) {
+        return vm_error(vm, e->span, "only named functions can be called");
+    }
+
+    long fn = ast_find_fn(vm->prog, callee->as.str);
+    int bi = fn < 0 ? builtin_find(callee->as.str) : -1;
+    if (fn < 0 && bi < 0) {
+        return vm_error(vm, callee->span, "call to undefined function '%.*s'",
+                        (int)callee->as.str.len, callee->as.str.ptr);
+    }
+    if ((e->as.call.spawn || e->as.call.go) && fn < 0) {
+        return vm_error(vm, callee->span, "cannot %s builtin '%.*s'", e->as.call.go ? "go" : "spawn",
+                        (int)callee->as.str.len, callee->as.str.ptr);
+    }
+
+    // arguments go straight onto the stack; unnamed slots never match a lookup
+    const Builtin *b = bi >= 0 ? builtin_get(bi) : NULL;
+    size_t argc = e->as.call.args_len;
+    for (size_t i = 0; i < argc; i++) {
+        const Expr *a = e->as.call.args[i];
+        Value v;
+        if (b && b->fn_arg == (int)i + 1 && a->kind == EXPR_NAME && find_local(w, a->as.str) < 0 &&
+            ast_find_fn(vm->prog, a->as.str) >= 0) {
+            v = value_str(a->as.str);
+        } else if (!eval(w, a, &v)) {
+            return 0;
+        }
+        if (!push_local(w, (StrView){0}, 0, v, e->span)) return 0;
+    }
+
+    if (fn >= 0) {
+        if (vm->tier.pgo_gen) count_site(vm, e, 0);
+        size_t want = vm->prog->fns[fn]->params_len;
+        if (want != argc) {
+            vm->sp -= argc;
+            return vm_error(vm, e->span, "'%.*s' expects %zu argument(s), got %zu",
+                            (int)callee->as.str.len, callee->as.str.ptr, want, argc);
+        }
+        if (e->as.call.spawn || e->as.call.go) {
+            int ok = e->as.call.go ? coro_go(vm, (size_t)fn, argc, e->span, out)
+                                   : task_spawn(vm, (size_t)fn, argc, e->span, out);
+            vm->sp -= argc;
+            return ok;
+        }
+        if (tail) {
+            if (!vm_walk_tail_call(vm, (size_t)fn, argc, e->span, out, &w->tail)) return 0;
+            if (w->tail) w->fn = (size_t)fn;
+            return 1;
+        }
+        return vm_call(vm, (size_t)fn, argc, e->span, out);
+    }
+
+    if (b->arity != argc) {
+        vm->sp -= argc;
+        return vm_error(vm, e->span, "'%s' expects %zu argument(s), got %zu", b->name, b->arity, argc);
+    }
+    int ok = b->fn(vm, &vm->stack[vm->sp - argc], argc, e->span, out);
+    vm->sp -= argc;
+    if (ok && vm->prof_pending) prof_sample(vm, e->span);
+    return ok;
+}
+
+static int eval(Walker *w, const Expr *e, Value *out) {
+    Vm *vm = w->vm;
+
+    switch (e->kind) {
+        case EXPR_INT:
+            *out = value_int(e->as.int_val);
+            return 1;
+
+        case EXPR_STRING:
+            *out = value_str(e->as.str);
+            return 1;
+
+        case EXPR_BOOL:
+            *out = value_bool(e->as.bool_val);
+            return 1;
+
+        case EXPR_NAME: {
+            long slot = find_local(w, e->as.str);
+            if (slot < 0) {
+                return vm_error(vm, e->span, "undefined variable '%.*s'",
+                                (int)e->as.str.len, e->as.str.ptr);
+            }
+            *out = vm->stack[slot];
+            return 1;
+        }
+
+        case EXPR_UNARY: {
+            Value v;
+            if (!eval(w, e->as.unary.rhs, &v)) return 0;
+            return vm_unary(vm, e->as.unary.op, v, e->span, out);
+        }
+
+        case EXPR_BINARY: {
+            Value l, r;
+            if (!eval(w, e->as.binary.lhs, &l)) return 0;
+            if (!hold(w, l, e->span)) return 0;
+            if (!eval(w, e->as.binary.rhs, &r)) return 0;
+            l = unhold(w);
+            return vm_binary(vm, e->as.binary.op, l, r, e->span, out);
+        }
+
+        case EXPR_ASSIGN: {
+            long slot = find_local(w, e->as.assign.name);
+            if (slot < 0) {
+                return vm_error(vm, e->span, "undefined variable '%.*s'",
+                                (int)e->as.assign.name.len, e->as.assign.name.ptr);
+            }
+            if (!vm->binds[slot].is_mut) {
+                return vm_error(vm, e->span, "cannot assign to immutable '%.*s' (declare it with 'let mut')",
+                                (int)e->as.assign.name.len, e->as.assign.name.ptr);
+            }
+            Value v;
+            if (!eval(w, e->as.assign.value, &v)) return 0;
+            vm->stack[slot] = v;
+            *out = v;
+            return 1;
+        }
+
+        case EXPR_CALL:
+            return eval_call(w, e, out, 0);
+
+        case EXPR_LIST: {
+            // items are staged on the stack like call arguments
+            size_t n = e->as.list.items_len;
+            for (size_t i = 0; i < n; i++) {
+                Value v;
+                if (!eval(w, e->as.list.items[i], &v)) return 0;
+                if (!push_local(w, (StrView){0}, 0, v, e->span)) return 0;
+            }
+            ValueKind elem = value_list_elem_for_type(e->as.list.type_name);
+            int ok = vm_new_list(vm, elem, &vm->stack[vm->sp - n], n, e->span, out);
+            vm->sp -= n;
+            return ok;
+        }
+
+        case EXPR_MAP: {
+            size_t n = e->as.map.len;
+            for (size_t i = 0; i < n; i++) {
+                Value k, v;
+                if (!eval(w, e->as.map.keys[i], &k)) return 0;
+                if (!push_local(w, (StrView){0}, 0, k, e->span)) return 0;
+                if (!eval(w, e->as.map.values[i], &v)) return 0;
+                if (!push_local(w, (StrView){0}, 0, v, e->span)) return 0;
+            }
+            ValueKind key = value_map_key_for_type(e->as.map.type_name);
+            int ok = vm_new_map(vm, key, &vm->stack[vm->sp - 2 * n], n, e->span, out);
+            vm->sp -= 2 * n;
+            return ok;
+        }
+
+        case EXPR_INDEX: {
+            Value target, index;
+            if (!eval(w, e->as.index.target, &target)) return 0;
+            if (!hold(w, target, e->span)) return 0;
+            if (!eval(w, e->as.index.index, &index)) return 0;
+            target = unhold(w);
+            return vm_index(vm, target, index, e->span, out);
+        }
+
+        case EXPR_SET_INDEX: {
+            Value target, index, v;
+            if (!eval(w, e->as.index.target, &target)) return 0;
+            if (!hold(w, target, e->span)) return 0;
+            if (!eval(w, e->as.index.index, &index)) return 0;
+            if (!hold(w, index, e->span)) return 0;
+            if (!eval(w, e->as.index.value, &v)) return 0;
+            index = unhold(w);
+            target = unhold(w);
+            if (!vm_set_index(vm, target, index, v, e->span)) return 0;
+            *out = v;
+            return 1;
+        }
+    }
+    return vm_error(vm, e->span, "unknown expression");
+}
+
+static ExecResult exec_while(Walker *w, const Stmt *s) {
+    Vm *vm = w->vm;
+    for (;;) {
+        Value c;
+        int truth = 0;
+        if (!eval(w, s->as.while_stmt.cond, &c)) return EXEC_ERROR;
+        if (!vm_truthy(vm, c, s->as.while_stmt.cond->span, &truth)) return EXEC_ERROR;
+        if (vm->tier.pgo_gen) count_site(vm, s, !truth);
+        if (!truth) return EXEC_NEXT;
+
+        ExecResult r = exec_block(w, s->as.while_stmt.body, s->as.while_stmt.body_len);
+        if (r != EXEC_NEXT) return r;
+
+        if (!vm_safepoint(vm, s->span)) return EXEC_ERROR;
+        const LoopEntry *le = vm_loop_backedge(vm, w->fn, s);
+        if (le && le->live_locals == vm->sp - w->base) {
+            // finish the rest of this call in bytecode
+            return vm_enter_osr(vm, le, &w->ret) ? EXEC_RETURN : EXEC_ERROR;
+        }
+    }
+}
+
+static ExecResult exec_stmt(Walker *w, const Stmt *s) {
+    Vm *vm = w->vm;
+
+    switch (s->kind) {
+        case STMT_LET: {
+            Value v;
+            if (!s->as.let_stmt.init) {
+                vm_error(vm, s->span, "'let' requires an initializer");
+                return EXEC_ERROR;
+            }
+            if (!eval(w, s->as.let_stmt.init, &v)) return EXEC_ERROR;
+            if (!push_local(w, s->as.let_stmt.name, s->as.let_stmt.is_mut, v, s->span)) return EXEC_ERROR;
+            return EXEC_NEXT;
+        }
+
+        case STMT_RETURN: {
+            const Expr *v = s->as.ret_stmt.value;
+            w->ret = value_int(0);
+            if (v && !(v->kind == EXPR_CALL ? eval_call(w, v, &w->ret, 1) : eval(w, v, &w->ret))) return EXEC_ERROR;
+            return w->tail ? EXEC_TAIL : EXEC_RETURN;
+        }
+
+        case STMT_EXPR: {
+            Value v;
+            if (!s->as.expr_stmt.expr) return EXEC_NEXT;
+            return eval(w, s->as.expr_stmt.expr, &v) ? EXEC_NEXT : EXEC_ERROR;
+        }
+
+        case STMT_IF: {
+            Value c;
+            int truth = 0;
+            if (!eval(w, s->as.if_stmt.cond, &c)) return EXEC_ERROR;
+            if (!vm_truthy(vm, c, s->as.if_stmt.cond->span, &truth)) return EXEC_ERROR;
+            if (vm->tier.pgo_gen) count_site(vm, s, !truth);
+            if (truth) return exec_block(w, s->as.if_stmt.then_body, s->as.if_stmt.then_len);
+            return exec_block(w, s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+        }
+
+        case STMT_WHILE:
+            return exec_while(w, s);
+    }
+    vm_error(vm, s->span, "unknown statement");
+    return EXEC_ERROR;
+}
+
+static ExecResult exec_block(Walker *w, Stmt **stmts, size_t len) {
+    size_t saved = w->vm->sp;
+    for (size_t i = 0; i < len; i++) {
+        ExecResult r = exec_stmt(w, stmts[i]);
+        if (r != EXEC_NEXT) return r;
+    }
+    w->vm->sp = saved; // drop block-scoped lets
+    return EXEC_NEXT;
+}
+
+int interp_call(Vm *vm, size_t fn, size_t base, Value *out) {
+    if (vm->walk_depth >= vm->walk_max) return vm_error(vm, vm->fns[fn].decl->span, "stack overflow");
+    vm->walk_depth++;
+
+    Walker w;
+    w.vm = vm;
+    w.fn = fn;
+    w.base = base;
+
+    ExecResult r;
+    do {
+        // a tail call replaced the function and its arguments
+        FnDecl *decl = vm->fns[w.fn].decl;
+        for (size_t i = 0; i < decl->params_len; i++) {
+            vm->binds[base + i].name = decl->params[i].name;
+            vm->binds[base + i].is_mut = 1;
+        }
+        w.ret = value_int(0);
+        w.tail = 0;
+        r = exec_block(&w, decl->body, decl->body_len);
+    } while (r == EXEC_TAIL);
+    vm->walk_depth--;
+    if (r == EXEC_ERROR) return 0;
+
+    *out = w.ret;
+    return 1;
+}
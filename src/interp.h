@@ -0,0 +1,12 @@
+#ifndef LUNAR_INTERP_H
+#define LUNAR_INTERP_H
+
+#include "vm.h"
+
+// Tier 0: walks the FnDecl body directly. Locals are pushed on the VM
+// stack in declaration order, so a hot loop can hand its frame over to
+// the bytecode tier as-is.
+// params are the argc values at vm->stack[base..]. returns 1 on success.
+int interp_call(Vm *vm, size_t fn, size_t base, Value *out);
+
+#endif
@@ -110,27 +110,44 @@ static TokenKind keyword_or_ident(const char *s, size_t n) {
     KW("return", TOK_KW_RETURN);
     KW("true",   TOK_KW_TRUE);
     KW("false",  TOK_KW_FALSE);
+    KW("spawn",  TOK_KW_SPAWN);
+    KW("go",     TOK_KW_GO);
+    KW("import", TOK_KW_IMPORT);
 
     #undef KW
     return TOK_IDENT;
 }
 
+static void lex_error(Lexer *lx, Span sp, const char *fmt, ...) {
+    lx->had_error = 1;
+    lx->errors++;
+    va_list ap;
+    va_start(ap, fmt);
+    diag_verror(sp, fmt, ap);
+    va_end(ap);
+}
+
 static Token lex_string(Lexer *lx, Span sp) {
     // assumes opening " was already consumed
     const char *start = &lx->src[lx->i];
     size_t begin = lx->i;
 
     while (peek(lx) != '\0' && peek(lx) != '"') {
+        Span esc = span_here(lx);
         char c = advance(lx);
         if (c == '\\') {
-            // v0: accept escape sequences loosely (do not interpret yet)
-            if (peek(lx) != '\0') advance(lx);
+            // only checked here; the parser decodes them (see string_literal)
+            char e = peek(lx);
+            if (e == '\0') continue;
+            advance(lx);
+            if (!strchr("ntr0\\\"", e)) {
+                lex_error(lx, esc, "unknown escape sequence '\\%c' in string literal", e);
+            }
         }
     }
 
     if (peek(lx) != '"') {
-        lx->had_error = 1;
-        diag_error(sp, "unterminated string literal");
+        lex_error(lx, sp, "unterminated string literal");
         return make_token(lx, TOK_STRING, sp, start, lx->i - begin);
     }
 
@@ -146,9 +163,10 @@ void lexer_init(Lexer *lx, const char *path, const char *src, size_t len) {
     lx->line = 1;
     lx->col = 1;
     lx->had_error = 0;
+    lx->errors = 0;
 }
 
-Token lexer_next(Lexer *lx) {
+static Token lex_token(Lexer *lx) {
     skip_whitespace_and_comments(lx);
 
     Span sp = span_here(lx);
@@ -168,19 +186,26 @@ Token lexer_next(Lexer *lx) {
         return make_token(lx, k, sp, &lx->src[begin], n);
     }
 
-    // integers
+    // integers. 2^63 itself gets through as INT64_MIN: it is only valid
+    // right after a unary minus, which the parser checks
     if (isdigit((unsigned char)c)) {
-        int64_t v = (int64_t)(c - '0');
+        uint64_t v = (uint64_t)(c - '0');
+        int too_big = 0;
         size_t begin = lx->i - 1;
 
         while (isdigit((unsigned char)peek(lx))) {
-            int digit = advance(lx) - '0';
-            // v0: naive overflow behavior
-            v = v * 10 + digit;
+            uint64_t digit = (uint64_t)(advance(lx) - '0');
+            if (v > ((uint64_t)INT64_MAX + 1 - digit) / 10) too_big = 1;
+            else v = v * 10 + digit;
         }
 
         Token t = make_token(lx, TOK_INT, sp, &lx->src[begin], lx->i - begin);
-        t.int_val = v;
+        if (too_big) {
+            lex_error(lx, sp, "integer literal '%.*s' does not fit in an int (max %lld)",
+                       (int)t.length, t.start, (long long)INT64_MAX);
+            return t;
+        }
+        t.int_val = v > (uint64_t)INT64_MAX ? INT64_MIN : (int64_t)v;
         return t;
     }
 
@@ -224,14 +249,23 @@ Token lexer_next(Lexer *lx) {
             return make_token(lx, TOK_GT, sp, start, 1);
 
         default:
-            lx->had_error = 1;
-            diag_error(sp, "unexpected character '%c' (0x%02x)",
+            lex_error(lx, sp, "unexpected character '%c' (0x%02x)",
                        (c >= 32 && c < 127) ? c : '?',
                        (unsigned char)c);
             return make_token(lx, TOK_EOF, sp, start, 0);
     }
 }
 
+// a stray character is reported and then skipped, so the parser gets
+// to see (and report on) the rest of the file rather than an early EOF
+Token lexer_next(Lexer *lx) {
+    for (;;) {
+        size_t errors = lx->errors;
+        Token t = lex_token(lx);
+        if (t.kind != TOK_EOF || lx->errors == errors || diag_limit_reached()) return t;
+    }
+}
+
 const char *token_kind_name(TokenKind k) {
     switch (k) {
         case TOK_EOF: return "EOF";
@@ -249,6 +283,9 @@ const char *token_kind_name(TokenKind k) {
         case TOK_KW_RETURN:return "KW_RETURN";
         case TOK_KW_TRUE:  return "KW_TRUE";
         case TOK_KW_FALSE: return "KW_FALSE";
+        case TOK_KW_SPAWN: return "KW_SPAWN";
+        case TOK_KW_GO: return "KW_GO";
+        case TOK_KW_IMPORT: return "KW_IMPORT";
 
         case TOK_LPAREN: return "(";
         case TOK_RPAREN: return ")";
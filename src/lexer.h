@@ -24,6 +24,9 @@ typedef enum {
     TOK_KW_RETURN,  // return (statement)
     TOK_KW_TRUE,
     TOK_KW_FALSE,
+    TOK_KW_SPAWN,   // spawn f(args): run the call as a task
+    TOK_KW_GO,      // go f(args): run the call as a coroutine
+    TOK_KW_IMPORT,  // import a.b: the functions of a/b.lr
 
     // operators & punctuation
     TOK_LPAREN,
@@ -75,6 +78,7 @@ typedef struct{
     size_t line;
     size_t col;
     int had_error;
+    size_t errors; // reported so far; the parser resyncs after each
 }Lexer;
 
 void lexer_init(Lexer *lx, const char *path, const char *src, size_t len);
@@ -0,0 +1,119 @@
+#include "list.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t elem_size(ValueKind elem) {
+    switch (elem) {
+        case VAL_INT:  return sizeof(int64_t);
+        case VAL_BOOL: return sizeof(uint8_t);
+        default:       return sizeof(Value);
+    }
+}
+
+int list_accepts(List *l, Value v) {
+    if (!l->elem) {
+        l->elem = v.kind;
+        return 1;
+    }
+    return l->elem == v.kind;
+}
+
+int list_reserve(List *l, size_t n) {
+    if (n <= l->cap) return 1;
+    size_t size = elem_size(l->elem);
+    size_t new_cap = l->cap ? l->cap * 2 : 8;
+    while (new_cap < n) new_cap *= 2;
+    if (new_cap > SIZE_MAX / size) return 0;
+
+    void *nb = realloc(l->as.raw, new_cap * size);
+    if (!nb) return 0;
+    l->as.raw = nb;
+    l->cap = new_cap;
+    return 1;
+}
+
+int list_push(List *l, Value v) {
+    if (l->len == l->cap && !list_reserve(l, l->len + 1)) return 0;
+    list_set(l, l->len++, v);
+    return 1;
+}
+
+int list_resize(List *l, size_t n) {
+    if (!list_reserve(l, n)) return 0;
+    if (n > l->len) {
+        if (l->elem == VAL_STR) {
+            Value empty = value_str((StrView){ "", 0 });
+            for (size_t i = l->len; i < n; i++) l->as.vals[i] = empty;
+        } else {
+            memset((char *)l->as.raw + l->len * elem_size(l->elem), 0, (n - l->len) * elem_size(l->elem));
+        }
+    }
+    l->len = n;
+    return 1;
+}
+
+void list_fill(List *l, Value v) {
+    switch (l->elem) {
+        case VAL_INT:  simd_fill_i64(l->as.ints, l->len, v.as.i); break;
+        case VAL_BOOL: memset(l->as.bools, v.as.b, l->len); break;
+        default:
+            for (size_t i = 0; i < l->len; i++) l->as.vals[i] = v;
+            break;
+    }
+}
+
+int list_contains(const List *l, Value v) {
+    if (v.kind != l->elem) return 0;
+    switch (l->elem) {
+        case VAL_INT:  return simd_find_i64(l->as.ints, l->len, v.as.i) < l->len;
+        case VAL_BOOL: return simd_find_u8(l->as.bools, l->len, (uint8_t)v.as.b) < l->len;
+        default:
+            for (size_t i = 0; i < l->len; i++) {
+                if (value_equal(l->as.vals[i], v)) return 1;
+            }
+            return 0;
+    }
+}
+
+int64_t list_sum(const List *l) {
+    if (l->elem == VAL_INT) return simd_sum_i64(l->as.ints, l->len);
+    if (l->elem == VAL_BOOL) return (int64_t)simd_count_u8(l->as.bools, l->len);
+    return 0;
+}
+
+int64_t list_min(const List *l) {
+    return simd_min_i64(l->as.ints, l->len);
+}
+
+int64_t list_max(const List *l) {
+    return simd_max_i64(l->as.ints, l->len);
+}
+
+int list_equal(const List *a, const List *b, const ListPair *up) {
+    if (a == b) return 1;
+    if (a->len != b->len) return 0;
+    if (!a->len) return 1;
+    if (a->elem != b->elem) return 0;
+    if (a->elem == VAL_INT || a->elem == VAL_BOOL) {
+        return memcmp(a->as.raw, b->as.raw, a->len * elem_size(a->elem)) == 0;
+    }
+    for (const ListPair *p = up; p; p = p->up) {
+        if (p->a == a && p->b == b) return 1;
+    }
+    ListPair here = { a, b, up };
+    for (size_t i = 0; i < a->len; i++) {
+        if (!value_equal_in(a->as.vals[i], b->as.vals[i], &here)) return 0;
+    }
+    return 1;
+}
+
+size_t list_bytes(const List *l) {
+    return l->cap * elem_size(l->elem);
+}
+
+void list_release(List *l) {
+    free(l->as.raw);
+    l->as.raw = NULL;
+    l->len = l->cap = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef LUNAR_LIST_H
+#define LUNAR_LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+// list[T] storage and the bulk operations behind the list builtins.
+// These only manage memory and elements; type errors are reported by the
+// callers, which know the source location.
+
+// 1 if v can be stored in l. an untyped list adopts v's kind.
+int list_accepts(List *l, Value v);
+
+// makes room for at least n elements, doubling the capacity.
+// returns 0 when out of memory.
+int list_reserve(List *l, size_t n);
+
+// v must already be accepted. returns 0 when out of memory.
+int list_push(List *l, Value v);
+
+// grows or shrinks to n elements; new ones are 0 / false / "".
+// l must be typed and hold ints, bools or strings.
+int list_resize(List *l, size_t n);
+
+static inline Value list_get(const List *l, size_t i) {
+    switch (l->elem) {
+        case VAL_INT:  return value_int(l->as.ints[i]);
+        case VAL_BOOL: return value_bool(l->as.bools[i]);
+        default:       return l->as.vals[i];
+    }
+}
+
+// v must already be accepted
+static inline void list_set(List *l, size_t i, Value v) {
+    switch (l->elem) {
+        case VAL_INT:  l->as.ints[i] = v.as.i; break;
+        case VAL_BOOL: l->as.bools[i] = (uint8_t)v.as.b; break;
+        default:       l->as.vals[i] = v; break;
+    }
+}
+
+// v must already be accepted
+void list_fill(List *l, Value v);
+
+int list_contains(const List *l, Value v);
+
+// ints: wrapping sum; bools: number of trues
+int64_t list_sum(const List *l);
+
+// int lists with len > 0 only
+int64_t list_min(const List *l);
+int64_t list_max(const List *l);
+
+// up: the lists being compared further up, NULL at the top
+int list_equal(const List *a, const List *b, const ListPair *up);
+
+// bytes of element storage currently allocated
+size_t list_bytes(const List *l);
+
+// frees the element storage, not the List itself
+void list_release(List *l);
+
+#endif
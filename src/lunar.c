@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lunar.h"
+#include "diag.h"
+#include "lexer.h"
+#include "parser.h"
+#include "str.h"
+#include "vm.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LUNAR_ARGS_INLINE 8
+
+struct LunarModule {
+    char *name;
+    char *src; // own copy: tokens, names and literals point into it
+    Arena arena;
+    Program *prog;
+    Chunk **chunks; // shared by every VM; NULL with no_compile
+    TierConfig tier;
+    GcConfig gc;
+    uint32_t threads;
+};
+
+struct LunarVm {
+    const LunarModule *mod;
+    Vm vm;
+    Value ret;   // the last result; small strings live inside it
+    char *error; // of the last call; NULL when it succeeded
+};
+
+static char *format_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return NULL;
+    char *s = (char *)malloc((size_t)n + 1);
+    if (!s) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(s, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    return s;
+}
+
+int lunar_api_version(void) {
+    return LUNAR_API_VERSION;
+}
+
+void lunar_options_init(LunarOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->max_errors = DIAG_DEFAULT_MAX_ERRORS;
+}
+
+// ----- modules -----
+
+void lunar_module_free(LunarModule *m) {
+    if (!m) return;
+    if (m->chunks) {
+        for (size_t i = 0; i < m->prog->fns_len; i++) chunk_free(m->chunks[i]);
+        free(m->chunks);
+    }
+    arena_free(&m->arena);
+    free(m->src);
+    free(m->name);
+    free(m);
+}
+
+LunarModule *lunar_compile(const char *name, const char *src, size_t len, const LunarOptions *opts, char *err,
+                           size_t err_cap) {
+    LunarOptions defaults;
+    if (!opts) {
+        lunar_options_init(&defaults);
+        opts = &defaults;
+    }
+    if (err && err_cap) err[0] = '\0';
+
+    LunarModule *m = (LunarModule *)calloc(1, sizeof(LunarModule));
+    if (!m) return NULL;
+    m->name = strdup(name ? name : "<script>");
+    m->src = (char *)malloc(len + 1);
+    if (!m->name || !m->src) {
+        lunar_module_free(m);
+        return NULL;
+    }
+    memcpy(m->src, src, len);
+    m->src[len] = '\0';
+    arena_init(&m->arena, 64 * 1024);
+
+    m->tier.mode = opts->no_compile ? TIER_INTERP : TIER_AUTO;
+    m->tier.no_inline = opts->no_inline;
+    m->tier.wrap_ints = opts->wrap_ints;
+    m->gc.nursery_bytes = opts->nursery_kb << 10;
+    m->threads = opts->threads;
+
+    Lexer lx;
+    lexer_init(&lx, m->name, m->src, len);
+    Parser p;
+    parser_init(&p, &lx, &m->arena);
+    diag_begin(opts->max_errors);
+    m->prog = parse_program(&p);
+    char *errors = diag_take();
+    if (m->prog && m->prog->imports_len && !p.had_error && !lx.had_error) {
+        const Import *imp = &m->prog->imports[0];
+        free(errors);
+        errors = format_error("%s:%zu:%zu: error: cannot import '%.*s': lunar_compile takes one source buffer\n",
+                              m->name, imp->span.line, imp->span.col, (int)imp->name.len, imp->name.ptr);
+        p.had_error = 1;
+    }
+    if (!m->prog || p.had_error || lx.had_error) {
+        if (err && err_cap) snprintf(err, err_cap, "%s", errors ? errors : "out of memory\n");
+        free(errors);
+        m->prog = NULL;
+        lunar_module_free(m);
+        return NULL;
+    }
+    free(errors);
+
+    // compiled once here instead of per VM; whatever the compiler bails
+    // on is tree-walked
+    if (!opts->no_compile) {
+        size_t compiled = 0;
+        m->chunks = (Chunk **)calloc(m->prog->fns_len ? m->prog->fns_len : 1, sizeof(Chunk *));
+        if (!m->chunks) {
+            lunar_module_free(m);
+            return NULL;
+        }
+        vm_compile_all(m->prog, &m->tier, m->chunks, &compiled);
+    }
+    return m;
+}
+
+// ----- VMs -----
+
+LunarVm *lunar_vm_new(const LunarModule *m) {
+    LunarVm *v = (LunarVm *)calloc(1, sizeof(LunarVm));
+    if (!v) return NULL;
+    v->mod = m;
+    // the VM only reads the program; tasks share it across threads the same way
+    if (!vm_init(&v->vm, m->prog, m->tier)) {
+        free(v);
+        return NULL;
+    }
+    heap_configure(&v->vm.heap, &m->gc);
+    v->vm.threads = m->threads;
+    if (m->chunks) {
+        vm_borrow_chunks(&v->vm, m->chunks);
+        // no use trying again in every VM
+        for (size_t i = 0; i < v->vm.fns_len; i++) {
+            if (!m->chunks[i]) v->vm.fns[i].no_compile = 1;
+        }
+    }
+    return v;
+}
+
+void lunar_vm_free(LunarVm *vm) {
+    if (!vm) return;
+    vm_free(&vm->vm);
+    free(vm->error);
+    free(vm);
+}
+
+int lunar_vm_set_output(LunarVm *vm, int fd) {
+    outbuf_free(&vm->vm.out);
+    return outbuf_init(&vm->vm.out, fd);
+}
+
+const char *lunar_vm_error(const LunarVm *vm) {
+    return vm->error ? vm->error : "";
+}
+
+void lunar_vm_reset(LunarVm *vm) {
+    vm->ret = value_int(0);
+    vm_reset(&vm->vm, 1);
+}
+
+static int fail(LunarVm *v, char *msg) {
+    free(v->error);
+    v->error = msg ? msg : format_error("%s: error: out of memory\n", v->mod->name);
+    return 0;
+}
+
+int lunar_call(LunarVm *v, const char *fn, const LunarValue *args, size_t argc, LunarValue *ret) {
+    const LunarModule *m = v->mod;
+    Vm *vm = &v->vm;
+    vm_reset(vm, 0);
+    free(v->error);
+    v->error = NULL;
+    v->ret = value_int(0);
+    if (ret) ret->type = LUNAR_NONE;
+
+    long idx = ast_find_fn(m->prog, (StrView){ fn, strlen(fn) });
+    if (idx < 0) return fail(v, format_error("%s: error: no function '%s'\n", m->name, fn));
+    const FnDecl *decl = m->prog->fns[idx];
+    if (argc != decl->params_len) {
+        return fail(v, format_error("%s:%zu:%zu: error: '%s' takes %zu argument(s), got %zu\n", m->name,
+                                    decl->span.line, decl->span.col, fn, decl->params_len, argc));
+    }
+
+    // no safepoint until they are on the VM stack, so the strings are safe unrooted
+    Value inline_args[LUNAR_ARGS_INLINE];
+    Value *vals = argc <= LUNAR_ARGS_INLINE ? inline_args : (Value *)malloc(argc * sizeof(Value));
+    if (!vals) return fail(v, NULL);
+    for (size_t i = 0; i < argc; i++) {
+        const LunarValue *a = &args[i];
+        int ok = 1;
+        if (a->type == LUNAR_INT) vals[i] = value_int(a->as.i);
+        else if (a->type == LUNAR_BOOL) vals[i] = value_bool(a->as.b);
+        else if (a->type == LUNAR_STRING) ok = str_from(&vm->heap, a->as.str.ptr, a->as.str.len, &vals[i]);
+        else {
+            if (vals != inline_args) free(vals);
+            return fail(v, format_error("%s: error: argument %zu of '%s' is not an int, bool or string\n",
+                                        m->name, i + 1, fn));
+        }
+        if (!ok) {
+            if (vals != inline_args) free(vals);
+            return fail(v, NULL);
+        }
+    }
+
+    diag_begin(0);
+    int ok = vm_run_fn(vm, (size_t)idx, vals, argc, &v->ret);
+    if (vals != inline_args) free(vals);
+    if (!ok) {
+        char *errors = diag_take();
+        return fail(v, errors ? errors : format_error("%s: error: '%s' failed\n", m->name, fn));
+    }
+    diag_flush(stderr); // nothing to write
+
+    if (!ret) return 1;
+    switch (v->ret.kind) {
+        case VAL_INT:
+            *ret = lunar_int(v->ret.as.i);
+            break;
+        case VAL_BOOL:
+            *ret = lunar_bool(v->ret.as.b);
+            break;
+        case VAL_STR: {
+            StrView s = value_sv(&v->ret);
+            *ret = lunar_string(s.ptr, s.len);
+            break;
+        }
+        case VAL_LIST:
+            ret->type = LUNAR_LIST;
+            break;
+        case VAL_MAP:
+            ret->type = LUNAR_MAP;
+            break;
+    }
+    return 1;
+}
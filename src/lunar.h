@@ -0,0 +1,127 @@
+#ifndef LUNAR_H
+#define LUNAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// liblunar: running Lunar code inside another program (liblunar.a or
+// liblunar.so; this header is all of the API).
+//
+// lunar_compile parses and compiles a source buffer once into a module.
+// A module never changes afterwards, so any number of VMs on any threads
+// can run it at the same time. A VM holds the state of one run (stacks,
+// GC heap, output buffer) and is used by one thread at a time; it is
+// cheap to create, and lunar_vm_reset drops everything a request left
+// behind while keeping the memory for the next one.
+//
+// Functions return 1 or a pointer on success, 0 or NULL on failure.
+// Error messages are the "file:line:col: error: ..." lines the lunar
+// binary prints, one per line.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LUNAR_API_VERSION 1
+
+#if defined(__GNUC__)
+#define LUNAR_API __attribute__((visibility("default")))
+#else
+#define LUNAR_API
+#endif
+
+typedef struct LunarModule LunarModule;
+typedef struct LunarVm LunarVm;
+
+typedef struct {
+    int no_compile;     // tree-walk everything (--tier=interp); otherwise all of it is compiled up front
+    int no_inline;      // --no-inline
+    int wrap_ints;      // --overflow=wrap
+    size_t max_errors;  // syntax errors reported before giving up (--max-errors); 0: no limit
+    uint32_t threads;   // workers for spawn (--threads); 0: one per core
+    size_t nursery_kb;  // GC nursery per VM (--gc-nursery); 0: the default
+} LunarOptions;
+
+typedef enum {
+    LUNAR_NONE = 0,
+    LUNAR_INT,
+    LUNAR_BOOL,
+    LUNAR_STRING,
+    LUNAR_LIST, // results only, and only the type: lists and maps stay inside the VM
+    LUNAR_MAP,
+} LunarType;
+
+typedef struct {
+    LunarType type;
+    union {
+        int64_t i;
+        int b;
+        struct {
+            const char *ptr;
+            size_t len;
+        } str;
+    } as;
+} LunarValue;
+
+static inline LunarValue lunar_int(int64_t i) {
+    LunarValue v;
+    v.type = LUNAR_INT;
+    v.as.i = i;
+    return v;
+}
+
+static inline LunarValue lunar_bool(int b) {
+    LunarValue v;
+    v.type = LUNAR_BOOL;
+    v.as.b = b ? 1 : 0;
+    return v;
+}
+
+// the bytes are copied into the VM when the call starts
+static inline LunarValue lunar_string(const char *ptr, size_t len) {
+    LunarValue v;
+    v.type = LUNAR_STRING;
+    v.as.str.ptr = ptr;
+    v.as.str.len = len;
+    return v;
+}
+
+// LUNAR_API_VERSION of the library, to check it against the header
+LUNAR_API int lunar_api_version(void);
+
+LUNAR_API void lunar_options_init(LunarOptions *opts);
+
+// Compiles len bytes of source; name is what error messages call the
+// file. opts may be NULL for the defaults. On failure the errors are
+// written to err (up to err_cap bytes, NUL-terminated) when it is given.
+LUNAR_API LunarModule *lunar_compile(const char *name, const char *src, size_t len, const LunarOptions *opts,
+                                     char *err, size_t err_cap);
+
+// every VM made from the module must be freed first
+LUNAR_API void lunar_module_free(LunarModule *m);
+
+LUNAR_API LunarVm *lunar_vm_new(const LunarModule *m);
+LUNAR_API void lunar_vm_free(LunarVm *vm);
+
+// where `print` writes (stdout by default)
+LUNAR_API int lunar_vm_set_output(LunarVm *vm, int fd);
+
+// Calls the module's function `fn` with argc arguments and runs it to
+// the end, like `main` in the lunar binary: coroutines and tasks it
+// started finish first. A string result points into the VM and stays
+// valid until its next lunar_call, lunar_vm_reset or lunar_vm_free. On
+// failure lunar_vm_error says why; the VM can be called again.
+LUNAR_API int lunar_call(LunarVm *vm, const char *fn, const LunarValue *args, size_t argc, LunarValue *ret);
+
+// errors of the last lunar_call, or "" after one that succeeded
+LUNAR_API const char *lunar_vm_error(const LunarVm *vm);
+
+// Frees every object the VM allocated, for the next request. Without it
+// garbage from earlier calls is only freed by the GC as usual.
+LUNAR_API void lunar_vm_reset(LunarVm *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
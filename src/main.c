@@ -1,14 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "util.h"
 #include "lexer.h"
 #include "parser.h"
 #include "ast.h"
+#include "vm.h"
+#include "cache.h"
+#include "module.h"
+#include "daemon.h"
+#include "stats.h"
 
 static void usage(const char *argv0) {
-    fprintf(stderr, "usage: %s <file.lr>\n", argv0);
+    char sock[256];
+    daemon_socket_path(sock, sizeof(sock));
+    fprintf(stderr,
+            "usage: %s [options] <file.lr>\n"
+            "options:\n"
+            "  --parse-only           parse and print a summary, do not run\n"
+            "  --check                read, parse and link the program and its imports, do not run\n"
+            "  --dump-bc              compile every function and print its bytecode\n"
+            "  --tier=auto|interp|bytecode\n"
+            "                         auto: tree-walk cold code, compile hot code (default)\n"
+            "                         interp: never compile; bytecode: compile everything up front\n"
+            "  --tier-calls=N         calls before a function is compiled (default %d)\n"
+            "  --tier-loops=N         loop back-edges before a function is compiled (default %d)\n"
+            "  --tier-stats           print tiering statistics to stderr\n"
+            "  --inline-budget=N      largest callee (in AST nodes) to inline (default %d)\n"
+            "  --no-inline            never inline calls\n"
+            "  --no-vectorize         compile element-wise list loops as plain loops\n"
+            "  --no-fold              never evaluate pure functions at compile time\n"
+            "  --opt-report           print what the optimizer did per function to stderr\n"
+            "  --overflow=trap|wrap   int overflow is a runtime error (default) or wraps around\n"
+            "  --threads=N            worker threads for spawn (default: one per core)\n"
+            "  --cache                compile each module separately, keeping interfaces and bytecode\n"
+            "                         next to the source (<file>.lri, <file>.lrc) for the next run\n"
+            "  --cache-dir=DIR        same, but keep those files in DIR (or set LUNAR_CACHE_DIR)\n"
+            "  --jobs=N               threads reading and compiling modules (default: one per core)\n"
+            "  --gc-nursery=KB        young generation size (default %u)\n"
+            "  --gc-pause=US          shrink the nursery while minor pauses exceed this (default: fixed size)\n"
+            "  --gc-heap-max=MB       fail once live data exceeds this after a full collection\n"
+            "  --gc-stats             print garbage collector statistics to stderr\n"
+            "  --time-passes          print the time each compiler pass and the run took to stderr\n"
+            "  --stats[=json]         same, plus memory use and AST node counts (as JSON: one object)\n"
+            "  --profile[=FILE]       sample where the time goes: a report on stderr, collapsed stacks\n"
+            "                         for flame graphs in FILE (default %s)\n"
+            "  --pgo-gen[=FILE]       count calls and branches while running, into FILE (default %s)\n"
+            "  --pgo-use[=FILE]       compile with the counts in FILE: inlining, branch layout, tiering\n"
+            "  --max-errors=N         stop after N syntax errors (default %d, 0: no limit)\n"
+            "  --daemon[=SOCKET]      serve --connect, keeping modules parsed and compiled in memory\n"
+            "                         (default socket %s)\n"
+            "  --connect[=SOCKET]     have the daemon run this command (here if none is listening)\n",
+            argv0, TIER_DEFAULT_CALLS, TIER_DEFAULT_LOOPS, BC_DEFAULT_INLINE_BUDGET,
+            GC_DEFAULT_NURSERY >> 10, PROF_DEFAULT_PATH, PGO_DEFAULT_PATH, DIAG_DEFAULT_MAX_ERRORS, sock);
 }
 
 static int has_lr_extension(const char *path) {
@@ -20,51 +68,352 @@ static void print_sv(StrView s) {
     fwrite(s.ptr, 1, s.len, stdout);
 }
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
+// Lexes the parsed modules once more on their own, for --time-passes:
+// parsing pulls tokens as it goes, so this is the only way to see what
+// lexing costs. Only run after a clean parse, so it reports no errors of
+// its own.
+static void lex_pass(RunStats *rs, const Build *b) {
+    size_t tokens = 0, bytes = 0;
+    uint64_t t0 = monotonic_ns();
+    for (size_t i = 0; i < b->modules_len; i++) {
+        const Module *m = b->modules[i];
+        if (!m->stats.pass[PASS_PARSE].ran) continue; // from a cache or kept
+        Lexer lx;
+        lexer_init(&lx, m->path, m->src.data, m->src.len);
+        while (lexer_next(&lx).kind != TOK_EOF) tokens++;
+        bytes += m->src.len;
+    }
+    if (!rs->pass[PASS_PARSE].ran) return; // every module came from the cache
+    stats_pass(rs, PASS_LEX, t0, bytes);
+    rs->pass[PASS_LEX].tokens = tokens;
+    rs->pass[PASS_PARSE].tokens = tokens;
+    PassStats *parse = &rs->pass[PASS_PARSE];
+    parse->ns = parse->ns > rs->pass[PASS_LEX].ns ? parse->ns - rs->pass[PASS_LEX].ns : 0;
+}
+
+static int parse_u32_opt(const char *arg, const char *prefix, uint32_t *out) {
+    size_t n = strlen(prefix);
+    if (strncmp(arg, prefix, n) != 0) return 0;
+    char *end = NULL;
+    unsigned long v = strtoul(arg + n, &end, 10);
+    if (!*(arg + n) || *end || v == 0 || v > UINT32_MAX) return -1;
+    *out = (uint32_t)v;
+    return 1;
+}
+
+// One command line. In the daemon, warm is the store it keeps modules
+// in, and the program runs in a forked child (see daemon.h).
+static int run(int argc, char **argv, ModuleStore *warm) {
+    uint64_t start_ns = monotonic_ns();
+
+    const char *path = NULL;
+    int parse_only = 0;
+    int check = 0;
+    const char *daemon_sock = NULL, *connect_sock = NULL;
+    char default_sock[256];
+    daemon_socket_path(default_sock, sizeof(default_sock));
+    int dump_bc = 0;
+    int tier_stats = 0;
+    int opt_report = 0;
+    int use_cache = 0;
+    const char *cache_dir = getenv("LUNAR_CACHE_DIR");
+    TierConfig tier = {0};
+    int gc_stats = 0;
+    uint32_t gc_nursery_kb = 0, gc_pause_us = 0, gc_heap_max_mb = 0;
+    uint32_t threads = 0;
+    uint32_t jobs = 0;
+    const char *profile_path = NULL;
+    const char *pgo_gen_path = NULL, *pgo_use_path = NULL;
+    int stats = 0;
+    StatsFormat stats_fmt = STATS_PASSES;
+    size_t max_errors = DIAG_DEFAULT_MAX_ERRORS;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        int r;
+        if (strcmp(a, "--parse-only") == 0) parse_only = 1;
+        else if (strcmp(a, "--check") == 0) check = 1;
+        else if (strcmp(a, "--daemon") == 0) daemon_sock = default_sock;
+        else if (strncmp(a, "--daemon=", 9) == 0 && a[9]) daemon_sock = a + 9;
+        else if (strcmp(a, "--connect") == 0) connect_sock = default_sock;
+        else if (strncmp(a, "--connect=", 10) == 0 && a[10]) connect_sock = a + 10;
+        else if (strcmp(a, "--dump-bc") == 0) dump_bc = 1;
+        else if (strcmp(a, "--tier-stats") == 0) tier_stats = 1;
+        else if (strcmp(a, "--opt-report") == 0) opt_report = 1;
+        else if (strcmp(a, "--no-inline") == 0) tier.no_inline = 1;
+        else if (strcmp(a, "--no-vectorize") == 0) tier.no_vectorize = 1;
+        else if (strcmp(a, "--no-fold") == 0) tier.no_fold = 1;
+        else if (strcmp(a, "--gc-stats") == 0) gc_stats = 1;
+        else if (strcmp(a, "--cache") == 0) use_cache = 1;
+        else if (strcmp(a, "--time-passes") == 0) stats = 1;
+        else if (strcmp(a, "--stats") == 0) stats = 1, stats_fmt = STATS_ALL;
+        else if (strcmp(a, "--stats=json") == 0) stats = 1, stats_fmt = STATS_JSON;
+        else if (strcmp(a, "--profile") == 0) profile_path = PROF_DEFAULT_PATH;
+        else if (strncmp(a, "--profile=", 10) == 0 && a[10]) profile_path = a + 10;
+        else if (strcmp(a, "--pgo-gen") == 0) pgo_gen_path = PGO_DEFAULT_PATH;
+        else if (strncmp(a, "--pgo-gen=", 10) == 0 && a[10]) pgo_gen_path = a + 10;
+        else if (strcmp(a, "--pgo-use") == 0) pgo_use_path = PGO_DEFAULT_PATH;
+        else if (strncmp(a, "--pgo-use=", 10) == 0 && a[10]) pgo_use_path = a + 10;
+        else if (strncmp(a, "--cache-dir=", 12) == 0) cache_dir = a + 12;
+        else if (strncmp(a, "--max-errors=", 13) == 0) {
+            // unlike the other counts, 0 is allowed: no limit
+            char *end = NULL;
+            unsigned long v = strtoul(a + 13, &end, 10);
+            if (!a[13] || *end) { usage(argv[0]); return 2; }
+            max_errors = (size_t)v;
+        }
+        else if (strcmp(a, "--overflow=trap") == 0) tier.wrap_ints = 0;
+        else if (strcmp(a, "--overflow=wrap") == 0) tier.wrap_ints = 1;
+        else if (strcmp(a, "--tier=auto") == 0) tier.mode = TIER_AUTO;
+        else if (strcmp(a, "--tier=interp") == 0) tier.mode = TIER_INTERP;
+        else if (strcmp(a, "--tier=bytecode") == 0) tier.mode = TIER_BYTECODE;
+        else if ((r = parse_u32_opt(a, "--tier-calls=", &tier.call_threshold)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--tier-loops=", &tier.loop_threshold)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--inline-budget=", &tier.inline_budget)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--threads=", &threads)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--jobs=", &jobs)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--gc-nursery=", &gc_nursery_kb)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--gc-pause=", &gc_pause_us)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if ((r = parse_u32_opt(a, "--gc-heap-max=", &gc_heap_max_mb)) != 0) {
+            if (r < 0) { usage(argv[0]); return 2; }
+        } else if (a[0] == '-' || path) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            path = a;
+        }
+    }
+
+    if (daemon_sock) {
+        if (path || warm) {
+            usage(argv[0]);
+            return 2;
+        }
+        return daemon_serve(daemon_sock, run);
+    }
+    if (connect_sock && !warm) {
+        // the daemon gets the whole command line and ignores --connect
+        int status = daemon_request(connect_sock, argc, argv);
+        if (status >= 0) return status;
+    }
+
+    if (!path) {
         usage(argv[0]);
         return 2;
     }
 
-    const char *path = argv[1];
     if (!has_lr_extension(path)) {
         fprintf(stderr, "%s: error: expected a .lr file\n", path);
         return 2;
     }
 
-    FileBuf fb = read_whole_file(path);
-    if (!fb.data) {
-        fprintf(stderr, "%s: error: failed to read file\n", path);
+    RunStats rs;
+    memset(&rs, 0, sizeof(rs));
+
+    if (pgo_gen_path && pgo_use_path) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (cache_dir && *cache_dir) use_cache = 1;
+    // profiles are matched against the parsed program, and compiled code
+    // depends on them: nothing is compiled ahead (or cached) with one
+    int pgo = pgo_gen_path || pgo_use_path;
+    if (parse_only || dump_bc || pgo) use_cache = 0;
+
+    // reads and parses the program and what it imports; with a cache also
+    // compiles it, or loads precompiled code and never parses at all
+    BuildOptions bopts = { &tier, max_errors, jobs, use_cache, cache_dir, warm };
+    Build build;
+    int built = module_build(&build, path, &bopts);
+    size_t cache_hits = 0;
+    module_stats(&build, &rs, &cache_hits);
+    if (!built) {
+        module_build_free(&build);
         return 1;
     }
+    if (stats) lex_pass(&rs, &build);
 
-    Lexer lx;
-    lexer_init(&lx, path, fb.data, fb.len);
+    Program *prog = build.prog;
+    Chunk **chunks = build.chunks;
+    build.chunks = NULL;
+    rs.prog = prog;
+    uint64_t t0;
 
-    Arena arena;
-    arena_init(&arena, 64 * 1024);
+    Pgo *profile = NULL;
+    if (pgo && !parse_only && !check) {
+        profile = pgo_new(prog);
+        size_t matched = 0;
+        if (!profile) {
+            fprintf(stderr, "%s: warning: out of memory for the profile, not using one\n", path);
+        } else if (pgo_use_path && !pgo_load(profile, pgo_use_path, &matched)) {
+            fprintf(stderr, "%s: warning: could not read a profile from %s\n", path, pgo_use_path);
+            pgo_free(profile);
+            profile = NULL;
+        } else if (pgo_use_path && !matched) {
+            fprintf(stderr, "%s: warning: %s has no counts for this program\n", path, pgo_use_path);
+        }
+        tier.pgo = profile;
+        tier.pgo_gen = profile && pgo_gen_path;
+        // recording sees every call where it is written
+        if (tier.pgo_gen) tier.no_inline = 1;
+    }
 
-    Parser p;
-    parser_init(&p, &lx, &arena);
+    if (parse_only) {
+        // basic parse summary
+        printf("parsed ok: %zu function(s)\n", prog->fns_len);
+        for (size_t i = 0; i < prog->fns_len; i++) {
+            FnDecl *fn = prog->fns[i];
+            printf("  fn ");
+            print_sv(fn->name);
+            printf(" (params=%zu) body_stmts=%zu\n", fn->params_len, fn->body_len);
+        }
+        fflush(stdout);
+        if (stats) stats_print(&rs, stats_fmt, stderr);
 
-    Program *prog = parse_program(&p);
+        module_build_free(&build);
+        return 0;
+    }
+
+    if (dump_bc) {
+        Chunk **all = (Chunk **)calloc(prog->fns_len ? prog->fns_len : 1, sizeof(Chunk *));
+        t0 = monotonic_ns();
+        if (all) vm_compile_all(prog, &tier, all, &rs.pass[PASS_COMPILE].items);
+        stats_pass(&rs, PASS_COMPILE, t0, 0);
+
+        for (size_t i = 0; all && i < prog->fns_len; i++) {
+            Chunk *c = all[i];
+            if (!c) {
+                printf("== ");
+                print_sv(prog->fns[i]->name);
+                printf(" (not compilable, stays in the tree-walker) ==\n");
+                continue;
+            }
+            bc_disassemble(stdout, c, prog->fns[i]->name);
+            chunk_free(c);
+        }
+        free(all);
+        fflush(stdout);
+        if (stats) stats_print(&rs, stats_fmt, stderr);
+
+        pgo_free(profile);
+        module_build_free(&build);
+        return 0;
+    }
 
-    if (!prog || p.had_error || lx.had_error) {
-        free_filebuf(&fb);
-        arena_free(&arena);
+    if (check) {
+        if (stats) stats_print(&rs, stats_fmt, stderr);
+        module_build_free(&build);
+        return 0;
+    }
+
+    if (warm) {
+        // the store keeps the code as compiled: the child links its own copy
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = daemon_fork();
+        if (pid != 0) {
+            int status = 0;
+            int waited = pid > 0 && daemon_wait(pid, &status);
+            if (!waited) fprintf(stderr, "%s: error: could not start the program\n", path);
+            module_build_free(&build);
+            if (!waited) return 1;
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        if (!pgo) {
+            if (!module_link_code(&build)) exit(1);
+            chunks = build.chunks;
+            build.chunks = NULL;
+        }
+    }
+
+    Vm vm;
+    if (!vm_init(&vm, prog, tier)) {
+        fprintf(stderr, "%s: error: out of memory\n", path);
+        if (chunks) {
+            for (size_t i = 0; i < prog->fns_len; i++) chunk_free(chunks[i]);
+        }
+        free(chunks);
+        pgo_free(profile);
+        module_build_free(&build);
+        if (warm) exit(1);
         return 1;
     }
+    vm.stats.start_ns = start_ns;
+    vm.threads = threads;
+    GcConfig gc = {
+        .nursery_bytes = (size_t)gc_nursery_kb << 10,
+        .heap_max = (size_t)gc_heap_max_mb << 20,
+        .pause_target_ns = (uint64_t)gc_pause_us * 1000,
+    };
+    heap_configure(&vm.heap, &gc);
+    if (chunks) vm_adopt_chunks(&vm, chunks);
+    free(chunks);
+    size_t adopted = vm.stats.compiled; // counted as compiled, but built before (or loaded)
 
-    // basic parse summary 
-    printf("parsed ok: %zu function(s)\n", prog->fns_len);
-    for (size_t i = 0; i < prog->fns_len; i++) {
-        FnDecl *fn = prog->fns[i];
-        printf("  fn ");
-        print_sv(fn->name);
-        printf(" (params=%zu) body_stmts=%zu\n", fn->params_len, fn->body_len);
+    Profile *prof = NULL;
+    if (profile_path) {
+        prof = prof_new(prog);
+        vm.prof = prof;
+        if (!prof || !prof_start(&vm)) fprintf(stderr, "%s: warning: could not start the profiler\n", path);
     }
 
-    free_filebuf(&fb);
-    arena_free(&arena);
-    return 0;
+    int64_t exit_code = 0;
+    t0 = monotonic_ns();
+    int ok = vm_run_main(&vm, &exit_code);
+    fflush(stdout);
+    stats_pass(&rs, PASS_RUN, t0, 0);
+
+    if (prof) {
+        prof_stop();
+        if (!prof_write_folded(prof, profile_path)) {
+            fprintf(stderr, "%s: warning: could not write %s\n", path, profile_path);
+        }
+        prof_report(prof, stderr);
+    }
+    if (tier.pgo_gen && !pgo_write(profile, pgo_gen_path)) {
+        fprintf(stderr, "%s: warning: could not write %s\n", path, pgo_gen_path);
+    }
+
+    if (tier_stats) {
+        vm_print_tier_stats(&vm, stderr);
+        if (use_cache || warm) fprintf(stderr, "  cache: %zu of %zu module(s) up to date\n", cache_hits, build.modules_len);
+    }
+    if (opt_report) vm_print_opt_report(&vm, stderr);
+    if (gc_stats) heap_print_stats(&vm.heap, stderr);
+    if (stats) {
+        // compiling and collecting happened during the run
+        PassStats *run = &rs.pass[PASS_RUN];
+        run->ns = run->ns > vm.stats.compile_ns ? run->ns - vm.stats.compile_ns : 0;
+        if (vm.stats.compiled > adopted || vm.stats.bailouts) {
+            rs.pass[PASS_COMPILE].ran = 1;
+            rs.pass[PASS_COMPILE].ns += vm.stats.compile_ns;
+            rs.pass[PASS_COMPILE].items += vm.stats.compiled - adopted;
+        }
+        rs.pass[PASS_GC].ran = 1;
+        rs.pass[PASS_GC].ns = vm.heap.stats.pause_total_ns;
+        rs.pass[PASS_GC].items = vm.heap.stats.minor + vm.heap.stats.major;
+        rs.heap_allocated = vm.heap.stats.allocated;
+        rs.heap_old_peak = vm.heap.stats.old_peak;
+        stats_print(&rs, stats_fmt, stderr);
+    }
+
+    vm_free(&vm);
+    prof_free(prof);
+    pgo_free(profile);
+    module_build_free(&build);
+    int code = ok ? (int)(exit_code & 0xff) : 1;
+    if (warm) exit(code); // the daemon's child, not the daemon
+    return code;
+}
+
+int main(int argc, char **argv) {
+    return run(argc, argv, NULL);
 }
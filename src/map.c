@@ -0,0 +1,316 @@
+#include "map.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    int64_t key;
+    Value val;
+} IntSlot;
+
+typedef struct {
+    Value key;     // a whole Value: small strings keep their bytes inline
+    uint64_t hash; // cached: string hashing is the expensive part of a rehash
+    Value val;
+} StrSlot;
+
+// ----- hashing -----
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hash_int(int64_t k) {
+    return mix64((uint64_t)k);
+}
+
+// 8 bytes per step; FNV-1a (util.h) is fine for cache keys but too slow here
+static uint64_t hash_str(StrView s) {
+    const char *p = s.ptr;
+    size_t n = s.len;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (uint64_t)n;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    return mix64(h ^ w);
+}
+
+// ----- control bytes -----
+// the slot's control byte is the low 7 bits of the hash; probing starts
+// at the slot picked by the remaining bits
+
+#define H2(h) ((uint8_t)((h) & 0x7f))
+#define HOME(h, mask) ((size_t)((h) >> 7) & (mask))
+
+// bit i set: ctrl byte i of the group equals h2
+static inline uint32_t group_match(const uint8_t *g, uint8_t h2) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)(const void *)g);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < MAP_GROUP; i++) bits |= (uint32_t)(g[i] == h2) << i;
+    return bits;
+#endif
+}
+
+// bit i set: slot i of the group is empty (only MAP_EMPTY has the top bit)
+static inline uint32_t group_empty(const uint8_t *g) {
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(const void *)g));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < MAP_GROUP; i++) bits |= (uint32_t)(g[i] >> 7) << i;
+    return bits;
+#endif
+}
+
+static inline void set_ctrl(Map *m, size_t i, uint8_t c) {
+    m->ctrl[i] = c;
+    // mirror the first group so a group load never wraps
+    if (i < MAP_GROUP) m->ctrl[m->cap + i] = c;
+}
+
+static size_t slot_size(ValueKind key) {
+    return key == VAL_INT ? sizeof(IntSlot) : sizeof(StrSlot);
+}
+
+static uint64_t slot_hash(const Map *m, size_t i) {
+    if (m->key == VAL_INT) return hash_int(((const IntSlot *)m->slots)[i].key);
+    return ((const StrSlot *)m->slots)[i].hash;
+}
+
+// ----- lookup -----
+
+static size_t find_int(const Map *m, int64_t key, uint64_t h) {
+    const IntSlot *slots = (const IntSlot *)m->slots;
+    size_t mask = m->cap - 1;
+    size_t pos = HOME(h, mask);
+    for (;;) {
+        const uint8_t *g = m->ctrl + pos;
+        uint32_t match = group_match(g, H2(h));
+        while (match) {
+            size_t i = (pos + (size_t)__builtin_ctz(match)) & mask;
+            if (slots[i].key == key) return i;
+            match &= match - 1;
+        }
+        // linear probing without tombstones: an empty slot ends the chain
+        if (group_empty(g)) return SIZE_MAX;
+        pos = (pos + MAP_GROUP) & mask;
+    }
+}
+
+static size_t find_str(const Map *m, StrView key, uint64_t h) {
+    const StrSlot *slots = (const StrSlot *)m->slots;
+    size_t mask = m->cap - 1;
+    size_t pos = HOME(h, mask);
+    for (;;) {
+        const uint8_t *g = m->ctrl + pos;
+        uint32_t match = group_match(g, H2(h));
+        while (match) {
+            size_t i = (pos + (size_t)__builtin_ctz(match)) & mask;
+            if (slots[i].hash == h && sv_eq(value_sv(&slots[i].key), key)) return i;
+            match &= match - 1;
+        }
+        if (group_empty(g)) return SIZE_MAX;
+        pos = (pos + MAP_GROUP) & mask;
+    }
+}
+
+static uint64_t hash_key(const Map *m, const Value *key) {
+    return m->key == VAL_INT ? hash_int(key->as.i) : hash_str(value_sv(key));
+}
+
+// keys travel by pointer: a Value copied through the stack costs a
+// store-forwarding stall per call, which showed up as a third of a lookup
+static size_t find(const Map *m, const Value *key, uint64_t h) {
+    if (m->key == VAL_INT) return find_int(m, key->as.i, h);
+    return find_str(m, value_sv(key), h);
+}
+
+// first empty slot at or after the key's home
+static size_t find_free(const Map *m, uint64_t h) {
+    size_t mask = m->cap - 1;
+    size_t pos = HOME(h, mask);
+    for (;;) {
+        uint32_t empty = group_empty(m->ctrl + pos);
+        if (empty) return (pos + (size_t)__builtin_ctz(empty)) & mask;
+        pos = (pos + MAP_GROUP) & mask;
+    }
+}
+
+// ----- public -----
+
+void map_init(Map *m, ValueKind key) {
+    m->key = key;
+    m->val = 0;
+    m->len = 0;
+    m->cap = 0;
+    m->ctrl = NULL;
+    m->slots = NULL;
+}
+
+int map_key_ok(Map *m, Value key) {
+    if (!m->key && (key.kind == VAL_INT || key.kind == VAL_STR)) m->key = key.kind;
+    return m->key == key.kind;
+}
+
+int map_val_ok(Map *m, Value v) {
+    if (!m->val) m->val = v.kind;
+    return m->val == v.kind;
+}
+
+static Value *slot_val(const Map *m, size_t i) {
+    if (m->key == VAL_INT) return &((IntSlot *)m->slots)[i].val;
+    return &((StrSlot *)m->slots)[i].val;
+}
+
+Value *map_find(const Map *m, Value key) {
+    if (!m->cap || key.kind != m->key) return NULL;
+    size_t i = find(m, &key, hash_key(m, &key));
+    return i == SIZE_MAX ? NULL : slot_val(m, i);
+}
+
+static int resize(Map *m, size_t new_cap) {
+    size_t ssize = slot_size(m->key);
+    if (new_cap > (SIZE_MAX - MAP_GROUP) / (ssize + 1)) return 0;
+    uint8_t *block = (uint8_t *)malloc(new_cap + MAP_GROUP + new_cap * ssize);
+    if (!block) return 0;
+
+    Map old = *m;
+    m->cap = new_cap;
+    m->ctrl = block;
+    m->slots = block + new_cap + MAP_GROUP;
+    memset(m->ctrl, MAP_EMPTY, new_cap + MAP_GROUP);
+
+    // walk the old table a group at a time so empty slots cost no branch,
+    // and probe the new one byte-wise: a 16-byte group load right after
+    // storing one of its bytes cannot be forwarded and stalls
+    size_t mask = new_cap - 1;
+    for (size_t g = 0; g < old.cap; g += MAP_GROUP) {
+        uint32_t full = ~group_empty(old.ctrl + g) & 0xffff;
+        while (full) {
+            size_t i = g + (size_t)__builtin_ctz(full);
+            full &= full - 1;
+            uint64_t h = slot_hash(&old, i);
+            size_t j = HOME(h, mask);
+            while (m->ctrl[j] != MAP_EMPTY) j = (j + 1) & mask;
+            set_ctrl(m, j, H2(h));
+            if (m->key == VAL_INT) ((IntSlot *)m->slots)[j] = ((const IntSlot *)old.slots)[i];
+            else ((StrSlot *)m->slots)[j] = ((const StrSlot *)old.slots)[i];
+        }
+    }
+    free(old.ctrl);
+    return 1;
+}
+
+int map_set(Map *m, Value key, Value val) {
+    uint64_t h = hash_key(m, &key);
+    if (m->cap) {
+        size_t i = find(m, &key, h);
+        if (i != SIZE_MAX) {
+            *slot_val(m, i) = val;
+            return 1;
+        }
+    }
+
+    // keep at least 1/8 of the slots empty so every probe terminates quickly
+    if (!m->cap || (m->len + 1) * 8 > m->cap * 7) {
+        if (!resize(m, m->cap ? m->cap * 2 : MAP_GROUP)) return 0;
+    }
+
+    size_t i = find_free(m, h);
+    set_ctrl(m, i, H2(h));
+    if (m->key == VAL_INT) {
+        IntSlot *s = &((IntSlot *)m->slots)[i];
+        s->key = key.as.i;
+        s->val = val;
+    } else {
+        StrSlot *s = &((StrSlot *)m->slots)[i];
+        s->key = key;
+        s->hash = h;
+        s->val = val;
+    }
+    m->len++;
+    return 1;
+}
+
+int map_remove(Map *m, Value key) {
+    if (!m->cap || key.kind != m->key) return 0;
+    size_t i = find(m, &key, hash_key(m, &key));
+    if (i == SIZE_MAX) return 0;
+
+    // backward-shift deletion: pull later entries of the same probe run
+    // into the hole so lookups never need tombstones
+    size_t mask = m->cap - 1;
+    size_t ssize = slot_size(m->key);
+    for (size_t j = (i + 1) & mask; m->ctrl[j] != MAP_EMPTY; j = (j + 1) & mask) {
+        size_t home = HOME(slot_hash(m, j), mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            set_ctrl(m, i, m->ctrl[j]);
+            memcpy((char *)m->slots + i * ssize, (const char *)m->slots + j * ssize, ssize);
+            i = j;
+        }
+    }
+    set_ctrl(m, i, MAP_EMPTY);
+    m->len--;
+    return 1;
+}
+
+int map_next(const Map *m, size_t *it, Value *key, Value *val) {
+    for (size_t i = *it; i < m->cap; i++) {
+        if (m->ctrl[i] == MAP_EMPTY) continue;
+        if (m->key == VAL_INT) {
+            const IntSlot *s = &((const IntSlot *)m->slots)[i];
+            *key = value_int(s->key);
+            *val = s->val;
+        } else {
+            const StrSlot *s = &((const StrSlot *)m->slots)[i];
+            *key = s->key;
+            *val = s->val;
+        }
+        *it = i + 1;
+        return 1;
+    }
+    *it = m->cap;
+    return 0;
+}
+
+size_t map_bytes(const Map *m) {
+    return m->cap ? m->cap + MAP_GROUP + m->cap * slot_size(m->key) : 0;
+}
+
+void map_each_ref(Map *m, void (*visit)(void *ctx, Value *v), void *ctx) {
+    int vals = m->val == VAL_STR || m->val == VAL_LIST || m->val == VAL_MAP;
+    if (m->key != VAL_STR && !vals) return;
+    for (size_t i = 0; i < m->cap; i++) {
+        if (m->ctrl[i] == MAP_EMPTY) continue;
+        if (m->key == VAL_INT) {
+            visit(ctx, &((IntSlot *)m->slots)[i].val);
+            continue;
+        }
+        StrSlot *s = &((StrSlot *)m->slots)[i];
+        visit(ctx, &s->key);
+        if (vals) visit(ctx, &s->val);
+    }
+}
+
+void map_release(Map *m) {
+    free(m->ctrl);
+    map_init(m, m->key);
+}
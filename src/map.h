@@ -0,0 +1,55 @@
+#ifndef LUNAR_MAP_H
+#define LUNAR_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+// map[K] storage, Swiss-table style.
+//
+// Every slot has a control byte: MAP_EMPTY, or the low 7 bits of the
+// key's hash when full. Lookups compare 16 control bytes at once (SSE2
+// where available) and only touch slots whose byte matches. Probing is
+// linear, so deletion shifts later entries back instead of leaving
+// tombstones. Keys sit inline in the slots: int keys next to their
+// value, string keys together with their cached hash.
+//
+// Like list.h, these only manage storage; the VM reports type errors.
+
+#define MAP_GROUP 16
+#define MAP_EMPTY 0x80
+
+// key: VAL_INT, VAL_STR or 0 (decided by the first insert)
+void map_init(Map *m, ValueKind key);
+
+// 1 if key can be used with m; an untyped map adopts int/string keys
+int map_key_ok(Map *m, Value key);
+
+// 1 if v can be stored in m; the first value stored fixes the kind
+int map_val_ok(Map *m, Value v);
+
+// value stored under key, or NULL. keys of the wrong kind are never found.
+Value *map_find(const Map *m, Value key);
+
+// inserts or overwrites; key/val must already be accepted.
+// returns 0 when out of memory.
+int map_set(Map *m, Value key, Value val);
+
+// returns 1 if key was present
+int map_remove(Map *m, Value key);
+
+// iteration in slot order: start with *it = 0; returns 0 when done
+int map_next(const Map *m, size_t *it, Value *key, Value *val);
+
+// bytes of table storage currently allocated
+size_t map_bytes(const Map *m);
+
+// calls visit on every stored Value that may point at a heap object
+// (string keys, and values when they are strings, lists or maps).
+// visit may rewrite the Value as long as its contents stay equal.
+void map_each_ref(Map *m, void (*visit)(void *ctx, Value *v), void *ctx);
+
+// frees the table, not the Map itself
+void map_release(Map *m);
+
+#endif
@@ -0,0 +1,935 @@
+#define _XOPEN_SOURCE 700
+#include "module.h"
+#include "diag.h"
+#include "lexer.h"
+#include "parser.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// ----- work queue -----
+//
+// Modules ready to be worked on; a job can queue more (discovery finds
+// imports, building a module frees its importers). The calling thread
+// works too, so with one job no thread is started.
+
+typedef struct Pool Pool;
+
+struct Pool {
+    Build *b;
+    void (*run)(Pool *pl, Module *m);
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Module **ready;
+    size_t ready_len;
+    size_t ready_cap;
+    size_t busy;
+    int oom;
+};
+
+// with pl->lock held
+static void pool_push(Pool *pl, Module *m) {
+    if (pl->ready_len == pl->ready_cap) {
+        size_t cap = pl->ready_cap ? pl->ready_cap * 2 : 16;
+        Module **r = (Module **)realloc(pl->ready, cap * sizeof(Module *));
+        if (!r) {
+            pl->oom = 1;
+            return;
+        }
+        pl->ready = r;
+        pl->ready_cap = cap;
+    }
+    pl->ready[pl->ready_len++] = m;
+    pthread_cond_signal(&pl->cond);
+}
+
+static void *pool_worker(void *arg) {
+    Pool *pl = (Pool *)arg;
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        while (!pl->ready_len && pl->busy) pthread_cond_wait(&pl->cond, &pl->lock);
+        if (!pl->ready_len) break; // and nobody left who could queue more
+        Module *m = pl->ready[--pl->ready_len];
+        pl->busy++;
+        pthread_mutex_unlock(&pl->lock);
+        pl->run(pl, m);
+        pthread_mutex_lock(&pl->lock);
+        pl->busy--;
+        pthread_cond_broadcast(&pl->cond);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+static size_t job_count(const Build *b) {
+    if (b->opts->jobs) return b->opts->jobs;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+static void pool_run(Pool *pl, size_t jobs) {
+    size_t extra = jobs > 1 ? jobs - 1 : 0;
+    pthread_t *tids = extra ? (pthread_t *)calloc(extra, sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    while (tids && started < extra && pthread_create(&tids[started], NULL, pool_worker, pl) == 0) started++;
+    pool_worker(pl);
+    for (size_t i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+}
+
+// ----- realpath index -----
+
+static uint64_t path_hash(const char *real) {
+    return hash_bytes(real, strlen(real), HASH_SEED);
+}
+
+static Module *index_find(const ModuleIndex *ix, const char *real, uint64_t hash) {
+    size_t mask = ix->cap - 1;
+    for (size_t i = (size_t)hash & mask; ix->cap && ix->slots[i]; i = (i + 1) & mask) {
+        const Module *m = ix->slots[i];
+        if (m->real_hash == hash && strcmp(m->real, real) == 0) return ix->slots[i];
+    }
+    return NULL;
+}
+
+// room for one more, so that index_add cannot fail
+static int index_reserve(ModuleIndex *ix) {
+    if ((ix->len + 1) * 2 <= ix->cap) return 1;
+    size_t cap = ix->cap ? ix->cap * 2 : 64;
+    Module **slots = (Module **)calloc(cap, sizeof(Module *));
+    if (!slots) return 0;
+    for (size_t i = 0; i < ix->cap; i++) {
+        Module *m = ix->slots[i];
+        if (!m) continue;
+        size_t j = (size_t)m->real_hash & (cap - 1);
+        while (slots[j]) j = (j + 1) & (cap - 1);
+        slots[j] = m;
+    }
+    free(ix->slots);
+    ix->slots = slots;
+    ix->cap = cap;
+    return 1;
+}
+
+static void index_add(ModuleIndex *ix, Module *m) {
+    size_t mask = ix->cap - 1;
+    size_t i = (size_t)m->real_hash & mask;
+    while (ix->slots[i]) i = (i + 1) & mask;
+    ix->slots[i] = m;
+    ix->len++;
+}
+
+// backward-shift deletion, so lookups never meet a tombstone
+static void index_remove(ModuleIndex *ix, const Module *m) {
+    size_t mask = ix->cap - 1;
+    size_t i = (size_t)m->real_hash & mask;
+    while (ix->cap && ix->slots[i] && ix->slots[i] != m) i = (i + 1) & mask;
+    if (!ix->cap || !ix->slots[i]) return;
+    for (size_t j = (i + 1) & mask; ix->slots[j]; j = (j + 1) & mask) {
+        // the entry at j may fill the hole at i if i is not before its home
+        size_t home = (size_t)ix->slots[j]->real_hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            ix->slots[i] = ix->slots[j];
+            i = j;
+        }
+    }
+    ix->slots[i] = NULL;
+    ix->len--;
+}
+
+// ----- modules -----
+
+// appends to the module's messages, which go out in module order
+static void add_message(Module *m, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    size_t len = m->errors ? strlen(m->errors) : 0;
+    char *s = n >= 0 ? (char *)realloc(m->errors, len + (size_t)n + 1) : NULL;
+    if (!s) return;
+    va_start(ap, fmt);
+    vsnprintf(s + len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    m->errors = s;
+}
+
+static void take_diags(Module *m) {
+    char *text = diag_take();
+    if (!text) return;
+    add_message(m, "%s", text);
+    free(text);
+}
+
+static size_t module_own_fns(const Module *m) {
+    if (m->prog) return m->prog->fns_len;
+    return m->img.prog ? m->img.prog->fns_len : 0;
+}
+
+static void drop_code(Module *m) {
+    size_t own = module_own_fns(m);
+    for (size_t j = 0; m->chunks && j < own; j++) chunk_free(m->chunks[j]);
+    free(m->chunks);
+    m->chunks = NULL;
+    cache_unload(&m->img);
+    free(m->externs);
+    m->externs = NULL;
+    m->externs_len = 0;
+    m->code_hit = 0;
+}
+
+static void module_free(Module *m) {
+    drop_code(m);
+    cache_unload_iface(&m->iface);
+    free(m->deps);
+    free(m->importers);
+    free(m->errors);
+    free_filebuf(&m->src);
+    arena_free(&m->arena);
+    free(m->path);
+    free(m->real);
+    free(m);
+}
+
+static void store_remove(ModuleStore *s, Module *m) {
+    index_remove(&s->by_real, m);
+    s->modules[m->slot] = s->modules[--s->len];
+    s->modules[m->slot]->slot = m->slot;
+}
+
+// The kept module of `real`, if it was reached by the same path: its
+// spans, and so its messages, name that path.
+static Module *store_take(ModuleStore *s, const char *path, const char *real, uint64_t hash) {
+    Module *m = index_find(&s->by_real, real, hash);
+    if (!m) return NULL;
+    store_remove(s, m);
+    if (strcmp(m->path, path) == 0) return m;
+    module_free(m);
+    return NULL;
+}
+
+// with the build's lock held (if there is one yet); takes path and real
+// unless it returns NULL
+static Module *module_add(Build *b, char *path, char *real) {
+    if (b->modules_len == b->modules_cap) {
+        size_t cap = b->modules_cap ? b->modules_cap * 2 : 8;
+        Module **ms = (Module **)realloc(b->modules, cap * sizeof(Module *));
+        if (!ms) return NULL;
+        b->modules = ms;
+        b->modules_cap = cap;
+    }
+    if (!index_reserve(&b->by_real)) return NULL;
+    uint64_t hash = path_hash(real);
+    Module *m = b->opts->warm ? store_take(b->opts->warm, path, real, hash) : NULL;
+    if (m) {
+        free(path);
+        free(real);
+    } else {
+        m = (Module *)calloc(1, sizeof(Module));
+        if (!m) return NULL;
+        m->path = path;
+        m->real = real;
+        m->real_hash = hash;
+        arena_init(&m->arena, 64 * 1024);
+    }
+    m->index = b->modules_len;
+    b->modules[b->modules_len++] = m;
+    index_add(&b->by_real, m);
+    return m;
+}
+
+// a.b imported from dir/x.lr is dir/a/b.lr
+static char *import_path(const char *importer, StrView name) {
+    const char *slash = strrchr(importer, '/');
+    size_t dir = slash ? (size_t)(slash - importer) + 1 : 0;
+    char *p = (char *)malloc(dir + name.len + 4);
+    if (!p) return NULL;
+    memcpy(p, importer, dir);
+    for (size_t i = 0; i < name.len; i++) p[dir + i] = name.ptr[i] == '.' ? '/' : name.ptr[i];
+    memcpy(p + dir + name.len, ".lr", 4);
+    return p;
+}
+
+static int module_cache_path(const Build *b, const Module *m, const char *ext, char *out, size_t cap) {
+    uint64_t key = hash_bytes(m->real, strlen(m->real), HASH_SEED);
+    return cache_path(out, cap, m->path, b->opts->cache_dir, key, ext);
+}
+
+static int parse_module(Module *m) {
+    Lexer lx;
+    lexer_init(&lx, m->path, m->src.data, m->src.len);
+    Parser p;
+    parser_init(&p, &lx, &m->arena);
+    uint64_t t0 = monotonic_ns();
+    m->prog = parse_program(&p);
+    stats_pass(&m->stats, PASS_PARSE, t0, m->src.len);
+    if (!m->prog || p.had_error || lx.had_error) {
+        if (!m->prog) add_message(m, "%s: error: out of memory\n", m->path);
+        m->prog = NULL;
+        return 0;
+    }
+    m->imports = m->prog->imports;
+    m->imports_len = m->prog->imports_len;
+    m->iface_hash = cache_iface_hash(m->prog->fns, m->prog->fns_len);
+    return 1;
+}
+
+// Reads the module and finds its imports: from its interface when that
+// is up to date, else by parsing it. A kept module has done that in an
+// earlier build. Queues the imports not seen yet.
+static void discover(Pool *pl, Module *m) {
+    Build *b = pl->b;
+    if (!m->src.data) {
+        uint64_t t0 = monotonic_ns();
+        m->src = read_whole_file(m->path);
+        if (!m->src.data) {
+            add_message(m, "%s: error: failed to read file\n", m->path);
+            m->failed = 1;
+            return;
+        }
+        stats_pass(&m->stats, PASS_READ, t0, m->src.len);
+        m->src_hash = hash_bytes(m->src.data, m->src.len, HASH_SEED);
+    }
+
+    diag_begin(b->opts->max_errors);
+    if (!m->prog && !m->iface.map) {
+        char lri[4096];
+        if (b->opts->use_cache && module_cache_path(b, m, "lri", lri, sizeof(lri))) {
+            uint64_t t0 = monotonic_ns();
+            if (cache_load_iface(&m->iface, lri, m->src_hash, m->path, &m->arena)) {
+                m->imports = m->iface.imports;
+                m->imports_len = m->iface.imports_len;
+                m->iface_hash = m->iface.hash;
+            }
+            stats_pass(&m->stats, PASS_CACHE_LOAD, t0, 0);
+        }
+        if (!m->iface.map && !parse_module(m)) {
+            m->failed = 1;
+            take_diags(m);
+            return;
+        }
+    }
+
+    m->deps = (size_t *)malloc((m->imports_len ? m->imports_len : 1) * sizeof(size_t));
+    if (!m->deps) m->failed = 1;
+    for (size_t i = 0; i < m->imports_len && m->deps; i++) m->deps[i] = SIZE_MAX; // not found (yet)
+    for (size_t i = 0; i < m->imports_len && m->deps; i++) {
+        const Import *imp = &m->imports[i];
+        char *path = import_path(m->path, imp->name);
+        char *real = path ? realpath(path, NULL) : NULL;
+        if (!real) {
+            diag_error(imp->span, "cannot find module '%.*s' (no %s)", (int)imp->name.len, imp->name.ptr,
+                       path ? path : "memory");
+            free(path);
+            m->failed = 1;
+            continue;
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        Module *dep = index_find(&b->by_real, real, path_hash(real));
+        if (dep) {
+            free(path);
+            free(real);
+        } else if ((dep = module_add(b, path, real)) != NULL) {
+            pool_push(pl, dep);
+        } else {
+            free(path);
+            free(real);
+            pl->oom = 1;
+        }
+        if (dep) m->deps[i] = dep->index;
+        else m->failed = 1;
+        pthread_mutex_unlock(&pl->lock);
+    }
+    take_diags(m);
+}
+
+// ----- import order -----
+
+// Depth-first from the root: imports before importers, in the order
+// they are written, so the result does not depend on which thread found
+// what. A module met again while its own imports are still open closes
+// a cycle.
+static int visit(Build *b, size_t mi, unsigned char *mark, size_t *stack, size_t depth, size_t *order_len) {
+    Module *m = b->modules[mi];
+    mark[mi] = 1;
+    stack[depth] = mi;
+    int ok = 1;
+    for (size_t i = 0; i < m->imports_len && m->deps; i++) {
+        size_t d = m->deps[i];
+        if (d == SIZE_MAX || mark[d] == 2) continue;
+        if (mark[d] == 1) {
+            // the cycle is what is on the stack from d up
+            size_t from = depth;
+            while (stack[from] != d) from--;
+            char chain[2048];
+            size_t n = 0;
+            for (size_t j = from; j <= depth && n < sizeof(chain); j++) {
+                int w = snprintf(chain + n, sizeof(chain) - n, "%s -> ", b->modules[stack[j]]->path);
+                if (w > 0) n += (size_t)w;
+            }
+            diag_error(m->imports[i].span, "import cycle: %s%s", n < sizeof(chain) ? chain : "",
+                       b->modules[d]->path);
+            ok = 0;
+            continue;
+        }
+        if (!visit(b, d, mark, stack, depth + 1, order_len)) ok = 0;
+    }
+    mark[mi] = 2;
+    b->order[(*order_len)++] = mi;
+    return ok;
+}
+
+// ----- separate compilation -----
+
+static int has_dep(const Module *m, size_t i, size_t d) {
+    for (size_t j = 0; j < i; j++) {
+        if (m->deps[j] == d) return 1;
+    }
+    return 0;
+}
+
+static FnDecl *const *module_fns(const Module *m, size_t *len) {
+    if (m->prog) {
+        *len = m->prog->fns_len;
+        return m->prog->fns;
+    }
+    *len = m->iface.fns_len;
+    return m->iface.fns;
+}
+
+// The module's own functions followed by copies of what it imports,
+// marked external: compiling against this uses nothing of the imports
+// but their interfaces.
+static Program *compile_view(Build *b, Module *m) {
+    size_t own = m->prog->fns_len, total = own;
+    for (size_t i = 0; i < m->imports_len; i++) {
+        if (has_dep(m, i, m->deps[i])) continue;
+        size_t n;
+        module_fns(b->modules[m->deps[i]], &n);
+        total += n;
+    }
+
+    Program *v = ast_new_program(&m->arena);
+    FnDecl **fns = (FnDecl **)arena_alloc(&m->arena, (total ? total : 1) * sizeof(FnDecl *), _Alignof(FnDecl *));
+    FnDecl *copies = (FnDecl *)arena_alloc(&m->arena, (total - own + 1) * sizeof(FnDecl), _Alignof(FnDecl));
+    m->externs = (StrView *)calloc(total - own + 1, sizeof(StrView));
+    if (!v || !fns || !copies || !m->externs) return NULL;
+
+    memcpy(fns, m->prog->fns, own * sizeof(FnDecl *));
+    size_t k = own;
+    for (size_t i = 0; i < m->imports_len; i++) {
+        if (has_dep(m, i, m->deps[i])) continue;
+        size_t n;
+        FnDecl *const *dfns = module_fns(b->modules[m->deps[i]], &n);
+        for (size_t j = 0; j < n; j++, k++) {
+            FnDecl *c = &copies[k - own];
+            *c = *dfns[j];
+            c->body = NULL;
+            c->body_len = 0;
+            c->external = 1;
+            // the name is kept with the code, which may outlive the import's
+            // source (see ModuleStore)
+            char *name = (char *)arena_alloc(&m->arena, c->name.len ? c->name.len : 1, 1);
+            if (!name) return NULL;
+            memcpy(name, c->name.ptr, c->name.len);
+            c->name.ptr = name;
+            fns[k] = c;
+            m->externs[k - own] = c->name;
+        }
+    }
+    m->externs_len = total - own;
+    v->fns = fns;
+    v->fns_len = total;
+    ast_index_fns(v, &m->arena);
+    return v;
+}
+
+static void compile_module(Build *b, Module *m, const char *lrc, uint64_t key) {
+    Program *view = compile_view(b, m);
+    size_t own = m->prog->fns_len;
+    m->chunks = (Chunk **)calloc(own ? own : 1, sizeof(Chunk *));
+    if (!view || !m->chunks) {
+        add_message(m, "%s: error: out of memory\n", m->path);
+        m->failed = 1;
+        return;
+    }
+
+    const TierConfig *tier = b->opts->tier;
+    BcOptions opts;
+    vm_bc_options(tier, &opts);
+    CallGraph cg = {0};
+    uint64_t t0 = monotonic_ns();
+    if ((!tier->no_inline || !tier->no_fold) && callgraph_build(&cg, view)) {
+        if (!tier->no_inline) opts.cg = &cg;
+        if (!tier->no_fold) opts.fold = &cg;
+    }
+    int all = 1;
+    for (size_t i = 0; i < own; i++) {
+        m->chunks[i] = bc_compile(view, i, &opts);
+        if (m->chunks[i]) m->stats.pass[PASS_COMPILE].items++;
+        else all = 0;
+    }
+    callgraph_free(&cg);
+    stats_pass(&m->stats, PASS_COMPILE, t0, 0);
+
+    // what does not compile is tree-walked, which needs the source: no .lrc then
+    t0 = monotonic_ns();
+    if (all && lrc && !cache_write(lrc, key, view, own, m->chunks)) {
+        add_message(m, "%s: warning: could not write %s\n", m->path, lrc);
+    }
+    char lri[4096];
+    if (b->opts->use_cache && !m->iface.map && module_cache_path(b, m, "lri", lri, sizeof(lri)) &&
+        !cache_write_iface(lri, m->src_hash, m->prog)) {
+        add_message(m, "%s: warning: could not write %s\n", m->path, lri);
+    }
+    stats_pass(&m->stats, PASS_CACHE_WRITE, t0, 0);
+}
+
+// Loads the module's code if the .lrc matches its source, the options
+// and the interfaces it imports; otherwise parses (if discovery did not)
+// and compiles it. Then its importers may go.
+static void build_one(Pool *pl, Module *m) {
+    Build *b = pl->b;
+    const TierConfig *tier = b->opts->tier;
+    BcOptions opts;
+    vm_bc_options(tier, &opts);
+    uint64_t key = cache_key(m->src.data, m->src.len, tier->no_inline ? 0 : opts.inline_budget,
+                             tier->no_inline ? 0 : opts.inline_depth, opts.wrap_ints, opts.no_vectorize,
+                             tier->no_fold);
+    for (size_t i = 0; i < m->imports_len; i++) {
+        if (!has_dep(m, i, m->deps[i])) key = hash_bytes(&b->modules[m->deps[i]]->iface_hash, sizeof(uint64_t), key);
+    }
+
+    char lrc[4096];
+    int have_path = b->opts->use_cache && module_cache_path(b, m, "lrc", lrc, sizeof(lrc));
+    if (m->chunks && m->code_key == key) {
+        m->code_hit = 1; // kept from an earlier build
+    } else {
+        drop_code(m);
+        m->code_key = key;
+        if (!m->prog && have_path) {
+            uint64_t t0 = monotonic_ns();
+            m->code_hit = cache_load(&m->img, lrc, key, m->path, &m->arena);
+            stats_pass(&m->stats, PASS_CACHE_LOAD, t0, 0);
+        }
+        if (m->code_hit) {
+            m->chunks = m->img.chunks;
+            m->img.chunks = NULL;
+            m->externs = (StrView *)calloc(m->img.externs_len + 1, sizeof(StrView));
+            if (m->externs) memcpy(m->externs, m->img.externs, m->img.externs_len * sizeof(StrView));
+            m->externs_len = m->img.externs_len;
+            if (!m->externs) m->failed = 1;
+        } else {
+            diag_begin(b->opts->max_errors);
+            if (m->prog || parse_module(m)) compile_module(b, m, have_path ? lrc : NULL, key);
+            else m->failed = 1;
+            take_diags(m);
+        }
+    }
+
+    pthread_mutex_lock(&pl->lock);
+    for (size_t i = 0; i < m->importers_len; i++) {
+        Module *up = b->modules[m->importers[i]];
+        if (--up->waiting == 0) pool_push(pl, up);
+    }
+    pthread_mutex_unlock(&pl->lock);
+}
+
+static int build_all(Build *b) {
+    for (size_t i = 0; i < b->modules_len; i++) {
+        Module *m = b->modules[i];
+        for (size_t j = 0; j < m->imports_len; j++) {
+            if (has_dep(m, j, m->deps[j])) continue;
+            Module *d = b->modules[m->deps[j]];
+            size_t *up = (size_t *)realloc(d->importers, (d->importers_len + 1) * sizeof(size_t));
+            if (!up) return 0;
+            d->importers = up;
+            d->importers[d->importers_len++] = i;
+            m->waiting++;
+        }
+    }
+
+    Pool pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.b = b;
+    pl.run = build_one;
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.cond, NULL);
+    // leaves first, in import order, so one job builds them in that order
+    for (size_t i = b->modules_len; i-- > 0;) {
+        Module *m = b->modules[b->order[i]];
+        if (!m->waiting) pool_push(&pl, m);
+    }
+    size_t jobs = job_count(b);
+    pool_run(&pl, jobs < b->modules_len ? jobs : b->modules_len);
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.cond);
+    free(pl.ready);
+
+    int ok = !pl.oom;
+    for (size_t i = 0; i < b->modules_len; i++) {
+        if (b->modules[i]->failed) ok = 0;
+    }
+    return ok;
+}
+
+// ----- linking -----
+
+typedef struct {
+    const Build *b;
+    const size_t *owner; // module index per linked fn
+    size_t mi;
+} Scope;
+
+static void check_stmts(const Scope *s, Stmt **stmts, size_t len);
+
+static int imports_module(const Module *m, size_t d) {
+    for (size_t i = 0; i < m->imports_len; i++) {
+        if (m->deps[i] == d) return 1;
+    }
+    return 0;
+}
+
+// calls that reach into a module this one does not import
+static void check_expr(const Scope *s, const Expr *e) {
+    if (!e) return;
+    switch (e->kind) {
+        case EXPR_UNARY:
+            check_expr(s, e->as.unary.rhs);
+            break;
+        case EXPR_BINARY:
+            check_expr(s, e->as.binary.lhs);
+            check_expr(s, e->as.binary.rhs);
+            break;
+        case EXPR_ASSIGN:
+            check_expr(s, e->as.assign.value);
+            break;
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            if (callee && callee->kind == EXPR_NAME) {
+                long fn = ast_find_fn(s->b->prog, callee->as.str);
+                const Module *m = s->b->modules[s->mi];
+                if (fn >= 0 && s->owner[fn] != s->mi && !imports_module(m, s->owner[fn])) {
+                    diag_error(callee->span, "'%.*s' is defined in %s, which is not imported here",
+                               (int)callee->as.str.len, callee->as.str.ptr, s->b->modules[s->owner[fn]]->path);
+                }
+            }
+            for (size_t i = 0; i < e->as.call.args_len; i++) check_expr(s, e->as.call.args[i]);
+            break;
+        }
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) check_expr(s, e->as.list.items[i]);
+            break;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                check_expr(s, e->as.map.keys[i]);
+                check_expr(s, e->as.map.values[i]);
+            }
+            break;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            check_expr(s, e->as.index.target);
+            check_expr(s, e->as.index.index);
+            check_expr(s, e->as.index.value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void check_stmts(const Scope *s, Stmt **stmts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *st = stmts[i];
+        switch (st->kind) {
+            case STMT_LET:
+                check_expr(s, st->as.let_stmt.init);
+                break;
+            case STMT_RETURN:
+                check_expr(s, st->as.ret_stmt.value);
+                break;
+            case STMT_EXPR:
+                check_expr(s, st->as.expr_stmt.expr);
+                break;
+            case STMT_IF:
+                check_expr(s, st->as.if_stmt.cond);
+                check_stmts(s, st->as.if_stmt.then_body, st->as.if_stmt.then_len);
+                check_stmts(s, st->as.if_stmt.else_body, st->as.if_stmt.else_len);
+                break;
+            case STMT_WHILE:
+                check_expr(s, st->as.while_stmt.cond);
+                check_stmts(s, st->as.while_stmt.body, st->as.while_stmt.body_len);
+                break;
+        }
+    }
+}
+
+static Span fn_span(const Module *m, size_t i, const FnDecl *linked) {
+    // a function loaded from a .lrc has no position; its interface does
+    if (!m->prog && i < m->iface.fns_len) return m->iface.fns[i]->span;
+    return linked->span;
+}
+
+// One Program out of all modules, imports first. Reports names defined
+// twice and calls into modules that are not imported.
+static int link_modules(Build *b) {
+    size_t total = 0;
+    for (size_t i = 0; i < b->modules_len; i++) {
+        Module *m = b->modules[i];
+        total += m->prog ? m->prog->fns_len : m->img.prog->fns_len;
+    }
+
+    Program *prog = ast_new_program(&b->arena);
+    FnDecl **fns = (FnDecl **)arena_alloc(&b->arena, (total ? total : 1) * sizeof(FnDecl *), _Alignof(FnDecl *));
+    size_t *owner = (size_t *)calloc(total ? total : 1, sizeof(size_t));
+    size_t *base = (size_t *)calloc(b->modules_len, sizeof(size_t));
+    if (!prog || !fns || !owner || !base) {
+        free(owner);
+        free(base);
+        return 0;
+    }
+    size_t k = 0;
+    for (size_t oi = 0; oi < b->modules_len; oi++) {
+        size_t mi = b->order[oi];
+        Module *m = b->modules[mi];
+        const Program *src = m->prog ? m->prog : m->img.prog;
+        base[mi] = k;
+        for (size_t j = 0; j < src->fns_len; j++, k++) {
+            fns[k] = src->fns[j];
+            owner[k] = mi;
+        }
+    }
+    prog->fns = fns;
+    prog->fns_len = total;
+    ast_index_fns(prog, &b->arena);
+    b->prog = prog;
+
+    diag_begin(0);
+    for (size_t i = 0; i < total; i++) {
+        long first = ast_find_fn(prog, fns[i]->name);
+        if (first < 0 || (size_t)first == i || owner[first] == owner[i]) continue;
+        const Module *m = b->modules[owner[i]], *fm = b->modules[owner[first]];
+        Span at = fn_span(m, i - base[owner[i]], fns[i]);
+        Span was = fn_span(fm, (size_t)first - base[owner[first]], fns[first]);
+        diag_error(at, "'%.*s' is already defined at %s:%zu:%zu", (int)fns[i]->name.len, fns[i]->name.ptr,
+                   was.path, was.line, was.col);
+    }
+    for (size_t mi = 0; mi < b->modules_len; mi++) {
+        const Module *m = b->modules[mi];
+        if (!m->prog) continue; // loaded code was compiled against its imports only
+        Scope s = { b, owner, mi };
+        for (size_t j = 0; j < m->prog->fns_len; j++) check_stmts(&s, m->prog->fns[j]->body, m->prog->fns[j]->body_len);
+    }
+
+    free(owner);
+    free(base);
+
+    char *errors = diag_take();
+    if (errors) {
+        fputs(errors, stderr);
+        free(errors);
+        return 0;
+    }
+    return 1;
+}
+
+int module_link_code(Build *b) {
+    const Program *prog = b->prog;
+    b->chunks = (Chunk **)calloc(prog->fns_len ? prog->fns_len : 1, sizeof(Chunk *));
+    if (!b->chunks) return 0;
+
+    diag_begin(0);
+    size_t base = 0; // the module's first fn in prog, modules being in import order
+    for (size_t oi = 0; oi < b->modules_len; oi++) {
+        Module *m = b->modules[b->order[oi]];
+        size_t own = module_own_fns(m);
+        uint32_t *map = (uint32_t *)malloc((own + m->externs_len + 1) * sizeof(uint32_t));
+        if (!map || !m->chunks) {
+            free(map);
+            base += own;
+            continue;
+        }
+        for (size_t j = 0; j < own; j++) map[j] = (uint32_t)(base + j);
+        for (size_t j = 0; j < m->externs_len; j++) {
+            long fn = ast_find_fn(prog, m->externs[j]);
+            map[own + j] = fn >= 0 ? (uint32_t)fn : UINT32_MAX;
+        }
+        for (size_t j = 0; j < own; j++) {
+            Chunk *c = m->chunks[j];
+            m->chunks[j] = NULL;
+            if (c && !bc_relocate(c, map, own + m->externs_len)) {
+                // too many functions for a u16, or a stale .lrc: only the tree-walker is left
+                chunk_free(c);
+                c = NULL;
+                const FnDecl *fn = prog->fns[base + j];
+                if (!m->prog) diag_error(fn->span, "cannot link the cached code of '%.*s'", (int)fn->name.len, fn->name.ptr);
+            }
+            b->chunks[base + j] = c;
+        }
+        free(map);
+        base += own;
+    }
+
+    char *errors = diag_take();
+    if (errors) {
+        fputs(errors, stderr);
+        free(errors);
+        return 0;
+    }
+    return 1;
+}
+
+// ----- kept modules -----
+
+// back into the store, as if just discovered
+static void store_put(ModuleStore *s, Module *m) {
+    if (s->len == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 64;
+        Module **ms = (Module **)realloc(s->modules, cap * sizeof(Module *));
+        if (ms) {
+            s->modules = ms;
+            s->cap = cap;
+        }
+    }
+    if (s->len == s->cap || !index_reserve(&s->by_real)) {
+        module_free(m);
+        return;
+    }
+    free(m->deps);
+    free(m->importers);
+    free(m->errors);
+    m->deps = NULL;
+    m->importers = NULL;
+    m->importers_len = 0;
+    m->waiting = 0;
+    m->errors = NULL;
+    m->code_hit = 0;
+    memset(&m->stats, 0, sizeof(m->stats));
+    m->slot = s->len;
+    s->modules[s->len++] = m;
+    index_add(&s->by_real, m);
+}
+
+void module_store_forget(ModuleStore *s, const char *real) {
+    if (real) {
+        Module *m = index_find(&s->by_real, real, path_hash(real));
+        if (m) {
+            store_remove(s, m);
+            module_free(m);
+        }
+        return;
+    }
+    for (size_t i = 0; i < s->len; i++) module_free(s->modules[i]);
+    s->len = 0;
+    if (s->by_real.cap) memset(s->by_real.slots, 0, s->by_real.cap * sizeof(Module *));
+    s->by_real.len = 0;
+}
+
+void module_store_free(ModuleStore *s) {
+    module_store_forget(s, NULL);
+    free(s->modules);
+    free(s->by_real.slots);
+    memset(s, 0, sizeof(*s));
+}
+
+// ----- entry points -----
+
+// root first, then its imports
+static void print_messages(Build *b, size_t order_len) {
+    for (size_t i = order_len; i-- > 0;) {
+        Module *m = b->modules[b->order[i]];
+        if (m->errors) fputs(m->errors, stderr);
+        free(m->errors);
+        m->errors = NULL;
+    }
+}
+
+int module_build(Build *b, const char *root, const BuildOptions *opts) {
+    memset(b, 0, sizeof(*b));
+    b->opts = opts;
+    arena_init(&b->arena, 4096);
+
+    char *path = strdup(root);
+    char *real = path ? realpath(root, NULL) : NULL;
+    if (path && !real) real = strdup(root); // reported as unreadable below
+    Module *m = real ? module_add(b, path, real) : NULL;
+    if (!m) {
+        free(path);
+        free(real);
+        fprintf(stderr, "%s: error: out of memory\n", root);
+        return 0;
+    }
+
+    Pool pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.b = b;
+    pl.run = discover;
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.cond, NULL);
+    // the root alone first: a single-file program never starts a thread
+    discover(&pl, m);
+    if (pl.ready_len) pool_run(&pl, job_count(b));
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.cond);
+    free(pl.ready);
+
+    int ok = !pl.oom;
+    for (size_t i = 0; i < b->modules_len; i++) {
+        if (b->modules[i]->failed) ok = 0;
+    }
+
+    b->order = (size_t *)calloc(b->modules_len, sizeof(size_t));
+    unsigned char *mark = (unsigned char *)calloc(b->modules_len, 1);
+    size_t *stack = (size_t *)calloc(b->modules_len, sizeof(size_t));
+    size_t order_len = 0;
+    diag_begin(0);
+    if (!b->order || !mark || !stack || !visit(b, 0, mark, stack, 0, &order_len)) ok = 0;
+    char *cycles = diag_take();
+    free(mark);
+    free(stack);
+
+    print_messages(b, order_len);
+    if (cycles) fputs(cycles, stderr);
+    free(cycles);
+    if (!ok) return 0;
+
+    if ((opts->use_cache || opts->warm) && !build_all(b)) ok = 0;
+    print_messages(b, order_len);
+    if (!ok || !link_modules(b)) return 0;
+    return !opts->use_cache || opts->warm || module_link_code(b);
+}
+
+void module_build_free(Build *b) {
+    ModuleStore *warm = b->opts ? b->opts->warm : NULL;
+    for (size_t i = 0; i < b->modules_len; i++) {
+        Module *m = b->modules[i];
+        if (warm && !m->failed && (m->prog || m->iface.map)) store_put(warm, m);
+        else module_free(m);
+    }
+    free(b->modules);
+    free(b->by_real.slots);
+    free(b->order);
+    // still here if linking failed or the caller did not take them
+    for (size_t i = 0; b->chunks && b->prog && i < b->prog->fns_len; i++) chunk_free(b->chunks[i]);
+    free(b->chunks);
+    arena_free(&b->arena);
+    memset(b, 0, sizeof(*b));
+}
+
+void module_stats(const Build *b, RunStats *rs, size_t *code_hits) {
+    *code_hits = 0;
+    for (size_t i = 0; i < b->modules_len; i++) {
+        const Module *m = b->modules[i];
+        stats_merge(rs, &m->stats);
+        ArenaStats as;
+        arena_stats(&m->arena, &as);
+        rs->arena.blocks += as.blocks;
+        rs->arena.reserved += as.reserved;
+        rs->arena.requested += as.requested;
+        if (m->code_hit) (*code_hits)++;
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef LUNAR_MODULE_H
+#define LUNAR_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "cache.h"
+#include "stats.h"
+#include "util.h"
+#include "vm.h"
+
+// Programs made of several files.
+//
+// `import a.b;` makes the functions of a/b.lr (next to the importing
+// file) callable from it. All functions share one namespace, so a name
+// may be defined in one module only, and calling a function of a module
+// that was not imported is an error. Modules are found and parsed on
+// `jobs` threads, then linked into one Program, imports first.
+//
+// With a cache (--cache, see cache.h) every module is also compiled on
+// its own into a .lri interface and a .lrc with its code. An unchanged
+// module is not parsed at all, and its code is reused as long as the
+// interfaces it imports are the same: editing a function body rebuilds
+// that module only, changing a signature rebuilds its importers too.
+// Modules whose imports are done compile in parallel. Calls across
+// modules are not inlined, since the code would then depend on more
+// than the interfaces.
+//
+// A ModuleStore does the same in memory (lunar --daemon): modules are
+// kept parsed and compiled between builds and used again without
+// reading their files, so whoever keeps the store must forget the ones
+// that change.
+
+typedef struct ModuleStore ModuleStore;
+
+typedef struct {
+    const TierConfig *tier;
+    size_t max_errors; // per module
+    uint32_t jobs;     // threads; 0: one per core
+    int use_cache;
+    const char *cache_dir;
+    ModuleStore *warm; // modules kept from earlier builds, or NULL
+} BuildOptions;
+
+typedef struct {
+    char *path;     // as reached from the root: relative to the cwd or absolute
+    char *real;     // realpath, which is what tells modules apart
+    uint64_t real_hash;
+    size_t index;   // in the build's modules
+    size_t slot;    // in the store's modules, while kept
+    FileBuf src;
+    uint64_t src_hash;
+    Arena arena;
+
+    Program *prog;    // parsed; NULL if the source is unchanged and nothing needed it
+    CacheIface iface; // the loaded .lri when prog is NULL
+    uint64_t iface_hash;
+    const Import *imports;
+    size_t imports_len;
+
+    size_t *deps;       // module index per import
+    size_t *importers;  // modules importing this one
+    size_t importers_len;
+    size_t waiting;     // imports not built yet
+
+    CacheImage img; // code loaded from the .lrc
+    Chunk **chunks; // own functions, NULL where not compiled (with a cache or store only)
+    uint64_t code_key; // what chunks were built from, as in the .lrc key
+    StrView *externs; // what fn indices past the own ones call, for linking
+    size_t externs_len;
+
+    int failed;
+    int code_hit; // the .lrc or the kept code was up to date
+    char *errors; // its diagnostics, printed in module order
+    RunStats stats;
+} Module;
+
+// modules by realpath: open addressing, power-of-two capacity
+typedef struct {
+    Module **slots;
+    size_t cap;
+    size_t len;
+} ModuleIndex;
+
+typedef struct {
+    Module **modules; // [0] is the root, the rest in the order found
+    size_t modules_len;
+    size_t modules_cap;
+    ModuleIndex by_real;
+    size_t *order;    // imports before importers
+
+    Program *prog; // all of them
+    Chunk **chunks; // one per prog->fns with a cache (see module_link_code), else NULL; taken by the caller
+    Arena arena;
+
+    const BuildOptions *opts;
+} Build;
+
+// Reads root and everything it imports and links them into b->prog.
+// Errors are printed to stderr; returns 0 if there were any.
+int module_build(Build *b, const char *root, const BuildOptions *opts);
+// Kept modules go back to the store, the rest is freed.
+void module_build_free(Build *b);
+
+// Moves each module's code into b->chunks, renumbering calls for the
+// linked program. module_build does this itself unless there is a
+// store: the store keeps the code as compiled, so only a forked child
+// that is about to run it links it.
+int module_link_code(Build *b);
+
+struct ModuleStore {
+    Module **modules;
+    size_t len;
+    size_t cap;
+    ModuleIndex by_real;
+};
+
+// drops the module of realpath `real`, or every module when NULL
+void module_store_forget(ModuleStore *s, const char *real);
+void module_store_free(ModuleStore *s);
+
+// passes, arena use and cache hits of all modules together
+void module_stats(const Build *b, RunStats *rs, size_t *code_hits);
+
+#endif
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+#include "outbuf.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int outbuf_init(OutBuf *ob, int fd) {
+    ob->fd = fd;
+    ob->line_buffered = isatty(fd);
+    ob->failed = 0;
+    ob->len = 0;
+    ob->cap = OUTBUF_SIZE;
+    ob->buf = (char *)malloc(ob->cap);
+    return ob->buf != NULL;
+}
+
+void outbuf_free(OutBuf *ob) {
+    if (ob->buf) outbuf_flush(ob);
+    free(ob->buf);
+    ob->buf = NULL;
+    ob->len = ob->cap = 0;
+}
+
+static void write_all(OutBuf *ob, const char *p, size_t n) {
+    while (n && !ob->failed) {
+        ssize_t w = write(ob->fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            ob->failed = 1;
+            break;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+void outbuf_flush(OutBuf *ob) {
+    write_all(ob, ob->buf, ob->len);
+    ob->len = 0;
+}
+
+void outbuf_write(OutBuf *ob, const char *p, size_t n) {
+    if (n > ob->cap - ob->len) {
+        outbuf_flush(ob);
+        // too big to be worth copying: hand it straight to the fd
+        if (n >= ob->cap / 2) {
+            write_all(ob, p, n);
+            return;
+        }
+    }
+    memcpy(ob->buf + ob->len, p, n);
+    ob->len += n;
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// decimal formatting without printf: two digits per division, written
+// backwards into a scratch buffer
+void outbuf_int(OutBuf *ob, int64_t v) {
+    char tmp[20];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    while (u >= 100) {
+        unsigned d = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    if (u >= 10) {
+        unsigned d = (unsigned)u * 2;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    } else {
+        *--p = (char)('0' + u);
+    }
+    if (v < 0) *--p = '-';
+
+    size_t n = (size_t)(end - p);
+    if (ob->cap - ob->len < n) outbuf_flush(ob);
+    memcpy(ob->buf + ob->len, p, n);
+    ob->len += n;
+}
@@ -0,0 +1,42 @@
+#ifndef LUNAR_OUTBUF_H
+#define LUNAR_OUTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Program output. `print` appends here instead of going through stdio,
+// and the bytes reach the fd in large writes: when the buffer fills, on
+// an explicit flush, and when the VM shuts down. On a terminal every
+// finished line is flushed so interactive output still shows up promptly.
+
+#define OUTBUF_SIZE (64u * 1024)
+
+typedef struct {
+    int fd;
+    int line_buffered; // fd is a TTY
+    int failed;        // a write failed; later output is dropped
+    char *buf;
+    size_t len;
+    size_t cap;
+} OutBuf;
+
+// returns 0 when out of memory
+int outbuf_init(OutBuf *ob, int fd);
+void outbuf_free(OutBuf *ob); // flushes first
+
+void outbuf_flush(OutBuf *ob);
+void outbuf_write(OutBuf *ob, const char *p, size_t n);
+void outbuf_int(OutBuf *ob, int64_t v);
+
+static inline void outbuf_putc(OutBuf *ob, char c) {
+    if (ob->len == ob->cap) outbuf_flush(ob);
+    ob->buf[ob->len++] = c;
+}
+
+// ends a line of output; the flush point on terminals
+static inline void outbuf_newline(OutBuf *ob) {
+    outbuf_putc(ob, '\n');
+    if (ob->line_buffered) outbuf_flush(ob);
+}
+
+#endif
@@ -1,9 +1,20 @@
 #include "parser.h"
+#include "util.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+// once the error limit is hit the rest of the file reads as EOF, so
+// every loop in here winds down without looking at it
 static void next(Parser *p) {
+    if (diag_limit_reached()) {
+        p->cur.kind = TOK_EOF;
+        return;
+    }
+    size_t errors = p->lx->errors;
+    p->prev = p->cur.kind;
     p->cur = lexer_next(p->lx);
+    if (p->lx->errors != errors) p->panic = 1; // a bad token makes the parser's errors noise
 }
 
 static int is(Parser *p, TokenKind k) {
@@ -20,9 +31,30 @@ static int accept(Parser *p, TokenKind k) {
 
 static void error_at(Parser *p, Span sp, const char *msg) {
     p->had_error = 1;
+    if (p->panic) return;
+    p->panic = 1;
     diag_error(sp, "%s", msg);
 }
 
+// Panic-mode recovery: skip ahead to where parsing can sensibly go on
+// and leave panic mode. Inside a function that is just past the next ';',
+// or at a '}' or 'funct'; at the top level only 'funct' or 'import' will do.
+static void synchronize(Parser *p, int top_level) {
+    if (!top_level && p->prev == TOK_SEMI) {
+        p->panic = 0; // the broken statement ended properly
+        return;
+    }
+    while (!is(p, TOK_EOF) && !is(p, TOK_KW_FUNCT) && !(top_level && is(p, TOK_KW_IMPORT))) {
+        if (!top_level) {
+            if (is(p, TOK_RBRACE)) break;
+            if (accept(p, TOK_SEMI)) break;
+        }
+        next(p);
+    }
+    // nothing left to recover for: what is missing at EOF is noise
+    p->panic = is(p, TOK_EOF);
+}
+
 static int expect(Parser *p, TokenKind k, const char *what) {
     if (is(p, k)) {
         next(p);
@@ -41,11 +73,82 @@ static StrView tok_strview(Token t) {
     return sv;
 }
 
+// ----- string literals -----
+
+static int intern_grow(Parser *p) {
+    size_t cap = p->strings_cap ? p->strings_cap * 2 : 64;
+    StrView *t = (StrView *)arena_alloc(p->arena, cap * sizeof(StrView), _Alignof(StrView));
+    if (!t) return 0;
+    memset(t, 0, cap * sizeof(StrView));
+    for (size_t i = 0; i < p->strings_cap; i++) {
+        StrView s = p->strings[i];
+        if (!s.ptr) continue;
+        size_t j = (size_t)hash_bytes(s.ptr, s.len, HASH_SEED) & (cap - 1);
+        while (t[j].ptr) j = (j + 1) & (cap - 1);
+        t[j] = s;
+    }
+    p->strings = t;
+    p->strings_cap = cap;
+    return 1;
+}
+
+// one shared copy per distinct literal, so equal literals compare by
+// pointer. s is copied into the arena unless it already lives in the source.
+static StrView intern(Parser *p, StrView s, int in_source) {
+    if ((p->strings_len + 1) * 2 > p->strings_cap && !intern_grow(p)) return (StrView){ NULL, 0 };
+    size_t mask = p->strings_cap - 1;
+    size_t j = (size_t)hash_bytes(s.ptr, s.len, HASH_SEED) & mask;
+    for (; p->strings[j].ptr; j = (j + 1) & mask) {
+        if (sv_eq(p->strings[j], s)) return p->strings[j];
+    }
+    if (!in_source) {
+        char *copy = (char *)arena_alloc(p->arena, s.len ? s.len : 1, 1);
+        if (!copy) return (StrView){ NULL, 0 };
+        memcpy(copy, s.ptr, s.len);
+        s.ptr = copy;
+    }
+    p->strings[j] = s;
+    p->strings_len++;
+    return p->strings[j];
+}
+
+// Literals without escapes stay views into the source. Escaped ones are
+// decoded once, here, so neither tier ever has to look at a backslash.
+// The lexer already rejected unknown escapes.
+static StrView string_literal(Parser *p, Token t) {
+    StrView raw = tok_strview(t);
+    if (!memchr(raw.ptr, '\\', raw.len)) return intern(p, raw, 1);
+
+    char stackbuf[256];
+    char *buf = raw.len <= sizeof(stackbuf) ? stackbuf : (char *)malloc(raw.len);
+    if (!buf) return (StrView){ NULL, 0 };
+    size_t n = 0;
+    for (size_t i = 0; i < raw.len; i++) {
+        char c = raw.ptr[i];
+        if (c == '\\' && i + 1 < raw.len) {
+            switch (raw.ptr[++i]) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                default:  c = raw.ptr[i]; break; // \\ and \"
+            }
+        }
+        buf[n++] = c;
+    }
+    StrView s = intern(p, (StrView){ buf, n }, 0);
+    if (buf != stackbuf) free(buf);
+    return s;
+}
+
 // ----- Forward decls -----
+static int parse_import(Parser *p, Import *out);
 static FnDecl *parse_fn(Parser *p);
+static StrView parse_type(Parser *p);
 static void parse_block(Parser *p, Stmt ***out_stmts, size_t *out_len);
 
 static Stmt *parse_stmt(Parser *p);
+static Stmt *parse_if(Parser *p);
 
 static Expr *parse_expr(Parser *p);
 static Expr *parse_assignment(Parser *p);
@@ -61,6 +164,12 @@ void parser_init(Parser *p, Lexer *lx, Arena *arena) {
     p->lx = lx;
     p->arena = arena;
     p->had_error = 0;
+    p->panic = 0;
+    p->prev = TOK_EOF;
+    p->cur.kind = TOK_EOF;
+    p->strings = NULL;
+    p->strings_len = 0;
+    p->strings_cap = 0;
     next(p);
 }
 
@@ -72,16 +181,42 @@ Program *parse_program(Parser *p) {
     size_t fns_len = 0;
     size_t fns_cap = 0;
 
+    Import *imports = NULL;
+    size_t imports_len = 0;
+    size_t imports_cap = 0;
+
     while (!is(p, TOK_EOF)) {
+        if (is(p, TOK_KW_IMPORT)) {
+            Import imp;
+            int ok = parse_import(p, &imp);
+            if (p->panic) synchronize(p, 1);
+            if (!ok) {
+                if (!p->had_error) break; // out of memory
+                continue;
+            }
+            if (imports_len == imports_cap) {
+                size_t new_cap = imports_cap ? imports_cap * 2 : 4;
+                Import *ni = (Import *)arena_alloc(p->arena, new_cap * sizeof(Import), _Alignof(Import));
+                if (!ni) return NULL;
+                if (imports) memcpy(ni, imports, imports_len * sizeof(Import));
+                imports = ni;
+                imports_cap = new_cap;
+            }
+            imports[imports_len++] = imp;
+            continue;
+        }
         if (!is(p, TOK_KW_FUNCT)) {
-            error_at(p, p->cur.span, "top-level: expected 'funct'");
-            // best-effort recovery: skip one token
-            next(p);
+            error_at(p, p->cur.span, "top-level: expected 'funct' or 'import'");
+            synchronize(p, 1);
             continue;
         }
 
         FnDecl *fn = parse_fn(p);
-        if (!fn) break;
+        if (p->panic) synchronize(p, 1);
+        if (!fn) {
+            if (!p->had_error) break; // out of memory
+            continue;
+        }
 
         if (fns_len == fns_cap) {
             size_t new_cap = fns_cap ? fns_cap * 2 : 8;
@@ -96,9 +231,38 @@ Program *parse_program(Parser *p) {
 
     prog->fns = fns;
     prog->fns_len = fns_len;
+    prog->imports = imports;
+    prog->imports_len = imports_len;
+    ast_index_fns(prog, p->arena);
     return prog;
 }
 
+// import <ident> ( '.' <ident> )* ';'
+static int parse_import(Parser *p, Import *out) {
+    out->span = p->cur.span;
+    expect(p, TOK_KW_IMPORT, "'import'");
+
+    StrView name = { NULL, 0 };
+    do {
+        Token t = p->cur;
+        if (!expect(p, TOK_IDENT, "module name")) return 0;
+        size_t len = name.len ? name.len + 1 + t.length : t.length;
+        char *s = (char *)arena_alloc(p->arena, len, 1);
+        if (!s) return 0;
+        if (name.len) {
+            memcpy(s, name.ptr, name.len);
+            s[name.len] = '.';
+        }
+        memcpy(s + len - t.length, t.start, t.length);
+        name.ptr = s;
+        name.len = len;
+    } while (accept(p, TOK_DOT));
+
+    out->name = name;
+    expect(p, TOK_SEMI, "';'");
+    return 1;
+}
+
 // funct <ident> ( <params>? ) ret <type> { <stmts>* }
 static FnDecl *parse_fn(Parser *p) {
     Token funct_tok = p->cur;
@@ -126,11 +290,7 @@ static FnDecl *parse_fn(Parser *p) {
             if (!expect(p, TOK_IDENT, "parameter name")) break;
 
             StrView type_name = (StrView){0};
-            if (accept(p, TOK_COLON)) {
-                Token ty = p->cur;
-                expect(p, TOK_IDENT, "type name");
-                type_name = tok_strview(ty);
-            }
+            if (accept(p, TOK_COLON)) type_name = parse_type(p);
 
             if (params_len == params_cap) {
                 size_t new_cap = params_cap ? params_cap * 2 : 4;
@@ -154,12 +314,10 @@ static FnDecl *parse_fn(Parser *p) {
 
     expect(p, TOK_RPAREN, "')'");
 
-    // required return type: ret Ident
+    // required return type: ret <type>
     fn->return_type = (StrView){0};
     expect(p, TOK_KW_RET, "'ret'");
-    Token rt = p->cur;
-    expect(p, TOK_IDENT, "return type");
-    fn->return_type = tok_strview(rt);
+    fn->return_type = parse_type(p);
 
     // body
     expect(p, TOK_LBRACE, "'{'");
@@ -176,18 +334,32 @@ static FnDecl *parse_fn(Parser *p) {
     return fn;
 }
 
+// type -> ident ( '[' type ']' )?     e.g. int, list[int], list[list[bool]]
+// returns the source text of the whole type
+static StrView parse_type(Parser *p) {
+    Token first = p->cur;
+    if (!expect(p, TOK_IDENT, "type name")) return (StrView){0};
+
+    StrView sv = tok_strview(first);
+    if (accept(p, TOK_LBRACK)) {
+        parse_type(p);
+        Token close = p->cur;
+        if (expect(p, TOK_RBRACK, "']'")) sv.len = (size_t)(close.start + close.length - first.start);
+    }
+    return sv;
+}
+
 static void parse_block(Parser *p, Stmt ***out_stmts, size_t *out_len) {
     Stmt **stmts = NULL;
     size_t len = 0;
     size_t cap = 0;
 
-    while (!is(p, TOK_EOF) && !is(p, TOK_RBRACE)) {
+    // a 'funct' here means the '}' is missing; the top level picks it up
+    while (!is(p, TOK_EOF) && !is(p, TOK_RBRACE) && !is(p, TOK_KW_FUNCT)) {
         Stmt *s = parse_stmt(p);
-        if (!s) {
-            // best-effort recovery: skip one token
-            next(p);
-            continue;
-        }
+        if (p->panic) synchronize(p, 0);
+        else if (!s) return; // out of memory
+        if (!s) continue;
 
         if (len == cap) {
             size_t new_cap = cap ? cap * 2 : 8;
@@ -206,11 +378,58 @@ static void parse_block(Parser *p, Stmt ***out_stmts, size_t *out_len) {
     *out_len = len;
 }
 
+// if expr { stmts* } ( else ( if ... | { stmts* } ) )?
+static Stmt *parse_if(Parser *p) {
+    Token if_tok = p->cur;
+    expect(p, TOK_KW_IF, "'if'");
+
+    Stmt *s = ast_new_stmt(p->arena, STMT_IF, if_tok.span);
+    if (!s) return NULL;
+    s->as.if_stmt.cond = parse_expr(p);
+
+    expect(p, TOK_LBRACE, "'{'");
+    parse_block(p, &s->as.if_stmt.then_body, &s->as.if_stmt.then_len);
+
+    if (accept(p, TOK_KW_ELSE)) {
+        if (is(p, TOK_KW_IF)) {
+            // else-if chains become a single nested if in the else body
+            Stmt *nested = parse_if(p);
+            if (!nested) return NULL;
+            Stmt **body = (Stmt **)arena_alloc(p->arena, sizeof(Stmt *), _Alignof(Stmt *));
+            if (!body) return NULL;
+            body[0] = nested;
+            s->as.if_stmt.else_body = body;
+            s->as.if_stmt.else_len = 1;
+        } else {
+            expect(p, TOK_LBRACE, "'{'");
+            parse_block(p, &s->as.if_stmt.else_body, &s->as.if_stmt.else_len);
+        }
+    }
+    return s;
+}
+
 // stmt:
 //   let (mut)? ident ( : ident )? = expr ;
 //   return expr? ;
+//   if expr { stmts* } ( else ... )?
+//   while expr { stmts* }
 //   expr ;
 static Stmt *parse_stmt(Parser *p) {
+    if (is(p, TOK_KW_IF)) {
+        return parse_if(p);
+    }
+
+    if (is(p, TOK_KW_WHILE)) {
+        Token while_tok = p->cur;
+        next(p);
+        Stmt *s = ast_new_stmt(p->arena, STMT_WHILE, while_tok.span);
+        if (!s) return NULL;
+        s->as.while_stmt.cond = parse_expr(p);
+        expect(p, TOK_LBRACE, "'{'");
+        parse_block(p, &s->as.while_stmt.body, &s->as.while_stmt.body_len);
+        return s;
+    }
+
     if (accept(p, TOK_KW_LET)) {
         Span sp = p->cur.span; // best effort (already advanced past 'let')
         int is_mut = accept(p, TOK_KW_MUT);
@@ -219,17 +438,17 @@ static Stmt *parse_stmt(Parser *p) {
         if (!expect(p, TOK_IDENT, "variable name")) return NULL;
 
         StrView type_name = (StrView){0};
-        if (accept(p, TOK_COLON)) {
-            Token ty = p->cur;
-            expect(p, TOK_IDENT, "type name");
-            type_name = tok_strview(ty);
-        }
+        if (accept(p, TOK_COLON)) type_name = parse_type(p);
 
         expect(p, TOK_EQ, "'='");
 
         Expr *init = parse_expr(p);
         expect(p, TOK_SEMI, "';'");
 
+        // `let xs: list[int] = [];` gives the literal its element type
+        if (init && init->kind == EXPR_LIST) init->as.list.type_name = type_name;
+        if (init && init->kind == EXPR_MAP) init->as.map.type_name = type_name;
+
         Stmt *s = ast_new_stmt(p->arena, STMT_LET, name.span);
         if (!s) return NULL;
         s->as.let_stmt.is_mut = is_mut;
@@ -275,11 +494,21 @@ static Expr *parse_assignment(Parser *p) {
     if (!lhs) return NULL;
 
     if (accept(p, TOK_EQ)) {
-        // only allow "name = expr" for now
+        Expr *rhs = parse_assignment(p);
+
+        if (lhs->kind == EXPR_INDEX) {
+            Expr *e = ast_new_expr(p->arena, EXPR_SET_INDEX, lhs->span);
+            if (!e) return NULL;
+            e->as.index.target = lhs->as.index.target;
+            e->as.index.index = lhs->as.index.index;
+            e->as.index.value = rhs;
+            return e;
+        }
+
+        // otherwise only "name = expr"
         if (lhs->kind != EXPR_NAME) {
-            error_at(p, lhs->span, "left side of assignment must be a name");
+            error_at(p, lhs->span, "left side of assignment must be a name or an index");
         }
-        Expr *rhs = parse_assignment(p);
 
         Expr *e = ast_new_expr(p->arena, EXPR_ASSIGN, lhs->span);
         if (!e) return NULL;
@@ -374,11 +603,20 @@ static Expr *parse_factor(Parser *p) {
     return e;
 }
 
-// unary -> ('-' | '!') unary | call
+// unary -> ('-' | '!') unary | ('spawn' | 'go') call | call
 static Expr *parse_unary(Parser *p) {
     if (is(p, TOK_MINUS) || is(p, TOK_EXCL)) {
         Token op = p->cur;
         next(p);
+
+        // -9223372036854775808: the literal alone does not fit (see lexer_next)
+        if (op.kind == TOK_MINUS && is(p, TOK_INT) && p->cur.int_val == INT64_MIN) {
+            Expr *e = ast_new_expr(p->arena, EXPR_INT, op.span);
+            next(p);
+            if (!e) return NULL;
+            e->as.int_val = INT64_MIN;
+            return e;
+        }
         Expr *rhs = parse_unary(p);
 
         Expr *e = ast_new_expr(p->arena, EXPR_UNARY, op.span);
@@ -387,40 +625,76 @@ static Expr *parse_unary(Parser *p) {
         e->as.unary.rhs = rhs;
         return e;
     }
+    if (is(p, TOK_KW_SPAWN) || is(p, TOK_KW_GO)) {
+        Token kw = p->cur;
+        next(p);
+        Expr *e = parse_call(p);
+        if (!e) return NULL;
+        if (e->kind != EXPR_CALL) {
+            error_at(p, kw.span, kw.kind == TOK_KW_GO ? "'go' expects a function call" : "'spawn' expects a function call");
+            return e;
+        }
+        if (kw.kind == TOK_KW_GO) e->as.call.go = 1;
+        else e->as.call.spawn = 1;
+        return e;
+    }
     return parse_call(p);
 }
 
-// call -> primary ( '(' args? ')' )*
+// comma-separated expressions up to (and consuming) `close`
+static Expr **parse_expr_list(Parser *p, TokenKind close, const char *what, size_t *out_len) {
+    Expr **items = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+
+    if (!is(p, close)) {
+        for (;;) {
+            Expr *a = parse_expr(p);
+            if (!a) break;
+
+            if (len == cap) {
+                size_t new_cap = cap ? cap * 2 : 4;
+                Expr **na = (Expr **)arena_alloc(p->arena, new_cap * sizeof(Expr *), _Alignof(Expr *));
+                if (!na) return NULL;
+                if (items) memcpy(na, items, len * sizeof(Expr *));
+                items = na;
+                cap = new_cap;
+            }
+            items[len++] = a;
+
+            if (accept(p, TOK_COMMA)) continue;
+            break;
+        }
+    }
+
+    expect(p, close, what);
+    *out_len = len;
+    return items;
+}
+
+// call -> primary ( '(' args? ')' | '[' expr ']' )*
 static Expr *parse_call(Parser *p) {
     Expr *e = parse_primary(p);
     for (;;) {
+        if (e && is(p, TOK_LBRACK)) {
+            Token open = p->cur;
+            next(p);
+            Expr *index = parse_expr(p);
+            expect(p, TOK_RBRACK, "']'");
+
+            Expr *ix = ast_new_expr(p->arena, EXPR_INDEX, open.span);
+            if (!ix) return NULL;
+            ix->as.index.target = e;
+            ix->as.index.index = index;
+            ix->as.index.value = NULL;
+            e = ix;
+            continue;
+        }
+
         if (!accept(p, TOK_LPAREN)) break;
 
-        Expr **args = NULL;
         size_t args_len = 0;
-        size_t args_cap = 0;
-
-        if (!is(p, TOK_RPAREN)) {
-            for (;;) {
-                Expr *a = parse_expr(p);
-                if (!a) break;
-
-                if (args_len == args_cap) {
-                    size_t new_cap = args_cap ? args_cap * 2 : 4;
-                    Expr **na = (Expr **)arena_alloc(p->arena, new_cap * sizeof(Expr *), _Alignof(Expr *));
-                    if (!na) return NULL;
-                    if (args) memcpy(na, args, args_len * sizeof(Expr *));
-                    args = na;
-                    args_cap = new_cap;
-                }
-                args[args_len++] = a;
-
-                if (accept(p, TOK_COMMA)) continue;
-                break;
-            }
-        }
-
-        expect(p, TOK_RPAREN, "')'");
+        Expr **args = parse_expr_list(p, TOK_RPAREN, "')'", &args_len);
 
         Expr *call = ast_new_expr(p->arena, EXPR_CALL, e->span);
         if (!call) return NULL;
@@ -432,11 +706,60 @@ static Expr *parse_call(Parser *p) {
     return e;
 }
 
-// primary -> INT | STRING | true | false | IDENT | '(' expr ')'
+// map literal body after '{':  ( expr ':' expr ( ',' expr ':' expr )* )? '}'
+static Expr *parse_map(Parser *p, Span sp) {
+    Expr *e = ast_new_expr(p->arena, EXPR_MAP, sp);
+    if (!e) return NULL;
+
+    Expr **keys = NULL;
+    Expr **values = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+
+    if (!is(p, TOK_RBRACE)) {
+        for (;;) {
+            Expr *k = parse_expr(p);
+            if (!k) break;
+            expect(p, TOK_COLON, "':'");
+            Expr *v = parse_expr(p);
+            if (!v) break;
+
+            if (len == cap) {
+                size_t new_cap = cap ? cap * 2 : 4;
+                Expr **nk = (Expr **)arena_alloc(p->arena, new_cap * sizeof(Expr *), _Alignof(Expr *));
+                Expr **nv = (Expr **)arena_alloc(p->arena, new_cap * sizeof(Expr *), _Alignof(Expr *));
+                if (!nk || !nv) return NULL;
+                if (keys) memcpy(nk, keys, len * sizeof(Expr *));
+                if (values) memcpy(nv, values, len * sizeof(Expr *));
+                keys = nk;
+                values = nv;
+                cap = new_cap;
+            }
+            keys[len] = k;
+            values[len] = v;
+            len++;
+
+            if (accept(p, TOK_COMMA)) continue;
+            break;
+        }
+    }
+    expect(p, TOK_RBRACE, "'}'");
+
+    e->as.map.keys = keys;
+    e->as.map.values = values;
+    e->as.map.len = len;
+    e->as.map.type_name = (StrView){0};
+    return e;
+}
+
+// primary -> INT | STRING | true | false | IDENT | '(' expr ')' | '[' items? ']' | '{' pairs? '}'
 static Expr *parse_primary(Parser *p) {
     Token t = p->cur;
 
     if (accept(p, TOK_INT)) {
+        if (t.int_val == INT64_MIN) {
+            error_at(p, t.span, "integer literal 9223372036854775808 does not fit in an int (only its negation does)");
+        }
         Expr *e = ast_new_expr(p->arena, EXPR_INT, t.span);
         if (!e) return NULL;
         e->as.int_val = t.int_val;
@@ -446,7 +769,8 @@ static Expr *parse_primary(Parser *p) {
     if (accept(p, TOK_STRING)) {
         Expr *e = ast_new_expr(p->arena, EXPR_STRING, t.span);
         if (!e) return NULL;
-        e->as.str = tok_strview(t);
+        e->as.str = string_literal(p, t);
+        if (!e->as.str.ptr) return NULL;
         return e;
     }
 
@@ -477,6 +801,18 @@ static Expr *parse_primary(Parser *p) {
         return e;
     }
 
+    if (accept(p, TOK_LBRACK)) {
+        Expr *e = ast_new_expr(p->arena, EXPR_LIST, t.span);
+        if (!e) return NULL;
+        e->as.list.items = parse_expr_list(p, TOK_RBRACK, "']'", &e->as.list.items_len);
+        e->as.list.type_name = (StrView){0};
+        return e;
+    }
+
+    if (accept(p, TOK_LBRACE)) {
+        return parse_map(p, t.span);
+    }
+
     error_at(p, p->cur.span, "expected expression");
     return NULL;
 }
@@ -9,7 +9,14 @@ typedef struct {
     Arena *arena;
 
     Token cur;
+    TokenKind prev; // kind of the token before cur
     int had_error;
+    int panic; // after an error, until synchronize: report nothing more
+
+    // decoded string literals, interned so equal ones share one copy
+    StrView *strings;
+    size_t strings_len;
+    size_t strings_cap; // power of two, open addressing
 } Parser;
 
 void parser_init(Parser *p, Lexer *lx, Arena *arena);
@@ -0,0 +1,323 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pgo.h"
+#include "callgraph.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PGO_HEADER "lunar-pgo 1"
+
+typedef enum {
+    SITE_CALL,
+    SITE_BRANCH, // if or while condition
+} SiteKind;
+
+typedef struct {
+    const void *node; // the EXPR_CALL, STMT_IF or STMT_WHILE
+    uint32_t fn;      // the function it is in
+    uint32_t callee;  // SITE_CALL only
+    uint32_t line;
+    uint32_t col;
+    SiteKind kind;
+    int is_loop;
+    int known;        // --pgo-use: the profile had counts for it
+    _Atomic uint64_t count[2]; // calls made; or conditions true, false
+} Site;
+
+struct Pgo {
+    const Program *prog;
+
+    Site *sites;
+    size_t sites_len;
+    size_t sites_cap;
+    size_t *fn_sites; // fns[i]'s sites are fn_sites[i] up to fn_sites[i + 1]
+
+    _Atomic uint64_t *fn_calls;
+    size_t *fn_size; // AST nodes: a profile of another size is stale
+    int *fn_known;
+
+    uint32_t *by_node; // site + 1 by node pointer, open addressing, power-of-two cap
+    size_t by_node_cap;
+
+    uint64_t hot_calls;
+};
+
+// ----- numbering sites -----
+
+static int add_site(Pgo *p, const void *node, SiteKind kind, size_t fn, Span sp) {
+    if (p->sites_len == p->sites_cap) {
+        size_t cap = p->sites_cap ? p->sites_cap * 2 : 256;
+        Site *s = (Site *)realloc(p->sites, cap * sizeof(Site));
+        if (!s) return 0;
+        p->sites = s;
+        p->sites_cap = cap;
+    }
+    Site *s = &p->sites[p->sites_len++];
+    memset(s, 0, sizeof(*s));
+    s->node = node;
+    s->kind = kind;
+    s->fn = (uint32_t)fn;
+    s->line = (uint32_t)sp.line;
+    s->col = (uint32_t)sp.col;
+    return 1;
+}
+
+static int walk_stmts(Pgo *p, size_t fn, Stmt **stmts, size_t len);
+
+static int walk_expr(Pgo *p, size_t fn, const Expr *e) {
+    if (!e) return 1;
+    switch (e->kind) {
+        case EXPR_UNARY:
+            return walk_expr(p, fn, e->as.unary.rhs);
+        case EXPR_BINARY:
+            return walk_expr(p, fn, e->as.binary.lhs) && walk_expr(p, fn, e->as.binary.rhs);
+        case EXPR_ASSIGN:
+            return walk_expr(p, fn, e->as.assign.value);
+        case EXPR_CALL: {
+            const Expr *callee = e->as.call.callee;
+            long target = callee && callee->kind == EXPR_NAME ? ast_find_fn(p->prog, callee->as.str) : -1;
+            if (target >= 0) {
+                if (!add_site(p, e, SITE_CALL, fn, e->span)) return 0;
+                p->sites[p->sites_len - 1].callee = (uint32_t)target;
+            }
+            for (size_t i = 0; i < e->as.call.args_len; i++) {
+                if (!walk_expr(p, fn, e->as.call.args[i])) return 0;
+            }
+            return 1;
+        }
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) {
+                if (!walk_expr(p, fn, e->as.list.items[i])) return 0;
+            }
+            return 1;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                if (!walk_expr(p, fn, e->as.map.keys[i]) || !walk_expr(p, fn, e->as.map.values[i])) return 0;
+            }
+            return 1;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            return walk_expr(p, fn, e->as.index.target) && walk_expr(p, fn, e->as.index.index) &&
+                   walk_expr(p, fn, e->as.index.value);
+        default:
+            return 1;
+    }
+}
+
+static int walk_stmts(Pgo *p, size_t fn, Stmt **stmts, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const Stmt *s = stmts[i];
+        int ok = 1;
+        switch (s->kind) {
+            case STMT_LET: ok = walk_expr(p, fn, s->as.let_stmt.init); break;
+            case STMT_RETURN: ok = walk_expr(p, fn, s->as.ret_stmt.value); break;
+            case STMT_EXPR: ok = walk_expr(p, fn, s->as.expr_stmt.expr); break;
+            case STMT_IF:
+                ok = add_site(p, s, SITE_BRANCH, fn, s->span) && walk_expr(p, fn, s->as.if_stmt.cond) &&
+                     walk_stmts(p, fn, s->as.if_stmt.then_body, s->as.if_stmt.then_len) &&
+                     walk_stmts(p, fn, s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+                break;
+            case STMT_WHILE:
+                ok = add_site(p, s, SITE_BRANCH, fn, s->span);
+                if (ok) p->sites[p->sites_len - 1].is_loop = 1;
+                ok = ok && walk_expr(p, fn, s->as.while_stmt.cond) &&
+                     walk_stmts(p, fn, s->as.while_stmt.body, s->as.while_stmt.body_len);
+                break;
+        }
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+static size_t node_slot(const Pgo *p, const void *node) {
+    uint64_t h = (uint64_t)(uintptr_t)node * 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32) & (p->by_node_cap - 1);
+}
+
+Pgo *pgo_new(const Program *prog) {
+    Pgo *p = (Pgo *)calloc(1, sizeof(Pgo));
+    if (!p) return NULL;
+    size_t n = prog->fns_len;
+    p->prog = prog;
+    p->fn_sites = (size_t *)calloc(n + 1, sizeof(size_t));
+    p->fn_calls = (_Atomic uint64_t *)calloc(n ? n : 1, sizeof(*p->fn_calls));
+    p->fn_size = (size_t *)calloc(n ? n : 1, sizeof(size_t));
+    p->fn_known = (int *)calloc(n ? n : 1, sizeof(int));
+    if (!p->fn_sites || !p->fn_calls || !p->fn_size || !p->fn_known) {
+        pgo_free(p);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const FnDecl *fn = prog->fns[i];
+        p->fn_sites[i] = p->sites_len;
+        if (fn->external) continue;
+        p->fn_size[i] = ast_stmts_size(fn->body, fn->body_len);
+        if (!walk_stmts(p, i, fn->body, fn->body_len)) {
+            pgo_free(p);
+            return NULL;
+        }
+    }
+    p->fn_sites[n] = p->sites_len;
+
+    p->by_node_cap = 64;
+    while (p->by_node_cap < p->sites_len * 2) p->by_node_cap *= 2;
+    p->by_node = (uint32_t *)calloc(p->by_node_cap, sizeof(uint32_t));
+    if (!p->by_node || p->sites_len >= UINT32_MAX) {
+        pgo_free(p);
+        return NULL;
+    }
+    for (size_t i = 0; i < p->sites_len; i++) {
+        size_t j = node_slot(p, p->sites[i].node);
+        while (p->by_node[j]) j = (j + 1) & (p->by_node_cap - 1);
+        p->by_node[j] = (uint32_t)i + 1;
+    }
+    return p;
+}
+
+void pgo_free(Pgo *p) {
+    if (!p) return;
+    free(p->sites);
+    free(p->fn_sites);
+    free(p->fn_calls);
+    free(p->fn_size);
+    free(p->fn_known);
+    free(p->by_node);
+    free(p);
+}
+
+long pgo_site(const Pgo *p, const void *node) {
+    for (size_t j = node_slot(p, node); p->by_node[j]; j = (j + 1) & (p->by_node_cap - 1)) {
+        size_t s = p->by_node[j] - 1;
+        if (p->sites[s].node == node) return (long)s;
+    }
+    return -1;
+}
+
+// ----- recording -----
+
+void pgo_count(Pgo *p, size_t site, int which) {
+    atomic_fetch_add_explicit(&p->sites[site].count[which], 1, memory_order_relaxed);
+}
+
+void pgo_enter(Pgo *p, size_t fn) {
+    atomic_fetch_add_explicit(&p->fn_calls[fn], 1, memory_order_relaxed);
+}
+
+// One block per function that ran: its name, size and entries, then a
+// line per site with its position (and callee) and counts. Sites that
+// never ran are written too: that they did not is what makes them cold.
+int pgo_write(const Pgo *p, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    fprintf(f, "%s\n", PGO_HEADER);
+    for (size_t i = 0; i < p->prog->fns_len; i++) {
+        uint64_t calls = atomic_load_explicit(&p->fn_calls[i], memory_order_relaxed);
+        if (!calls) continue;
+        StrView name = p->prog->fns[i]->name;
+        fprintf(f, "fn %.*s %zu %llu\n", (int)name.len, name.ptr, p->fn_size[i], (unsigned long long)calls);
+        for (size_t j = p->fn_sites[i]; j < p->fn_sites[i + 1]; j++) {
+            const Site *s = &p->sites[j];
+            unsigned long long n0 = atomic_load_explicit(&s->count[0], memory_order_relaxed);
+            unsigned long long n1 = atomic_load_explicit(&s->count[1], memory_order_relaxed);
+            if (s->kind == SITE_CALL) {
+                StrView callee = p->prog->fns[s->callee]->name;
+                fprintf(f, "call %u:%u %.*s %llu\n", s->line, s->col, (int)callee.len, callee.ptr, n0);
+            } else {
+                fprintf(f, "%s %u:%u %llu %llu\n", s->is_loop ? "while" : "if", s->line, s->col, n0, n1);
+            }
+        }
+    }
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+// ----- using a profile -----
+
+static Site *find_site(Pgo *p, size_t fn, SiteKind kind, int is_loop, unsigned line, unsigned col) {
+    for (size_t j = p->fn_sites[fn]; j < p->fn_sites[fn + 1]; j++) {
+        Site *s = &p->sites[j];
+        if (s->kind == kind && s->is_loop == is_loop && s->line == line && s->col == col && !s->known) return s;
+    }
+    return NULL;
+}
+
+int pgo_load(Pgo *p, const char *path, size_t *matched) {
+    *matched = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, f);
+    int ok = n > 0 && strcmp(line, PGO_HEADER "\n") == 0;
+
+    long fn = -1; // the block we are in, if it matches this program
+    uint64_t max_calls = 0;
+    while (ok && (n = getline(&line, &cap, f)) > 0) {
+        unsigned l = 0, c = 0;
+        unsigned long long a = 0, b = 0;
+        if (strncmp(line, "fn ", 3) == 0) {
+            char *name = line + 3;
+            char *end = strchr(name, ' ');
+            unsigned long long size = 0;
+            fn = -1;
+            if (!end || sscanf(end, " %llu %llu", &size, &a) != 2) continue;
+            StrView sv = { name, (size_t)(end - name) };
+            fn = ast_find_fn(p->prog, sv);
+            if (fn >= 0 && (p->prog->fns[fn]->external || p->fn_size[fn] != size)) fn = -1;
+            if (fn < 0) continue;
+            p->fn_known[fn] = 1;
+            atomic_store_explicit(&p->fn_calls[fn], a, memory_order_relaxed);
+            continue;
+        }
+        if (fn < 0) continue;
+        Site *s = NULL;
+        if (sscanf(line, "call %u:%u %*s %llu", &l, &c, &a) == 3) {
+            s = find_site(p, (size_t)fn, SITE_CALL, 0, l, c);
+            if (s && a > max_calls) max_calls = a;
+        } else if (sscanf(line, "if %u:%u %llu %llu", &l, &c, &a, &b) == 4) {
+            s = find_site(p, (size_t)fn, SITE_BRANCH, 0, l, c);
+        } else if (sscanf(line, "while %u:%u %llu %llu", &l, &c, &a, &b) == 4) {
+            s = find_site(p, (size_t)fn, SITE_BRANCH, 1, l, c);
+        }
+        if (!s) continue;
+        s->known = 1;
+        atomic_store_explicit(&s->count[0], a, memory_order_relaxed);
+        atomic_store_explicit(&s->count[1], b, memory_order_relaxed);
+        (*matched)++;
+    }
+    free(line);
+    fclose(f);
+
+    p->hot_calls = max_calls / PGO_HOT_SHARE;
+    if (p->hot_calls < PGO_HOT_MIN) p->hot_calls = PGO_HOT_MIN;
+    return ok;
+}
+
+int pgo_fn_hot(const Pgo *p, size_t fn, uint32_t call_threshold, uint32_t loop_threshold) {
+    if (!p->fn_known[fn]) return 0;
+    if (atomic_load_explicit(&p->fn_calls[fn], memory_order_relaxed) >= call_threshold) return 1;
+    uint64_t trips = 0;
+    for (size_t j = p->fn_sites[fn]; j < p->fn_sites[fn + 1]; j++) {
+        const Site *s = &p->sites[j];
+        if (s->is_loop && s->known) trips += atomic_load_explicit(&s->count[0], memory_order_relaxed);
+    }
+    return trips >= loop_threshold;
+}
+
+PgoHeat pgo_call_heat(const Pgo *p, const Expr *call) {
+    long s = pgo_site(p, call);
+    if (s < 0 || !p->sites[s].known) return PGO_UNKNOWN;
+    uint64_t n = atomic_load_explicit(&p->sites[s].count[0], memory_order_relaxed);
+    if (!n) return PGO_COLD;
+    return n >= p->hot_calls ? PGO_HOT : PGO_WARM;
+}
+
+int pgo_else_first(const Pgo *p, const Stmt *if_stmt) {
+    long s = pgo_site(p, if_stmt);
+    if (s < 0 || !p->sites[s].known) return 0;
+    const Site *site = &p->sites[s];
+    return atomic_load_explicit(&site->count[1], memory_order_relaxed) >
+           atomic_load_explicit(&site->count[0], memory_order_relaxed);
+}
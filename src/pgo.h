@@ -0,0 +1,74 @@
+#ifndef LUNAR_PGO_H
+#define LUNAR_PGO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// --pgo-gen / --pgo-use: profile-guided optimization.
+//
+// A run with --pgo-gen counts how often each function is entered, each
+// call to a Lunar function (EXPR_CALL) is made, and each `if` and `while`
+// condition comes out true or false. Both tiers count: the tree-walker as
+// it goes, compiled code through OP_COUNT and OP_COUNT_BRANCH, which the
+// compiler only emits in this mode. Nothing is inlined while recording, so
+// every call is counted where it is written. The counts go to a profile
+// file when the program ends.
+//
+// A run with --pgo-use reads them back, and then:
+//   - functions the profile found hot (entered --tier-calls times, or
+//     their loops going round --tier-loops times) are compiled on their
+//     first call instead of warming up in the tree-walker;
+//   - calls made at least hot_calls times (see pgo_load) may inline a
+//     callee PGO_HOT_BUDGET times bigger than --inline-budget, one level
+//     deeper; calls that never ran in a function that did are left out of
+//     line;
+//   - an if/else whose else branch ran more often is laid out else first
+//     (OP_JUMP_IF_TRUE), so the common case falls through.
+// Everything the profile says nothing about gets the usual heuristics.
+//
+// Sites are matched by function name and source position, so a profile
+// survives edits elsewhere in the program. A function whose size (in AST
+// nodes) changed since the profile was recorded is treated as unknown.
+
+typedef struct Pgo Pgo;
+
+#define PGO_DEFAULT_PATH "lunar.pgo"
+#define PGO_HOT_BUDGET   4   // inline budget multiplier for hot calls
+#define PGO_HOT_SHARE    100 // a call is hot within this factor of the busiest one...
+#define PGO_HOT_MIN      100 // ...and made at least this often
+
+typedef enum {
+    PGO_UNKNOWN = 0, // no profile, or nothing recorded for the call
+    PGO_COLD,        // never made, though its function ran
+    PGO_WARM,
+    PGO_HOT,
+} PgoHeat;
+
+// numbers the call and branch sites of prog, all counts at 0
+Pgo *pgo_new(const Program *prog);
+void pgo_free(Pgo *p);
+
+// the site of an EXPR_CALL to a Lunar function or of an if/while
+// statement, or -1
+long pgo_site(const Pgo *p, const void *node);
+
+// --pgo-gen counting; safe from any thread. which: 0 for calls and true
+// conditions, 1 for false ones
+void pgo_count(Pgo *p, size_t site, int which);
+void pgo_enter(Pgo *p, size_t fn);
+
+// returns 0 if the file could not be written
+int pgo_write(const Pgo *p, const char *path);
+
+// Reads a profile written by pgo_write for (a version of) this program.
+// returns 0 if the file cannot be read or is not a profile; *matched is
+// the number of sites it had counts for.
+int pgo_load(Pgo *p, const char *path, size_t *matched);
+
+// --pgo-use queries
+int pgo_fn_hot(const Pgo *p, size_t fn, uint32_t call_threshold, uint32_t loop_threshold);
+PgoHeat pgo_call_heat(const Pgo *p, const Expr *call);
+int pgo_else_first(const Pgo *p, const Stmt *if_stmt);
+
+#endif
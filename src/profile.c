@@ -0,0 +1,363 @@
+#define _DEFAULT_SOURCE
+#include "profile.h"
+#include "vm.h"
+#include "util.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+typedef struct {
+    uint32_t fn;
+    uint32_t line;
+    uint64_t self;
+    uint64_t total;
+    uint64_t seen; // sample that last counted it in total
+    int used;
+} ProfLine;
+
+// a distinct chain of functions, main first
+typedef struct {
+    uint64_t hash;
+    size_t off; // into ids
+    size_t len;
+    uint64_t count;
+} ProfStack;
+
+struct Profile {
+    const Program *prog;
+    pthread_mutex_t lock; // task workers sample too
+
+    uint64_t ticks;
+    uint64_t taken; // samples, to stamp `seen`
+    uint64_t cpu_ns; // between prof_start and prof_stop
+
+    uint64_t *fn_self;
+    uint64_t *fn_total;
+    uint64_t *fn_seen;
+
+    ProfLine *lines; // open addressing, power-of-two cap
+    size_t lines_len;
+    size_t lines_cap;
+
+    ProfStack *stacks; // same
+    size_t stacks_len;
+    size_t stacks_cap;
+    uint32_t *ids;
+    size_t ids_len;
+    size_t ids_cap;
+
+    uint32_t *chain; // this sample's functions and lines
+    uint32_t *chain_lines;
+};
+
+// the Vm that counts ticks landing on this thread
+static _Thread_local Vm *prof_vm;
+static Profile *running;
+
+static uint64_t cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void on_sigprof(int sig) {
+    (void)sig;
+    Vm *vm = prof_vm;
+    if (vm) vm->prof_pending = vm->prof_pending + 1;
+}
+
+Profile *prof_new(const Program *prog) {
+    Profile *p = (Profile *)calloc(1, sizeof(Profile));
+    if (!p) return NULL;
+    size_t n = prog->fns_len ? prog->fns_len : 1;
+    p->prog = prog;
+    p->fn_self = (uint64_t *)calloc(n, sizeof(uint64_t));
+    p->fn_total = (uint64_t *)calloc(n, sizeof(uint64_t));
+    p->fn_seen = (uint64_t *)calloc(n, sizeof(uint64_t));
+    p->chain = (uint32_t *)malloc(VM_FRAMES_MAX * sizeof(uint32_t));
+    p->chain_lines = (uint32_t *)malloc(VM_FRAMES_MAX * sizeof(uint32_t));
+    if (!p->fn_self || !p->fn_total || !p->fn_seen || !p->chain || !p->chain_lines) {
+        prof_free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    return p;
+}
+
+void prof_free(Profile *p) {
+    if (!p) return;
+    if (p->chain) pthread_mutex_destroy(&p->lock);
+    free(p->fn_self);
+    free(p->fn_total);
+    free(p->fn_seen);
+    free(p->lines);
+    free(p->stacks);
+    free(p->ids);
+    free(p->chain);
+    free(p->chain_lines);
+    free(p);
+}
+
+int prof_start(Vm *vm) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return 0;
+    prof_vm = vm;
+    running = vm->prof;
+    running->cpu_ns = cpu_ns();
+
+    struct itimerval it;
+    it.it_interval.tv_sec = 0;
+    it.it_interval.tv_usec = 1000000 / PROF_HZ;
+    it.it_value = it.it_interval;
+    return setitimer(ITIMER_PROF, &it, NULL) == 0;
+}
+
+void prof_stop(void) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    // a tick already on its way would otherwise kill the process
+    signal(SIGPROF, SIG_IGN);
+    prof_vm = NULL;
+    if (running) running->cpu_ns = cpu_ns() - running->cpu_ns;
+    running = NULL;
+}
+
+void prof_attach(Vm *vm) {
+    prof_vm = vm;
+}
+
+// ----- recording -----
+
+static int grow(void **arr, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) return 1;
+    size_t n = *cap ? *cap * 2 : 256;
+    while (n < need) n *= 2;
+    void *q = realloc(*arr, n * size);
+    if (!q) return 0;
+    *arr = q;
+    *cap = n;
+    return 1;
+}
+
+static uint64_t line_hash(uint32_t fn, uint32_t line) {
+    uint64_t h = ((uint64_t)fn << 32 | line) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+}
+
+static int rehash_lines(Profile *p) {
+    size_t cap = p->lines_cap ? p->lines_cap * 2 : 256;
+    ProfLine *t = (ProfLine *)calloc(cap, sizeof(ProfLine));
+    if (!t) return 0;
+    for (size_t i = 0; i < p->lines_cap; i++) {
+        ProfLine *e = &p->lines[i];
+        if (!e->used) continue;
+        size_t j = (size_t)line_hash(e->fn, e->line) & (cap - 1);
+        while (t[j].used) j = (j + 1) & (cap - 1);
+        t[j] = *e;
+    }
+    free(p->lines);
+    p->lines = t;
+    p->lines_cap = cap;
+    return 1;
+}
+
+static ProfLine *find_line(Profile *p, uint32_t fn, uint32_t line) {
+    if ((p->lines_len + 1) * 2 > p->lines_cap && !rehash_lines(p)) return NULL;
+    size_t mask = p->lines_cap - 1;
+    size_t j = (size_t)line_hash(fn, line) & mask;
+    while (p->lines[j].used) {
+        ProfLine *e = &p->lines[j];
+        if (e->fn == fn && e->line == line) return e;
+        j = (j + 1) & mask;
+    }
+    ProfLine *e = &p->lines[j];
+    memset(e, 0, sizeof(*e));
+    e->fn = fn;
+    e->line = line;
+    e->used = 1;
+    p->lines_len++;
+    return e;
+}
+
+static int rehash_stacks(Profile *p) {
+    size_t cap = p->stacks_cap ? p->stacks_cap * 2 : 256;
+    ProfStack *t = (ProfStack *)calloc(cap, sizeof(ProfStack));
+    if (!t) return 0;
+    for (size_t i = 0; i < p->stacks_cap; i++) {
+        ProfStack *e = &p->stacks[i];
+        if (!e->count) continue;
+        size_t j = (size_t)e->hash & (cap - 1);
+        while (t[j].count) j = (j + 1) & (cap - 1);
+        t[j] = *e;
+    }
+    free(p->stacks);
+    p->stacks = t;
+    p->stacks_cap = cap;
+    return 1;
+}
+
+static void add_stack(Profile *p, const uint32_t *fns, size_t n, uint64_t ticks) {
+    if ((p->stacks_len + 1) * 2 > p->stacks_cap && !rehash_stacks(p)) return;
+    uint64_t h = hash_bytes(fns, n * sizeof(uint32_t), HASH_SEED);
+    size_t mask = p->stacks_cap - 1;
+    size_t j = (size_t)h & mask;
+    while (p->stacks[j].count) {
+        ProfStack *e = &p->stacks[j];
+        if (e->hash == h && e->len == n && memcmp(p->ids + e->off, fns, n * sizeof(uint32_t)) == 0) {
+            e->count += ticks;
+            return;
+        }
+        j = (j + 1) & mask;
+    }
+    if (!grow((void **)&p->ids, &p->ids_cap, p->ids_len + n, sizeof(uint32_t))) return;
+    memcpy(p->ids + p->ids_len, fns, n * sizeof(uint32_t));
+    ProfStack *e = &p->stacks[j];
+    e->hash = h;
+    e->off = p->ids_len;
+    e->len = n;
+    e->count = ticks;
+    p->ids_len += n;
+    p->stacks_len++;
+}
+
+// the line frames[i] is at, for every frame but the top one
+static uint32_t frame_line(const Vm *vm, size_t i) {
+    const Frame *fr = &vm->frames[i];
+    if (!fr->ip) return fr[1].site_line; // tree-walked: the callee knows where it was called from
+    const Chunk *ch = vm->fns[fr->fn].chunk;
+    size_t off = (size_t)(fr->ip - ch->code);
+    // ip is past the call instruction by now
+    return chunk_pos_at(ch, off ? off - 1 : 0).line;
+}
+
+void prof_sample(Vm *vm, Span where) {
+    uint64_t ticks = (uint64_t)vm->prof_pending;
+    vm->prof_pending = 0;
+    Profile *p = vm->prof;
+    size_t n = vm->frames_len;
+    if (!p || !ticks || !n) return;
+
+    pthread_mutex_lock(&p->lock);
+    for (size_t i = 0; i < n; i++) {
+        p->chain[i] = vm->frames[i].fn;
+        p->chain_lines[i] = i + 1 == n ? (uint32_t)where.line : frame_line(vm, i);
+    }
+    p->ticks += ticks;
+    uint64_t stamp = ++p->taken;
+
+    uint32_t top = p->chain[n - 1];
+    p->fn_self[top] += ticks;
+    ProfLine *e = find_line(p, top, p->chain_lines[n - 1]);
+    if (e) e->self += ticks;
+    // recursion shows a function (or line) several times; total counts it once
+    for (size_t i = 0; i < n; i++) {
+        uint32_t fn = p->chain[i];
+        if (p->fn_seen[fn] != stamp) {
+            p->fn_seen[fn] = stamp;
+            p->fn_total[fn] += ticks;
+        }
+        e = find_line(p, fn, p->chain_lines[i]);
+        if (e && e->seen != stamp) {
+            e->seen = stamp;
+            e->total += ticks;
+        }
+    }
+    add_stack(p, p->chain, n, ticks);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// ----- output -----
+
+static StrView fn_name(const Profile *p, uint32_t fn) {
+    return p->prog->fns[fn]->name;
+}
+
+int prof_write_folded(const Profile *p, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    for (size_t i = 0; i < p->stacks_cap; i++) {
+        const ProfStack *e = &p->stacks[i];
+        if (!e->count) continue;
+        for (size_t j = 0; j < e->len; j++) {
+            StrView name = fn_name(p, p->ids[e->off + j]);
+            fprintf(f, "%s%.*s", j ? ";" : "", (int)name.len, name.ptr);
+        }
+        fprintf(f, " %llu\n", (unsigned long long)e->count);
+    }
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+typedef struct {
+    uint64_t self;
+    uint64_t total;
+    uint32_t fn;
+    uint32_t line;
+} ProfRow;
+
+static int row_cmp(const void *a, const void *b) {
+    const ProfRow *x = (const ProfRow *)a, *y = (const ProfRow *)b;
+    if (x->self != y->self) return x->self < y->self ? 1 : -1;
+    if (x->total != y->total) return x->total < y->total ? 1 : -1;
+    if (x->fn != y->fn) return x->fn < y->fn ? -1 : 1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+static double pct(uint64_t n, uint64_t of) {
+    return of ? 100.0 * (double)n / (double)of : 0.0;
+}
+
+void prof_report(const Profile *p, FILE *out) {
+    // the kernel may deliver fewer ticks than asked for; the CPU time says what one is worth
+    fprintf(out, "profile: %llu samples over %.1f ms of CPU time\n", (unsigned long long)p->ticks, (double)p->cpu_ns / 1e6);
+    if (!p->ticks) return;
+
+    size_t fns = p->prog->fns_len;
+    size_t cap = fns > p->lines_len ? fns : p->lines_len;
+    ProfRow *rows = (ProfRow *)malloc((cap ? cap : 1) * sizeof(ProfRow));
+    if (!rows) return;
+
+    size_t n = 0;
+    for (size_t i = 0; i < fns; i++) {
+        if (!p->fn_total[i]) continue;
+        rows[n].self = p->fn_self[i];
+        rows[n].total = p->fn_total[i];
+        rows[n].fn = (uint32_t)i;
+        rows[n].line = 0;
+        n++;
+    }
+    qsort(rows, n, sizeof(ProfRow), row_cmp);
+    fprintf(out, "  functions:   self   total\n");
+    for (size_t i = 0; i < n && i < PROF_REPORT_ROWS; i++) {
+        StrView name = fn_name(p, rows[i].fn);
+        fprintf(out, "             %5.1f%%  %5.1f%%  %.*s\n", pct(rows[i].self, p->ticks), pct(rows[i].total, p->ticks),
+                (int)name.len, name.ptr);
+    }
+
+    n = 0;
+    for (size_t i = 0; i < p->lines_cap; i++) {
+        const ProfLine *e = &p->lines[i];
+        if (!e->used) continue;
+        rows[n].self = e->self;
+        rows[n].total = e->total;
+        rows[n].fn = e->fn;
+        rows[n].line = e->line;
+        n++;
+    }
+    qsort(rows, n, sizeof(ProfRow), row_cmp);
+    fprintf(out, "  lines:       self   total\n");
+    for (size_t i = 0; i < n && i < PROF_REPORT_ROWS; i++) {
+        const FnDecl *fn = p->prog->fns[rows[i].fn];
+        fprintf(out, "             %5.1f%%  %5.1f%%  %s:%u (%.*s)\n", pct(rows[i].self, p->ticks),
+                pct(rows[i].total, p->ticks), fn->span.path, (unsigned)rows[i].line, (int)fn->name.len, fn->name.ptr);
+    }
+    free(rows);
+}
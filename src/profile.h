@@ -0,0 +1,54 @@
+#ifndef LUNAR_PROFILE_H
+#define LUNAR_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+
+// --profile: a sampling profiler for Lunar code.
+//
+// A SIGPROF timer ticks PROF_HZ times per second of CPU time. The
+// handler only counts the tick on the Vm of the thread it lands on; that
+// Vm records a sample at its next safepoint (call or loop back-edge) or
+// when the builtin it is in returns, weighted by the ticks it got since
+// the last one. A sample is the chain of frames, each with its function
+// and line: the top frame at the safepoint's position, the others at the
+// call they are in. Straight-line code between two safepoints is counted
+// where it ends, so a loop body without calls shows up on its `while`.
+//
+// Calls the compiler inlined count as part of their caller, which is
+// where they run. Tasks and coroutines are sampled like any other code,
+// the root of their stack being the function they started with.
+
+typedef struct Vm Vm;
+typedef struct Profile Profile;
+
+#define PROF_HZ           1000
+#define PROF_DEFAULT_PATH "lunar.prof"
+#define PROF_REPORT_ROWS  20
+
+Profile *prof_new(const Program *prog);
+void prof_free(Profile *p);
+
+// Starts the timer, with vm (which must have vm->prof set) taking the
+// main thread's ticks. prof_stop turns it off again.
+int prof_start(Vm *vm);
+void prof_stop(void);
+
+// Makes vm take the ticks that land on the calling thread; for task
+// workers, which share the owner's Profile.
+void prof_attach(Vm *vm);
+
+// Records vm's pending ticks as one sample; where is the position of the
+// top frame. Called through vm_safepoint and after builtins.
+void prof_sample(Vm *vm, Span where);
+
+// collapsed stacks ("main;f;g 42" per line), as flamegraph.pl and
+// speedscope read them. returns 0 if the file could not be written.
+int prof_write_folded(const Profile *p, const char *path);
+
+// self and total time per function and per line, the top rows of each
+void prof_report(const Profile *p, FILE *out);
+
+#endif
@@ -0,0 +1,336 @@
+#include "simd.h"
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// ----- scalar fallbacks (also used for the tails) -----
+
+static int64_t sum_i64_scalar(const int64_t *p, size_t n) {
+    uint64_t s = 0;
+    for (size_t i = 0; i < n; i++) s += (uint64_t)p[i];
+    return (int64_t)s;
+}
+
+static int64_t min_i64_scalar(const int64_t *p, size_t n) {
+    // four independent chains so the compares can overlap
+    int64_t m0 = p[0], m1 = p[0], m2 = p[0], m3 = p[0];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        if (p[i] < m0) m0 = p[i];
+        if (p[i + 1] < m1) m1 = p[i + 1];
+        if (p[i + 2] < m2) m2 = p[i + 2];
+        if (p[i + 3] < m3) m3 = p[i + 3];
+    }
+    for (; i < n; i++) {
+        if (p[i] < m0) m0 = p[i];
+    }
+    if (m1 < m0) m0 = m1;
+    if (m3 < m2) m2 = m3;
+    return m2 < m0 ? m2 : m0;
+}
+
+static int64_t max_i64_scalar(const int64_t *p, size_t n) {
+    int64_t m0 = p[0], m1 = p[0], m2 = p[0], m3 = p[0];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        if (p[i] > m0) m0 = p[i];
+        if (p[i + 1] > m1) m1 = p[i + 1];
+        if (p[i + 2] > m2) m2 = p[i + 2];
+        if (p[i + 3] > m3) m3 = p[i + 3];
+    }
+    for (; i < n; i++) {
+        if (p[i] > m0) m0 = p[i];
+    }
+    if (m1 > m0) m0 = m1;
+    if (m3 > m2) m2 = m3;
+    return m2 > m0 ? m2 : m0;
+}
+
+static size_t find_i64_scalar(const int64_t *p, size_t n, int64_t v) {
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] == v) return i;
+    }
+    return n;
+}
+
+static size_t count_u8_scalar(const uint8_t *p, size_t n) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++) c += p[i];
+    return c;
+}
+
+static size_t arith_i64_scalar(SimdOp op, int64_t *dst, const int64_t *x, const int64_t *y, int64_t k, size_t n, int wrap) {
+    for (size_t i = 0; i < n; i++) {
+        int64_t a = x ? x[i] : k, b = y ? y[i] : k, r;
+        int overflow;
+        switch (op) {
+            case SIMD_ADD: overflow = __builtin_add_overflow(a, b, &r); break;
+            case SIMD_SUB: overflow = __builtin_sub_overflow(a, b, &r); break;
+            default:       overflow = __builtin_mul_overflow(a, b, &r); break;
+        }
+        if (overflow && !wrap) return i;
+        dst[i] = r;
+    }
+    return n;
+}
+
+#if SIMD_X86
+
+static int has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+// ----- SSE2 -----
+
+static int64_t sum_i64_sse2(const int64_t *p, size_t n) {
+    __m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i *)(const void *)(p + i)));
+        a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i *)(const void *)(p + i + 2)));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)(void *)lanes, _mm_add_epi64(a0, a1));
+    return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)sum_i64_scalar(p + i, n - i));
+}
+
+static size_t find_i64_sse2(const int64_t *p, size_t n, int64_t v) {
+    // no 64-bit compare in SSE2: compare 32-bit halves, then require both
+    __m128i needle = _mm_set1_epi64x(v);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(const void *)(p + i)), needle);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_epi8(eq);
+        if (mask) return i + ((mask & 0xff) ? 0 : 1);
+    }
+    return i + find_i64_scalar(p + i, n - i, v);
+}
+
+static size_t find_u8_sse2(const uint8_t *p, size_t n, uint8_t v) {
+    __m128i needle = _mm_set1_epi8((char)v);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *)(p + i)), needle));
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    const void *hit = memchr(p + i, v, n - i);
+    return hit ? (size_t)((const uint8_t *)hit - p) : n;
+}
+
+static size_t count_u8_sse2(const uint8_t *p, size_t n) {
+    // psadbw sums 8 bytes at a time into 64-bit lanes, so it cannot overflow
+    __m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(const void *)(p + i)), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)(void *)lanes, acc);
+    return (size_t)(lanes[0] + lanes[1]) + count_u8_scalar(p + i, n - i);
+}
+
+static void fill_i64_sse2(int64_t *p, size_t n, int64_t v) {
+    __m128i x = _mm_set1_epi64x(v);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_si128((__m128i *)(void *)(p + i), x);
+    if (i < n) p[i] = v;
+}
+
+// signed overflow shows in the sign bit: a + b overflowed iff both
+// operands differ in sign from the result, a - b iff a differs from b
+// and from the result
+static size_t addsub_i64_sse2(int sub, int64_t *dst, const int64_t *x, const int64_t *y, int64_t k, size_t n, int wrap) {
+    __m128i kv = _mm_set1_epi64x(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = x ? _mm_loadu_si128((const __m128i *)(const void *)(x + i)) : kv;
+        __m128i b = y ? _mm_loadu_si128((const __m128i *)(const void *)(y + i)) : kv;
+        __m128i r = sub ? _mm_sub_epi64(a, b) : _mm_add_epi64(a, b);
+        __m128i ov = sub ? _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r))
+                         : _mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r));
+        if (!wrap && _mm_movemask_pd(_mm_castsi128_pd(ov))) break;
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), r);
+    }
+    return i + arith_i64_scalar(sub ? SIMD_SUB : SIMD_ADD, dst + i, x ? x + i : NULL, y ? y + i : NULL, k, n - i, wrap);
+}
+
+// ----- AVX2 -----
+
+__attribute__((target("avx2")))
+static int64_t sum_i64_avx2(const int64_t *p, size_t n) {
+    __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(const void *)(p + i)));
+        a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i *)(const void *)(p + i + 4)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)(void *)lanes, _mm256_add_epi64(a0, a1));
+    uint64_t s = (uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)lanes[2] + (uint64_t)lanes[3];
+    return (int64_t)(s + (uint64_t)sum_i64_scalar(p + i, n - i));
+}
+
+__attribute__((target("avx2")))
+static int64_t minmax_i64_avx2(const int64_t *p, size_t n, int want_max) {
+    __m256i m = _mm256_set1_epi64x(p[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)(p + i));
+        __m256i gt = want_max ? _mm256_cmpgt_epi64(x, m) : _mm256_cmpgt_epi64(m, x);
+        m = _mm256_blendv_epi8(m, x, gt);
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)(void *)lanes, m);
+    int64_t r = lanes[0];
+    for (size_t k = 1; k < 4; k++) {
+        if (want_max ? lanes[k] > r : lanes[k] < r) r = lanes[k];
+    }
+    for (; i < n; i++) {
+        if (want_max ? p[i] > r : p[i] < r) r = p[i];
+    }
+    return r;
+}
+
+__attribute__((target("avx2")))
+static size_t find_i64_avx2(const int64_t *p, size_t n, int64_t v) {
+    __m256i needle = _mm256_set1_epi64x(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(const void *)(p + i)), needle);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return i + find_i64_scalar(p + i, n - i, v);
+}
+
+__attribute__((target("avx2")))
+static size_t find_u8_avx2(const uint8_t *p, size_t n, uint8_t v) {
+    __m256i needle = _mm256_set1_epi8((char)v);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(const void *)(p + i)), needle);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + find_u8_sse2(p + i, n - i, v);
+}
+
+__attribute__((target("avx2")))
+static size_t count_u8_avx2(const uint8_t *p, size_t n) {
+    __m256i zero = _mm256_setzero_si256(), acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(const void *)(p + i)), zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)(void *)lanes, acc);
+    return (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + count_u8_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void fill_i64_avx2(int64_t *p, size_t n, int64_t v) {
+    __m256i x = _mm256_set1_epi64x(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_si256((__m256i *)(void *)(p + i), x);
+    for (; i < n; i++) p[i] = v;
+}
+
+__attribute__((target("avx2")))
+static size_t addsub_i64_avx2(int sub, int64_t *dst, const int64_t *x, const int64_t *y, int64_t k, size_t n, int wrap) {
+    __m256i kv = _mm256_set1_epi64x(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = x ? _mm256_loadu_si256((const __m256i *)(const void *)(x + i)) : kv;
+        __m256i b = y ? _mm256_loadu_si256((const __m256i *)(const void *)(y + i)) : kv;
+        __m256i r = sub ? _mm256_sub_epi64(a, b) : _mm256_add_epi64(a, b);
+        __m256i ov = sub ? _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r))
+                         : _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r));
+        if (!wrap && _mm256_movemask_pd(_mm256_castsi256_pd(ov))) break;
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), r);
+    }
+    return i + addsub_i64_sse2(sub, dst + i, x ? x + i : NULL, y ? y + i : NULL, k, n - i, wrap);
+}
+
+#endif
+
+// ----- dispatch -----
+
+int64_t simd_sum_i64(const int64_t *p, size_t n) {
+#if SIMD_X86
+    return has_avx2() ? sum_i64_avx2(p, n) : sum_i64_sse2(p, n);
+#else
+    return sum_i64_scalar(p, n);
+#endif
+}
+
+int64_t simd_min_i64(const int64_t *p, size_t n) {
+#if SIMD_X86
+    if (has_avx2()) return minmax_i64_avx2(p, n, 0);
+#endif
+    return min_i64_scalar(p, n);
+}
+
+int64_t simd_max_i64(const int64_t *p, size_t n) {
+#if SIMD_X86
+    if (has_avx2()) return minmax_i64_avx2(p, n, 1);
+#endif
+    return max_i64_scalar(p, n);
+}
+
+void simd_fill_i64(int64_t *p, size_t n, int64_t v) {
+#if SIMD_X86
+    if (has_avx2()) fill_i64_avx2(p, n, v);
+    else fill_i64_sse2(p, n, v);
+#else
+    for (size_t i = 0; i < n; i++) p[i] = v;
+#endif
+}
+
+size_t simd_find_i64(const int64_t *p, size_t n, int64_t v) {
+#if SIMD_X86
+    return has_avx2() ? find_i64_avx2(p, n, v) : find_i64_sse2(p, n, v);
+#else
+    return find_i64_scalar(p, n, v);
+#endif
+}
+
+size_t simd_find_u8(const uint8_t *p, size_t n, uint8_t v) {
+#if SIMD_X86
+    return has_avx2() ? find_u8_avx2(p, n, v) : find_u8_sse2(p, n, v);
+#else
+    const void *hit = memchr(p, v, n);
+    return hit ? (size_t)((const uint8_t *)hit - p) : n;
+#endif
+}
+
+size_t simd_count_u8(const uint8_t *p, size_t n) {
+#if SIMD_X86
+    return has_avx2() ? count_u8_avx2(p, n) : count_u8_sse2(p, n);
+#else
+    return count_u8_scalar(p, n);
+#endif
+}
+
+size_t simd_arith_i64(SimdOp op, int64_t *dst, const int64_t *x, const int64_t *y, int64_t k, size_t n, int wrap) {
+#if SIMD_X86
+    if (op != SIMD_MUL) {
+        int sub = op == SIMD_SUB;
+        return has_avx2() ? addsub_i64_avx2(sub, dst, x, y, k, n, wrap) : addsub_i64_sse2(sub, dst, x, y, k, n, wrap);
+    }
+#endif
+    return arith_i64_scalar(op, dst, x, y, k, n, wrap);
+}
+
+const char *simd_level_name(void) {
+#if SIMD_X86
+    return has_avx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef LUNAR_SIMD_H
+#define LUNAR_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scan kernels over raw list storage.
+// On x86-64 these pick AVX2 at runtime when the CPU has it and fall back
+// to SSE2 (always present there); elsewhere they are plain loops.
+// Integer sums wrap like the language's `+`.
+
+int64_t simd_sum_i64(const int64_t *p, size_t n);
+int64_t simd_min_i64(const int64_t *p, size_t n); // n > 0
+int64_t simd_max_i64(const int64_t *p, size_t n); // n > 0
+void simd_fill_i64(int64_t *p, size_t n, int64_t v);
+
+// index of the first element equal to v, or n
+size_t simd_find_i64(const int64_t *p, size_t n, int64_t v);
+size_t simd_find_u8(const uint8_t *p, size_t n, uint8_t v);
+
+// sum of bytes; with 0/1 bytes that is the number of set ones
+size_t simd_count_u8(const uint8_t *p, size_t n);
+
+typedef enum {
+    SIMD_ADD,
+    SIMD_SUB,
+    SIMD_MUL,
+} SimdOp;
+
+// dst[i] = x[i] op y[i] for i < n; x or y may be NULL, meaning k in every
+// element. dst may be x or y. Unless wrap, stops at the first element
+// that overflows. Returns how many were written.
+// There is no 64-bit vector multiply below AVX-512, so SIMD_MUL is a
+// plain loop.
+size_t simd_arith_i64(SimdOp op, int64_t *dst, const int64_t *x, const int64_t *y, int64_t k, size_t n, int wrap);
+
+// "avx2", "sse2" or "scalar", for stats output
+const char *simd_level_name(void);
+
+#endif
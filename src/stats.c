@@ -0,0 +1,225 @@
+#define _DEFAULT_SOURCE
+#include "stats.h"
+#include "util.h"
+#include <string.h>
+#include <sys/resource.h>
+
+static const char *const pass_names[PASS_COUNT] = {
+    "read", "cache-load", "lex", "parse", "compile", "cache-write", "run", "gc",
+};
+
+// indexed by ExprKind / StmtKind, which start at 1
+#define EXPR_KINDS (EXPR_SET_INDEX + 1)
+#define STMT_KINDS (STMT_WHILE + 1)
+
+static const char *const expr_names[EXPR_KINDS] = {
+    "?", "int", "string", "name", "bool", "unary", "binary", "assign", "call", "list", "map", "index", "set_index",
+};
+
+static const char *const stmt_names[STMT_KINDS] = {
+    "?", "let", "return", "expr", "if", "while",
+};
+
+typedef struct {
+    size_t fns;
+    size_t exprs[EXPR_KINDS];
+    size_t stmts[STMT_KINDS];
+    size_t expr_total;
+    size_t stmt_total;
+} AstCounts;
+
+void stats_pass(RunStats *st, PassId id, uint64_t t0, size_t bytes) {
+    PassStats *p = &st->pass[id];
+    p->ran = 1;
+    p->ns += monotonic_ns() - t0;
+    p->bytes += bytes;
+}
+
+void stats_merge(RunStats *into, const RunStats *from) {
+    for (size_t i = 0; i < PASS_COUNT; i++) {
+        const PassStats *f = &from->pass[i];
+        PassStats *p = &into->pass[i];
+        if (!f->ran) continue;
+        p->ran = 1;
+        p->ns += f->ns;
+        p->bytes += f->bytes;
+        p->tokens += f->tokens;
+        p->items += f->items;
+    }
+}
+
+// ----- AST counts -----
+
+static void count_stmts(AstCounts *c, Stmt **stmts, size_t len);
+
+static void count_expr(AstCounts *c, const Expr *e) {
+    if (!e) return;
+    if (e->kind > 0 && e->kind < EXPR_KINDS) c->exprs[e->kind]++;
+    c->expr_total++;
+    switch (e->kind) {
+        case EXPR_UNARY:
+            count_expr(c, e->as.unary.rhs);
+            break;
+        case EXPR_BINARY:
+            count_expr(c, e->as.binary.lhs);
+            count_expr(c, e->as.binary.rhs);
+            break;
+        case EXPR_ASSIGN:
+            count_expr(c, e->as.assign.value);
+            break;
+        case EXPR_CALL:
+            count_expr(c, e->as.call.callee);
+            for (size_t i = 0; i < e->as.call.args_len; i++) count_expr(c, e->as.call.args[i]);
+            break;
+        case EXPR_LIST:
+            for (size_t i = 0; i < e->as.list.items_len; i++) count_expr(c, e->as.list.items[i]);
+            break;
+        case EXPR_MAP:
+            for (size_t i = 0; i < e->as.map.len; i++) {
+                count_expr(c, e->as.map.keys[i]);
+                count_expr(c, e->as.map.values[i]);
+            }
+            break;
+        case EXPR_INDEX:
+        case EXPR_SET_INDEX:
+            count_expr(c, e->as.index.target);
+            count_expr(c, e->as.index.index);
+            count_expr(c, e->as.index.value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void count_stmt(AstCounts *c, const Stmt *s) {
+    if (s->kind > 0 && s->kind < STMT_KINDS) c->stmts[s->kind]++;
+    c->stmt_total++;
+    switch (s->kind) {
+        case STMT_LET:
+            count_expr(c, s->as.let_stmt.init);
+            break;
+        case STMT_RETURN:
+            count_expr(c, s->as.ret_stmt.value);
+            break;
+        case STMT_EXPR:
+            count_expr(c, s->as.expr_stmt.expr);
+            break;
+        case STMT_IF:
+            count_expr(c, s->as.if_stmt.cond);
+            count_stmts(c, s->as.if_stmt.then_body, s->as.if_stmt.then_len);
+            count_stmts(c, s->as.if_stmt.else_body, s->as.if_stmt.else_len);
+            break;
+        case STMT_WHILE:
+            count_expr(c, s->as.while_stmt.cond);
+            count_stmts(c, s->as.while_stmt.body, s->as.while_stmt.body_len);
+            break;
+    }
+}
+
+static void count_stmts(AstCounts *c, Stmt **stmts, size_t len) {
+    for (size_t i = 0; i < len; i++) count_stmt(c, stmts[i]);
+}
+
+static void count_ast(AstCounts *c, const Program *prog) {
+    memset(c, 0, sizeof(*c));
+    if (!prog) return;
+    c->fns = prog->fns_len;
+    // a cached program has no bodies
+    for (size_t i = 0; i < prog->fns_len; i++) count_stmts(c, prog->fns[i]->body, prog->fns[i]->body_len);
+}
+
+// ----- printing -----
+
+static size_t peak_rss(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return (size_t)ru.ru_maxrss * 1024; // KB on Linux
+}
+
+static double per_sec(size_t n, uint64_t ns) {
+    return ns ? (double)n * 1e9 / (double)ns : 0.0;
+}
+
+static double mb(size_t bytes) {
+    return (double)bytes / 1048576.0;
+}
+
+// "12.3 KB" below a megabyte, "4.56 MB" from there
+static const char *size_str(char *buf, size_t cap, size_t bytes) {
+    if (bytes < 1048576) snprintf(buf, cap, "%.1f KB", (double)bytes / 1024.0);
+    else snprintf(buf, cap, "%.2f MB", mb(bytes));
+    return buf;
+}
+
+static void print_passes(const RunStats *st, FILE *out) {
+    uint64_t total = 0;
+    fprintf(out, "passes:\n");
+    for (int i = 0; i < PASS_COUNT; i++) {
+        const PassStats *p = &st->pass[i];
+        if (!p->ran) continue;
+        if (i != PASS_GC) total += p->ns;
+        fprintf(out, "  %-12s %10.3f ms", pass_names[i], (double)p->ns / 1e6);
+        if (p->bytes) fprintf(out, "  %8.1f MB/s", mb((size_t)per_sec(p->bytes, p->ns)));
+        if (p->tokens) fprintf(out, "  %zu tokens, %.2fM tokens/s", p->tokens, per_sec(p->tokens, p->ns) / 1e6);
+        if (i == PASS_COMPILE) fprintf(out, "  %zu fn(s)", p->items);
+        if (i == PASS_GC) fprintf(out, "  %zu collection(s), part of run", p->items);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "  %-12s %10.3f ms\n", "total", (double)total / 1e6);
+}
+
+static void print_text(const RunStats *st, FILE *out) {
+    print_passes(st, out);
+
+    ArenaStats as = st->arena;
+    char a[32], b[32];
+    fprintf(out, "memory:\n");
+    fprintf(out, "  source:      %s\n", size_str(a, sizeof(a), st->pass[PASS_READ].bytes));
+    fprintf(out, "  arena:       %s used, %s wasted, %zu block(s)\n", size_str(a, sizeof(a), as.requested),
+            size_str(b, sizeof(b), as.reserved - as.requested), as.blocks);
+    fprintf(out, "  heap:        %s allocated, old gen peak %s\n", size_str(a, sizeof(a), st->heap_allocated),
+            size_str(b, sizeof(b), st->heap_old_peak));
+    fprintf(out, "  peak rss:    %s\n", size_str(a, sizeof(a), peak_rss()));
+
+    AstCounts c;
+    count_ast(&c, st->prog);
+    fprintf(out, "ast: %zu fn(s), %zu stmt(s), %zu expr(s)\n", c.fns, c.stmt_total, c.expr_total);
+    fprintf(out, "  stmts:");
+    for (int k = 1; k < STMT_KINDS; k++) fprintf(out, " %s=%zu", stmt_names[k], c.stmts[k]);
+    fprintf(out, "\n  exprs:");
+    for (int k = 1; k < EXPR_KINDS; k++) fprintf(out, " %s=%zu", expr_names[k], c.exprs[k]);
+    fprintf(out, "\n");
+}
+
+// raw counts only; rates are easy to derive and do not round
+static void print_json(const RunStats *st, FILE *out) {
+    fprintf(out, "{\"passes\": {");
+    int first = 1;
+    for (int i = 0; i < PASS_COUNT; i++) {
+        const PassStats *p = &st->pass[i];
+        if (!p->ran) continue;
+        fprintf(out, "%s\"%s\": {\"ns\": %llu, \"bytes\": %zu, \"tokens\": %zu, \"items\": %zu}", first ? "" : ", ",
+                pass_names[i], (unsigned long long)p->ns, p->bytes, p->tokens, p->items);
+        first = 0;
+    }
+
+    ArenaStats as = st->arena;
+    fprintf(out, "}, \"memory\": {\"source_bytes\": %zu, \"arena_used\": %zu, \"arena_wasted\": %zu, \"arena_blocks\": %zu, ",
+            st->pass[PASS_READ].bytes, as.requested, as.reserved - as.requested, as.blocks);
+    fprintf(out, "\"heap_allocated\": %zu, \"heap_old_peak\": %zu, \"peak_rss\": %zu}", st->heap_allocated,
+            st->heap_old_peak, peak_rss());
+
+    AstCounts c;
+    count_ast(&c, st->prog);
+    fprintf(out, ", \"ast\": {\"fns\": %zu, \"stmts\": {", c.fns);
+    for (int k = 1; k < STMT_KINDS; k++) fprintf(out, "%s\"%s\": %zu", k > 1 ? ", " : "", stmt_names[k], c.stmts[k]);
+    fprintf(out, "}, \"exprs\": {");
+    for (int k = 1; k < EXPR_KINDS; k++) fprintf(out, "%s\"%s\": %zu", k > 1 ? ", " : "", expr_names[k], c.exprs[k]);
+    fprintf(out, "}}}\n");
+}
+
+void stats_print(const RunStats *st, StatsFormat fmt, FILE *out) {
+    if (fmt == STATS_PASSES) print_passes(st, out);
+    else if (fmt == STATS_ALL) print_text(st, out);
+    else print_json(st, out);
+}
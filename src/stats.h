@@ -0,0 +1,60 @@
+#ifndef LUNAR_STATS_H
+#define LUNAR_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+
+// --time-passes and --stats: where the time and memory of one run go.
+//
+// main times each pass it runs and fills in a RunStats; the rest (AST
+// node counts, arena use, peak RSS) is gathered when printing. Lexing
+// runs interleaved with parsing, so with stats on the source is lexed a
+// second time on its own once parsing succeeded: that pass gives the lex
+// time and token count, and parse is reported without it.
+
+typedef enum {
+    PASS_READ,
+    PASS_CACHE_LOAD,
+    PASS_LEX,
+    PASS_PARSE,
+    PASS_COMPILE,    // up front (--cache, --dump-bc) and lazily while running
+    PASS_CACHE_WRITE,
+    PASS_RUN,        // main, without the compiling done along the way
+    PASS_GC,         // part of run
+    PASS_COUNT,
+} PassId;
+
+typedef struct {
+    int ran;
+    uint64_t ns;
+    size_t bytes;  // of source, where that is what the pass goes through
+    size_t tokens;
+    size_t items;  // functions compiled, collections
+} PassStats;
+
+typedef struct {
+    PassStats pass[PASS_COUNT];
+    const Program *prog; // for the AST counts; NULL before parsing
+    ArenaStats arena;    // summed over every module's arena
+    size_t heap_allocated; // bytes the program allocated
+    size_t heap_old_peak;
+} RunStats;
+
+typedef enum {
+    STATS_PASSES, // --time-passes
+    STATS_ALL,    // --stats
+    STATS_JSON,   // --stats=json: STATS_ALL as one JSON object
+} StatsFormat;
+
+// records a pass that started at t0 (monotonic_ns) and ends now
+void stats_pass(RunStats *st, PassId id, uint64_t t0, size_t bytes);
+
+// adds the passes of `from` to `into` (modules are built on several
+// threads, each into its own RunStats)
+void stats_merge(RunStats *into, const RunStats *from);
+
+void stats_print(const RunStats *st, StatsFormat fmt, FILE *out);
+
+#endif
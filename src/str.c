@@ -0,0 +1,83 @@
+#include "str.h"
+#include <string.h>
+
+static Value small_str(void) {
+    Value v;
+    v.kind = VAL_STR;
+    v.str = STR_SMALL;
+    v.small_len = 0;
+    return v;
+}
+
+static Value heap_str(Str *s, size_t len) {
+    Value v;
+    v.kind = VAL_STR;
+    v.str = STR_HEAP;
+    v.as.s.ptr = s->data;
+    v.as.s.len = len;
+    return v;
+}
+
+// room to keep appending: growth is geometric, so a chain of n appends
+// copies O(n) bytes in total
+static size_t grown_cap(size_t len) {
+    return len < 48 ? 64 : len + len / 2;
+}
+
+int str_from(Heap *h, const char *p, size_t n, Value *out) {
+    if (n <= STR_SMALL_MAX) {
+        *out = small_str();
+        if (n) memcpy(out->as.small, p, n);
+        out->small_len = (uint8_t)n;
+        return 1;
+    }
+    Str *s = heap_new_str(h, n);
+    if (!s) return 0;
+    memcpy(s->data, p, n);
+    s->used = n;
+    *out = heap_str(s, n);
+    return 1;
+}
+
+int str_concat(Heap *h, const Value *a, const Value *b, Value *out) {
+    StrView x = value_sv(a);
+    StrView y = value_sv(b);
+    if (!y.len) {
+        *out = *a;
+        return 1;
+    }
+    if (!x.len) {
+        *out = *b;
+        return 1;
+    }
+    if (x.len > SIZE_MAX - y.len) return 0;
+    size_t len = x.len + y.len;
+
+    if (len <= STR_SMALL_MAX) {
+        Value v = small_str();
+        memcpy(v.as.small, x.ptr, x.len);
+        memcpy(v.as.small + x.len, y.ptr, y.len);
+        v.small_len = (uint8_t)len;
+        *out = v;
+        return 1;
+    }
+
+    // a is the longest string seen in its buffer and there is room: append
+    if (a->str == STR_HEAP) {
+        Str *s = (Str *)value_obj(*a);
+        if (x.len == s->used && s->cap - s->used >= y.len) {
+            memcpy(s->data + s->used, y.ptr, y.len);
+            s->used = len;
+            *out = heap_str(s, len);
+            return 1;
+        }
+    }
+
+    Str *s = heap_new_str(h, grown_cap(len));
+    if (!s) return 0;
+    memcpy(s->data, x.ptr, x.len);
+    memcpy(s->data + x.len, y.ptr, y.len);
+    s->used = len;
+    *out = heap_str(s, len);
+    return 1;
+}
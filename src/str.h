@@ -0,0 +1,18 @@
+#ifndef LUNAR_STR_H
+#define LUNAR_STR_H
+
+#include <stddef.h>
+#include "value.h"
+#include "heap.h"
+
+// Strings built at run time. Results of at most STR_SMALL_MAX bytes are
+// stored inline in the Value; longer ones go to a heap Str, which doubles
+// as a builder for chains of `+` (see struct Str in value.h).
+
+// a + b; both must be strings. returns 0 when out of memory.
+int str_concat(Heap *h, const Value *a, const Value *b, Value *out);
+
+// copies n bytes into a new string value. returns 0 when out of memory.
+int str_from(Heap *h, const char *p, size_t n, Value *out);
+
+#endif
@@ -0,0 +1,831 @@
+#define _POSIX_C_SOURCE 200809L
+#include "task.h"
+#include "vm.h"
+#include "map.h"
+#include "str.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    TASK_QUEUED = 0, // or running
+    TASK_DONE,
+    TASK_FAILED,
+};
+
+// what a task runs
+enum {
+    TASK_CALL = 0, // fns[fn](args...)
+    TASK_MAP,      // one chunk of parallel_map: args is the slice, the result a list
+    TASK_REDUCE,   // one chunk of parallel_reduce: the slice folded with fns[fn]
+};
+
+typedef struct Task {
+    uint8_t op;
+    uint32_t fn;
+    uint32_t argc;
+    Span where;      // the spawn, for errors
+    uint8_t *args;   // packed (see pack), freed once the task starts
+    uint8_t *result; // packed, set before state leaves TASK_QUEUED
+    _Atomic int state;
+    _Atomic int *cancel; // chunks: set once one of the call's chunks fails
+} Task;
+
+// left in a handle's slot once it has been joined
+static Task joined;
+
+// ----- deques -----
+// Chase-Lev with the C11 orderings from Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (2013). The owner
+// pushes and takes at the bottom; thieves take from the top, and the
+// last element goes to whoever wins the CAS on top.
+
+typedef struct {
+    _Atomic int64_t top;
+    char pad0[64 - sizeof(_Atomic int64_t)]; // thieves and the owner hit different lines
+    _Atomic int64_t bottom;
+    char pad1[64 - sizeof(_Atomic int64_t)];
+    _Atomic(Task *) buf[TASK_DEQUE_CAP];
+} Deque;
+
+#define DEQUE_MASK (TASK_DEQUE_CAP - 1)
+
+// owner only; 0 if full
+static int deque_push(Deque *d, Task *t) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - top >= TASK_DEQUE_CAP) return 0;
+    atomic_store_explicit(&d->buf[b & DEQUE_MASK], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return 1;
+}
+
+// owner only: the newest task, or NULL
+static Task *deque_take(Deque *d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (top > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    Task *t = atomic_load_explicit(&d->buf[b & DEQUE_MASK], memory_order_relaxed);
+    if (top == b) {
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed)) t = NULL;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return t;
+}
+
+// any thread: the oldest task, or NULL (also when another thief got it)
+static Task *deque_steal(Deque *d) {
+    int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (top >= b) return NULL;
+    Task *t = atomic_load_explicit(&d->buf[top & DEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed)) return NULL;
+    return t;
+}
+
+// ----- the pool -----
+
+typedef struct {
+    Deque dq;
+    TaskPool *pool;
+    size_t index;
+    Vm *vm;       // worker 0: the owner's; others are created by their thread
+    uint64_t rng; // victim selection
+    pthread_t thread;
+    int running;
+} Worker;
+
+// Handles index a table that grows in segments which never move:
+// segment s holds TASK_SEG0 << s slots.
+#define TASK_SEG0 1024
+#define TASK_SEGS 40
+
+typedef _Atomic(Task *) TaskSlot;
+
+struct TaskPool {
+    Program *prog;
+    TierConfig tier;
+    GcConfig gc;
+    Chunk **shared; // the owner's .lrc chunks (read-only), run by every worker
+    struct Profile *prof; // the owner's, if profiling; workers sample into it
+
+    Worker *workers;
+    size_t workers_len;
+
+    _Atomic(TaskSlot *) segs[TASK_SEGS];
+    _Atomic int64_t next_id;
+    _Atomic int64_t pending; // pushed, not taken yet (may dip below 0 for a moment)
+    _Atomic int64_t live;    // spawned, not finished
+    _Atomic int sleepers;
+    _Atomic int stop;
+    _Atomic int failed;
+
+    pthread_mutex_t lock; // only for sleeping
+    pthread_cond_t wake;
+    int stopped;          // threads joined
+};
+
+static TaskSlot *slot_of(TaskPool *p, int64_t id, int create) {
+    uint64_t k = (uint64_t)(id - 1) / TASK_SEG0 + 1;
+    unsigned s = 63 - (unsigned)__builtin_clzll(k);
+    if (s >= TASK_SEGS) return NULL;
+    size_t off = (size_t)(id - 1) - (size_t)TASK_SEG0 * (((size_t)1 << s) - 1);
+
+    TaskSlot *seg = atomic_load_explicit(&p->segs[s], memory_order_acquire);
+    if (!seg && create) {
+        TaskSlot *fresh = (TaskSlot *)calloc((size_t)TASK_SEG0 << s, sizeof(TaskSlot));
+        if (!fresh) return NULL;
+        if (atomic_compare_exchange_strong(&p->segs[s], &seg, fresh)) seg = fresh;
+        else free(fresh);
+    }
+    return seg ? &seg[off] : NULL;
+}
+
+// ----- copying values between heaps -----
+// A kind byte, then: int 8 bytes; bool 1; string u64 length + bytes;
+// list elem kind, u64 length, then raw ints/bools or packed values;
+// map key kind, value kind, u64 length, then packed key/value pairs.
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+} Packed;
+
+static int put(Packed *b, const void *p, size_t n) {
+    if (!n) return 1;
+    if (b->cap - b->len < n) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap - b->len < n) cap *= 2;
+        uint8_t *nb = (uint8_t *)realloc(b->buf, cap);
+        if (!nb) return 0;
+        b->buf = nb;
+        b->cap = cap;
+    }
+    memcpy(b->buf + b->len, p, n);
+    b->len += n;
+    return 1;
+}
+
+static int put_u8(Packed *b, unsigned v) {
+    uint8_t x = (uint8_t)v;
+    return put(b, &x, 1);
+}
+
+static int put_u64(Packed *b, uint64_t v) {
+    return put(b, &v, 8);
+}
+
+static int pack(Packed *b, Value v, int depth);
+
+// l[lo..hi) as a list of its own
+static int pack_slice(Packed *b, const List *l, size_t lo, size_t hi, int depth) {
+    if (!put_u8(b, VAL_LIST) || !put_u8(b, l->elem) || !put_u64(b, hi - lo)) return 0;
+    if (l->elem == VAL_INT) return put(b, l->as.ints + lo, (hi - lo) * sizeof(int64_t));
+    if (l->elem == VAL_BOOL) return put(b, l->as.bools + lo, hi - lo);
+    for (size_t i = lo; i < hi; i++) {
+        int r = pack(b, l->as.vals[i], depth + 1);
+        if (r <= 0) return r;
+    }
+    return 1;
+}
+
+// 1 on success, 0 when out of memory, -1 when nested too deeply (which
+// is also how a list that contains itself ends)
+static int pack(Packed *b, Value v, int depth) {
+    if (depth > TASK_COPY_DEPTH) return -1;
+    if (v.kind == VAL_LIST) return pack_slice(b, v.as.list, 0, v.as.list->len, depth);
+    if (!put_u8(b, v.kind)) return 0;
+    switch (v.kind) {
+        case VAL_INT:  return put(b, &v.as.i, 8);
+        case VAL_BOOL: return put_u8(b, (unsigned)v.as.b);
+        case VAL_STR: {
+            StrView s = value_sv(&v);
+            return put_u64(b, s.len) && put(b, s.ptr, s.len);
+        }
+        case VAL_LIST: return 0; // above
+        case VAL_MAP: {
+            const Map *m = v.as.map;
+            if (!put_u8(b, m->key) || !put_u8(b, m->val) || !put_u64(b, m->len)) return 0;
+            size_t it = 0;
+            Value k, e;
+            while (map_next(m, &it, &k, &e)) {
+                int r = pack(b, k, depth + 1);
+                if (r > 0) r = pack(b, e, depth + 1);
+                if (r <= 0) return r;
+            }
+            return 1;
+        }
+    }
+    return 1;
+}
+
+static uint64_t get_u64(const uint8_t **p) {
+    uint64_t v;
+    memcpy(&v, *p, 8);
+    *p += 8;
+    return v;
+}
+
+// rebuilds a packed value in vm's heap; 0 when out of memory. there is
+// no safepoint in here, so the parts may sit in C locals.
+static int unpack(Vm *vm, const uint8_t **p, Value *out) {
+    ValueKind kind = (ValueKind)*(*p)++;
+    switch (kind) {
+        case VAL_INT:
+            *out = value_int((int64_t)get_u64(p));
+            return 1;
+        case VAL_BOOL:
+            *out = value_bool(*(*p)++);
+            return 1;
+        case VAL_STR: {
+            size_t n = (size_t)get_u64(p);
+            const char *s = (const char *)*p;
+            *p += n;
+            return str_from(&vm->heap, s, n, out);
+        }
+        case VAL_LIST: {
+            ValueKind elem = (ValueKind)*(*p)++;
+            size_t n = (size_t)get_u64(p);
+            List *l = heap_new_list(&vm->heap, elem, n);
+            if (!l) return 0;
+            if (elem == VAL_INT || elem == VAL_BOOL) {
+                size_t bytes = elem == VAL_INT ? n * sizeof(int64_t) : n;
+                if (bytes) memcpy(l->as.raw, *p, bytes);
+                *p += bytes;
+                l->len = n;
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    Value e;
+                    if (!unpack(vm, p, &e)) return 0;
+                    heap_list_set(&vm->heap, l, i, e);
+                    l->len = i + 1;
+                }
+            }
+            *out = value_list(l);
+            return 1;
+        }
+        case VAL_MAP: {
+            ValueKind key = (ValueKind)*(*p)++;
+            ValueKind val = (ValueKind)*(*p)++;
+            size_t n = (size_t)get_u64(p);
+            Map *m = heap_new_map(&vm->heap, key);
+            if (!m) return 0;
+            m->val = val;
+            for (size_t i = 0; i < n; i++) {
+                Value k, e;
+                if (!unpack(vm, p, &k) || !unpack(vm, p, &e)) return 0;
+                if (!heap_map_set(&vm->heap, m, k, e)) return 0;
+            }
+            *out = value_map(m);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int copy_error(Vm *vm, Span where, int r) {
+    if (r < 0) {
+        return vm_error(vm, where, "cannot pass a value nested more than %d levels deep between tasks",
+                        TASK_COPY_DEPTH);
+    }
+    return vm_error(vm, where, "out of memory");
+}
+
+// ----- running tasks -----
+
+// The chunk in stack slot `at` through fns[fn]; the running result (the
+// mapped list, or the fold so far) is kept in slot at + 1, where the
+// collector can see it across the calls.
+static int exec_chunk(Vm *vm, const Task *t, size_t at) {
+    size_t n = vm->stack[at].as.list->len;
+    if (t->op == TASK_MAP) {
+        List *out = heap_new_list(&vm->heap, 0, 0);
+        if (!out) return vm_error(vm, t->where, "out of memory");
+        vm->stack[vm->sp++] = value_list(out);
+    } else {
+        vm->stack[vm->sp++] = list_get(vm->stack[at].as.list, 0);
+    }
+
+    for (size_t i = t->op == TASK_MAP ? 0 : 1; i < n; i++) {
+        if (atomic_load_explicit(t->cancel, memory_order_relaxed)) return 0;
+        size_t argc = 1;
+        if (t->op == TASK_REDUCE) vm->stack[vm->sp++] = vm->stack[at + 1], argc = 2;
+        vm->stack[vm->sp++] = list_get(vm->stack[at].as.list, i);
+        Value r;
+        if (!vm_call(vm, t->fn, argc, t->where, &r)) return 0;
+        if (t->op == TASK_REDUCE) {
+            vm->stack[at + 1] = r;
+            continue;
+        }
+        List *out = vm->stack[at + 1].as.list;
+        if (!vm_list_accepts(vm, out, r, t->where)) return 0;
+        if (!heap_list_push(&vm->heap, out, r)) return vm_error(vm, t->where, "out of memory");
+    }
+    return 1;
+}
+
+// runs t on vm and packs the result into t->result; 0 after reporting
+// an error
+static int task_exec(Vm *vm, Task *t) {
+    // a failed chunk has reported the error; the rest of its call is moot
+    if (t->cancel && atomic_load_explicit(t->cancel, memory_order_relaxed)) return 0;
+    size_t base = vm->sp;
+    // arguments go on the stack like a call's; a chunk needs one more slot
+    if (VM_STACK_MAX - vm->sp < (size_t)t->argc + 1) return vm_error(vm, t->where, "stack overflow");
+
+    const uint8_t *rd = t->args;
+    for (size_t i = 0; i < t->argc; i++) {
+        if (!unpack(vm, &rd, &vm->stack[vm->sp])) {
+            vm->sp = base;
+            return vm_error(vm, t->where, "out of memory");
+        }
+        vm->binds[vm->sp].name = (StrView){0};
+        vm->binds[vm->sp].is_mut = 0;
+        vm->sp++;
+    }
+    free(t->args);
+    t->args = NULL;
+
+    Value r;
+    int ok;
+    vm->prof_pending = 0; // ticks spent looking for work are not this task's
+    vm->task_depth++;
+    if (t->op == TASK_CALL) {
+        ok = vm_call(vm, t->fn, t->argc, t->where, &r);
+    } else {
+        ok = exec_chunk(vm, t, base);
+        r = vm->stack[base + 1];
+    }
+    vm->task_depth--;
+    vm->sp = base;
+    if (!ok) {
+        if (t->cancel) atomic_store_explicit(t->cancel, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    Packed res = {0};
+    int c = pack(&res, r, 0);
+    if (c <= 0) {
+        free(res.buf);
+        if (t->cancel) atomic_store_explicit(t->cancel, 1, memory_order_relaxed);
+        return copy_error(vm, t->where, c);
+    }
+    t->result = res.buf;
+    return 1;
+}
+
+// task_exec for a task counted in the pool's live tasks
+static void task_run(Vm *vm, Task *t) {
+    TaskPool *p = vm->pool;
+    int ok = task_exec(vm, t);
+    outbuf_flush(&vm->out);
+
+    if (!ok) atomic_store(&p->failed, 1);
+    // a joiner may free t as soon as it sees this
+    atomic_store_explicit(&t->state, ok ? TASK_DONE : TASK_FAILED, memory_order_release);
+    atomic_fetch_sub(&p->live, 1);
+}
+
+static uint64_t xorshift(uint64_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+// Runs one waiting task on vm: the worker's own newest first, else the
+// oldest of a random victim. 0 if there was nothing to run.
+static int help(Vm *vm) {
+    TaskPool *p = vm->pool;
+    Worker *w = &p->workers[vm->worker];
+    Task *t = deque_take(&w->dq);
+    if (!t && p->workers_len > 1) {
+        size_t n = p->workers_len;
+        size_t start = (size_t)(xorshift(&w->rng) % n);
+        for (size_t i = 0; i < n && !t; i++) {
+            size_t v = (start + i) % n;
+            if (v != vm->worker) t = deque_steal(&p->workers[v].dq);
+        }
+        if (t) vm->stats.tasks_stolen++;
+    }
+    if (!t) return 0;
+    atomic_fetch_sub(&p->pending, 1);
+    task_run(vm, t);
+    return 1;
+}
+
+// spins for a while, then sleeps until there is work or the pool stops
+static void idle(TaskPool *p) {
+    for (int i = 0; i < 64; i++) {
+        if (atomic_load(&p->pending) > 0 || atomic_load(&p->stop)) return;
+        sched_yield();
+    }
+    pthread_mutex_lock(&p->lock);
+    atomic_fetch_add(&p->sleepers, 1);
+    while (!atomic_load(&p->stop) && atomic_load(&p->pending) <= 0) pthread_cond_wait(&p->wake, &p->lock);
+    atomic_fetch_sub(&p->sleepers, 1);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    TaskPool *p = w->pool;
+
+    // the Vm is built here so its memory is first touched by this thread
+    Vm *vm = (Vm *)malloc(sizeof(Vm));
+    if (!vm || !vm_init(vm, p->prog, p->tier)) {
+        free(vm);
+        return NULL;
+    }
+    heap_configure(&vm->heap, &p->gc);
+    for (size_t i = 0; i < vm->fns_len; i++) {
+        if (!p->shared[i]) continue;
+        vm->fns[i].chunk = p->shared[i];
+        vm->fns[i].borrowed = 1;
+    }
+    vm->pool = p;
+    vm->worker = w->index;
+    vm->prof = p->prof;
+    if (vm->prof) prof_attach(vm);
+    w->vm = vm;
+
+    while (!atomic_load(&p->stop)) {
+        if (!help(vm)) idle(p);
+    }
+    return NULL;
+}
+
+static size_t pool_size(const Vm *vm) {
+    if (vm->pool) return vm->pool->workers_len;
+    if (vm->threads) return vm->threads;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+static int pool_start(Vm *owner) {
+    size_t n = pool_size(owner);
+
+    TaskPool *p = (TaskPool *)calloc(1, sizeof(TaskPool));
+    if (!p) return 0;
+    p->workers = (Worker *)calloc(n, sizeof(Worker));
+    p->shared = (Chunk **)calloc(owner->fns_len ? owner->fns_len : 1, sizeof(Chunk *));
+    if (!p->workers || !p->shared) {
+        free(p->workers);
+        free(p->shared);
+        free(p);
+        return 0;
+    }
+    for (size_t i = 0; i < owner->fns_len; i++) {
+        const Chunk *ch = owner->fns[i].chunk;
+        if (ch && (ch->mapped || owner->fns[i].borrowed)) p->shared[i] = owner->fns[i].chunk;
+    }
+    p->prog = owner->prog;
+    p->tier = owner->tier;
+    p->gc = owner->heap.cfg;
+    p->prof = owner->prof;
+    p->workers_len = n;
+    atomic_store(&p->next_id, 1);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+
+    for (size_t i = 0; i < n; i++) {
+        Worker *w = &p->workers[i];
+        w->pool = p;
+        w->index = i;
+        w->rng = 0x9e3779b97f4a7c15ull * (i + 1);
+    }
+    p->workers[0].vm = owner;
+    owner->pool = p;
+    owner->worker = 0;
+
+    // a worker that fails to start just leaves the others more to steal
+    for (size_t i = 1; i < n; i++) {
+        Worker *w = &p->workers[i];
+        w->running = pthread_create(&w->thread, NULL, worker_main, w) == 0;
+    }
+    return 1;
+}
+
+static void pool_stop(TaskPool *p) {
+    if (p->stopped) return;
+    p->stopped = 1;
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->stop, 1);
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (size_t i = 1; i < p->workers_len; i++) {
+        if (p->workers[i].running) pthread_join(p->workers[i].thread, NULL);
+    }
+}
+
+// ----- public -----
+
+int task_spawn(Vm *vm, size_t fn, size_t argc, Span where, Value *out) {
+    if (!vm->pool && !pool_start(vm)) return vm_error(vm, where, "out of memory starting the task pool");
+    TaskPool *p = vm->pool;
+
+    Packed args = {0};
+    for (size_t i = 0; i < argc; i++) {
+        int r = pack(&args, vm->stack[vm->sp - argc + i], 0);
+        if (r <= 0) {
+            free(args.buf);
+            return copy_error(vm, where, r);
+        }
+    }
+    Task *t = (Task *)calloc(1, sizeof(Task));
+    int64_t id = atomic_fetch_add(&p->next_id, 1);
+    TaskSlot *slot = t ? slot_of(p, id, 1) : NULL;
+    if (!slot) {
+        free(args.buf);
+        free(t);
+        return vm_error(vm, where, "out of memory");
+    }
+    t->fn = (uint32_t)fn;
+    t->argc = (uint32_t)argc;
+    t->where = where;
+    t->args = args.buf;
+    atomic_store_explicit(slot, t, memory_order_release);
+    atomic_fetch_add(&p->live, 1);
+    vm->stats.tasks_spawned++;
+
+    // what we printed so far goes out before anything the task prints
+    outbuf_flush(&vm->out);
+
+    if (!deque_push(&p->workers[vm->worker].dq, t)) {
+        task_run(vm, t); // full: nobody is keeping up anyway
+    } else {
+        atomic_fetch_add(&p->pending, 1);
+        if (atomic_load(&p->sleepers)) {
+            pthread_mutex_lock(&p->lock);
+            pthread_cond_signal(&p->wake);
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    *out = value_int(id);
+    return 1;
+}
+
+int task_join(Vm *vm, Value handle, Span where, Value *out) {
+    if (handle.kind != VAL_INT) {
+        return vm_error(vm, where, "'join' expects a task handle, got %s", value_kind_name(handle.kind));
+    }
+    TaskPool *p = vm->pool;
+    int64_t id = handle.as.i;
+    TaskSlot *slot = p && id >= 1 && id < atomic_load(&p->next_id) ? slot_of(p, id, 0) : NULL;
+    Task *t = slot ? atomic_exchange(slot, &joined) : NULL;
+    if (!t || t == &joined) {
+        return vm_error(vm, where, "no task %lld to join (never spawned, or already joined)", (long long)id);
+    }
+
+    // help out instead of blocking: the task we wait for is often the
+    // one at the bottom of our own deque
+    while (atomic_load_explicit(&t->state, memory_order_acquire) == TASK_QUEUED) {
+        if (!help(vm)) sched_yield();
+    }
+
+    int ok;
+    if (atomic_load_explicit(&t->state, memory_order_relaxed) == TASK_DONE) {
+        const uint8_t *rd = t->result;
+        ok = unpack(vm, &rd, out) ? 1 : vm_error(vm, where, "out of memory");
+    } else {
+        // the task reported its own error when it failed
+        ok = vm_error(vm, where, "joined task %lld failed", (long long)id);
+    }
+    free(t->result);
+    free(t);
+    return ok;
+}
+
+// ----- parallel_map / parallel_reduce -----
+
+static void free_chunks(Task *ts, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(ts[i].args);
+        free(ts[i].result);
+    }
+    free(ts);
+}
+
+// Cuts args[0] into chunks and runs op over each one with fns[fn]: on
+// the caller when there is one chunk or one worker, else on the pool.
+// The cut depends on the length alone, so a reduction groups the same
+// elements whatever the thread count. On success *out holds the
+// finished chunks in order.
+static int run_chunks(Vm *vm, uint8_t op, size_t fn, const Value *args, Span where, Task **out, size_t *out_len) {
+    const List *l = args[0].as.list;
+    size_t n = l->len;
+    _Atomic int cancel; // outlives the chunks: we wait for all of them
+    atomic_init(&cancel, 0);
+    size_t size = (n + TASK_PAR_CHUNKS - 1) / TASK_PAR_CHUNKS;
+    if (size < TASK_PAR_GRAIN) size = TASK_PAR_GRAIN;
+    size_t k = (n + size - 1) / size;
+
+    Task *ts = (Task *)calloc(k ? k : 1, sizeof(Task));
+    if (!ts) return vm_error(vm, where, "out of memory");
+    for (size_t i = 0; i < k; i++) {
+        size_t lo = i * size;
+        size_t hi = n - lo < size ? n : lo + size;
+        Packed b = {0};
+        int r = pack_slice(&b, l, lo, hi, 0);
+        if (r <= 0) {
+            free(b.buf);
+            free_chunks(ts, i);
+            return copy_error(vm, where, r);
+        }
+        ts[i].op = op;
+        ts[i].fn = (uint32_t)fn;
+        ts[i].argc = 1;
+        ts[i].where = where;
+        ts[i].args = b.buf;
+        atomic_init(&ts[i].state, TASK_QUEUED);
+        ts[i].cancel = &cancel;
+    }
+    *out = ts;
+    *out_len = k;
+
+    if (k <= 1 || pool_size(vm) == 1) {
+        for (size_t i = 0; i < k; i++) {
+            if (task_exec(vm, &ts[i])) continue;
+            free_chunks(ts, k);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (!vm->pool && !pool_start(vm)) {
+        free_chunks(ts, k);
+        return vm_error(vm, where, "out of memory starting the task pool");
+    }
+    TaskPool *p = vm->pool;
+    outbuf_flush(&vm->out);
+    atomic_fetch_add(&p->live, (int64_t)k);
+    vm->stats.tasks_spawned += k;
+
+    // the last chunk goes in first: we take from the front, thieves from the back
+    Deque *dq = &p->workers[vm->worker].dq;
+    for (size_t i = k; i-- > 0;) {
+        if (!deque_push(dq, &ts[i])) {
+            task_run(vm, &ts[i]);
+            continue;
+        }
+        atomic_fetch_add(&p->pending, 1);
+    }
+    if (atomic_load(&p->sleepers)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    int ok = 1;
+    for (size_t i = 0; i < k; i++) {
+        while (atomic_load_explicit(&ts[i].state, memory_order_acquire) == TASK_QUEUED) {
+            if (!help(vm)) sched_yield();
+        }
+        if (atomic_load_explicit(&ts[i].state, memory_order_relaxed) == TASK_FAILED) ok = 0;
+    }
+    if (!ok) {
+        // the chunk reported its own error
+        free_chunks(ts, k);
+        vm->had_error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+int task_parallel_map(Vm *vm, size_t fn, const Value *args, Span where, Value *out) {
+    Task *ts;
+    size_t k;
+    if (!run_chunks(vm, TASK_MAP, fn, args, where, &ts, &k)) return 0;
+
+    // no safepoint from here on
+    List *res = heap_new_list(&vm->heap, 0, 0);
+    int ok = res != NULL;
+    for (size_t i = 0; i < k && ok; i++) {
+        const uint8_t *rd = ts[i].result;
+        Value part;
+        ok = unpack(vm, &rd, &part);
+        for (size_t j = 0; ok && j < part.as.list->len; j++) {
+            Value e = list_get(part.as.list, j);
+            if (!j && !vm_list_accepts(vm, res, e, where)) {
+                free_chunks(ts, k);
+                return 0;
+            }
+            ok = heap_list_push(&vm->heap, res, e);
+        }
+    }
+    free_chunks(ts, k);
+    if (!ok) return vm_error(vm, where, "out of memory");
+    *out = value_list(res);
+    return 1;
+}
+
+int task_parallel_reduce(Vm *vm, size_t fn, const Value *args, Span where, Value *out) {
+    Task *ts;
+    size_t k;
+    if (!run_chunks(vm, TASK_REDUCE, fn, args, where, &ts, &k)) return 0;
+
+    // the partial results, then the fold over them starting from init
+    size_t base = vm->sp;
+    if (VM_STACK_MAX - base < k + 3) {
+        free_chunks(ts, k);
+        return vm_error(vm, where, "stack overflow");
+    }
+    for (size_t i = 0; i < k; i++) {
+        const uint8_t *rd = ts[i].result;
+        if (!unpack(vm, &rd, &vm->stack[vm->sp])) {
+            vm->sp = base;
+            free_chunks(ts, k);
+            return vm_error(vm, where, "out of memory");
+        }
+        vm->binds[vm->sp].name = (StrView){0};
+        vm->binds[vm->sp].is_mut = 0;
+        vm->sp++;
+    }
+    free_chunks(ts, k);
+    size_t acc = vm->sp++;
+    vm->stack[acc] = args[2];
+
+    for (size_t i = 0; i < k; i++) {
+        vm->stack[vm->sp++] = vm->stack[acc];
+        vm->stack[vm->sp++] = vm->stack[base + i];
+        Value r;
+        if (!vm_call(vm, fn, 2, where, &r)) {
+            vm->sp = base;
+            return 0;
+        }
+        vm->stack[acc] = r;
+    }
+    *out = vm->stack[acc];
+    vm->sp = base;
+    return 1;
+}
+
+static void add_stats(TierStats *into, const TierStats *s) {
+    into->compile_ns += s->compile_ns;
+    into->compiled += s->compiled;
+    into->bailouts += s->bailouts;
+    into->osr_entries += s->osr_entries;
+    into->interp_calls += s->interp_calls;
+    into->bytecode_calls += s->bytecode_calls;
+    into->region_allocs += s->region_allocs;
+    into->vector_elems += s->vector_elems;
+    into->tasks_spawned += s->tasks_spawned;
+    into->tasks_stolen += s->tasks_stolen;
+}
+
+int task_pool_finish(Vm *vm, int abort) {
+    TaskPool *p = vm->pool;
+    if (!p || vm->worker) return 1;
+    if (!abort) {
+        while (atomic_load(&p->live) > 0) {
+            if (!help(vm)) sched_yield();
+        }
+    }
+    pool_stop(p);
+    for (size_t i = 1; i < p->workers_len; i++) {
+        if (p->workers[i].vm) add_stats(&vm->stats, &p->workers[i].vm->stats);
+    }
+    return !atomic_load(&p->failed);
+}
+
+void task_pool_free(TaskPool *p) {
+    if (!p) return;
+    pool_stop(p);
+    for (size_t i = 1; i < p->workers_len; i++) {
+        Vm *vm = p->workers[i].vm;
+        if (!vm) continue;
+        vm_free(vm);
+        free(vm);
+    }
+    // tasks nobody joined
+    for (size_t s = 0; s < TASK_SEGS; s++) {
+        TaskSlot *seg = atomic_load(&p->segs[s]);
+        if (!seg) continue;
+        for (size_t i = 0; i < ((size_t)TASK_SEG0 << s); i++) {
+            Task *t = atomic_load_explicit(&seg[i], memory_order_relaxed);
+            if (!t || t == &joined) continue;
+            free(t->args);
+            free(t->result);
+            free(t);
+        }
+        free(seg);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    free(p->shared);
+    free(p->workers);
+    free(p);
+}
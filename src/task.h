@@ -0,0 +1,62 @@
+#ifndef LUNAR_TASK_H
+#define LUNAR_TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+// Tasks: `spawn f(args)` and join(h).
+//
+// The first spawn starts a pool of worker threads (Vm.threads, or one
+// per online core). Every worker runs its own Vm with its own heap, so
+// allocation needs no locks; the Program and cached bytecode are shared
+// read-only. The Vm that spawned first is worker 0 and runs tasks only
+// while it waits in join() or at the end of main.
+//
+// Each worker has a fixed-size Chase-Lev deque: it pushes and takes
+// tasks at the bottom, idle workers steal from the top of a random
+// victim. A full deque makes spawn run the call right away.
+//
+// Values cross threads by deep copy: the arguments when the task is
+// spawned, the result when it is joined. A handle is a plain int; each
+// one can be joined once. A task's output is flushed when it finishes.
+//
+// parallel_map and parallel_reduce cut a list into chunks of at least
+// TASK_PAR_GRAIN elements (at most TASK_PAR_CHUNKS of them) and run each
+// chunk as a task; a list that makes a single chunk, or a pool of one,
+// runs on the caller.
+
+typedef struct Vm Vm;
+typedef struct TaskPool TaskPool;
+
+#define TASK_DEQUE_CAP 8192 // per worker; a power of two
+#define TASK_COPY_DEPTH 256 // nesting of lists/maps that can be passed along
+#define TASK_PAR_GRAIN 256   // elements per parallel_map/reduce chunk, at least
+#define TASK_PAR_CHUNKS 1024 // chunks per call, at most (longer lists get longer chunks)
+
+// Spawns fns[fn] with the argc arguments on top of vm's stack (left
+// there for the caller to pop). *out is the handle. returns 0 after
+// reporting an error.
+int task_spawn(Vm *vm, size_t fn, size_t argc, Span where, Value *out);
+
+// Waits for the task behind `handle`, running other tasks meanwhile.
+// This is a GC safepoint like a call.
+int task_join(Vm *vm, Value handle, Span where, Value *out);
+
+// parallel_map(xs, f): f applied to every element of the list args[0],
+// in order. parallel_reduce(xs, f, init): every chunk is folded with f,
+// then init and the chunk results are, left to right; with an
+// associative f that is the plain left fold. fn is f and args are the
+// builtin's. A safepoint, like a call.
+int task_parallel_map(Vm *vm, size_t fn, const Value *args, Span where, Value *out);
+int task_parallel_reduce(Vm *vm, size_t fn, const Value *args, Span where, Value *out);
+
+// Called by the owner once main returns: runs every task nobody joined
+// (or, with abort set, drops the ones that have not started) and stops
+// the workers, adding their tier stats to the owner's. returns 0 if a
+// task failed.
+int task_pool_finish(Vm *vm, int abort);
+
+void task_pool_free(TaskPool *p);
+
+#endif
@@ -1,10 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 FileBuf read_whole_file(const char *path) {
     FileBuf out = {0};
-
     FILE *f = fopen(path, "rb");
     if(!f) return out;
 
@@ -37,4 +38,20 @@ void free_filebuf(FileBuf *fb) {
     free(fb->data);
     fb->data = NULL;
     fb->len = 0; /* full field reset */
-}
\ No newline at end of file
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
@@ -2,8 +2,12 @@
 #define LUNAR_UTIL_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-// file buffer struct def
+// file buffer struct def.
+// String literals and names point into this buffer, so it has to outlive
+// the program run. It is always read, never mapped: a source truncated
+// under a mapping (an editor saving in place) would end the run with SIGBUS.
 typedef struct {
     char *data;
     size_t len;
@@ -12,4 +16,11 @@ typedef struct {
 FileBuf read_whole_file(const char *path);
 void free_filebuf(FileBuf *fb);
 
+// monotonic clock in nanoseconds, for timing stats
+uint64_t monotonic_ns(void);
+
+// 64-bit FNV-1a; pass the previous result as seed to hash in pieces
+#define HASH_SEED 0xcbf29ce484222325ull
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+
 #endif
\ No newline at end of file
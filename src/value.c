@@ -0,0 +1,127 @@
+#include "value.h"
+#include "list.h"
+#include "map.h"
+
+const char *value_kind_name(ValueKind k) {
+    switch (k) {
+        case VAL_INT:  return "int";
+        case VAL_BOOL: return "bool";
+        case VAL_STR:  return "string";
+        case VAL_LIST: return "list";
+        case VAL_MAP:  return "map";
+        default: return "<?>";
+    }
+}
+
+ValueKind value_kind_for_type(StrView t) {
+    if (sv_eq_cstr(t, "int")) return VAL_INT;
+    if (sv_eq_cstr(t, "bool")) return VAL_BOOL;
+    if (sv_eq_cstr(t, "string")) return VAL_STR;
+    if (t.len > 5 && sv_eq_cstr((StrView){ t.ptr, 5 }, "list[") && t.ptr[t.len - 1] == ']') return VAL_LIST;
+    if (t.len > 4 && sv_eq_cstr((StrView){ t.ptr, 4 }, "map[") && t.ptr[t.len - 1] == ']') return VAL_MAP;
+    return 0;
+}
+
+ValueKind value_list_elem_for_type(StrView t) {
+    if (value_kind_for_type(t) != VAL_LIST) return 0;
+    return value_kind_for_type((StrView){ t.ptr + 5, t.len - 6 });
+}
+
+ValueKind value_map_key_for_type(StrView t) {
+    if (value_kind_for_type(t) != VAL_MAP) return 0;
+    ValueKind k = value_kind_for_type((StrView){ t.ptr + 4, t.len - 5 });
+    return k == VAL_INT || k == VAL_STR ? k : 0;
+}
+
+int value_equal(Value a, Value b) {
+    return value_equal_in(a, b, NULL);
+}
+
+int value_equal_in(Value a, Value b, const ListPair *up) {
+    if (a.kind != b.kind) return 0;
+    switch (a.kind) {
+        case VAL_INT:  return a.as.i == b.as.i;
+        case VAL_BOOL: return a.as.b == b.as.b;
+        case VAL_STR:  return sv_eq(value_sv(&a), value_sv(&b));
+        case VAL_LIST: return list_equal(a.as.list, b.as.list, up);
+        case VAL_MAP:  return a.as.map == b.as.map;
+        default: return 0;
+    }
+}
+
+// containers being printed further up
+typedef struct Printing {
+    const void *c;
+    const struct Printing *up;
+} Printing;
+
+static void print_value(OutBuf *out, Value v, const Printing *up);
+
+// elements inside containers: strings get quotes
+static void print_elem(OutBuf *out, Value v, const Printing *up) {
+    if (v.kind == VAL_STR) {
+        outbuf_putc(out, '"');
+        print_value(out, v, up);
+        outbuf_putc(out, '"');
+    } else {
+        print_value(out, v, up);
+    }
+}
+
+static int printing(const void *c, const Printing *up) {
+    for (; up; up = up->up) {
+        if (up->c == c) return 1;
+    }
+    return 0;
+}
+
+static void print_list(OutBuf *out, const List *l, const Printing *up) {
+    if (printing(l, up)) {
+        outbuf_write(out, "[...]", 5);
+        return;
+    }
+    Printing here = { l, up };
+    outbuf_putc(out, '[');
+    for (size_t i = 0; i < l->len; i++) {
+        if (i) outbuf_write(out, ", ", 2);
+        print_elem(out, list_get(l, i), &here);
+    }
+    outbuf_putc(out, ']');
+}
+
+static void print_map(OutBuf *out, const Map *m, const Printing *up) {
+    if (printing(m, up)) {
+        outbuf_write(out, "{...}", 5);
+        return;
+    }
+    Printing here = { m, up };
+    outbuf_putc(out, '{');
+    size_t it = 0;
+    Value k, v;
+    for (int first = 1; map_next(m, &it, &k, &v); first = 0) {
+        if (!first) outbuf_write(out, ", ", 2);
+        print_elem(out, k, &here);
+        outbuf_write(out, ": ", 2);
+        print_elem(out, v, &here);
+    }
+    outbuf_putc(out, '}');
+}
+
+static void print_value(OutBuf *out, Value v, const Printing *up) {
+    switch (v.kind) {
+        case VAL_INT:  outbuf_int(out, v.as.i); break;
+        case VAL_BOOL: v.as.b ? outbuf_write(out, "true", 4) : outbuf_write(out, "false", 5); break;
+        case VAL_STR: {
+            StrView s = value_sv(&v);
+            outbuf_write(out, s.ptr, s.len);
+            break;
+        }
+        case VAL_LIST: print_list(out, v.as.list, up); break;
+        case VAL_MAP:  print_map(out, v.as.map, up); break;
+        default: outbuf_write(out, "<?>", 3); break;
+    }
+}
+
+void value_print(OutBuf *out, Value v) {
+    print_value(out, v, NULL);
+}
@@ -0,0 +1,208 @@
+#ifndef LUNAR_VALUE_H
+#define LUNAR_VALUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "outbuf.h"
+
+// runtime values shared by both execution tiers
+
+typedef enum {
+    VAL_INT = 1,
+    VAL_BOOL,
+    VAL_STR,
+    VAL_LIST,
+    VAL_MAP,
+} ValueKind;
+
+typedef struct List List;
+typedef struct Map Map;
+typedef struct Str Str;
+
+// How a string value holds its bytes. Literals are views into memory that
+// outlives the run (the source file, the .lrc mapping, or the arena for
+// literals with escapes); strings built at run time are either small
+// enough to sit inside the Value or live in a heap Str.
+typedef enum {
+    STR_VIEW = 0,
+    STR_SMALL,
+    STR_HEAP,
+} StrRepr;
+
+#define STR_SMALL_MAX 16
+
+typedef struct {
+    ValueKind kind;
+    uint8_t str;       // VAL_STR: a StrRepr
+    uint8_t small_len; // STR_SMALL: bytes used in as.small
+    union {
+        int64_t i;
+        int b;     // 0/1
+        StrView s; // STR_VIEW and STR_HEAP; read strings through value_sv
+        char small[STR_SMALL_MAX];
+        List *list;
+        Map *map;
+    } as;
+} Value;
+
+// ----- heap objects -----
+
+typedef enum {
+    OBJ_LIST = 1,
+    OBJ_MAP,
+    OBJ_STR,
+} ObjKind;
+
+// where an object lives; see heap.h
+typedef enum {
+    GEN_YOUNG = 0, // in the nursery
+    GEN_OLD,       // malloc'd, linked into the old generation
+    GEN_FORWARDED, // nursery husk of a promoted object; next is the copy
+    GEN_REGION,    // owned by a call frame, freed on return (see vm.h); never collected
+} ObjGen;
+
+// common header of every heap object
+typedef struct Obj {
+    ObjKind kind;
+    uint8_t gen;        // ObjGen
+    uint8_t marked;     // old generation mark bit
+    uint8_t remembered; // old object already in the remembered set
+    struct Obj *next;   // old: next old object; forwarded: the promoted copy
+} Obj;
+
+// Element storage is picked by the element kind, not boxed per element:
+// list[int] is a plain int64_t array and list[bool] one byte per element.
+// Other element kinds (strings, nested lists) are stored as Values.
+// elem is 0 for an empty list whose type is not known yet; the first
+// element stored decides it.
+struct List {
+    Obj obj;
+    ValueKind elem;
+    size_t len;
+    size_t cap;
+    union {
+        int64_t *ints;
+        uint8_t *bools;
+        Value *vals;
+        void *raw;
+    } as;
+};
+
+// map[K]: open addressing with one control byte per slot (see map.h).
+// Keys are ints or strings, all values share one kind; both kinds are
+// fixed by the annotation or by the first insert.
+struct Map {
+    Obj obj;
+    ValueKind key;
+    ValueKind val;
+    size_t len;
+    size_t cap;     // slots; a power of two, 0 before the first insert
+    uint8_t *ctrl;  // cap + MAP_GROUP bytes, the first group mirrored at the end
+    void *slots;    // layout depends on the key kind
+};
+
+// Bytes behind STR_HEAP values. A value views data[0..len) and never
+// looks past its own length, while `used` records the furthest any value
+// has seen. So `a + b` may write b into the spare capacity whenever a
+// ends exactly at `used`: nobody else can observe those bytes. Repeated
+// `s = s + x` then appends in place instead of copying s every time.
+struct Str {
+    Obj obj;
+    size_t used;
+    size_t cap;
+    char data[];
+};
+
+static inline Value value_int(int64_t i) {
+    Value v;
+    v.kind = VAL_INT;
+    v.as.i = i;
+    return v;
+}
+
+static inline Value value_bool(int b) {
+    Value v;
+    v.kind = VAL_BOOL;
+    v.as.b = b ? 1 : 0;
+    return v;
+}
+
+// s must outlive the run (see StrRepr)
+static inline Value value_str(StrView s) {
+    Value v;
+    v.kind = VAL_STR;
+    v.str = STR_VIEW;
+    v.as.s = s;
+    return v;
+}
+
+// 1 if v points at a heap object
+static inline int value_is_obj(Value v) {
+    return v.kind == VAL_LIST || v.kind == VAL_MAP || (v.kind == VAL_STR && v.str == STR_HEAP);
+}
+
+// the object behind a value; value_is_obj(v) must hold. heap strings
+// always view their Str from data[0].
+static inline Obj *value_obj(Value v) {
+    if (v.kind == VAL_LIST) return &v.as.list->obj;
+    if (v.kind == VAL_MAP) return &v.as.map->obj;
+    return (Obj *)(void *)((char *)(uintptr_t)v.as.s.ptr - offsetof(Str, data));
+}
+
+// the bytes of a string value; for small strings the view points into
+// *v, so it is only good while *v stays where it is
+static inline StrView value_sv(const Value *v) {
+    if (v->str == STR_SMALL) {
+        StrView s = { v->as.small, v->small_len };
+        return s;
+    }
+    return v->as.s;
+}
+
+static inline Value value_list(List *l) {
+    Value v;
+    v.kind = VAL_LIST;
+    v.as.list = l;
+    return v;
+}
+
+static inline Value value_map(Map *m) {
+    Value v;
+    v.kind = VAL_MAP;
+    v.as.map = m;
+    return v;
+}
+
+const char *value_kind_name(ValueKind k);
+
+// kind named by a type annotation: "int", "bool", "string", "list[...]";
+// 0 if unknown
+ValueKind value_kind_for_type(StrView type_name);
+
+// element kind of a `list[T]` annotation, 0 if it is not a list type or
+// T is unknown
+ValueKind value_list_elem_for_type(StrView type_name);
+
+// key kind of a `map[K]` annotation, 0 if it is not a map type or K is
+// not int/string
+ValueKind value_map_key_for_type(StrView type_name);
+
+// 1 if both values have the same kind and contents (lists compare
+// element-wise, maps by identity)
+int value_equal(Value a, Value b);
+
+// lists being compared further up. A pair that comes up again is taken
+// as equal, so lists that contain themselves compare in finite time.
+typedef struct ListPair {
+    const List *a, *b;
+    const struct ListPair *up;
+} ListPair;
+
+// value_equal inside the lists in up (for list_equal)
+int value_equal_in(Value a, Value b, const ListPair *up);
+
+// lists and maps inside themselves print as [...] and {...}
+void value_print(OutBuf *out, Value v);
+
+#endif
@@ -0,0 +1,1056 @@
+#include "vm.h"
+#include "interp.h"
+#include "builtins.h"
+#include "coro.h"
+#include "list.h"
+#include "map.h"
+#include "simd.h"
+#include "str.h"
+#include "task.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+int vm_init(Vm *vm, Program *prog, TierConfig cfg) {
+    memset(vm, 0, sizeof(*vm));
+    vm->prog = prog;
+    vm->tier = cfg;
+    if (!vm->tier.call_threshold) vm->tier.call_threshold = TIER_DEFAULT_CALLS;
+    if (!vm->tier.loop_threshold) vm->tier.loop_threshold = TIER_DEFAULT_LOOPS;
+    vm_bc_options(&vm->tier, &vm->bc);
+
+    vm->fns_len = prog->fns_len;
+    vm->fns = (FnInfo *)calloc(prog->fns_len ? prog->fns_len : 1, sizeof(FnInfo));
+    vm->stack = (Value *)malloc(VM_STACK_MAX * sizeof(Value));
+    vm->binds = (Binding *)malloc(VM_STACK_MAX * sizeof(Binding));
+    vm->frames = (Frame *)malloc(VM_FRAMES_MAX * sizeof(Frame));
+    vm->walk_max = VM_WALK_DEPTH_MAX;
+    if (!vm->fns || !vm->stack || !vm->binds || !vm->frames || !outbuf_init(&vm->out, 1)) {
+        vm_free(vm);
+        return 0;
+    }
+
+    for (size_t i = 0; i < prog->fns_len; i++) {
+        vm->fns[i].decl = prog->fns[i];
+        if (vm->tier.pgo && !vm->tier.pgo_gen) {
+            vm->fns[i].hot = pgo_fn_hot(vm->tier.pgo, i, vm->tier.call_threshold, vm->tier.loop_threshold);
+        }
+    }
+    return 1;
+}
+
+void vm_free(Vm *vm) {
+    // the workers may borrow our chunks, so they go first
+    if (vm->pool && !vm->worker) task_pool_free(vm->pool);
+    coro_sched_free(vm->sched);
+    if (vm->fns) {
+        for (size_t i = 0; i < vm->fns_len; i++) {
+            if (!vm->fns[i].borrowed) chunk_free(vm->fns[i].chunk);
+        }
+    }
+    callgraph_free(&vm->cg);
+    heap_free(&vm->heap);
+    for (size_t i = 0; i < vm->region_used; i++) list_release(&vm->region[i]);
+    free(vm->region);
+    outbuf_free(&vm->out);
+    free(vm->fns);
+    free(vm->stack);
+    free(vm->binds);
+    free(vm->frames);
+    memset(vm, 0, sizeof(*vm));
+}
+
+void vm_adopt_chunks(Vm *vm, Chunk **chunks) {
+    for (size_t i = 0; i < vm->fns_len; i++) {
+        if (!chunks[i]) continue;
+        chunk_free(vm->fns[i].chunk);
+        vm->fns[i].chunk = chunks[i];
+        vm->stats.compiled++;
+    }
+}
+
+void vm_borrow_chunks(Vm *vm, Chunk *const *chunks) {
+    for (size_t i = 0; i < vm->fns_len; i++) {
+        if (!chunks[i]) continue;
+        vm->fns[i].chunk = chunks[i];
+        vm->fns[i].borrowed = 1;
+    }
+}
+
+void vm_bc_options(const TierConfig *tier, BcOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->inline_budget = tier->inline_budget ? tier->inline_budget : BC_DEFAULT_INLINE_BUDGET;
+    opts->inline_depth = BC_DEFAULT_INLINE_DEPTH;
+    opts->wrap_ints = tier->wrap_ints;
+    opts->no_vectorize = tier->no_vectorize;
+    opts->pgo = tier->pgo;
+    opts->pgo_gen = tier->pgo_gen;
+}
+
+int vm_compile_all(Program *prog, const TierConfig *tier, Chunk **chunks, size_t *compiled) {
+    CallGraph cg = {0};
+    BcOptions opts;
+    vm_bc_options(tier, &opts);
+    if ((!tier->no_inline || !tier->no_fold) && callgraph_build(&cg, prog)) {
+        if (!tier->no_inline) opts.cg = &cg;
+        if (!tier->no_fold) opts.fold = &cg;
+    }
+
+    int all = 1;
+    for (size_t i = 0; i < prog->fns_len; i++) {
+        chunks[i] = bc_compile(prog, i, &opts);
+        if (!chunks[i]) all = 0;
+        else (*compiled)++;
+    }
+    callgraph_free(&cg);
+    return all;
+}
+
+int vm_error(Vm *vm, Span where, const char *fmt, ...) {
+    // whatever the program printed so far goes out before the message
+    if (vm->out.buf) outbuf_flush(&vm->out);
+    va_list ap;
+    va_start(ap, fmt);
+    diag_verror(where, fmt, ap);
+    va_end(ap);
+    vm->had_error = 1;
+    return 0;
+}
+
+// ----- operators -----
+
+static const char *bop_name(BinaryOp op) {
+    switch (op) {
+        case BOP_ADD: return "+";
+        case BOP_SUB: return "-";
+        case BOP_MUL: return "*";
+        case BOP_DIV: return "/";
+        case BOP_EQ:  return "==";
+        case BOP_NE:  return "!=";
+        case BOP_LT:  return "<";
+        case BOP_LTE: return "<=";
+        case BOP_GT:  return ">";
+        case BOP_GTE: return ">=";
+        default: return "?";
+    }
+}
+
+int vm_unary(Vm *vm, UnaryOp op, Value v, Span where, Value *out) {
+    if (op == UOP_NEG) {
+        if (v.kind != VAL_INT) {
+            return vm_error(vm, where, "operator '-' expects an int, got %s", value_kind_name(v.kind));
+        }
+        if (v.as.i == INT64_MIN && !vm->tier.wrap_ints) {
+            return vm_error(vm, where, "integer overflow: -(%lld) does not fit in an int", (long long)v.as.i);
+        }
+        *out = value_int((int64_t)(0 - (uint64_t)v.as.i));
+        return 1;
+    }
+
+    int truth = 0;
+    if (!vm_truthy(vm, v, where, &truth)) return 0;
+    *out = value_bool(!truth);
+    return 1;
+}
+
+int vm_binary(Vm *vm, BinaryOp op, Value l, Value r, Span where, Value *out) {
+    if (op == BOP_EQ || op == BOP_NE) {
+        int eq = value_equal(l, r);
+        *out = value_bool(op == BOP_EQ ? eq : !eq);
+        return 1;
+    }
+
+    if (op == BOP_ADD && l.kind == VAL_STR && r.kind == VAL_STR) {
+        if (!str_concat(&vm->heap, &l, &r, out)) return vm_error(vm, where, "out of memory");
+        return 1;
+    }
+
+    if (l.kind != VAL_INT || r.kind != VAL_INT) {
+        if (op == BOP_ADD) {
+            return vm_error(vm, where, "operator '+' expects two ints or two strings, got %s and %s",
+                            value_kind_name(l.kind), value_kind_name(r.kind));
+        }
+        return vm_error(vm, where, "operator '%s' expects int operands, got %s and %s",
+                        bop_name(op), value_kind_name(l.kind), value_kind_name(r.kind));
+    }
+
+    int64_t a = l.as.i;
+    int64_t b = r.as.i;
+    int64_t v = 0;
+    int overflow = 0;
+    switch (op) {
+        // the builtins leave the wrapped result in v either way
+        case BOP_ADD: overflow = __builtin_add_overflow(a, b, &v); break;
+        case BOP_SUB: overflow = __builtin_sub_overflow(a, b, &v); break;
+        case BOP_MUL: overflow = __builtin_mul_overflow(a, b, &v); break;
+        case BOP_DIV:
+            if (b == 0) return vm_error(vm, where, "division by zero");
+            overflow = a == INT64_MIN && b == -1;
+            v = overflow ? INT64_MIN : a / b;
+            break;
+        case BOP_LT:  *out = value_bool(a < b);  return 1;
+        case BOP_LTE: *out = value_bool(a <= b); return 1;
+        case BOP_GT:  *out = value_bool(a > b);  return 1;
+        case BOP_GTE: *out = value_bool(a >= b); return 1;
+        default: return vm_error(vm, where, "unknown operator");
+    }
+    if (overflow && !vm->tier.wrap_ints) {
+        return vm_error(vm, where, "integer overflow: %lld %s %lld does not fit in an int",
+                        (long long)a, bop_name(op), (long long)b);
+    }
+    *out = value_int(v);
+    return 1;
+}
+
+int vm_truthy(Vm *vm, Value v, Span where, int *out) {
+    switch (v.kind) {
+        case VAL_BOOL: *out = v.as.b; return 1;
+        case VAL_INT:  *out = v.as.i != 0; return 1;
+        default:
+            return vm_error(vm, where, "expected a bool condition, got %s", value_kind_name(v.kind));
+    }
+}
+
+// ----- lists -----
+
+int vm_list_accepts(Vm *vm, List *l, Value v, Span where) {
+    if (list_accepts(l, v)) return 1;
+    return vm_error(vm, where, "cannot store %s in list[%s]", value_kind_name(v.kind), value_kind_name(l->elem));
+}
+
+int vm_new_list(Vm *vm, ValueKind elem, const Value *items, size_t n, Span where, Value *out) {
+    if (!elem && n) elem = items[0].kind;
+    List *l = heap_new_list(&vm->heap, elem, n);
+    if (!l) return vm_error(vm, where, "out of memory");
+    for (size_t i = 0; i < n; i++) {
+        if (!vm_list_accepts(vm, l, items[i], where)) return 0;
+        heap_list_set(&vm->heap, l, i, items[i]);
+    }
+    l->len = n;
+    *out = value_list(l);
+    return 1;
+}
+
+int vm_map_key_ok(Vm *vm, Map *m, Value key, Span where) {
+    if (map_key_ok(m, key)) return 1;
+    if (!m->key) return vm_error(vm, where, "map keys must be int or string, got %s", value_kind_name(key.kind));
+    return vm_error(vm, where, "cannot use %s as a key of map[%s]", value_kind_name(key.kind), value_kind_name(m->key));
+}
+
+int vm_map_accepts(Vm *vm, Map *m, Value key, Value v, Span where) {
+    if (!vm_map_key_ok(vm, m, key, where)) return 0;
+    if (map_val_ok(m, v)) return 1;
+    return vm_error(vm, where, "cannot store %s in a map of %s values", value_kind_name(v.kind), value_kind_name(m->val));
+}
+
+// Takes a frame's region slots from the pool. NULL if the chunk has none
+// or the pool is used up, in which case its lists go on the heap.
+static List *frame_region(Vm *vm, const Chunk *ch) {
+    size_t n = ch->region_lists;
+    if (!n || VM_REGION_MAX - vm->region_top < n) return NULL;
+    if (!vm->region) {
+        vm->region = (List *)calloc(VM_REGION_MAX, sizeof(List));
+        if (!vm->region) return NULL;
+    }
+    List *r = vm->region + vm->region_top;
+    vm->region_top += n;
+    if (vm->region_top > vm->region_used) vm->region_used = vm->region_top;
+    return r;
+}
+
+// a list literal in region slot l; elem is always VAL_INT or VAL_BOOL
+static int region_list(Vm *vm, List *l, ValueKind elem, const Value *items, size_t n, Span where, Value *out) {
+    if (l->elem != elem || l->cap > VM_REGION_KEEP) list_release(l);
+    l->obj.kind = OBJ_LIST;
+    l->obj.gen = GEN_REGION;
+    l->elem = elem;
+    l->len = 0;
+    if (!list_reserve(l, n)) return vm_error(vm, where, "out of memory");
+    for (size_t i = 0; i < n; i++) {
+        if (!vm_list_accepts(vm, l, items[i], where)) return 0;
+        list_set(l, i, items[i]);
+    }
+    l->len = n;
+    vm->stats.region_allocs++;
+    *out = value_list(l);
+    return 1;
+}
+
+int vm_new_map(Vm *vm, ValueKind key, const Value *pairs, size_t n, Span where, Value *out) {
+    Map *m = heap_new_map(&vm->heap, key);
+    if (!m) return vm_error(vm, where, "out of memory");
+    for (size_t i = 0; i < n; i++) {
+        Value k = pairs[2 * i], v = pairs[2 * i + 1];
+        if (!vm_map_accepts(vm, m, k, v, where)) return 0;
+        if (!heap_map_set(&vm->heap, m, k, v)) return vm_error(vm, where, "out of memory");
+    }
+    *out = value_map(m);
+    return 1;
+}
+
+static int map_index(Vm *vm, Map *m, Value key, Span where, Value *out) {
+    Value *v = map_find(m, key);
+    if (v) {
+        *out = *v;
+        return 1;
+    }
+    if (key.kind == VAL_STR) {
+        StrView s = value_sv(&key);
+        return vm_error(vm, where, "key \"%.*s\" not in map", (int)s.len, s.ptr);
+    }
+    if (key.kind == VAL_INT) return vm_error(vm, where, "key %lld not in map", (long long)key.as.i);
+    return vm_error(vm, where, "%s key not in map", value_kind_name(key.kind));
+}
+
+static int check_index(Vm *vm, Value target, Value index, Span where, size_t *out) {
+    if (target.kind != VAL_LIST) {
+        return vm_error(vm, where, "cannot index %s", value_kind_name(target.kind));
+    }
+    if (index.kind != VAL_INT) {
+        return vm_error(vm, where, "list index must be an int, got %s", value_kind_name(index.kind));
+    }
+    size_t len = target.as.list->len;
+    if (index.as.i < 0 || (uint64_t)index.as.i >= len) {
+        return vm_error(vm, where, "index %lld out of bounds for list of length %zu", (long long)index.as.i, len);
+    }
+    *out = (size_t)index.as.i;
+    return 1;
+}
+
+int vm_index(Vm *vm, Value target, Value index, Span where, Value *out) {
+    if (target.kind == VAL_MAP) return map_index(vm, target.as.map, index, where, out);
+    size_t i = 0;
+    if (!check_index(vm, target, index, where, &i)) return 0;
+    *out = list_get(target.as.list, i);
+    return 1;
+}
+
+int vm_set_index(Vm *vm, Value target, Value index, Value v, Span where) {
+    if (target.kind == VAL_MAP) {
+        if (!vm_map_accepts(vm, target.as.map, index, v, where)) return 0;
+        if (!heap_map_set(&vm->heap, target.as.map, index, v)) return vm_error(vm, where, "out of memory");
+        return 1;
+    }
+    size_t i = 0;
+    if (!check_index(vm, target, index, where, &i)) return 0;
+    if (!vm_list_accepts(vm, target.as.list, v, where)) return 0;
+    heap_list_set(&vm->heap, target.as.list, i, v);
+    return 1;
+}
+
+// ----- garbage collection -----
+
+int vm_collect(Vm *vm, Span where) {
+    HeapRoots own = { vm->stack, vm->sp };
+    const HeapRoots *roots = &own;
+    size_t n = 1;
+    if (vm->sched) n = coro_roots(vm, &roots); // every coroutine's stack
+    if (heap_collect(&vm->heap, roots, n)) return 1;
+    return vm_error(vm, where, "out of memory: live data exceeds the heap limit of %zu MB",
+                    vm->heap.cfg.heap_max >> 20);
+}
+
+// ----- tiering -----
+
+static void tier_up(Vm *vm, size_t fn) {
+    FnInfo *fi = &vm->fns[fn];
+    if (fi->chunk || fi->no_compile) return;
+
+    uint64_t t0 = monotonic_ns();
+    if (!vm->cg_built && (!vm->tier.no_inline || !vm->tier.no_fold)) {
+        vm->cg_built = 1;
+        if (callgraph_build(&vm->cg, vm->prog)) {
+            if (!vm->tier.no_inline) vm->bc.cg = &vm->cg;
+            if (!vm->tier.no_fold) vm->bc.fold = &vm->cg;
+        }
+    }
+    fi->chunk = bc_compile(vm->prog, fn, &vm->bc);
+    vm->stats.compile_ns += monotonic_ns() - t0;
+
+    if (fi->chunk) vm->stats.compiled++;
+    else {
+        fi->no_compile = 1;
+        vm->stats.bailouts++;
+    }
+}
+
+static void count_call(Vm *vm, size_t fn) {
+    FnInfo *fi = &vm->fns[fn];
+    fi->calls++;
+    if (vm->tier.pgo_gen) pgo_enter(vm->tier.pgo, fn);
+    if (vm->tier.mode == TIER_AUTO && !fi->chunk && (fi->calls >= vm->tier.call_threshold || fi->hot)) {
+        tier_up(vm, fn);
+    }
+}
+
+const LoopEntry *vm_loop_backedge(Vm *vm, size_t fn, const Stmt *loop) {
+    FnInfo *fi = &vm->fns[fn];
+    if (vm->tier.mode != TIER_AUTO || fi->no_compile) return NULL;
+    if (!fi->chunk) {
+        if (++fi->loops < vm->tier.loop_threshold) return NULL;
+        // in a first call (main, say) what comes before the loop has run
+        // and may not run again: folding it would only repeat the work
+        vm->bc.fold_in_loops = fi->calls <= 1;
+        tier_up(vm, fn);
+        vm->bc.fold_in_loops = 0;
+        if (!fi->chunk) return NULL;
+    }
+    return chunk_find_loop(fi->chunk, loop);
+}
+
+// ----- bytecode execution -----
+
+static Span span_at(const FnInfo *fi, const uint8_t *ip) {
+    const Chunk *ch = fi->chunk;
+    SrcPos pos = chunk_pos_at(ch, (size_t)(ip - ch->code));
+    Span sp;
+    sp.path = fi->decl->span.path;
+    sp.line = pos.line;
+    sp.col = pos.col;
+    return sp;
+}
+
+static int invoke(Vm *vm, size_t fn, size_t argc, Span site, Value *out);
+
+// Runs bytecode starting at the top frame's ip until that frame returns.
+// Calls into other compiled functions stay in this loop; calls into
+// tree-walked ones recurse through invoke().
+// OP_VEC_ARITH: dst[i] = x[i] op y[i] for i up to n, as far as every
+// operand is an int list (or int k), in bounds, and nothing overflows.
+// Leaves i at the first element it did not do; the scalar loop that
+// follows picks up from there and reports whatever stopped us.
+static void vec_arith(Vm *vm, BinaryOp op, int form, Value dst, Value x, Value y, Value k, Value n, Value *i) {
+    if (i->kind != VAL_INT || n.kind != VAL_INT || i->as.i < 0 || i->as.i >= n.as.i) return;
+    if (dst.kind != VAL_LIST || dst.as.list->elem != VAL_INT) return;
+    const List *src[2] = {NULL, NULL};
+    size_t end = (size_t)n.as.i;
+    if (dst.as.list->len < end) end = dst.as.list->len;
+    for (int s = 0; s < 2; s++) {
+        Value l = s ? y : x;
+        if (!(form & (s ? VEC_Y_LIST : VEC_X_LIST))) {
+            if (k.kind != VAL_INT) return;
+            continue;
+        }
+        if (l.kind != VAL_LIST || l.as.list->elem != VAL_INT) return;
+        if (l.as.list->len < end) end = l.as.list->len;
+        src[s] = l.as.list;
+    }
+    size_t start = (size_t)i->as.i;
+    if (start >= end) return;
+
+    SimdOp sop = op == BOP_ADD ? SIMD_ADD : op == BOP_SUB ? SIMD_SUB : SIMD_MUL;
+    size_t done = simd_arith_i64(sop, dst.as.list->as.ints + start, src[0] ? src[0]->as.ints + start : NULL,
+                                 src[1] ? src[1]->as.ints + start : NULL, k.as.i, end - start, vm->tier.wrap_ints);
+    i->as.i += (int64_t)done;
+    vm->stats.vector_elems += done;
+}
+
+static int run(Vm *vm, Value *out) {
+    size_t entry = vm->frames_len - 1;
+    Frame *fr = &vm->frames[entry];
+    const FnInfo *fi = &vm->fns[fr->fn];
+    const Chunk *ch = fi->chunk;
+    const uint8_t *ip = fr->ip;
+    Value *slots = vm->stack + fr->base;
+    Value *sp = vm->stack + vm->sp;
+    const uint8_t *op_ip = ip;
+
+    #define READ_U16() (ip += 2, (size_t)ip[-2] | ((size_t)ip[-1] << 8))
+    #define PUSH(v) (*sp++ = (v))
+    #define POP() (*--sp)
+    #define SYNC() (vm->sp = (size_t)(sp - vm->stack), fr->ip = ip)
+    #define FAIL() do { SYNC(); return 0; } while (0)
+
+    for (;;) {
+        op_ip = ip;
+        switch ((OpCode)*ip++) {
+            case OP_INT:
+                PUSH(value_int(ch->ints[READ_U16()]));
+                break;
+
+            case OP_STR:
+                PUSH(value_str(ch->strs[READ_U16()]));
+                break;
+
+            case OP_TRUE:  PUSH(value_bool(1)); break;
+            case OP_FALSE: PUSH(value_bool(0)); break;
+
+            case OP_LOAD:
+                PUSH(slots[READ_U16()]);
+                break;
+
+            case OP_STORE:
+                slots[READ_U16()] = sp[-1];
+                break;
+
+            case OP_POP:
+                sp--;
+                break;
+
+            case OP_POPN:
+                sp -= READ_U16();
+                break;
+
+            case OP_NEG:
+            case OP_NOT: {
+                Value v = POP();
+                Value r;
+                SYNC();
+                if (!vm_unary(vm, *op_ip == OP_NEG ? UOP_NEG : UOP_NOT, v, span_at(fi, op_ip), &r)) FAIL();
+                PUSH(r);
+                break;
+            }
+
+            // the compiler proved both operands are ints and the result fits
+            case OP_IADD:
+                sp[-2].as.i = (int64_t)((uint64_t)sp[-2].as.i + (uint64_t)sp[-1].as.i);
+                sp--;
+                break;
+            case OP_ISUB:
+                sp[-2].as.i = (int64_t)((uint64_t)sp[-2].as.i - (uint64_t)sp[-1].as.i);
+                sp--;
+                break;
+            case OP_IMUL:
+                sp[-2].as.i = (int64_t)((uint64_t)sp[-2].as.i * (uint64_t)sp[-1].as.i);
+                sp--;
+                break;
+
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_EQ: case OP_NE:
+            case OP_LT: case OP_LTE: case OP_GT: case OP_GTE: {
+                Value r = POP();
+                Value l = POP();
+                OpCode op = (OpCode)*op_ip;
+
+                // int fast paths; everything else goes through vm_binary
+                if (l.kind == VAL_INT && r.kind == VAL_INT) {
+                    int64_t a = l.as.i, b = r.as.i, v;
+                    switch (op) {
+                        // on overflow, vm_binary wraps or reports it
+                        case OP_ADD: if (__builtin_add_overflow(a, b, &v)) break; PUSH(value_int(v)); continue;
+                        case OP_SUB: if (__builtin_sub_overflow(a, b, &v)) break; PUSH(value_int(v)); continue;
+                        case OP_MUL: if (__builtin_mul_overflow(a, b, &v)) break; PUSH(value_int(v)); continue;
+                        case OP_EQ:  PUSH(value_bool(a == b)); continue;
+                        case OP_NE:  PUSH(value_bool(a != b)); continue;
+                        case OP_LT:  PUSH(value_bool(a < b));  continue;
+                        case OP_LTE: PUSH(value_bool(a <= b)); continue;
+                        case OP_GT:  PUSH(value_bool(a > b));  continue;
+                        case OP_GTE: PUSH(value_bool(a >= b)); continue;
+                        default: break;
+                    }
+                }
+
+                static const BinaryOp bops[] = {
+                    BOP_ADD, BOP_SUB, BOP_MUL, BOP_DIV, BOP_EQ, BOP_NE,
+                    BOP_LT, BOP_LTE, BOP_GT, BOP_GTE,
+                };
+                Value res;
+                SYNC();
+                if (!vm_binary(vm, bops[op - OP_ADD], l, r, span_at(fi, op_ip), &res)) FAIL();
+                PUSH(res);
+                break;
+            }
+
+            case OP_JUMP: {
+                size_t off = READ_U16();
+                ip += off;
+                break;
+            }
+
+            case OP_JUMP_IF_FALSE: {
+                size_t off = READ_U16();
+                Value c = POP();
+                int truth = 0;
+                if (c.kind == VAL_BOOL) truth = c.as.b;
+                else {
+                    SYNC();
+                    if (!vm_truthy(vm, c, span_at(fi, op_ip), &truth)) FAIL();
+                }
+                if (!truth) ip += off;
+                break;
+            }
+
+            case OP_JUMP_IF_TRUE: {
+                size_t off = READ_U16();
+                Value c = POP();
+                int truth = 0;
+                if (c.kind == VAL_BOOL) truth = c.as.b;
+                else {
+                    SYNC();
+                    if (!vm_truthy(vm, c, span_at(fi, op_ip), &truth)) FAIL();
+                }
+                if (truth) ip += off;
+                break;
+            }
+
+            case OP_COUNT: {
+                size_t k = READ_U16();
+                pgo_count(vm->tier.pgo, (size_t)ch->ints[k], 0);
+                break;
+            }
+
+            case OP_COUNT_BRANCH: {
+                // a condition that is not a bool or int fails in the jump after this
+                size_t k = READ_U16();
+                Value c = sp[-1];
+                if (c.kind == VAL_BOOL) pgo_count(vm->tier.pgo, (size_t)ch->ints[k], !c.as.b);
+                else if (c.kind == VAL_INT) pgo_count(vm->tier.pgo, (size_t)ch->ints[k], c.as.i == 0);
+                break;
+            }
+
+            case OP_LOOP: {
+                size_t off = READ_U16();
+                ip -= off;
+                if (vm->heap.want_gc || vm->prof_pending) {
+                    SYNC();
+                    if (!vm_safepoint(vm, span_at(fi, op_ip))) FAIL();
+                }
+                break;
+            }
+
+            case OP_CALL: {
+                size_t callee = READ_U16();
+                size_t argc = *ip++;
+                SYNC();
+                if (!vm_safepoint(vm, span_at(fi, op_ip))) FAIL();
+                count_call(vm, callee);
+
+                const FnInfo *cf = &vm->fns[callee];
+                if (cf->chunk) {
+                    size_t base = vm->sp - argc;
+                    if (vm->frames_len >= VM_FRAMES_MAX || base + cf->chunk->max_stack > VM_STACK_MAX) {
+                        vm_error(vm, span_at(fi, op_ip), "stack overflow");
+                        FAIL();
+                    }
+                    vm->stats.bytecode_calls++;
+                    fr = &vm->frames[vm->frames_len++];
+                    fr->fn = (uint32_t)callee;
+                    fr->base = (uint32_t)base;
+                    fr->ip = cf->chunk->code;
+                    fr->region_base = (uint32_t)vm->region_top;
+                    fr->region = frame_region(vm, cf->chunk);
+
+                    fi = cf;
+                    ch = cf->chunk;
+                    ip = fr->ip;
+                    slots = vm->stack + base;
+                    break;
+                }
+
+                Value r;
+                if (!invoke(vm, callee, argc, span_at(fi, op_ip), &r)) FAIL();
+                sp = vm->stack + vm->sp;
+                PUSH(r);
+                break;
+            }
+
+            case OP_TAILCALL: {
+                size_t callee = READ_U16();
+                size_t argc = *ip++;
+                SYNC();
+                if (!vm_safepoint(vm, span_at(fi, op_ip))) FAIL();
+                count_call(vm, callee);
+
+                const FnInfo *cf = &vm->fns[callee];
+                if (cf->chunk) {
+                    // slide the arguments down over our own frame and restart
+                    if (fr->base + cf->chunk->max_stack > VM_STACK_MAX) {
+                        vm_error(vm, span_at(fi, op_ip), "stack overflow");
+                        FAIL();
+                    }
+                    memmove(slots, sp - argc, argc * sizeof(Value));
+                    sp = slots + argc;
+                    vm->stats.bytecode_calls++;
+                    fr->fn = (uint32_t)callee;
+                    fr->ip = cf->chunk->code;
+                    // nothing passed along can be in our region
+                    vm->region_top = fr->region_base;
+                    fr->region = frame_region(vm, cf->chunk);
+
+                    fi = cf;
+                    ch = cf->chunk;
+                    ip = fr->ip;
+                    break;
+                }
+
+                // tree-walked callees cannot share the frame: call, then return
+                Value r;
+                if (!invoke(vm, callee, argc, span_at(fi, op_ip), &r)) FAIL();
+                sp = vm->stack + vm->sp;
+                PUSH(r);
+                goto do_return;
+            }
+
+            case OP_SPAWN: {
+                size_t callee = READ_U16();
+                size_t argc = *ip++;
+                Value r;
+                SYNC();
+                if (!task_spawn(vm, callee, argc, span_at(fi, op_ip), &r)) FAIL();
+                sp -= argc;
+                PUSH(r);
+                break;
+            }
+
+            case OP_GO: {
+                size_t callee = READ_U16();
+                size_t argc = *ip++;
+                Value r;
+                SYNC();
+                if (!coro_go(vm, callee, argc, span_at(fi, op_ip), &r)) FAIL();
+                sp -= argc;
+                PUSH(r);
+                break;
+            }
+
+            case OP_BUILTIN: {
+                const Builtin *b = builtin_get(*ip++);
+                size_t argc = *ip++;
+                Value r;
+                SYNC();
+                if (!b->fn(vm, sp - argc, argc, span_at(fi, op_ip), &r)) FAIL();
+                if (vm->prof_pending) prof_sample(vm, span_at(fi, op_ip)); // time in the builtin is this line's
+                sp -= argc;
+                PUSH(r);
+                break;
+            }
+
+            case OP_LIST: {
+                size_t n = READ_U16();
+                ValueKind elem = (ValueKind)*ip++;
+                Value r;
+                SYNC();
+                if (!vm_new_list(vm, elem, sp - n, n, span_at(fi, op_ip), &r)) FAIL();
+                sp -= n;
+                PUSH(r);
+                break;
+            }
+
+            case OP_LIST_LOCAL: {
+                size_t n = READ_U16();
+                ValueKind elem = (ValueKind)*ip++;
+                size_t slot = READ_U16();
+                Value r;
+                SYNC();
+                int ok = fr->region ? region_list(vm, &fr->region[slot], elem, sp - n, n, span_at(fi, op_ip), &r)
+                                    : vm_new_list(vm, elem, sp - n, n, span_at(fi, op_ip), &r);
+                if (!ok) FAIL();
+                sp -= n;
+                PUSH(r);
+                break;
+            }
+
+            case OP_MAP: {
+                size_t n = READ_U16();
+                ValueKind key = (ValueKind)*ip++;
+                Value r;
+                SYNC();
+                if (!vm_new_map(vm, key, sp - 2 * n, n, span_at(fi, op_ip), &r)) FAIL();
+                sp -= 2 * n;
+                PUSH(r);
+                break;
+            }
+
+            case OP_INDEX: {
+                Value idx = POP();
+                Value t = POP();
+                if (t.kind == VAL_LIST && idx.kind == VAL_INT && (uint64_t)idx.as.i < t.as.list->len) {
+                    PUSH(list_get(t.as.list, (size_t)idx.as.i));
+                    break;
+                }
+                Value r;
+                SYNC();
+                if (!vm_index(vm, t, idx, span_at(fi, op_ip), &r)) FAIL();
+                PUSH(r);
+                break;
+            }
+
+            // the compiler proved the index in range for lists; anything
+            // else takes the checked route
+            case OP_LOAD_ELEM: {
+                Value t = slots[READ_U16()];
+                Value idx = slots[READ_U16()];
+                if (t.kind == VAL_LIST) {
+                    PUSH(list_get(t.as.list, (size_t)idx.as.i));
+                    break;
+                }
+                Value r;
+                SYNC();
+                if (!vm_index(vm, t, idx, span_at(fi, op_ip), &r)) FAIL();
+                PUSH(r);
+                break;
+            }
+
+            case OP_STORE_ELEM: {
+                Value t = slots[READ_U16()];
+                Value idx = slots[READ_U16()];
+                Value v = sp[-1];
+                if (t.kind == VAL_LIST && t.as.list->elem == v.kind) {
+                    heap_list_set(&vm->heap, t.as.list, (size_t)idx.as.i, v);
+                    break;
+                }
+                SYNC();
+                if (!vm_set_index(vm, t, idx, v, span_at(fi, op_ip))) FAIL();
+                break;
+            }
+
+            case OP_VEC_ARITH: {
+                BinaryOp op = (BinaryOp)*ip++;
+                int form = *ip++;
+                Value dst = slots[READ_U16()];
+                Value x = slots[READ_U16()];
+                Value y = slots[READ_U16()];
+                Value *i = &slots[READ_U16()];
+                Value k = form == (VEC_X_LIST | VEC_Y_LIST) ? value_int(0) : POP();
+                Value n = POP();
+                vec_arith(vm, op, form, dst, x, y, k, n, i);
+                break;
+            }
+
+            case OP_GUARD_LEN: {
+                Value t = slots[READ_U16()];
+                Value n = sp[-1];
+                sp[-1] = value_bool(t.kind == VAL_LIST && n.kind == VAL_INT && n.as.i <= (int64_t)t.as.list->len);
+                break;
+            }
+
+            case OP_SET_INDEX: {
+                Value v = POP();
+                Value idx = POP();
+                Value t = POP();
+                if (t.kind == VAL_LIST && idx.kind == VAL_INT && (uint64_t)idx.as.i < t.as.list->len &&
+                    t.as.list->elem == v.kind) {
+                    heap_list_set(&vm->heap, t.as.list, (size_t)idx.as.i, v);
+                    PUSH(v);
+                    break;
+                }
+                SYNC();
+                if (!vm_set_index(vm, t, idx, v, span_at(fi, op_ip))) FAIL();
+                PUSH(v);
+                break;
+            }
+
+            case OP_RETURN:
+            do_return: {
+                Value r = POP();
+                size_t base = fr->base;
+                if (vm->frames_len - 1 == entry) {
+                    // our caller owns this frame and pops it
+                    vm->sp = base;
+                    *out = r;
+                    return 1;
+                }
+                vm->region_top = fr->region_base;
+                vm->frames_len--;
+                sp = vm->stack + base;
+                PUSH(r);
+
+                fr = &vm->frames[vm->frames_len - 1];
+                fi = &vm->fns[fr->fn];
+                ch = fi->chunk;
+                ip = fr->ip;
+                slots = vm->stack + fr->base;
+                break;
+            }
+
+            default:
+                SYNC();
+                return vm_error(vm, span_at(fi, op_ip), "bad opcode %u", *op_ip);
+        }
+    }
+
+    #undef READ_U16
+    #undef PUSH
+    #undef POP
+    #undef SYNC
+    #undef FAIL
+}
+
+static int invoke(Vm *vm, size_t fn, size_t argc, Span site, Value *out) {
+    FnInfo *fi = &vm->fns[fn];
+    size_t base = vm->sp - argc;
+
+    if (vm->frames_len >= VM_FRAMES_MAX ||
+        (fi->chunk && base + fi->chunk->max_stack > VM_STACK_MAX)) {
+        return vm_error(vm, site, "stack overflow");
+    }
+    if (!vm->stats.first_insn_ns) vm->stats.first_insn_ns = monotonic_ns();
+    if (!vm_safepoint(vm, site)) return 0;
+
+    Frame *fr = &vm->frames[vm->frames_len++];
+    fr->fn = (uint32_t)fn;
+    fr->base = (uint32_t)base;
+    fr->ip = fi->chunk ? fi->chunk->code : NULL;
+    fr->region_base = (uint32_t)vm->region_top;
+    fr->site_line = (uint32_t)site.line;
+    fr->region = fi->chunk ? frame_region(vm, fi->chunk) : NULL;
+
+    int ok;
+    if (fi->chunk) {
+        vm->stats.bytecode_calls++;
+        ok = run(vm, out);
+    } else {
+        vm->stats.interp_calls++;
+        ok = interp_call(vm, fn, base, out);
+    }
+
+    vm->region_top = vm->frames[vm->frames_len - 1].region_base;
+    vm->frames_len--;
+    vm->sp = base;
+    return ok;
+}
+
+int vm_call(Vm *vm, size_t fn, size_t argc, Span site, Value *out) {
+    count_call(vm, fn);
+    return invoke(vm, fn, argc, site, out);
+}
+
+int vm_walk_tail_call(Vm *vm, size_t fn, size_t argc, Span site, Value *out, int *restart) {
+    *restart = 0;
+    count_call(vm, fn);
+    if (vm->fns[fn].chunk) return invoke(vm, fn, argc, site, out);
+    if (!vm_safepoint(vm, site)) return 0;
+
+    // like OP_TAILCALL: tree-walked frames have no region to drop
+    Frame *fr = &vm->frames[vm->frames_len - 1];
+    memmove(vm->stack + fr->base, vm->stack + vm->sp - argc, argc * sizeof(Value));
+    vm->sp = fr->base + argc;
+    fr->fn = (uint32_t)fn;
+    vm->stats.interp_calls++;
+    *restart = 1;
+    return 1;
+}
+
+int vm_enter_osr(Vm *vm, const LoopEntry *entry, Value *out) {
+    Frame *fr = &vm->frames[vm->frames_len - 1];
+    const Chunk *ch = vm->fns[fr->fn].chunk;
+    if (fr->base + ch->max_stack > VM_STACK_MAX) {
+        return vm_error(vm, vm->fns[fr->fn].decl->span, "stack overflow");
+    }
+    vm->stats.osr_entries++;
+    fr->ip = ch->code + entry->offset;
+    // the tree-walker put this frame's lists on the heap; later ones can use a region
+    vm->region_top = fr->region_base;
+    fr->region = frame_region(vm, ch);
+    return run(vm, out);
+}
+
+int vm_run_main(Vm *vm, int64_t *exit_code) {
+    long fn = -1;
+    for (size_t i = 0; i < vm->fns_len; i++) {
+        if (sv_eq_cstr(vm->fns[i].decl->name, "main")) fn = (long)i;
+    }
+    if (fn < 0) {
+        Span sp = {0};
+        if (vm->fns_len) sp.path = vm->fns[0].decl->span.path;
+        return vm_error(vm, sp, "no 'main' function");
+    }
+
+    // the eager mode pays for every function before main starts
+    if (vm->tier.mode == TIER_BYTECODE) {
+        for (size_t i = 0; i < vm->fns_len; i++) tier_up(vm, i);
+    }
+
+    // top-level arguments are not wired up yet; main's params start at 0
+    FnDecl *decl = vm->fns[fn].decl;
+    Value ret;
+    if (!vm_run_fn(vm, (size_t)fn, NULL, decl->params_len, &ret)) return 0;
+
+    *exit_code = 0;
+    if (ret.kind == VAL_INT) *exit_code = ret.as.i;
+    else if (ret.kind == VAL_BOOL) *exit_code = ret.as.b;
+    return 1;
+}
+
+int vm_run_fn(Vm *vm, size_t fn, const Value *args, size_t argc, Value *out) {
+    FnDecl *decl = vm->fns[fn].decl;
+    if (argc > VM_STACK_MAX - vm->sp) return vm_error(vm, decl->span, "stack overflow");
+    for (size_t i = 0; i < argc; i++) {
+        vm->stack[vm->sp] = args ? args[i] : value_int(0);
+        vm->binds[vm->sp].name = (StrView){0};
+        vm->binds[vm->sp].is_mut = 0;
+        vm->sp++;
+    }
+
+    int ok = vm_call(vm, fn, argc, decl->span, out);
+    // coroutines and tasks nobody waited for still run to the end, unless the call failed
+    if (vm->sched && !coro_finish(vm, !ok, decl->span)) ok = 0;
+    if (vm->pool && !task_pool_finish(vm, !ok)) ok = 0;
+    outbuf_flush(&vm->out);
+    return ok;
+}
+
+void vm_reset(Vm *vm, int drop_heap) {
+    if (vm->pool && !vm->worker) {
+        task_pool_free(vm->pool);
+        vm->pool = NULL;
+    }
+    coro_sched_free(vm->sched);
+    vm->sched = NULL;
+    vm->sp = 0;
+    vm->frames_len = 0;
+    vm->region_top = 0;
+    vm->walk_depth = 0;
+    vm->had_error = 0;
+    if (drop_heap) heap_reset(&vm->heap);
+}
+
+void vm_print_tier_stats(const Vm *vm, FILE *out) {
+    const TierStats *st = &vm->stats;
+    double ttfi = st->first_insn_ns > st->start_ns ? (double)(st->first_insn_ns - st->start_ns) / 1e3 : 0.0;
+
+    fprintf(out, "tier stats:\n");
+    double run_ms = st->first_insn_ns ? (double)(monotonic_ns() - st->first_insn_ns) / 1e6 : 0.0;
+    fprintf(out, "  time to first instruction: %.1f us\n", ttfi);
+    fprintf(out, "  run time: %.2f ms\n", run_ms);
+    fprintf(out, "  compiled: %zu fn(s) in %.1f us (bailouts: %zu)\n",
+            st->compiled, (double)st->compile_ns / 1e3, st->bailouts);
+    fprintf(out, "  osr entries: %zu\n", st->osr_entries);
+    fprintf(out, "  calls: tree-walk=%zu bytecode=%zu\n", st->interp_calls, st->bytecode_calls);
+    fprintf(out, "  tasks: spawned=%zu stolen=%zu\n", st->tasks_spawned, st->tasks_stolen);
+    fprintf(out, "  coroutines: started=%zu switches=%zu\n", st->coros_started, st->coro_switches);
+}
+
+void vm_print_opt_report(const Vm *vm, FILE *out) {
+    size_t inlined = 0, tails = 0, regions = 0, arith = 0, proven = 0, index = 0, in_bounds = 0, guards = 0;
+    size_t vectorized = 0, folded = 0;
+    fprintf(out, "opt report:\n");
+    for (size_t i = 0; i < vm->fns_len; i++) {
+        const FnInfo *fi = &vm->fns[i];
+        StrView name = fi->decl->name;
+        if (!fi->chunk) {
+            fprintf(out, "  %.*s: %s\n", (int)name.len, name.ptr,
+                    fi->no_compile ? "not compilable" : "not compiled (cold)");
+            continue;
+        }
+        const Chunk *ch = fi->chunk;
+        fprintf(out, "  %.*s: inlined %u call(s), %u tail call(s), %u list(s) in the frame region, "
+                "%u of %u overflow check(s) removed, %u of %u bounds check(s) removed (%u loop guard(s)), "
+                "%u loop(s) vectorized, %u call(s) evaluated at compile time\n",
+                (int)name.len, name.ptr, ch->inlined, ch->tail_calls, ch->region_lists,
+                ch->arith_proven, ch->arith_ops, ch->index_proven, ch->index_ops, ch->loop_guards, ch->vector_loops,
+                ch->folded);
+        if (vm->tier.pgo && !vm->tier.pgo_gen) {
+            fprintf(out, "    profile: %u call(s) inlined because hot, %u left out of line because cold, "
+                    "%u if/else laid out else first%s\n", ch->pgo_inlined, ch->pgo_cold, ch->pgo_flipped,
+                    fi->hot ? ", compiled on the first call" : "");
+        }
+        inlined += fi->chunk->inlined;
+        tails += fi->chunk->tail_calls;
+        regions += fi->chunk->region_lists;
+        arith += fi->chunk->arith_ops;
+        proven += fi->chunk->arith_proven;
+        index += ch->index_ops;
+        in_bounds += ch->index_proven;
+        guards += ch->loop_guards;
+        vectorized += ch->vector_loops;
+        folded += ch->folded;
+    }
+    fprintf(out, "  total: inlined %zu call(s), %zu tail call(s), %zu list(s) in frame regions, "
+            "%zu of %zu overflow check(s) removed, %zu of %zu bounds check(s) removed (%zu loop guard(s)), "
+            "%zu loop(s) vectorized, %zu call(s) evaluated at compile time\n", inlined, tails, regions, proven, arith,
+            in_bounds, index, guards, vectorized, folded);
+    fprintf(out, "  run time: %zu list allocation(s) moved off the heap, %zu element(s) computed by vector loops (%s)\n",
+            vm->stats.region_allocs, vm->stats.vector_elems, simd_level_name());
+}
@@ -0,0 +1,236 @@
+#ifndef LUNAR_VM_H
+#define LUNAR_VM_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "value.h"
+#include "heap.h"
+#include "bytecode.h"
+#include "profile.h"
+#include "pgo.h"
+
+// Tiered execution:
+//   tier 0: tree-walk the AST directly (no compile cost, slow)
+//   tier 1: bytecode, compiled lazily once a function's call counter or
+//           loop back-edge counter trips. hot loops jump straight into
+//           the compiled code mid-function (see LoopEntry).
+
+typedef enum {
+    TIER_AUTO = 0,
+    TIER_INTERP,   // never compile
+    TIER_BYTECODE, // compile every function on its first call
+} TierMode;
+
+typedef struct {
+    TierMode mode;
+    uint32_t call_threshold;
+    uint32_t loop_threshold;
+
+    // tier 1 compiler
+    int no_inline;
+    uint32_t inline_budget; // 0 = BC_DEFAULT_INLINE_BUDGET
+    int no_vectorize;
+    int no_fold;            // --no-fold: no compile-time evaluation of pure functions
+
+    // int + - * / and unary - wrap around instead of raising an error
+    // (--overflow=wrap); affects both tiers
+    int wrap_ints;
+
+    // --pgo-gen counts into pgo (both tiers), --pgo-use compiles with
+    // what it read (see pgo.h); NULL for neither
+    Pgo *pgo;
+    int pgo_gen;
+} TierConfig;
+
+#define TIER_DEFAULT_CALLS 8
+#define TIER_DEFAULT_LOOPS 512
+
+typedef struct {
+    FnDecl *decl;
+    Chunk *chunk;      // NULL while still tree-walked
+    uint32_t calls;
+    uint32_t loops;    // back-edges taken in the tree-walker
+    int no_compile;    // compiler bailed; stay in tier 0
+    int hot;           // --pgo-use: compile on the first call
+    int borrowed;      // chunk belongs to another Vm (a task worker sharing .lrc code)
+} FnInfo;
+
+typedef struct {
+    uint64_t start_ns;        // set by the caller before vm_run_main
+    uint64_t first_insn_ns;   // time-to-first-instruction
+    uint64_t compile_ns;
+    size_t compiled;
+    size_t bailouts;
+    size_t osr_entries;
+    size_t interp_calls;
+    size_t bytecode_calls;
+    size_t region_allocs; // list literals served from a frame region instead of the heap
+    size_t vector_elems;  // list elements computed by OP_VEC_ARITH
+    size_t tasks_spawned;
+    size_t tasks_stolen;  // run by a worker other than the one that spawned them
+    size_t coros_started;
+    size_t coro_switches;
+} TierStats;
+
+typedef struct {
+    StrView name;
+    int is_mut;
+} Binding;
+
+typedef struct {
+    uint32_t fn;
+    uint32_t base;        // first local slot in vm->stack
+    const uint8_t *ip;    // NULL for tree-walked frames
+    uint32_t region_base; // vm->region_top when the frame was pushed
+    uint32_t site_line;   // of the call, when it came through invoke(); for --profile
+    List *region;         // the chunk's region_lists slots, or NULL (then they go on the heap)
+} Frame;
+
+#define VM_STACK_MAX  (1u << 18)
+#define VM_FRAMES_MAX 10000
+#define VM_WALK_DEPTH_MAX 2000
+
+// Frame regions: lists the compiler proved never outlive their call
+// (see list_stays_local in bytecode.c) are taken from a stack of List
+// slots instead of the GC heap. A frame claims its chunk's slots when it
+// is pushed and gives them back in one go when it returns. Slots keep
+// their element buffer for the next frame, up to VM_REGION_KEEP elements.
+#define VM_REGION_MAX  (1u << 16)
+#define VM_REGION_KEEP (1u << 16)
+
+typedef struct Vm {
+    Program *prog;
+    FnInfo *fns;
+    size_t fns_len;
+
+    Value *stack;
+    Binding *binds; // tree-walker only: name of each live local slot
+    size_t sp;
+
+    Frame *frames;
+    size_t frames_len;
+
+    List *region;       // VM_REGION_MAX slots, allocated on first use
+    size_t region_top;
+    size_t region_used; // high-water mark, for freeing the buffers
+    size_t walk_depth; // nested tree-walker calls (they recurse on the C stack)
+    size_t walk_max;   // as many as that C stack has room for
+
+    TierConfig tier;
+    BcOptions bc;
+    CallGraph cg; // built on the first compile, not at startup
+    int cg_built;
+
+    Heap heap;
+    OutBuf out; // program output (stdout); see outbuf.h
+
+    // spawn/join (see task.h). pool is started by the first spawn;
+    // worker 0 owns it, the others are the pool's own Vms.
+    uint32_t threads; // pool size; 0 = one per online core
+    struct TaskPool *pool;
+    size_t worker;
+    size_t task_depth; // tasks running on this Vm right now (nested in join)
+
+    // go/wait (see coro.h), started by the first `go`. while a coroutine
+    // runs, stack through walk_max above are its own.
+    struct Sched *sched;
+
+    // --profile (see profile.h): the timer's ticks since the last sample,
+    // counted by the signal handler
+    struct Profile *prof;
+    volatile sig_atomic_t prof_pending;
+
+    TierStats stats;
+    int had_error;
+} Vm;
+
+int vm_init(Vm *vm, Program *prog, TierConfig cfg);
+void vm_free(Vm *vm);
+
+// Installs precompiled code (e.g. from a .lrc file) before running.
+// chunks[i] may be NULL; the VM takes ownership of the rest.
+void vm_adopt_chunks(Vm *vm, Chunk **chunks);
+
+// Same, for code owned by someone that outlives the VM (a module shared
+// by many VMs, see lunar.h): it is never freed here, and task workers
+// borrow it too. Functions without a chunk stay in the tree-walker.
+void vm_borrow_chunks(Vm *vm, Chunk *const *chunks);
+
+// compiler options for a tier configuration
+void vm_bc_options(const TierConfig *tier, BcOptions *opts);
+
+// Compiles every function up front into chunks[i] (NULL where the
+// compiler bails) and adds the number compiled to *compiled. returns 1
+// if all of them compiled.
+int vm_compile_all(Program *prog, const TierConfig *tier, Chunk **chunks, size_t *compiled);
+
+// error helper shared by both tiers; always returns 0
+int vm_error(Vm *vm, Span where, const char *fmt, ...);
+
+// operator semantics shared by both tiers
+int vm_unary(Vm *vm, UnaryOp op, Value v, Span where, Value *out);
+int vm_binary(Vm *vm, BinaryOp op, Value l, Value r, Span where, Value *out);
+int vm_truthy(Vm *vm, Value v, Span where, int *out);
+
+// list/map operations shared by both tiers.
+// vm_new_list: elem 0 means "whatever the first item is".
+// vm_new_map: pairs holds n key/value pairs, key 0 works like elem.
+int vm_new_list(Vm *vm, ValueKind elem, const Value *items, size_t n, Span where, Value *out);
+int vm_new_map(Vm *vm, ValueKind key, const Value *pairs, size_t n, Span where, Value *out);
+int vm_index(Vm *vm, Value target, Value index, Span where, Value *out);
+int vm_set_index(Vm *vm, Value target, Value index, Value v, Span where);
+
+// report a type error unless the container accepts the value; 1 if it does
+int vm_list_accepts(Vm *vm, List *l, Value v, Span where);
+int vm_map_key_ok(Vm *vm, Map *m, Value key, Span where);
+int vm_map_accepts(Vm *vm, Map *m, Value key, Value v, Span where);
+
+// GC safepoint: collects if the heap asked for it. Every live value must
+// be on the VM stack below vm->sp (see heap.h). returns 0 after reporting
+// that the heap limit was exceeded. Profiler samples are taken here too.
+int vm_collect(Vm *vm, Span where);
+
+static inline int vm_safepoint(Vm *vm, Span where) {
+    if (vm->prof_pending) prof_sample(vm, where);
+    return !vm->heap.want_gc || vm_collect(vm, where);
+}
+
+// Calls fns[fn]. The argc arguments must already be on top of the stack;
+// they are popped on return. returns 1 on success, 0 on runtime error.
+int vm_call(Vm *vm, size_t fn, size_t argc, Span site, Value *out);
+
+// The tree-walker's `return f(args)`, with the argc arguments on top of
+// the stack. If fn is still tree-walked, they slide down over the top
+// frame, which now runs fn, and *restart is set: the walker starts fn's
+// body in place, so tail recursion takes no stack. Otherwise this is
+// vm_call. returns 1 on success, 0 on runtime error.
+int vm_walk_tail_call(Vm *vm, size_t fn, size_t argc, Span site, Value *out, int *restart);
+
+// Jumps from the tree-walker into fn's bytecode at a hot loop header.
+// The top frame's locals must match entry->live_locals.
+int vm_enter_osr(Vm *vm, const LoopEntry *entry, Value *out);
+
+// Tier-up check run on back-edges by the tree-walker; returns the loop
+// entry to transfer to, or NULL to keep walking.
+const LoopEntry *vm_loop_backedge(Vm *vm, size_t fn, const Stmt *loop);
+
+// runs `main`, filling missing parameters with 0
+int vm_run_main(Vm *vm, int64_t *exit_code);
+
+// Calls fns[fn] with argc arguments (all 0 when args is NULL) and runs
+// to the end like main: coroutines and tasks left behind finish first,
+// and output is flushed. The caller checks argc against the parameters.
+int vm_run_fn(Vm *vm, size_t fn, const Value *args, size_t argc, Value *out);
+
+// Readies a VM that ran something for another run: the stacks are
+// emptied and the task pool and coroutine scheduler (stopped or failed
+// by then) are dropped, to be started again on demand. With drop_heap
+// every object goes too, while the heap keeps its nursery.
+void vm_reset(Vm *vm, int drop_heap);
+
+void vm_print_tier_stats(const Vm *vm, FILE *out);
+void vm_print_opt_report(const Vm *vm, FILE *out);
+
+#endif
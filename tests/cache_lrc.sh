@@ -0,0 +1,52 @@
+# .lrc caches: the first run writes one, the second loads it, and a file
+# with a flipped byte (code or header) fails its checksum and is rebuilt
+# rather than run; the runtime error must point at the same line every time
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+cat > p.lr <<'LR'
+funct pick(x: int) ret int {
+    if x - (x / 100) * 100 == 0 {
+        return 1;
+    }
+    return 2;
+}
+
+funct main() ret int {
+    let mut i: int = 0;
+    let mut s: int = 0;
+    while i < 1000 {
+        s = s + pick(i);
+        i = i + 1;
+    }
+    print(s);
+    let xs = [1, 2, 3];
+    print(xs[s - 1987]);
+    return 0;
+}
+LR
+
+run() {
+    "$LUNAR" --cache --tier-stats --tier=$1 p.lr 2>&1 | sed '/^tier stats/d; /^  cache:/b; /^ /d'
+}
+
+# overwrite byte $2 of file $1 with something else
+flip() {
+    printf '\377' | dd of="$1" bs=1 seek=$2 conv=notrunc 2>/dev/null
+}
+
+for tier in interp bytecode; do
+    echo "== $tier"
+    rm -f p.lrc p.lri
+    run $tier
+    cp p.lrc good.lrc
+    run $tier
+    # the header's reserved word, then the last bytes of the payload
+    for at in 68 $(($(wc -c < p.lrc) - 3)); do
+        flip p.lrc $at
+        cmp -s p.lrc good.lrc && echo "byte $at: not flipped"
+        run $tier
+        cmp -s p.lrc good.lrc && echo "rebuilt"
+    done
+done
@@ -0,0 +1,58 @@
+# .lri interfaces: with --cache each module keeps one next to its .lrc;
+# a flipped byte (header or payload) in an imported module's interface
+# fails its checksum, so that module is parsed again and the file rebuilt,
+# and the program still links and reports its error at the same line
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+cat > lib.lr <<'LR'
+funct scale(x: int, by: int) ret int {
+    return x * by;
+}
+
+funct total(n: int) ret int {
+    let mut i: int = 0;
+    let mut s: int = 0;
+    while i < n {
+        s = s + scale(i, 3);
+        i = i + 1;
+    }
+    return s;
+}
+LR
+cat > main.lr <<'LR'
+import lib;
+
+funct main() ret int {
+    print(total(100));
+    print(scale(7, 6));
+    let xs = [1, 2, 3];
+    print(xs[scale(1, 5)]);
+    return 0;
+}
+LR
+
+run() {
+    "$LUNAR" --cache --tier-stats --tier=$1 main.lr 2>&1 | sed '/^tier stats/d; /^  cache:/b; /^ /d'
+}
+
+# overwrite byte $2 of file $1 with something else
+flip() {
+    printf '\377' | dd of="$1" bs=1 seek=$2 conv=notrunc 2>/dev/null
+}
+
+for tier in interp bytecode; do
+    echo "== $tier"
+    rm -f *.lrc *.lri
+    run $tier
+    cp lib.lri good.lri
+    run $tier
+    # the header's reserved word, then the last bytes of the payload
+    for at in 52 $(($(wc -c < lib.lri) - 3)); do
+        flip lib.lri $at
+        cmp -s lib.lri good.lri && echo "byte $at: not flipped"
+        run $tier
+        cmp -s lib.lri good.lri && echo "rebuilt"
+    done
+done
@@ -0,0 +1,67 @@
+# profile-guided optimization: --pgo-gen writes the same counts from every
+# tier, --pgo-use compiles with them (hot functions on their first call,
+# cold calls left out of line, an if/else whose else ran more often laid
+# out else first), and a missing, unreadable or stale profile only warns
+# and leaves the output alone
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+cat > p.lr <<'LR'
+funct sign(x: int) ret int {
+    if x > 0 {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+funct cold(x: int) ret int {
+    return x * 2;
+}
+
+funct main() ret int {
+    let mut i: int = 0;
+    let mut s: int = 0;
+    while i < 2000 {
+        s = s + sign(i - 1990);
+        if i == 5000 {
+            s = s + cold(i);
+        }
+        i = i + 1;
+    }
+    print(s);
+    let xs = [1, 2, 3];
+    print(xs[s]);
+    return 0;
+}
+LR
+
+# the program's output, and what the profile changed
+run() {
+    "$LUNAR" --opt-report "$@" p.lr 2>&1 | awk '
+        /^opt report:/ { next }
+        /^    profile:/ { print "  " fn " " substr($0, 5); next }
+        /^  [a-z_]+: / { fn = $1; next }
+        /^ / { next }
+        { print }'
+}
+
+for tier in interp bytecode auto; do
+    "$LUNAR" --tier=$tier --pgo-gen=$tier.pgo p.lr 2>&1 || true
+done
+cmp interp.pgo bytecode.pgo && cmp interp.pgo auto.pgo && cat interp.pgo
+
+for tier in interp bytecode; do
+    echo "== $tier"
+    run --tier=$tier --pgo-use=interp.pgo
+    run --tier=$tier --pgo-use=missing.pgo
+    echo "not a profile" > bad.pgo
+    run --tier=$tier --pgo-use=bad.pgo
+    # sign changed size since the profile was taken: its counts no longer apply
+    sed 's/^fn sign [0-9]*/fn sign 99/' interp.pgo > stale.pgo
+    run --tier=$tier --pgo-use=stale.pgo
+    # nothing in it belongs to this program
+    printf 'lunar-pgo 1\nfn other 3 10\n' > other.pgo
+    run --tier=$tier --pgo-use=other.pgo
+done